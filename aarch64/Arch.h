@@ -28,13 +28,23 @@
 #include <cassert>
 #include <stdint.h>
 
+struct user_pt_regs;
+
 namespace penguinTrace
 {
+  // Register set returned by PTRACE_GETREGSET (NT_PRSTATUS)
+  typedef ::user_pt_regs RegisterSet;
+
   const int MAX_INSTR_BYTES = 4;
   const int MIN_INSTR_BYTES = 4;
 
   const int ADDR_BYTES = 8;
 
+  // Architectural limit, the kernel reports how many are implemented.
+  //  Trap before the access, so have to step over it without watchpoints
+  const unsigned MAX_WATCHPOINTS = 16;
+  const bool WATCHPOINT_BEFORE_ACCESS = true;
+
   extern const char * PC_REG_NAME;
   extern const char * SP_REG_NAME;
   extern const char * FB_REG_NAME;
@@ -36,85 +36,107 @@
 #include <sys/wait.h>
 #include <asm/ptrace.h>
 #include <fcntl.h>
+#include <signal.h>
+
+#include <sys/syscall.h>
+#include <linux/audit.h>
+
+#include <cstddef>
+#include <errno.h>
 
 namespace penguinTrace
 {
   const uint32_t BREAKPOINT_WORD = 0xd4200000UL;
   const uint32_t RETURN_WORD     = 0xd65f0000UL;
   const uint32_t RETURN_MASK     = 0xfffffc1fUL;
+  const uint32_t SYSCALL_WORD    = 0xd4000001UL;
+  const uint32_t SYSCALL_MASK    = 0xffffffffUL;
+  const uint32_t SYSCALL_AUDIT_ARCH = AUDIT_ARCH_AARCH64;
 
-  void Stepper::getRegisters()
+  namespace
   {
-    user_pt_regs regs;
-    struct iovec ioregs;
-    ioregs.iov_base = &regs;
-    ioregs.iov_len = sizeof(regs);
-
-    ptrace(PTRACE_GETREGSET, childPid, NT_PRSTATUS, &ioregs);
-
-    registerValues["x0"]  = regs.regs[0];
-    registerValues["x1"]  = regs.regs[1];
-    registerValues["x2"]  = regs.regs[2];
-    registerValues["x3"]  = regs.regs[3];
-    registerValues["x4"]  = regs.regs[4];
-    registerValues["x5"]  = regs.regs[5];
-    registerValues["x6"]  = regs.regs[6];
-    registerValues["x7"]  = regs.regs[7];
-    registerValues["x8"]  = regs.regs[8];
-    registerValues["x9"]  = regs.regs[9];
-    registerValues["x10"]  = regs.regs[10];
-    registerValues["x11"]  = regs.regs[11];
-    registerValues["x12"]  = regs.regs[12];
-    registerValues["x13"]  = regs.regs[13];
-    registerValues["x14"]  = regs.regs[14];
-    registerValues["x15"]  = regs.regs[15];
-    registerValues["x16"]  = regs.regs[16];
-    registerValues["x17"]  = regs.regs[17];
-    registerValues["x18"]  = regs.regs[18];
-    registerValues["x19"]  = regs.regs[19];
-    registerValues["x20"]  = regs.regs[20];
-    registerValues["x21"]  = regs.regs[21];
-    registerValues["x22"]  = regs.regs[22];
-    registerValues["x23"]  = regs.regs[23];
-    registerValues["x24"]  = regs.regs[24];
-    registerValues["x25"]  = regs.regs[25];
-    registerValues["x26"]  = regs.regs[26];
-    registerValues["x27"]  = regs.regs[27];
-    registerValues["x28"]  = regs.regs[28];
-    registerValues["x29"]  = regs.regs[29];
-    registerValues["x30"]  = regs.regs[30];
-    registerValues["sp"]   = regs.sp;
-    registerValues["pc"]   = regs.pc;
-    registerValues["pstate"] = regs.pstate;
+    // x0-x30 map to regs[0-30], followed by sp, pc and pstate
+    const char * REGISTER_NAMES[] = {
+      "x0", "x1", "x2", "x3", "x4", "x5", "x6", "x7",
+      "x8", "x9", "x10", "x11", "x12", "x13", "x14", "x15",
+      "x16", "x17", "x18", "x19", "x20", "x21", "x22", "x23",
+      "x24", "x25", "x26", "x27", "x28", "x29", "x30",
+      "sp", "pc", "pstate"
+    };
+
+    const int NUM_REGISTERS = sizeof(REGISTER_NAMES)/sizeof(REGISTER_NAMES[0]);
+
+    uint64_t regByIndex(const user_pt_regs& regs, int idx)
+    {
+      if (idx < 31)  return regs.regs[idx];
+      if (idx == 31) return regs.sp;
+      if (idx == 32) return regs.pc;
+      return regs.pstate;
+    }
   }
 
-  uint64_t Stepper::getPC()
+  void Stepper::getRegisters()
   {
-    user_pt_regs regs;
     struct iovec ioregs;
-    ioregs.iov_base = &regs;
-    ioregs.iov_len = sizeof(regs);
+    ioregs.iov_base = &registers.regs;
+    ioregs.iov_len = sizeof(registers.regs);
 
-    ptrace(PTRACE_GETREGSET, childPid, NT_PRSTATUS, &ioregs);
+    int ret = ptrace(PTRACE_GETREGSET, currentThread, NT_PRSTATUS, &ioregs);
+    assert(ret == 0);
 
-    cachedPC = regs.pc;
-    cachedPCvalid = true;
-    return regs.pc;
+    registers.valid = true;
+    registers.dirty = false;
   }
 
-  void Stepper::setPC(uint64_t pc)
+  void Stepper::setRegisters()
   {
-    cachedPCvalid = false;
-    user_pt_regs regs;
-    struct iovec ioregs;
-    ioregs.iov_base = &regs;
-    ioregs.iov_len = sizeof(regs);
+    if (registers.valid && registers.dirty)
+    {
+      struct iovec ioregs;
+      ioregs.iov_base = &registers.regs;
+      ioregs.iov_len = sizeof(registers.regs);
 
-    ptrace(PTRACE_GETREGSET, childPid, NT_PRSTATUS, &ioregs);
+      int ret = ptrace(PTRACE_SETREGSET, currentThread, NT_PRSTATUS, &ioregs);
+      assert(ret == 0);
+      registers.dirty = false;
+    }
+  }
 
-    regs.pc = pc;
+  std::map<std::string, uint64_t> Stepper::getRegValues()
+  {
+    std::map<std::string, uint64_t> values;
+    for (int i = 0; i < NUM_REGISTERS; ++i)
+    {
+      values[REGISTER_NAMES[i]] = regByIndex(registers.regs, i);
+    }
+    return values;
+  }
 
-    ptrace(PTRACE_SETREGSET, childPid, NT_PRSTATUS, &ioregs);
+  bool Stepper::regValueByName(const std::string& reg, uint64_t& value)
+  {
+    for (int i = 0; i < NUM_REGISTERS; ++i)
+    {
+      if (reg == REGISTER_NAMES[i])
+      {
+        value = regByIndex(registers.regs, i);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  uint64_t Stepper::getPC()
+  {
+    assert(registers.valid);
+    cachedPC = registers.regs.pc;
+    return registers.regs.pc;
+  }
+
+  void Stepper::setPC(uint64_t pc)
+  {
+    assert(registers.valid);
+    registers.regs.pc = pc;
+    registers.dirty = true;
   }
 
   uint64_t Stepper::breakPC(uint64_t pc)
@@ -122,34 +144,113 @@ namespace penguinTrace
     return pc;
   }
 
-  bool Stepper::isSyscall(uint64_t pc)
+  bool Stepper::setWatchpoints(bool enable)
+  {
+    struct user_hwdebug_state state;
+    memset(&state, 0, sizeof(state));
+    struct iovec iov;
+    iov.iov_base = &state;
+    iov.iov_len = sizeof(state);
+
+    if (ptrace(PTRACE_GETREGSET, currentThread, NT_ARM_HW_WATCH, &iov) != 0)
+    {
+      return false;
+    }
+    // Number of watchpoints implemented
+    unsigned slots = state.dbg_info & 0xff;
+    if (enable && (watchpointMap.size() > slots))
+    {
+      return false;
+    }
+
+    unsigned i = 0;
+    if (enable)
+    {
+      for (auto it : watchpointMap)
+      {
+        // Byte address select within an aligned double word, enabled for
+        //  stores at EL0
+        uint64_t base = it.first & ~0x7ULL;
+        uint32_t bas = ((1U << it.second) - 1) << (it.first - base);
+        state.dbg_regs[i].addr = base;
+        state.dbg_regs[i].ctrl = (bas << 5) | (0x2 << 3) | (0x2 << 1) | 0x1;
+        i++;
+      }
+    }
+    for (; i < slots; i++)
+    {
+      state.dbg_regs[i].addr = 0;
+      state.dbg_regs[i].ctrl = 0;
+    }
+
+    iov.iov_len = offsetof(struct user_hwdebug_state, dbg_regs) +
+                  slots*sizeof(state.dbg_regs[0]);
+    return ptrace(PTRACE_SETREGSET, currentThread, NT_ARM_HW_WATCH, &iov) == 0;
+  }
+
+  bool Stepper::watchpointHit(uint64_t& addr)
   {
-    uint32_t instr = (uint32_t)ptrace(PTRACE_PEEKTEXT, childPid, pc, nullptr);
-    return (instr & 0xffe0001f) == 0xd4000001;
+    siginfo_t info;
+    if (ptrace(PTRACE_GETSIGINFO, currentThread, nullptr, &info) != 0)
+    {
+      return false;
+    }
+    if ((info.si_signo != SIGTRAP) || (info.si_code != TRAP_HWBKPT))
+    {
+      return false;
+    }
+
+    // Reported address can be anywhere in the access, so match on the
+    //  double word being watched. Always report the hit as the access has
+    //  to be stepped over
+    uint64_t accessAddr = (uint64_t)info.si_addr;
+    addr = accessAddr;
+    for (auto it : watchpointMap)
+    {
+      if ((it.first & ~0x7ULL) == (accessAddr & ~0x7ULL))
+      {
+        addr = it.first;
+      }
+    }
+    return true;
   }
 
   Stepper::Syscall Stepper::getSyscall()
   {
-    uint64_t num = registerValues["x8"];
-    std::vector<uint64_t> args;
+    uint64_t num = registers.regs.regs[8];
+    std::vector<uint64_t> args(&registers.regs.regs[0], &registers.regs.regs[6]);
     return Syscall(num, args);
   }
 
-
-  void Stepper::errorSyscall(uint64_t pc)
+  void Stepper::denySyscall()
   {
-    setPC(pc+4);
-    user_regs_struct regs;
-    struct iovec ioregs;
-    ioregs.iov_base = &regs;
-    ioregs.iov_len = sizeof(regs);
-
-    int ret1 = ptrace(PTRACE_GETREGSET, childPid, NT_PRSTATUS, &ioregs);
+    // The syscall number is only read from its own regset after entry
+    int num = -1;
+    struct iovec iov;
+    iov.iov_base = &num;
+    iov.iov_len = sizeof(num);
+    int ret = ptrace(PTRACE_SETREGSET, currentThread, NT_ARM_SYSTEM_CALL, &iov);
+    assert(ret == 0);
+    registers.regs.regs[0] = -EPERM;
+    registers.dirty = true;
+  }
 
-    regs.regs[0] = -1;
+  Stepper::Syscall Stepper::forkSyscall()
+  {
+    // clone with no exit signal so the tracee isn't sent SIGCHLD when a
+    //  checkpoint is killed
+    std::vector<uint64_t> args = {0, 0, 0, 0, 0};
+    return Syscall(SYS_clone, args);
+  }
 
-    int ret2 = ptrace(PTRACE_SETREGSET, childPid, NT_PRSTATUS, &ioregs);
-    assert(ret1 == 0 && ret2 == 0);
+  void Stepper::syscallRegisters(RegisterSet& regs, uint64_t pc, const Syscall& sys)
+  {
+    regs.pc = pc;
+    regs.regs[8] = sys.num;
+    for (unsigned i = 0; i < sys.args.size() && i < 6; i++)
+    {
+      regs.regs[i] = sys.args[i];
+    }
   }
 
   bool Stepper::isLibraryCall(uint64_t pc)
@@ -157,7 +258,7 @@ namespace penguinTrace
     bool found = false;
     bool inImage = false;
     uint64_t addr = 0;
-    uint32_t instr = (uint32_t)ptrace(PTRACE_PEEKTEXT, childPid, pc, nullptr);
+    uint32_t instr = (uint32_t)getMemValue(pc);
     if ((instr & 0xfc000000) == 0x94000000) // BL
     {
       found = true;
@@ -172,15 +273,7 @@ namespace penguinTrace
     {
       found = true;
       int regNum = (instr & 0x3e0) >> 5;
-      // TODO move to get reg function
-      user_pt_regs regs;
-      struct iovec ioregs;
-      ioregs.iov_base = &regs;
-      ioregs.iov_len = sizeof(regs);
-
-      ptrace(PTRACE_GETREGSET, childPid, NT_PRSTATUS, &ioregs);
-
-      addr = regs.regs[regNum];
+      addr = registers.regs.regs[regNum];
     }
 
     for (int i = 0; i < memoryRanges.size(); ++i)
@@ -32,6 +32,12 @@ namespace penguinTrace
 
   bool Stepper::isolateTracee()
   {
+    // Not isolated, but new processes are still blocked
+    if (!installSyscallFilter())
+    {
+      writeWrap(oldStderr, "Failed to install syscall filter\n");
+      return false;
+    }
     return true;
   }
 
@@ -93,7 +93,15 @@ namespace penguinTrace
 
   bool Stepper::isolateTracee()
   {
-    if (!Config::get(C_ISOLATE_TRACEE).Bool()) return true;
+    if (!Config::get(C_ISOLATE_TRACEE).Bool())
+    {
+      if (!installSyscallFilter())
+      {
+        writeWrap(oldStderr, "Failed to install syscall filter\n");
+        return false;
+      }
+      return true;
+    }
 
     std::stringstream uidmap;
     std::stringstream gidmap;
@@ -247,6 +255,14 @@ namespace penguinTrace
       return false;
     }
 
+    if (!installSyscallFilter())
+    {
+      std::stringstream s;
+      s << "Failed to install syscall filter. " << strerror(errno) << std::endl;
+      writeWrap(oldStderr, s.str());
+      return false;
+    }
+
     // Filename for this thread set to exe in chroot
     filename = binaryName;
     return true;
@@ -0,0 +1,93 @@
+// ----------------------------------------------------------------
+// Copyright (C) 2019 Alex Beharrell
+//
+// This file is part of penguinTrace.
+//
+// penguinTrace is free software: you can redistribute it and/or
+// modify it under the terms of the GNU Affero General Public
+// License as published by the Free Software Foundation, either
+// version 3 of the License, or any later version.
+//
+// penguinTrace is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public
+// License along with penguinTrace. If not, see
+// <https://www.gnu.org/licenses/>.
+// ----------------------------------------------------------------
+//
+// Chunked arena allocator
+
+#ifndef COMMON_ARENA_H_
+#define COMMON_ARENA_H_
+
+#include <memory>
+#include <new>
+#include <vector>
+#include <type_traits>
+#include <utility>
+
+namespace penguinTrace
+{
+
+  // Objects are never freed individually, only when the arena is destroyed,
+  // so only types that don't need destructing can be stored
+  template <typename T>
+  class Arena
+  {
+      static_assert(std::is_trivially_destructible<T>::value,
+          "Arena objects are not destructed");
+    public:
+      Arena(size_t chunkSize = 4096) : chunkSize(chunkSize), used(0), available(0), next(nullptr)
+      {
+      }
+      Arena(const Arena&) = delete;
+      Arena& operator=(const Arena&) = delete;
+      template <typename... Args>
+      T* create(Args&&... args)
+      {
+        return new (reserve(1)) T(std::forward<Args>(args)...);
+      }
+      // Contiguous array of default constructed objects
+      T* allocate(size_t n)
+      {
+        Storage* s = reserve(n);
+        for (size_t i = 0; i < n; ++i)
+        {
+          new (&s[i]) T();
+        }
+        return reinterpret_cast<T*>(s);
+      }
+      size_t size()
+      {
+        return used;
+      }
+    private:
+      typedef typename std::aligned_storage<sizeof(T), alignof(T)>::type Storage;
+      Storage* reserve(size_t n)
+      {
+        if (n > available)
+        {
+          size_t size = (n > chunkSize) ? n : chunkSize;
+          chunks.emplace_back(new Storage[size]);
+          next = chunks.back().get();
+          available = size;
+        }
+        Storage* s = next;
+        next += n;
+        available -= n;
+        used += n;
+        return s;
+      }
+      std::vector<std::unique_ptr<Storage[]> > chunks;
+      size_t chunkSize;
+      size_t used;
+      size_t available;
+      Storage* next;
+  };
+
+} /* namespace penguinTrace */
+
+#endif /* COMMON_ARENA_H_ */
@@ -0,0 +1,216 @@
+// ----------------------------------------------------------------
+// Copyright (C) 2019 Alex Beharrell
+//
+// This file is part of penguinTrace.
+//
+// penguinTrace is free software: you can redistribute it and/or
+// modify it under the terms of the GNU Affero General Public
+// License as published by the Free Software Foundation, either
+// version 3 of the License, or any later version.
+//
+// penguinTrace is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public
+// License along with penguinTrace. If not, see
+// <https://www.gnu.org/licenses/>.
+// ----------------------------------------------------------------
+//
+// Bounds checked reader over a block of memory
+
+#ifndef COMMON_BYTECURSOR_H_
+#define COMMON_BYTECURSOR_H_
+
+#include <stdint.h>
+#include <string.h>
+#include <string>
+
+#include "Exception.h"
+
+namespace penguinTrace
+{
+
+  // String held in memory owned elsewhere (e.g. a section)
+  class StringRef
+  {
+    public:
+      StringRef(const char* data, size_t length)
+          : ptr(data), len(length)
+      {
+      }
+      const char* data() const
+      {
+        return ptr;
+      }
+      size_t length() const
+      {
+        return len;
+      }
+      std::string str() const
+      {
+        return std::string(ptr, len);
+      }
+    private:
+      const char* ptr;
+      size_t len;
+  };
+
+  class ByteCursor
+  {
+    public:
+      ByteCursor(const uint8_t* data, size_t size)
+          : start(data), pos(data), end(data + size)
+      {
+      }
+      ByteCursor()
+          : start(nullptr), pos(nullptr), end(nullptr)
+      {
+      }
+      uint64_t tell() const
+      {
+        return pos - start;
+      }
+      void seek(uint64_t offset)
+      {
+        if (offset > size())
+        {
+          throw Exception("Seek past end of buffer", __EINFO__);
+        }
+        pos = start + offset;
+      }
+      void skip(uint64_t length)
+      {
+        need(length);
+        pos += length;
+      }
+      size_t size() const
+      {
+        return end - start;
+      }
+      size_t remaining() const
+      {
+        return end - pos;
+      }
+      bool eof() const
+      {
+        return pos >= end;
+      }
+      const uint8_t* current() const
+      {
+        return pos;
+      }
+      uint8_t u8()
+      {
+        need(1);
+        return *pos++;
+      }
+      template <typename T> T read()
+      {
+        T value;
+        need(sizeof(value));
+        memcpy(&value, pos, sizeof(value));
+        pos += sizeof(value);
+        return value;
+      }
+      uint64_t uleb128()
+      {
+        // Most values (abbreviation codes, forms, small constants)
+        //  fit in a single byte
+        if (pos < end && (*pos & 0x80) == 0)
+        {
+          return *pos++;
+        }
+        return uleb128Slow();
+      }
+      int64_t sleb128()
+      {
+        if (pos < end && (*pos & 0x80) == 0)
+        {
+          uint8_t byte = *pos++;
+          // Sign extend from bit 6
+          return (int64_t)((uint64_t)byte << 57) >> 57;
+        }
+        return sleb128Slow();
+      }
+      // Null terminated string, the terminator is consumed but is
+      //  not part of the reference
+      StringRef cstr()
+      {
+        const uint8_t* nul = (const uint8_t*)memchr(pos, '\0', remaining());
+        if (nul == nullptr)
+        {
+          throw Exception("Unterminated string", __EINFO__);
+        }
+        StringRef s((const char*)pos, nul - pos);
+        pos = nul + 1;
+        return s;
+      }
+    private:
+      void need(uint64_t length) const
+      {
+        if (length > remaining())
+        {
+          throw Exception("Read past end of buffer", __EINFO__);
+        }
+      }
+      uint64_t uleb128Slow()
+      {
+        uint64_t value = 0;
+        unsigned shift = 0;
+        uint8_t byte;
+
+        do
+        {
+          byte = u8();
+          if (shift < 64)
+          {
+            value |= ((uint64_t)(byte & 0x7f)) << shift;
+          }
+          else if ((byte & 0x7f) != 0)
+          {
+            throw Exception("ULEB128 overflow", __EINFO__);
+          }
+          shift += 7;
+        }
+        while (byte & 0x80);
+
+        return value;
+      }
+      int64_t sleb128Slow()
+      {
+        uint64_t value = 0;
+        unsigned shift = 0;
+        uint8_t byte;
+
+        do
+        {
+          byte = u8();
+          if (shift < 64)
+          {
+            value |= ((uint64_t)(byte & 0x7f)) << shift;
+          }
+          else if ((byte & 0x7f) != 0 && (byte & 0x7f) != 0x7f)
+          {
+            throw Exception("SLEB128 overflow", __EINFO__);
+          }
+          shift += 7;
+        }
+        while (byte & 0x80);
+
+        if ((shift < 64) && (byte & 0x40))
+        {
+          value |= (~0ULL << shift);
+        }
+
+        return (int64_t)value;
+      }
+      const uint8_t* start;
+      const uint8_t* pos;
+      const uint8_t* end;
+  };
+
+} /* namespace penguinTrace */
+
+#endif /* COMMON_BYTECURSOR_H_ */
@@ -118,7 +118,9 @@ namespace penguinTrace
   {
     STEP_INSTR,
     STEP_LINE,
-    STEP_CONT
+    STEP_CONT,
+    STEP_BACK,
+    STEP_BACK_CONT
   };
 
   struct CompileFailureReason
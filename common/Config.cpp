@@ -68,6 +68,10 @@ namespace penguinTrace
   std::string C_HIDE_NON_PRETTY_PRINT = "HIDE_NON_PRETTY_PRINT";
   std::string C_ISOLATE_TRACEE        = "ISOLATE_TRACEE";
   std::string C_STRICT_MODE           = "STRICT_MODE";
+  std::string C_CHECKPOINT_INTERVAL   = "CHECKPOINT_INTERVAL";
+  std::string C_CHECKPOINT_MEMORY     = "CHECKPOINT_MEMORY";
+  std::string C_PARSE_THREADS         = "PARSE_THREADS";
+  std::string C_INDEX_CACHE_DIR       = "INDEX_CACHE_DIR";
 
   void regexError(int error, regex_t* r)
   {
@@ -228,7 +232,23 @@ namespace penguinTrace
       {C_HIDE_NON_PRETTY_PRINT,
         ConfigDefault(true,
                       CfgValue(false),
-                      "If there is a pretty printer, hide default representation") }
+                      "If there is a pretty printer, hide default representation") },
+      {C_CHECKPOINT_INTERVAL,
+        ConfigDefault(true,
+                      CfgValue((int64_t)50),
+                      "Steps between checkpoints of the tracee for stepping backwards (0 to disable)") },
+      {C_CHECKPOINT_MEMORY,
+        ConfigDefault(true,
+                      CfgValue((int64_t)256),
+                      "Memory (MiB) that checkpoints of the tracee may use") },
+      {C_PARSE_THREADS,
+        ConfigDefault(true,
+                      CfgValue((int64_t)0),
+                      "Threads used to parse debug information (0 for one per core)") },
+      {C_INDEX_CACHE_DIR,
+        ConfigDefault(true,
+                      CfgValue(std::string("")),
+                      "Directory to cache debug information indices in (disabled if empty)") }
   };
 
   std::string CfgValue::toString()
@@ -191,6 +191,10 @@ namespace penguinTrace
   extern std::string C_HIDE_NON_PRETTY_PRINT;
   extern std::string C_ISOLATE_TRACEE;
   extern std::string C_STRICT_MODE;
+  extern std::string C_CHECKPOINT_INTERVAL;
+  extern std::string C_CHECKPOINT_MEMORY;
+  extern std::string C_PARSE_THREADS;
+  extern std::string C_INDEX_CACHE_DIR;
 
   //----------------------
   // Static configuration
@@ -202,7 +206,8 @@ namespace penguinTrace
 
   // Stepper configuration
   const bool STEPPER_STEP_OVER_LIBRARY_CALLS = true;
-  const bool STEPPER_ALWAYS_SINGLE_STEP = true;
+  // Step lines by single stepping rather than with temporary breakpoints
+  const bool STEPPER_ALWAYS_SINGLE_STEP = false;
 
 } /* namespace penguinTrace */
 
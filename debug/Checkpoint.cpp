@@ -0,0 +1,481 @@
+// ----------------------------------------------------------------
+// Copyright (C) 2019 Alex Beharrell
+//
+// This file is part of penguinTrace.
+//
+// penguinTrace is free software: you can redistribute it and/or
+// modify it under the terms of the GNU Affero General Public
+// License as published by the Free Software Foundation, either
+// version 3 of the License, or any later version.
+//
+// penguinTrace is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public
+// License along with penguinTrace. If not, see
+// <https://www.gnu.org/licenses/>.
+// ----------------------------------------------------------------
+//
+// penguinTrace Process Checkpoints
+
+#include "Stepper.h"
+
+#include <fstream>
+#include <sstream>
+
+#include <linux/elf.h>
+
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <unistd.h>
+
+namespace penguinTrace
+{
+  namespace
+  {
+    // Single step a stopped process, discarding any signals delivered
+    //  first (SIGHUP/SIGCONT are sent to checkpoints when the tracee exits
+    //  and their process group is orphaned). The injected syscall is
+    //  allowed when the syscall filter stops for it.
+    bool singleStepStop(pid_t pid, int& status)
+    {
+      bool discard;
+      do
+      {
+        if ((ptrace(PTRACE_SINGLESTEP, pid, nullptr, nullptr) != 0) ||
+            (waitpid(pid, &status, __WALL) != pid))
+        {
+          return false;
+        }
+        int event = status >> 16;
+        discard = WIFSTOPPED(status) &&
+            ((event == PTRACE_EVENT_SECCOMP) ||
+             ((event == 0) && (WSTOPSIG(status) != SIGTRAP)));
+      } while (discard);
+      return WIFSTOPPED(status);
+    }
+  }
+
+  void Stepper::applyBreakpointChanges()
+  {
+    BreakpointChanges changes;
+    if (replaying)
+    {
+      // Changes made by the user are kept until the replay finishes, the
+      //  ones logged for this step are applied instead
+      auto it = changeLog.find(stepCount+1);
+      if (it != changeLog.end())
+      {
+        changes = it->second;
+      }
+    }
+    else
+    {
+      std::lock_guard<std::mutex> lock(breakpointMutex);
+      changes.bkptsAdded.swap(breakpointsToAdd);
+      changes.bkptsRemoved.swap(breakpointsToRemove);
+      changes.watchAdded.swap(watchpointsToAdd);
+      changes.watchRemoved.swap(watchpointsToRemove);
+      if (!changes.empty() && checkpointsEnabled())
+      {
+        changeLog[stepCount+1] = changes;
+      }
+    }
+
+    for (auto it : changes.bkptsAdded)
+    {
+      insertBreak(it);
+    }
+    for (auto it : changes.bkptsRemoved)
+    {
+      if (breakpointMap.find(it) != breakpointMap.end())
+      {
+        removeBreak(it);
+      }
+    }
+    for (auto it : changes.watchAdded)
+    {
+      watchpointMap[it.first] = it.second;
+      watchpointsArmed = false;
+    }
+    for (auto it : changes.watchRemoved)
+    {
+      if (watchpointMap.erase(it) != 0)
+      {
+        watchpointsArmed = false;
+      }
+    }
+  }
+
+  bool Stepper::checkpointsEnabled()
+  {
+    return (Config::get(C_CHECKPOINT_INTERVAL).Int() > 0) && !threaded;
+  }
+
+  void Stepper::checkpoint()
+  {
+    int interval = Config::get(C_CHECKPOINT_INTERVAL).Int();
+    if (replaying || done || !checkpointsEnabled() || injectAddr == 0)
+    {
+      return;
+    }
+    if (!checkpoints.empty() &&
+        (stepCount - checkpoints.back().stepCount) < interval)
+    {
+      return;
+    }
+
+    Checkpoint cp;
+    cp.stepCount = stepCount;
+    cp.regs = registers.regs;
+    cp.breakpoints = breakpointMap;
+    cp.tempBreakpoints = tempBreakpointMap;
+    cp.watchpoints = watchpointMap;
+    cp.resumePending = resumePending;
+    cp.resumeRequest = resumeRequest;
+    cp.continueToEnd = continueToEnd;
+    cp.hitBreakpoint = hitBreakpoint;
+    cp.hitTempBreakpoint = hitTempBreakpoint;
+    cp.hitWatchpoint = hitWatchpoint;
+    cp.watchpointAddr = watchpointAddr;
+    cp.cachedPC = cachedPC;
+    cp.lastDisasm = lastDisasm;
+
+    bool forked = injectFork(childPid, registers.regs, cp.pid);
+    // Registers were written back to the tracee by the injection
+    registers.dirty = false;
+    memory.invalidate();
+    if (!forked)
+    {
+      logger->log(Logger::WARN, "Failed to checkpoint tracee");
+      return;
+    }
+
+    // Pages are shared copy-on-write, resident size is an upper bound
+    cp.memoryBytes = 0;
+    std::ifstream statm("/proc/"+std::to_string(cp.pid)+"/statm");
+    uint64_t size, resident;
+    if (statm >> size >> resident)
+    {
+      cp.memoryBytes = resident * sysconf(_SC_PAGESIZE);
+    }
+    checkpoints.push_back(cp);
+
+    logger->log(Logger::DBG, [&]() {
+      std::stringstream s;
+      s << "Checkpoint @" << stepCount << " pid=" << cp.pid;
+      return s.str();
+    });
+
+    // Drop the oldest checkpoints (other than the first, so it is always
+    //  possible to go back to the start) when over the memory limit
+    uint64_t limit = (uint64_t)Config::get(C_CHECKPOINT_MEMORY).Int() << 20;
+    uint64_t total = 0;
+    for (auto& it : checkpoints)
+    {
+      total += it.memoryBytes;
+    }
+    while (total > limit && checkpoints.size() > 2)
+    {
+      auto it = std::next(checkpoints.begin());
+      total -= it->memoryBytes;
+      killProcess(it->pid);
+      checkpoints.erase(it);
+    }
+  }
+
+  void Stepper::clearCheckpoints()
+  {
+    for (auto& it : checkpoints)
+    {
+      killProcess(it.pid);
+    }
+    checkpoints.clear();
+    stepLog.clear();
+    changeLog.clear();
+  }
+
+  void Stepper::recordStop()
+  {
+    if (!done && checkpointsEnabled())
+    {
+      stopLog.push_back(std::make_pair(stepCount, hitBreakpoint));
+    }
+  }
+
+  bool Stepper::reverse(bool toBreakpoint)
+  {
+    if (done || checkpoints.empty())
+    {
+      return false;
+    }
+
+    // Go back to the previous stop (or the previous breakpoint hit), or to
+    //  the first checkpoint if there isn't one
+    int target = -1;
+    for (auto it = stopLog.rbegin(); it != stopLog.rend(); ++it)
+    {
+      if (it->first < stepCount && (!toBreakpoint || it->second))
+      {
+        target = it->first;
+        break;
+      }
+    }
+    if (target < 0)
+    {
+      if (checkpoints.front().stepCount >= stepCount)
+      {
+        return false;
+      }
+      target = checkpoints.front().stepCount;
+    }
+
+    auto cp = checkpoints.end();
+    for (auto it = checkpoints.begin(); it != checkpoints.end(); ++it)
+    {
+      if (it->stepCount <= target)
+      {
+        cp = it;
+      }
+    }
+    if (cp == checkpoints.end())
+    {
+      return false;
+    }
+
+    logger->log(Logger::DBG, [&]() {
+      std::stringstream s;
+      s << "Reverse from " << stepCount << " to " << target;
+      s << " (checkpoint @" << cp->stepCount << ")";
+      return s.str();
+    });
+
+    // Breakpoints aren't rolled back, the user's current set is restored
+    //  once the replay is done
+    std::set<uint64_t> userBreakpoints;
+    std::map<uint64_t, uint64_t> userWatchpoints;
+    {
+      std::lock_guard<std::mutex> lock(breakpointMutex);
+      for (auto it : breakpointMap)
+      {
+        userBreakpoints.insert(it.first);
+      }
+      userBreakpoints.insert(breakpointsToAdd.begin(), breakpointsToAdd.end());
+      for (auto it : breakpointsToRemove)
+      {
+        userBreakpoints.erase(it);
+      }
+      userWatchpoints = watchpointMap;
+      for (auto it : watchpointsToAdd)
+      {
+        userWatchpoints[it.first] = it.second;
+      }
+      for (auto it : watchpointsToRemove)
+      {
+        userWatchpoints.erase(it);
+      }
+      breakpointsToAdd.clear();
+      breakpointsToRemove.clear();
+      watchpointsToAdd.clear();
+      watchpointsToRemove.clear();
+    }
+
+    killTracee();
+    restoreCheckpoint(cp);
+
+    replaying = true;
+    while (stepCount < target && !done &&
+           stepCount < (int)stepLog.size())
+    {
+      step(stepLog[stepCount]);
+    }
+    replaying = false;
+
+    if (done)
+    {
+      logger->log(Logger::WARN, "Tracee exited during replay");
+      return false;
+    }
+
+    // Output already seen by the user is written again by the replay
+    discardPipes();
+
+    // Later history is replaced by whatever is done next
+    if ((int)stepLog.size() > target)
+    {
+      stepLog.resize(target);
+    }
+    changeLog.erase(changeLog.upper_bound(target), changeLog.end());
+    while (!stopLog.empty() && stopLog.back().first > target)
+    {
+      stopLog.pop_back();
+    }
+    while (!checkpoints.empty() && checkpoints.back().stepCount > target)
+    {
+      killProcess(checkpoints.back().pid);
+      checkpoints.pop_back();
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(breakpointMutex);
+      for (auto it : breakpointMap)
+      {
+        if (userBreakpoints.find(it.first) == userBreakpoints.end())
+        {
+          breakpointsToRemove.insert(it.first);
+        }
+      }
+      for (auto it : userBreakpoints)
+      {
+        if (breakpointMap.find(it) == breakpointMap.end())
+        {
+          breakpointsToAdd.insert(it);
+        }
+      }
+      for (auto it : watchpointMap)
+      {
+        if (userWatchpoints.find(it.first) == userWatchpoints.end())
+        {
+          watchpointsToRemove.insert(it.first);
+        }
+      }
+      for (auto it : userWatchpoints)
+      {
+        auto w = watchpointMap.find(it.first);
+        if (w == watchpointMap.end() || w->second != it.second)
+        {
+          watchpointsToAdd[it.first] = it.second;
+        }
+      }
+    }
+
+    return true;
+  }
+
+  void Stepper::restoreCheckpoint(std::list<Checkpoint>::iterator cp)
+  {
+    Checkpoint state = *cp;
+    // The checkpoint is forked again so it can be returned to later
+    pid_t replacement;
+    childPid = cp->pid;
+    currentThread = childPid;
+    threads.clear();
+    threads[childPid] = Thread();
+    if (injectFork(cp->pid, cp->regs, replacement))
+    {
+      cp->pid = replacement;
+    }
+    else
+    {
+      logger->log(Logger::WARN, "Failed to copy checkpoint, it is discarded");
+      checkpoints.erase(cp);
+    }
+    memory.attach(childPid);
+    memory.invalidate();
+    watchTracee();
+
+    registers.regs = state.regs;
+    registers.valid = true;
+    registers.dirty = false;
+    breakpointMap = state.breakpoints;
+    tempBreakpointMap = state.tempBreakpoints;
+    watchpointMap = state.watchpoints;
+    resumePending = state.resumePending;
+    resumeRequest = state.resumeRequest;
+    continueToEnd = state.continueToEnd;
+    hitBreakpoint = state.hitBreakpoint;
+    hitTempBreakpoint = state.hitTempBreakpoint;
+    hitWatchpoint = state.hitWatchpoint;
+    watchpointAddr = state.watchpointAddr;
+    cachedPC = state.cachedPC;
+    lastDisasm = state.lastDisasm;
+    stepCount = state.stepCount;
+    done = false;
+
+    variableValues.clear();
+    stackTrace.clear();
+    variablesPending = true;
+    stackPending = true;
+
+    // Debug registers aren't inherited by a fork
+    if (!setAllWatchpoints(true))
+    {
+      logger->log(Logger::WARN, "Failed to set watchpoints");
+    }
+    watchpointsArmed = true;
+  }
+
+  bool Stepper::injectFork(pid_t pid, const RegisterSet& regs, pid_t& forkPid)
+  {
+    forkPid = 0;
+    errno = 0;
+    long word = ptrace(PTRACE_PEEKTEXT, pid, injectAddr, nullptr);
+    if (errno != 0)
+    {
+      return false;
+    }
+    long sysWord = (word & ~(long)SYSCALL_MASK) | SYSCALL_WORD;
+
+    RegisterSet sysRegs = regs;
+    syscallRegisters(sysRegs, injectAddr, forkSyscall());
+    struct iovec ioregs;
+    ioregs.iov_base = &sysRegs;
+    ioregs.iov_len = sizeof(sysRegs);
+
+    int status = 0;
+    bool ok = (ptrace(PTRACE_POKETEXT, pid, injectAddr, sysWord) == 0) &&
+              (ptrace(PTRACE_SETREGSET, pid, NT_PRSTATUS, &ioregs) == 0) &&
+              (ptrace(PTRACE_SETOPTIONS, pid, nullptr,
+                  TRACE_OPTIONS | PTRACE_O_TRACEFORK | PTRACE_O_TRACECLONE) == 0) &&
+              singleStepStop(pid, status);
+
+    // Stopped at the fork event, the new process starts stopped
+    int event = status >> 16;
+    ok = ok && WIFSTOPPED(status) &&
+        (event == PTRACE_EVENT_FORK || event == PTRACE_EVENT_CLONE);
+    unsigned long msg = 0;
+    if (ok && (ptrace(PTRACE_GETEVENTMSG, pid, nullptr, &msg) == 0))
+    {
+      forkPid = (pid_t)msg;
+      ok = (waitpid(forkPid, &status, __WALL) == forkPid);
+      // Complete the syscall in the parent
+      ok = ok && singleStepStop(pid, status);
+    }
+    else
+    {
+      ok = false;
+    }
+
+    // Undo the injected syscall in both processes
+    ioregs.iov_base = const_cast<RegisterSet*>(&regs);
+    ioregs.iov_len = sizeof(regs);
+    ptrace(PTRACE_SETOPTIONS, pid, nullptr, TRACE_OPTIONS);
+    ptrace(PTRACE_POKETEXT, pid, injectAddr, word);
+    ptrace(PTRACE_SETREGSET, pid, NT_PRSTATUS, &ioregs);
+    if (forkPid != 0)
+    {
+      ptrace(PTRACE_SETOPTIONS, forkPid, nullptr,
+             TRACE_OPTIONS | PTRACE_O_EXITKILL);
+      ok = ok &&
+          (ptrace(PTRACE_POKETEXT, forkPid, injectAddr, word) == 0) &&
+          (ptrace(PTRACE_SETREGSET, forkPid, NT_PRSTATUS, &ioregs) == 0);
+      if (!ok)
+      {
+        killProcess(forkPid);
+        forkPid = 0;
+      }
+    }
+    return ok;
+  }
+
+  void Stepper::killProcess(pid_t pid)
+  {
+    int status;
+    kill(pid, SIGKILL);
+    waitpid(pid, &status, __WALL);
+  }
+
+} /* namespace penguinTrace */
@@ -114,6 +114,24 @@ namespace penguinTrace
                                "No language specified"));
     }
 
+    // Optional optimisation level, compiler default if not given
+    auto optIt = requestArgs.find("opt");
+    if (optIt != requestArgs.end() && optIt->second.length() > 0)
+    {
+      std::string level = optIt->second;
+      if (level.length() == 1 && std::string("0123sg").find(level) != std::string::npos)
+      {
+        optFlag = "-O"+level;
+      }
+      else
+      {
+        ok = false;
+        compileFailures.push(
+            CompileFailureReason("Request Error",
+                                 "Unknown optimisation level requested '"+level+"'"));
+      }
+    }
+
     if (ok)
     {
       clangParse();
@@ -334,7 +352,8 @@ namespace penguinTrace
     uint64_t pc = 0;
     bool ok = true;
 
-    auto tempSrcFile = getTempFile(Config::get(C_TEMP_FILE_TPL).String()+"-src");
+    std::string srcTpl = Config::get(C_TEMP_FILE_TPL).String()+"-src";
+    auto tempSrcFile = getTempFile(srcTpl);
     auto tempCfgFile = getTempFile(Config::get(C_TEMP_FILE_TPL).String()+"-cfg");
 
     std::ofstream srcFile(tempSrcFile.second);
@@ -353,6 +372,11 @@ namespace penguinTrace
     cfgStr << ELF_CONFIG_SECTION << "=" << tempCfgFile.second;
     std::string copyCfgStr = cfgStr.str();
 
+    // Debug information names the source without its random suffix, so
+    //  identical programs build to identical binaries (and build IDs)
+    std::string srcDir = tempSrcFile.second.substr(0, tempSrcFile.second.rfind('/')+1);
+    std::string prefixMap = "-fdebug-prefix-map="+tempSrcFile.second+"="+srcDir+srcTpl;
+
     const char* cTmpSrcFile    = tempSrcFile.second.c_str();
     const char* tmpOutputFile  = execFilename.c_str();
 
@@ -361,10 +385,15 @@ namespace penguinTrace
       compilerCmds.push_back(const_cast<char*>(cTmpSrcFile));
       // Add debug information
       compilerCmds.push_back(const_cast<char*>("-g"));
+      compilerCmds.push_back(const_cast<char*>(prefixMap.c_str()));
       // Disable position independent executables
       // (so PC matches image)
       compilerCmds.push_back(const_cast<char*>("-fno-pie"));
       compilerCmds.push_back(const_cast<char*>("-no-pie"));
+      if (optFlag.length() > 0)
+      {
+        compilerCmds.push_back(const_cast<char*>(optFlag.c_str()));
+      }
       if (Config::get(C_STRICT_MODE).Bool())
       {
         compilerCmds.push_back(const_cast<char*>("-Wall"));
@@ -62,6 +62,7 @@ namespace penguinTrace
       std::string reqLang;
       std::string langExt;
       std::string compileName;
+      std::string optFlag;
       std::vector<char*> compilerCmds;
   };
 
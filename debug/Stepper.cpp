@@ -22,17 +22,21 @@
 
 #include "Stepper.h"
 
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <thread>
 
 #include <string.h>
+#include <signal.h>
 
 #include <sys/uio.h>
 #include <sys/user.h>
 #include <sys/ptrace.h>
 #include <sys/wait.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <asm/ptrace.h>
 #include <fcntl.h>
 #include <pty.h>
@@ -45,16 +49,28 @@
 
 namespace penguinTrace
 {
+  namespace
+  {
+    // Bytes of a word covered by the breakpoint instruction
+    const uint64_t BREAKPOINT_MASK = (1ULL << (MIN_INSTR_BYTES*8)) - 1;
+    // Polls for a tracee stop before sleeping, and the longest sleep (ms)
+    const int WAIT_SPIN_POLLS = 64;
+    const int WAIT_MAX_POLL_MS = 10;
+  }
 
   Stepper::Stepper(std::string f, object::Parser* p,
       std::unique_ptr<std::queue<std::string> > args,
       std::unique_ptr<ComponentLogger> l) :
       logger(std::move(l)), filename(f), parser(p),
       dwarfInfo(p, logger->subLogger("DWARF")), disassembler(p->getSymbolAddrMap()),
-      argv(std::move(args)), childPid(0), done(false), stepCount(0),
-      seenFirstSymbol(false), pMaster(0), oldStderr(-1), tempDir(""), cachedPC(0),
-      cachedPCvalid(false), lastDisasm("?"), stepAgain(false),
-      continueToEnd(false), hitBreakpoint(false)
+      argv(std::move(args)), childPid(0), currentThread(0), threaded(false),
+      done(false), stepCount(0),
+      seenFirstSymbol(false), watchpointsArmed(true), pMaster(0), oldStderr(-1),
+      tempDir(""), cachedPC(0), lastDisasm("?"), variablesPending(false),
+      stackPending(false), resumePending(false), resumeRequest(PTRACE_CONT),
+      continueToEnd(false), hitBreakpoint(false), hitTempBreakpoint(false),
+      hitWatchpoint(false), watchpointAddr(0), replaying(false), injectAddr(0),
+      epollFd(-1), wakeFd(-1), pidFd(-1), stopRequested(false)
   {
     logger->log(Logger::DBG, [&]() {
       std::stringstream s;
@@ -130,11 +146,32 @@ namespace penguinTrace
 
   Stepper::~Stepper()
   {
+    clearCheckpoints();
+    if (childPid != 0 && !done)
+    {
+      killTracee();
+    }
+    if (pidFd != -1) close(pidFd);
+    if (wakeFd != -1) close(wakeFd);
+    if (epollFd != -1) close(epollFd);
     tidyIsolation();
   }
 
   bool Stepper::init()
   {
+    tracerThread = std::this_thread::get_id();
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (epollFd == -1 || wakeFd == -1)
+    {
+      logger->error(Logger::ERROR, "Failed to create event descriptors");
+      return false;
+    }
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.fd = wakeFd;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &ev);
+
     if (!Config::get(C_USE_PTY).Bool())
     {
       int i;
@@ -257,6 +294,9 @@ namespace penguinTrace
 
       close(oldStderr);
       ptrace(PTRACE_TRACEME, 0, nullptr, nullptr);
+      // Wait for the tracer to set options, so it sees the exec from the
+      //  syscall filter
+      raise(SIGSTOP);
       execve(filename.c_str(), args.data(), env.data());
       std::stringstream err;
       err << "Failed to exec '" << filename << "'. " << strerror(errno) << std::endl;
@@ -280,7 +320,38 @@ namespace penguinTrace
       close(pErrToParent[PIPE_WR]);
     }
 
+    int status;
+    if ((waitpid(p, &status, __WALL) != p) || !WIFSTOPPED(status) ||
+        (ptrace(PTRACE_SETOPTIONS, p, nullptr, TRACE_OPTIONS) != 0) ||
+        (ptrace(PTRACE_CONT, p, nullptr, nullptr) != 0))
+    {
+      logger->error(Logger::ERROR, "Failed to start tracing child process");
+      return false;
+    }
+
     childPid = p;
+    currentThread = p;
+    threads[p].running = true;
+    memory.attach(p);
+
+    // Output is read as it arrives, so the tracee can't block on a full pipe
+    std::vector<int> outFds;
+    if (Config::get(C_USE_PTY).Bool())
+    {
+      outFds.push_back(pMaster);
+    }
+    else
+    {
+      outFds.push_back(pOutToParent[PIPE_RD]);
+      outFds.push_back(pErrToParent[PIPE_RD]);
+    }
+    watchTracee();
+    for (auto fd : outFds)
+    {
+      ev.events = EPOLLIN;
+      ev.data.fd = fd;
+      epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev);
+    }
     logger->log(Logger::DBG, [&]() {
       std::stringstream s;
 
@@ -294,16 +365,45 @@ namespace penguinTrace
   uint64_t Stepper::step(StepType step)
   {
     uint64_t pc;
-    pushToPipe();
-    cachedPCvalid = false;
+    bool stopped = false;
+    if (!replaying)
+    {
+      // Input is not replayed, kept until the replay is done
+      pushToPipe();
+    }
     hitBreakpoint = false;
+    if (resumePending)
+    {
+      resumePending = false;
+      if (WATCHPOINT_BEFORE_ACCESS && hitWatchpoint)
+      {
+        // Step over the access that triggered the watchpoint, re-armed at
+        //  the next stop
+        setAllWatchpoints(false);
+        watchpointsArmed = false;
+      }
+      long retval = resume(resumeRequest);
+      if (retval != 0)
+      {
+        std::stringstream s;
+        s << "Step failed, pid=" << childPid;
+        logger->error(Logger::ERROR, s.str());
+      }
+      assert(retval == 0);
+    }
     doWait();
     if (done)
     {
+      // Values from the last stop are kept, the tracee can no longer be read
+      variablesPending = false;
+      stackPending = false;
+      // Pipes are closed, so can't continue from a checkpoint
+      clearCheckpoints();
       logger->log(Logger::INFO, "Trace process finished");
       // Child exited/signalled
 
-      readFromPipes();
+      if (replaying) discardPipes();
+      else           readFromPipes();
 
       if (Config::get(C_USE_PTY).Bool())
       {
@@ -317,27 +417,34 @@ namespace penguinTrace
       }
       return 0;
     }
+    // Only register read for this stop, all later accesses use the cache
+    getRegisters();
+    variableValues.clear();
+    stackTrace.clear();
+    variablesPending = false;
+    stackPending = false;
+    hitWatchpoint = false;
+    if (watchpointsArmed && !watchpointMap.empty())
+    {
+      hitWatchpoint = watchpointHit(watchpointAddr);
+    }
+    // Temporary breakpoints only last until the next stop
+    removeTempBreaks();
     // Set queued breakpoints
+    applyBreakpointChanges();
+    if (!watchpointsArmed)
     {
-      std::lock_guard<std::mutex> lock(breakpointMutex);
-      for (auto it : breakpointsToAdd)
+      if (!setAllWatchpoints(true))
       {
-        insertBreak(it);
-      }
-      for (auto it : breakpointsToRemove)
-      {
-        if (breakpointMap.find(it) != breakpointMap.end())
-        {
-          removeBreak(it);
-        }
+        logger->log(Logger::WARN, "Failed to set watchpoints");
       }
-      breakpointsToAdd.clear();
-      breakpointsToRemove.clear();
+      watchpointsArmed = true;
     }
-    // TODO merge with getting PC
-    //   (should only call getregset once per-step)
-    getRegisters();
     stepCount++;
+    if (!replaying && checkpointsEnabled())
+    {
+      stepLog.push_back(step);
+    }
 
     logger->log(Logger::TRACE, [&]() {
       std::stringstream s;
@@ -357,7 +464,15 @@ namespace penguinTrace
     else
     {
       pc = allStep(step);
-      readFromPipes();
+      if (!replaying)
+      {
+        readFromPipes();
+      }
+      else
+      {
+        discardPipes();
+      }
+      stopped = true;
     }
 
     logger->log(Logger::TRACE, [&]() {
@@ -373,6 +488,9 @@ namespace penguinTrace
       return s.str();
     });
 
+    // REVISIT cached PC handling is incorrect in places
+    cachedPC = pc;
+
     if (!continueToEnd && !Config::get(C_STEP_AFTER_MAIN).Bool())
     {
       // Try and detect returning from main
@@ -392,17 +510,24 @@ namespace penguinTrace
           return s.str();
         });
         continueToEnd = true;
+        // Last stop in main is shown once finished, evaluate while it can
+        //  still be read
+        getVarValues();
+        getStackTrace();
       }
     }
 
-    // REVISIT cached PC handling is incorrect in places
-    cachedPC = pc;
+    if (stopped)
+    {
+      checkpoint();
+    }
+
     return pc;
   }
 
   bool Stepper::isFunctionReturn(uint64_t pc)
   {
-    uint32_t instr = (uint32_t)ptrace(PTRACE_PEEKTEXT, childPid, pc, nullptr);
+    uint32_t instr = (uint32_t)getMemValue(pc);
     return (instr & RETURN_MASK) == RETURN_WORD;
   }
 
@@ -429,11 +554,15 @@ namespace penguinTrace
       s << "Using starting symbol '" << symItr->first << "'";
       logger->log(Logger::INFO, s.str());
 
+      cachedPC = symItr->second->getAddress();
+      // Shown until stopped there, read before the breakpoint is written
+      lastDisasm = disasmAtAddr(cachedPC);
       // Set breakpoint at symbol
-      insertBreak(symItr->second->getAddress());
+      insertTempBreak(symItr->second->getAddress());
+      // Known executable address to inject syscalls at
+      injectAddr = symItr->second->getAddress();
       // Continue
-      ptrace(PTRACE_CONT, childPid, nullptr, nullptr);
-      cachedPC = symItr->second->getAddress();
+      deferResume(PTRACE_CONT);
     }
 
     return cachedPC;
@@ -444,24 +573,26 @@ namespace penguinTrace
     uint64_t pc = getPC();
     uint64_t bkptPC = breakPC(pc);
 
-    if (breakpointMap.find(bkptPC) != breakpointMap.end())
+    if (hitWatchpoint)
     {
-      if (!stepAgain)
-      {
-        removeBreak(bkptPC);
-        hitBreakpoint = true;
-      }
+      hitBreakpoint = true;
+      logger->log(Logger::INFO, [&]() {
+        std::stringstream s;
+        s << "Watchpoint @" << HexPrint(watchpointAddr, 8);
+        s << " hit @" << HexPrint(pc, 8);
+        return s.str();
+      });
+    }
+    else if (!hitTempBreakpoint && (breakpointMap.find(bkptPC) != breakpointMap.end()))
+    {
+      removeBreak(bkptPC);
+      hitBreakpoint = true;
       pc = bkptPC;
       // Setting PC after a breakpoint is only needed for architectures that do
       //  not restore the PC, but no harm in doing on all architectures
       setPC(pc);
     }
 
-    if (stepAgain)
-    {
-      stepAgain = false;
-    }
-
     if (pc != 0)
     {
       // May be able to optimise to only disasm when required
@@ -472,39 +603,9 @@ namespace penguinTrace
       s << HexPrint(pc, 16) << " -> " << lastDisasm;
       logger->log(Logger::INFO, s.str());
 
-      getVariables(pc);
-      getStack(pc);
-
-      if (isSyscall(pc))
-      {
-        auto sys = getSyscall();
-        auto sysName = getSyscallName(sys.num);
-        std::stringstream s;
-        s << "syscall " << sysName << " (";
-        bool first = true;
-        for (auto i : sys.args)
-        {
-          if (!first) s << ", ";
-          else        first = false;
-
-          s << HexPrint(i, 1);
-        }
-        s << ")";
-        logger->log(Logger::INFO, s.str());
+      variablesPending = true;
+      stackPending = true;
 
-        if ((sysName == "fork") ||
-            (sysName == "vfork") ||
-            (sysName == "execve") ||
-            (sysName == "execveat") ||
-            (sysName == "clone") ||
-            (sysName == "UNKNOWN"))
-        {
-          errorSyscall(pc);
-          std::stringstream s;
-          s << "Blocking syscall - " << sysName;
-          logger->log(Logger::WARN, s.str());
-        }
-      }
       // Before stepping, will want to check current instruction
       // Not tracing dynamic symbols:
       // - If BL/BLR - set breakpoint at next PC
@@ -524,46 +625,30 @@ namespace penguinTrace
           s << HexPrint(pc, 16);
           return s.str();
         });
-        insertBreak(callReturnAddr(pc));
-        int retval = ptrace(PTRACE_CONT, childPid, nullptr, nullptr);
-        assert(retval == 0);
+        insertTempBreak(callReturnAddr(pc));
+        deferResume(PTRACE_CONT);
       }
       else
       {
-        if ((step == STEP_INSTR) ||
-            ((step == STEP_LINE) & STEPPER_ALWAYS_SINGLE_STEP))
+        // If this stop completes the step only advance by one instruction,
+        //  the next step then starts from there
+        bool stepDone = hitBreakpoint ||
+            ((step == STEP_LINE) && dwarfInfo.isLineAddress(pc));
+
+        if ((step == STEP_INSTR) || stepDone ||
+            ((step == STEP_LINE) && STEPPER_ALWAYS_SINGLE_STEP))
         {
-          int retval = ptrace(PTRACE_SINGLESTEP, childPid, nullptr, nullptr);
-          if (retval != 0)
-          {
-            std::stringstream s;
-            s << "Step failed, pid=" << childPid;
-            logger->error(Logger::ERROR, s.str());
-          }
-          assert(retval == 0);
+          deferResume(PTRACE_SINGLESTEP);
         }
         else if (step == STEP_LINE)
         {
-          uint64_t nextPc = dwarfInfo.nextLinePC(pc);
-          if (nextPc != 0)
-          {
-            insertBreak(nextPc);
-            int retval = ptrace(PTRACE_CONT, childPid, nullptr, nullptr);
-            assert(retval == 0);
-            stepAgain = true;
-          }
-          else
-          {
-            // If can't find line information - single step
-            int retval = ptrace(PTRACE_SINGLESTEP, childPid, nullptr, nullptr);
-            assert(retval == 0);
-          }
+          // Run to the next line without stopping at each instruction
+          insertLineBreaks(pc);
+          deferResume(PTRACE_CONT);
         }
         else if (step == STEP_CONT)
         {
-          int retval = ptrace(PTRACE_CONT, childPid, nullptr, nullptr);
-          assert(retval == 0);
-          stepAgain = true;
+          deferResume(PTRACE_CONT);
         }
         else
         {
@@ -578,10 +663,102 @@ namespace penguinTrace
     return pc;
   }
 
+  long Stepper::resume(enum __ptrace_request req)
+  {
+    // Other threads run while the current one is stepped
+    for (auto& it : threads)
+    {
+      if ((it.first != currentThread) && !it.second.running)
+      {
+        resumeThread(it.first, PTRACE_CONT);
+      }
+    }
+    return resumeThread(currentThread, req);
+  }
+
+  long Stepper::resumeThread(pid_t tid, enum __ptrace_request req)
+  {
+    pid_t current = currentThread;
+    switchThread(tid);
+    setRegisters();
+    registers.valid = false;
+    switchThread(current);
+    memory.invalidate();
+    long ret = ptrace(req, tid, nullptr, nullptr);
+    threads[tid].running = (ret == 0);
+    return ret;
+  }
+
+  void Stepper::switchThread(pid_t tid)
+  {
+    if (tid == currentThread)
+    {
+      return;
+    }
+    auto it = threads.find(currentThread);
+    if (it != threads.end())
+    {
+      it->second.registers = registers;
+    }
+    registers = threads[tid].registers;
+    currentThread = tid;
+  }
+
+  void Stepper::deferResume(enum __ptrace_request req)
+  {
+    // Resumed at the start of the next step, until then the tracee stays at
+    //  this stop for variables and the stack to be read
+    resumePending = true;
+    resumeRequest = req;
+  }
+
+  std::map<std::string, std::string>& Stepper::getVarValues()
+  {
+    if (variablesPending)
+    {
+      variablesPending = false;
+      try
+      {
+        getVariables(cachedPC);
+      }
+      catch (Exception& e)
+      {
+        logger->log(Logger::WARN, [&]() {
+          std::stringstream s;
+          s << "Failed to evaluate variables: " << e.what();
+          return s.str();
+        });
+      }
+    }
+    return variableValues;
+  }
+
+  std::list<std::string>& Stepper::getStackTrace()
+  {
+    if (stackPending)
+    {
+      stackPending = false;
+      try
+      {
+        getStack(cachedPC);
+      }
+      catch (Exception& e)
+      {
+        logger->log(Logger::WARN, [&]() {
+          std::stringstream s;
+          s << "Failed to evaluate stack: " << e.what();
+          return s.str();
+        });
+      }
+    }
+    return stackTrace;
+  }
+
   uint64_t Stepper::getRegValue(std::string reg)
   {
-    assert((registerValues.find(reg) != registerValues.end()) && "Register not found");
-    uint64_t value = registerValues[reg];
+    uint64_t value = 0;
+    bool found = regValueByName(reg, value);
+    assert(found && "Register not found");
     std::stringstream s;
     s << "Getting value of " << reg;
     s << " = " << HexPrint(value, 16);
@@ -609,10 +786,19 @@ namespace penguinTrace
 
   uint64_t Stepper::getMemValue(uint64_t ptr)
   {
-    long data = ptrace(PTRACE_PEEKTEXT, childPid, ptr, nullptr);
-    std::stringstream s;
-    s << "Getting value at " << HexPrint(ptr, 16) << " = " << HexPrint(data, 16);
-    logger->log(Logger::TRACE, s.str());
+    uint64_t data;
+    if (!memory.readWord(ptr, data))
+    {
+      // Not readable, give the same result as PTRACE_PEEKTEXT, which
+      //  fails on other threads without needing to be called
+      data = (std::this_thread::get_id() == tracerThread) ?
+          ptrace(PTRACE_PEEKTEXT, currentThread, ptr, nullptr) : -1;
+    }
+    logger->log(Logger::TRACE, [&]() {
+      std::stringstream s;
+      s << "Getting value at " << HexPrint(ptr, 16) << " = " << HexPrint(data, 16);
+      return s.str();
+    });
 
     return data;
   }
@@ -628,9 +814,23 @@ namespace penguinTrace
     {
       for (auto it : objects)
       {
-        std::string value = it->getValueString(std::bind(&Stepper::getRegValue, this, std::placeholders::_1),
-                                               std::bind(&Stepper::getMemValue, this, std::placeholders::_1),
-                                               pc);
+        std::string value;
+        // One variable that can't be evaluated leaves the others shown
+        try
+        {
+          value = it->getValueString(std::bind(&Stepper::getRegValue, this, std::placeholders::_1),
+                                     std::bind(&Stepper::getMemValue, this, std::placeholders::_1),
+                                     pc);
+        }
+        catch (Exception& e)
+        {
+          logger->log(Logger::DBG, [&]() {
+            std::stringstream s;
+            s << "Failed to evaluate " << it->getName() << ": " << e.what();
+            return s.str();
+          });
+          value = "<unsupported location>";
+        }
         if (value.length() == 0) continue;
         std::stringstream s;
         s << "# " << StringPad(it->getType()->typeString(), 30, false);
@@ -663,89 +863,84 @@ namespace penguinTrace
     }
     assert(fde != nullptr);
     assert(fde->contains(currentPc));
-    auto unwindInfo = fde->unwindInfo(currentPc);
-
-    // TODO move logic to FDE?
-    for (auto it : *unwindInfo)
+    dwarf::CFIRow* row = fde->unwindRow(currentPc);
+    if (row == nullptr)
     {
-      bool cfa = it.first == " ";
-      // CFA defined as " "
-      std::stringstream s;
-      s << "reg: " << (cfa ? "CFA": it.first);
-      s << " - rule: " << it.second.toString(cfa);
-      logger->log(Logger::TRACE, s.str());
+      std::stringstream err;
+      err << "No unwind row for " << HexPrint(currentPc, 1);
+      logger->log(Logger::WARN, err.str());
+      return false;
+    }
 
-      std::string regName = it.first;
-      if (it.first == " ")
-      {
-        regName = SP_REG_NAME;
-        doneSp = true;
-      }
-      else if (it.first == "ra")
-      {
-        regName = PC_REG_NAME;
-        donePc = true;
-      }
-      else if (it.first == FB_REG_NAME)
-      {
-        doneFb = true;
-      }
+    // The CFA becomes the new stack pointer, which the register
+    //  rules are relative to, so it is applied first, then the
+    //  return address
+    auto applyRule = [&](std::string regName, dwarf::RegRule& rule, bool cfa) -> bool
+    {
+      logger->log(Logger::TRACE, [&]() {
+        std::stringstream s;
+        s << "reg: " << (cfa ? "CFA" : regName);
+        s << " - rule: " << rule.toString(cfa);
+        return s.str();
+      });
 
       uint64_t newValue = unwindRegisterValues[regName];
 
-      if (it.second.getType() == dwarf::RegRule::SAME)
+      if (rule.getType() == dwarf::RegRule::UNDEFINED)
+      {
+        return false;
+      }
+      else if (rule.getType() == dwarf::RegRule::SAME)
       {
 
       }
-      else if (it.second.getType() == dwarf::RegRule::EXPR)
+      else if (rule.getType() == dwarf::RegRule::EXPR)
       {
         // TODO expr unwind
         throw Exception("Expression unwind unsupported", __EINFO__);
       }
-      else if (it.second.getType() == dwarf::RegRule::OFFSET)
+      else if (rule.getType() == dwarf::RegRule::OFFSET)
       {
         assert(!cfa);
-        std::string regFrom = SP_REG_NAME;
-        uint64_t baseValue = unwindRegisterValues[regFrom];
-        if (it.second.op().isSigned())
-        {
-          int64_t offset = it.second.op().getSInt();
-          newValue = getMemValue(baseValue+offset);
-        }
-        else
-        {
-          uint64_t offset = it.second.op().getInt();
-          newValue = getMemValue(baseValue+offset);
-        }
+        uint64_t baseValue = unwindRegisterValues[SP_REG_NAME];
+        newValue = getMemValue(baseValue+rule.getOffset());
       }
-      else if (it.second.getType() == dwarf::RegRule::VAL_OFFSET)
+      else if (rule.getType() == dwarf::RegRule::VAL_OFFSET)
       {
-        std::string regFrom = cfa ? it.second.regName() : SP_REG_NAME;
+        std::string regFrom = cfa ? dwarfRegString(rule.regNum()) : SP_REG_NAME;
         uint64_t baseValue = unwindRegisterValues[regFrom];
-        if (it.second.op().isSigned())
-        {
-          int64_t offset = it.second.op().getSInt();
-          newValue = baseValue+offset;
-        }
-        else
-        {
-          uint64_t offset = it.second.op().getInt();
-          newValue = baseValue+offset;
-        }
+        newValue = baseValue+rule.getOffset();
       }
-      else
+      else if (rule.getType() == dwarf::RegRule::REGISTER)
       {
-        throw Exception("Unhandled unwind rule", __EINFO__);
+        newValue = unwindRegisterValues[dwarfRegString(rule.regNum())];
       }
-
-      if (it.first == "ra")
+      else
       {
-        // DWARF recommends subtracting one instruction from return address
-        //  to get previous context
-        newValue -= MIN_INSTR_BYTES;
+        throw Exception("Unhandled unwind rule", __EINFO__);
       }
 
       unwindRegisterValues[regName] = newValue;
+      return true;
+    };
+
+    doneSp = applyRule(SP_REG_NAME, row->cfa(), true);
+
+    dwarf::RegRule* raRule = row->getRule(fde->raCol());
+    if (raRule != nullptr && applyRule(PC_REG_NAME, *raRule, false))
+    {
+      // DWARF recommends subtracting one instruction from return address
+      //  to get previous context
+      unwindRegisterValues[PC_REG_NAME] -= MIN_INSTR_BYTES;
+      donePc = true;
+    }
+
+    for (auto& it : row->getRules())
+    {
+      if (it.first == fde->raCol()) continue;
+      std::string regName = dwarfRegString(it.first);
+      bool done = applyRule(regName, it.second, false);
+      if (regName == FB_REG_NAME) doneFb = done;
     }
 
     return doneSp && donePc && doneFb;
@@ -814,8 +1009,10 @@ namespace penguinTrace
         stackTrace.push_back(s.str());
       }
 
-      // Set up register values for unwinding
-      unwindRegisterValues = registerValues;
+      // Set up register values for unwinding, from the stop PC as the
+      //  register may have been moved on (e.g. over a blocked syscall)
+      unwindRegisterValues = getRegValues();
+      unwindRegisterValues[PC_REG_NAME] = pc;
 
       std::string currentFunction = function->hasName() ? function->getName() : "???";
       dwarf::DIE* nextFunction = nullptr;
@@ -899,16 +1096,7 @@ namespace penguinTrace
         s << "Inserting breakpoint @" << penguinTrace::HexPrint(addr, 16);
         return s.str();
       });
-      long prevInstr = ptrace(PTRACE_PEEKTEXT, childPid, addr, nullptr);
-      breakpointMap[addr] = prevInstr;
-      int ret = ptrace(PTRACE_POKETEXT, childPid, addr, BREAKPOINT_WORD);
-      if (MIN_INSTR_BYTES == 1)
-      {
-        long newInstr = ptrace(PTRACE_PEEKTEXT, childPid, (addr & 0xffffFFFFffffFFFC), nullptr);
-        assert(((newInstr >> ((addr & 0x3)*8)) & 0xff) == BREAKPOINT_WORD && "Breakpoint instruction not written");
-      }
-      if (ret != 0) perror("bkpt");
-      assert(ret == 0 && "Failed to set breakpoint");
+      breakpointMap[addr] = writeBreak(addr);
     }
     else
     {
@@ -920,6 +1108,115 @@ namespace penguinTrace
     }
   }
 
+  void Stepper::insertTempBreak(uint64_t addr)
+  {
+    bool exists = (breakpointMap.find(addr) != breakpointMap.end()) ||
+                  (tempBreakpointMap.find(addr) != tempBreakpointMap.end());
+    if (!exists)
+    {
+      logger->log(Logger::TRACE, [&]() {
+        std::stringstream s;
+        s << "Inserting temporary breakpoint @" << penguinTrace::HexPrint(addr, 16);
+        return s.str();
+      });
+      tempBreakpointMap[addr] = writeBreak(addr);
+    }
+  }
+
+  void Stepper::removeTempBreaks()
+  {
+    hitTempBreakpoint = false;
+    if (tempBreakpointMap.empty())
+    {
+      return;
+    }
+
+    uint64_t bkptPC = breakPC(getPC());
+    hitTempBreakpoint = !hitWatchpoint &&
+        (tempBreakpointMap.find(bkptPC) != tempBreakpointMap.end());
+
+    for (auto it : tempBreakpointMap)
+    {
+      clearBreak(it.first, it.second);
+    }
+    tempBreakpointMap.clear();
+
+    if (hitTempBreakpoint)
+    {
+      setPC(bkptPC);
+    }
+  }
+
+  void Stepper::insertLineBreaks(uint64_t pc)
+  {
+    std::set<uint64_t> addrs;
+    dwarf::DIE* function = dwarfInfo.functionByPC(pc);
+    bool isMain = (function != nullptr) && function->hasName() &&
+                  (function->getName() == "main");
+    uint64_t retAddr = 0;
+    if ((function != nullptr) && !isMain)
+    {
+      retAddr = returnAddress();
+    }
+
+    if ((function != nullptr) && (isMain || (retAddr != 0)))
+    {
+      // Next line is in this function, a function it calls, or after
+      //  returning (probably mid-line, so will need to continue from there)
+      dwarfInfo.lineAddresses(function->lowPC(), function->highPC(), addrs);
+      dwarfInfo.functionEntries(addrs);
+      if (retAddr != 0)
+      {
+        addrs.insert(retAddr);
+      }
+    }
+    else
+    {
+      // Not in a known function (e.g. library code) so could resume anywhere
+      dwarfInfo.lineAddresses(0, UINT64_MAX, addrs);
+    }
+    addrs.erase(pc);
+
+    for (auto a : addrs)
+    {
+      insertTempBreak(a);
+    }
+  }
+
+  uint64_t Stepper::returnAddress()
+  {
+    unwindRegisterValues = getRegValues();
+    if (!unwindRegs())
+    {
+      return 0;
+    }
+    // Unwinding gives the calling instruction
+    return unwindRegisterValues[PC_REG_NAME] + MIN_INSTR_BYTES;
+  }
+
+  long Stepper::writeBreak(uint64_t addr)
+  {
+    long prevInstr = getMemValue(addr);
+    // Only replace the bytes of the breakpoint instruction so neighbouring
+    //  breakpoints are left in place
+    long newInstr = (prevInstr & ~BREAKPOINT_MASK) | BREAKPOINT_WORD;
+    int ret = ptrace(PTRACE_POKETEXT, currentThread, addr, newInstr);
+    if (ret != 0) perror("bkpt");
+    assert(ret == 0 && "Failed to set breakpoint");
+    memory.update(addr, newInstr);
+    invalidateDisassembly(addr);
+    return prevInstr;
+  }
+
+  void Stepper::clearBreak(uint64_t addr, long prevInstr)
+  {
+    long instr = (getMemValue(addr) & ~BREAKPOINT_MASK) | (prevInstr & BREAKPOINT_MASK);
+    int ret = ptrace(PTRACE_POKETEXT, currentThread, addr, instr);
+    assert(ret == 0);
+    memory.update(addr, instr);
+    invalidateDisassembly(addr);
+  }
+
   bool Stepper::queueBreakpoint(uint64_t a, bool line)
   {
     std::lock_guard<std::mutex> lock(breakpointMutex);
@@ -984,48 +1281,205 @@ namespace penguinTrace
     breakpointsToRemove.insert(addr);
   }
 
-  void Stepper::removeBreak(uint64_t addr)
+  bool Stepper::queueWatchpoint(uint64_t addr, uint64_t len)
   {
-    logger->log(Logger::DBG, [&]() {
-      std::stringstream s;
-      s << "Removing breakpoint @" << penguinTrace::HexPrint(addr, 16);
-      return s.str();
-    });
+    std::lock_guard<std::mutex> lock(breakpointMutex);
 
-    auto itr = breakpointMap.find(addr);
-    assert(itr != breakpointMap.end());
+    bool lenOk = (len == 1) || (len == 2) || (len == 4) || (len == 8);
+    if (!lenOk || ((addr % len) != 0))
+    {
+      return false;
+    }
 
-    int ret = ptrace(PTRACE_POKETEXT, childPid, addr, itr->second);
-    assert(ret == 0);
+    std::set<uint64_t> addrs;
+    for (auto it : watchpointMap)
+    {
+      addrs.insert(it.first);
+    }
+    for (auto it : watchpointsToAdd)
+    {
+      addrs.insert(it.first);
+    }
+    for (auto it : watchpointsToRemove)
+    {
+      addrs.erase(it);
+    }
+    addrs.insert(addr);
+    if (addrs.size() > MAX_WATCHPOINTS)
+    {
+      return false;
+    }
+
+    logger->log(Logger::DBG, [&]() {
+      std::stringstream s;
+      s << "Queueing watchpoint @" << HexPrint(addr, 8);
+      s << " (" << len << " bytes)";
+      return s.str();
+    });
+    watchpointsToRemove.erase(addr);
+    watchpointsToAdd[addr] = len;
+    return true;
+  }
+
+  void Stepper::removeWatchpoint(uint64_t addr)
+  {
+    std::lock_guard<std::mutex> lock(breakpointMutex);
+
+    watchpointsToAdd.erase(addr);
+    watchpointsToRemove.insert(addr);
+  }
+
+  bool Stepper::setAllWatchpoints(bool enable)
+  {
+    // Debug registers are per thread
+    bool ok = true;
+    pid_t current = currentThread;
+    for (auto& it : threads)
+    {
+      switchThread(it.first);
+      ok &= setWatchpoints(enable);
+    }
+    switchThread(current);
+    return ok;
+  }
+
+  bool Stepper::variableAddress(std::string name, uint64_t& addr, uint64_t& len)
+  {
+    if (done || dwarfInfo.inFunctionPrologue(cachedPC))
+    {
+      return false;
+    }
+
+    std::list<dwarf::DIE*> objects;
+    dwarfInfo.dataObjects(cachedPC, objects);
+
+    // Objects in inner scopes come later, so last match is the visible one
+    dwarf::DIE* object = nullptr;
+    for (auto it : objects)
+    {
+      if (it->getName() == name)
+      {
+        object = it;
+      }
+    }
+    if (object == nullptr)
+    {
+      return false;
+    }
+
+    try
+    {
+      auto value = object->getValue(std::bind(&Stepper::getRegValue, this, std::placeholders::_1),
+                                    std::bind(&Stepper::getMemValue, this, std::placeholders::_1),
+                                    cachedPC, dwarf_t::DW_AT_location);
+      // No address if held in a register
+      if (value.second == 0)
+      {
+        return false;
+      }
+      addr = value.second;
+    }
+    catch (Exception& e)
+    {
+      logger->log(Logger::WARN, [&]() {
+        std::stringstream s;
+        s << "Failed to find address of '" << name << "': " << e.what();
+        return s.str();
+      });
+      return false;
+    }
+
+    // Largest aligned length supported, larger objects only have their
+    //  first bytes watched
+    uint64_t size = object->byteSize();
+    len = 8;
+    while ((len > 1) && ((len > size) || ((addr % len) != 0)))
+    {
+      len /= 2;
+    }
+    return true;
+  }
+
+  void Stepper::removeBreak(uint64_t addr)
+  {
+    logger->log(Logger::DBG, [&]() {
+      std::stringstream s;
+      s << "Removing breakpoint @" << penguinTrace::HexPrint(addr, 16);
+      return s.str();
+    });
+
+    auto itr = breakpointMap.find(addr);
+    assert(itr != breakpointMap.end());
+
+    clearBreak(addr, itr->second);
     breakpointMap.erase(addr);
   }
 
   bool Stepper::doWait()
   {
-    int status;
-    pid_t p = waitpid(childPid, &status, 0);
-    if (p == -1 && errno == ECHILD)
+    int status = 0;
+    bool stopped = false;
+    while (!stopped && !done)
     {
-      // Can get ECHILD if child already exited
-      logger->error(Logger::ERROR, "ECHILD");
-      done = true;
-      return false;
+      pid_t p = waitTracee(status);
+      if (p == -1)
+      {
+        if (errno == ECHILD)
+        {
+          // Can get ECHILD if child already exited
+          logger->error(Logger::ERROR, "ECHILD");
+        }
+        else
+        {
+          perror("waitpid");
+          logger->error(Logger::ERROR, "Waiting for child process failed");
+        }
+        done = true;
+        threads.clear();
+        return false;
+      }
+      else if (WIFEXITED(status) || WIFSIGNALED(status))
+      {
+        // Leader is only reported once all other threads have exited
+        if (p == childPid)
+        {
+          traceeExited(status);
+        }
+        else
+        {
+          bool current = (p == currentThread);
+          threadExited(p);
+          // Nothing left to step, so stop in another thread
+          stopped = current;
+        }
+      }
+      else if (threadEvent(p, status, true))
+      {
+        // Handled, thread has been resumed
+      }
+      else if ((p == currentThread) || threadStopped(p, status))
+      {
+        stopped = true;
+      }
     }
-    else if (p != childPid)
+
+    if (!done)
     {
-      perror("waitpid");
-      logger->error(Logger::ERROR, "Waiting for child process failed");
+      stopThreads();
     }
-    assert(p == childPid);
+    return !done;
+  }
 
-    done = WIFEXITED(status) || WIFSIGNALED(status);
+  void Stepper::traceeExited(int status)
+  {
+    done = true;
+    threads.clear();
     if (WIFEXITED(status))
     {
       int retCode = WEXITSTATUS(status);
       std::stringstream s;
       s << "Exited (" << retCode << ")";
       logger->log(retCode == 0 ? Logger::INFO : Logger::WARN, s.str());
-      assert(done);
     }
     else if (WIFSIGNALED(status))
     {
@@ -1033,22 +1487,456 @@ namespace penguinTrace
       s << "Killed by signal: (" << WTERMSIG(status) << ") ";
       s << strsignal(WTERMSIG(status));
       logger->log(Logger::ERROR, s.str());
-      assert(done);
     }
-    return !done;
+  }
+
+  bool Stepper::threadEvent(pid_t tid, int status, bool resume)
+  {
+    auto& thread = threads[tid];
+    thread.running = false;
+    int event = status >> 16;
+    if (event == PTRACE_EVENT_SECCOMP)
+    {
+      // Syscall passed to the tracer by the filter, carry on once decided
+      pid_t current = currentThread;
+      switchThread(tid);
+      syscallStop();
+      switchThread(current);
+    }
+    else if (event == PTRACE_EVENT_CLONE)
+    {
+      unsigned long msg = 0;
+      int newStatus;
+      if ((ptrace(PTRACE_GETEVENTMSG, tid, nullptr, &msg) != 0) ||
+          (waitpid((pid_t)msg, &newStatus, __WALL) != (pid_t)msg))
+      {
+        logger->error(Logger::ERROR, "Failed to trace new thread");
+        return false;
+      }
+      // New thread starts stopped
+      pid_t newTid = (pid_t)msg;
+      threads[newTid] = Thread();
+      logger->log(Logger::INFO, [&]() {
+        std::stringstream s;
+        s << "Thread " << newTid << " started";
+        return s.str();
+      });
+      if (watchpointsArmed && !watchpointMap.empty())
+      {
+        // Debug registers aren't inherited by a new thread
+        pid_t current = currentThread;
+        switchThread(newTid);
+        setWatchpoints(true);
+        switchThread(current);
+      }
+      if (!threaded && !checkpoints.empty())
+      {
+        logger->log(Logger::WARN, "Tracee started a thread, checkpoints discarded");
+      }
+      clearCheckpoints();
+      threaded = true;
+      if (resume)
+      {
+        resumeThread(newTid, PTRACE_CONT);
+      }
+    }
+    else if ((event == 0) && (WSTOPSIG(status) == SIGSTOP) && thread.stopExpected)
+    {
+      thread.stopExpected = false;
+    }
+    else
+    {
+      return false;
+    }
+
+    if (resume)
+    {
+      resumeThread(tid, (tid == currentThread) ? resumeRequest : PTRACE_CONT);
+    }
+    return true;
+  }
+
+  bool Stepper::threadStopped(pid_t tid, int status)
+  {
+    // Another thread stopped while the current one was being stepped
+    pid_t current = currentThread;
+    switchThread(tid);
+    getRegisters();
+    uint64_t bkptPC = breakPC(getPC());
+    bool trap = WIFSTOPPED(status) && (WSTOPSIG(status) == SIGTRAP);
+    if (trap && (breakpointMap.find(bkptPC) == breakpointMap.end()) &&
+        (tempBreakpointMap.find(bkptPC) != tempBreakpointMap.end()))
+    {
+      // Internal breakpoints are only for the current thread, left stopped
+      //  to execute the instruction once the current thread has stopped
+      setPC(bkptPC);
+      switchThread(current);
+      return false;
+    }
+    // Breakpoints, watchpoints and signals stop all threads, and the thread
+    //  that stopped becomes the current one
+    logger->log(Logger::INFO, [&]() {
+      std::stringstream s;
+      s << "Thread " << tid << " stopped";
+      return s.str();
+    });
+    return true;
+  }
+
+  void Stepper::threadExited(pid_t tid)
+  {
+    logger->log(Logger::INFO, [&]() {
+      std::stringstream s;
+      s << "Thread " << tid << " exited";
+      return s.str();
+    });
+    threads.erase(tid);
+    if ((tid == currentThread) && !threads.empty())
+    {
+      // Leader is used if it hasn't exited
+      auto next = threads.find(childPid);
+      if (next == threads.end())
+      {
+        next = threads.begin();
+      }
+      registers = next->second.registers;
+      currentThread = next->first;
+    }
+  }
+
+  void Stepper::stopThreads()
+  {
+    // All-stop, every other thread is stopped while the current one is
+    std::vector<pid_t> stopping;
+    for (auto& it : threads)
+    {
+      if (it.second.running)
+      {
+        syscall(SYS_tgkill, childPid, it.first, SIGSTOP);
+        stopping.push_back(it.first);
+      }
+    }
+    // Polled as the leader can't be waited for until other threads exit
+    while (!stopping.empty())
+    {
+      for (auto it = stopping.begin(); it != stopping.end(); )
+      {
+        int status;
+        pid_t p = waitpid(*it, &status, __WALL | WNOHANG);
+        if (p == 0)
+        {
+          ++it;
+          continue;
+        }
+        if ((p == childPid) && (WIFEXITED(status) || WIFSIGNALED(status)))
+        {
+          // Exited before it could be stopped
+          traceeExited(status);
+          return;
+        }
+        else if (p == -1 || WIFEXITED(status) || WIFSIGNALED(status))
+        {
+          threadExited(*it);
+        }
+        else if ((status >> 16 == 0) && (WSTOPSIG(status) == SIGSTOP))
+        {
+          threads[p].running = false;
+          threads[p].stopExpected = false;
+        }
+        else
+        {
+          // Stopped for something else first, SIGSTOP is still to come
+          threads[p].stopExpected = true;
+          if (!threadEvent(p, status, false))
+          {
+            pid_t current = currentThread;
+            switchThread(p);
+            getRegisters();
+            uint64_t bkptPC = breakPC(getPC());
+            if ((WSTOPSIG(status) == SIGTRAP) &&
+                ((breakpointMap.find(bkptPC) != breakpointMap.end()) ||
+                 (tempBreakpointMap.find(bkptPC) != tempBreakpointMap.end())))
+            {
+              // Hit later once resumed
+              setPC(bkptPC);
+            }
+            switchThread(current);
+          }
+        }
+        it = stopping.erase(it);
+      }
+      if (!stopping.empty())
+      {
+        std::this_thread::yield();
+      }
+    }
+
+    if (threads.size() > 1)
+    {
+      // Registers of other threads are read now, as they can only be read
+      //  from the thread that traces them
+      pid_t current = currentThread;
+      for (auto& it : threads)
+      {
+        if (it.first != current)
+        {
+          switchThread(it.first);
+          if (!registers.valid)
+          {
+            getRegisters();
+          }
+          it.second.pc = getPC();
+        }
+      }
+      switchThread(current);
+    }
+  }
+
+  void Stepper::killTracee()
+  {
+    kill(childPid, SIGKILL);
+    // Other threads have to be waited for before the leader
+    for (auto& it : threads)
+    {
+      int status;
+      if (it.first != childPid)
+      {
+        waitpid(it.first, &status, __WALL);
+      }
+    }
+    int status;
+    waitpid(childPid, &status, __WALL);
+    threads.clear();
+  }
+
+  std::map<pid_t, uint64_t> Stepper::getThreads()
+  {
+    std::map<pid_t, uint64_t> pcs;
+    for (auto& it : threads)
+    {
+      pcs[it.first] = (it.first == currentThread) ? cachedPC : it.second.pc;
+    }
+    return pcs;
+  }
+
+  bool Stepper::selectThread(pid_t tid)
+  {
+    auto it = threads.find(tid);
+    if (tid == currentThread)
+    {
+      return !done;
+    }
+    else if (done || (it == threads.end()) || !it->second.registers.valid)
+    {
+      return false;
+    }
+    threads[currentThread].pc = cachedPC;
+    switchThread(tid);
+    cachedPC = it->second.pc;
+    lastDisasm = disasmAtAddr(cachedPC);
+    variableValues.clear();
+    stackTrace.clear();
+    variablesPending = true;
+    stackPending = true;
+    hitBreakpoint = false;
+    hitWatchpoint = false;
+    // Resume was decided for the previous thread, step from the new one
+    if (resumePending)
+    {
+      resumeRequest = PTRACE_SINGLESTEP;
+    }
+    return true;
+  }
+
+  void Stepper::watchTracee()
+  {
+    // A pidfd refers to one process and stays readable once it exits, so
+    //  is replaced whenever a checkpoint becomes the tracee
+    if (pidFd != -1)
+    {
+      epoll_ctl(epollFd, EPOLL_CTL_DEL, pidFd, nullptr);
+      close(pidFd);
+      pidFd = -1;
+    }
+    // Only readable once the tracee exits (not supported by older kernels)
+#ifdef SYS_pidfd_open
+    pidFd = syscall(SYS_pidfd_open, childPid, 0);
+#endif
+    if (pidFd != -1)
+    {
+      struct epoll_event ev;
+      ev.events = EPOLLIN;
+      ev.data.fd = pidFd;
+      epoll_ctl(epollFd, EPOLL_CTL_ADD, pidFd, &ev);
+    }
+  }
+
+  pid_t Stepper::waitTracee(int& status)
+  {
+    // A pidfd only becomes readable when the tracee exits, not when it
+    //  stops, so stops are polled for. Single steps stop almost immediately,
+    //  after that back off while the tracee runs
+    int timeout = 0;
+    int polls = 0;
+    while (true)
+    {
+      bool running = false;
+      for (auto& it : threads)
+      {
+        if (it.second.running)
+        {
+          running = true;
+          pid_t p = waitpid(it.first, &status, __WALL | WNOHANG);
+          if (p != 0)
+          {
+            return p;
+          }
+        }
+      }
+      if (!running)
+      {
+        errno = ECHILD;
+        return -1;
+      }
+      waitEvents(timeout);
+      if (++polls >= WAIT_SPIN_POLLS)
+      {
+        timeout = std::min(std::max(timeout*2, 1), WAIT_MAX_POLL_MS);
+      }
+    }
+  }
+
+  void Stepper::waitEvents(int timeout)
+  {
+    const int MAX_EVENTS = 4;
+    struct epoll_event events[MAX_EVENTS];
+    int n = epoll_wait(epollFd, events, MAX_EVENTS, timeout);
+    bool output = false;
+    bool woken = false;
+    for (int i = 0; i < n; ++i)
+    {
+      if (events[i].data.fd == wakeFd)
+      {
+        uint64_t count;
+        woken = read(wakeFd, &count, sizeof(count)) == sizeof(count);
+      }
+      else if (events[i].data.fd != pidFd)
+      {
+        output = true;
+      }
+    }
+    if (n == 0 && timeout == 0)
+    {
+      std::this_thread::yield();
+    }
+
+    if (stopRequested.exchange(false) && !done)
+    {
+      logger->log(Logger::INFO, "Stopping trace process");
+      kill(childPid, SIGKILL);
+    }
+    // Replayed output was shown the first time, input is kept until the
+    //  replay is done
+    if (output)
+    {
+      if (replaying) discardPipes();
+      else           readFromPipes();
+    }
+    if (woken && !replaying)
+    {
+      pushToPipe();
+    }
+  }
+
+  void Stepper::wake()
+  {
+    uint64_t one = 1;
+    if (write(wakeFd, &one, sizeof(one)) != sizeof(one))
+    {
+      logger->error(Logger::ERROR, "Failed to wake stepper");
+    }
+  }
+
+  void Stepper::sendStdin(std::string in)
+  {
+    {
+      std::lock_guard<std::mutex> lock(stdinMutex);
+      stdin.push(in);
+    }
+    wake();
+  }
+
+  void Stepper::requestStop()
+  {
+    stopRequested = true;
+    wake();
+  }
+
+  void Stepper::syscallStop()
+  {
+    getRegisters();
+    auto sys = getSyscall();
+    auto sysName = getSyscallName(sys.num);
+    logger->log(Logger::INFO, [&]() {
+      std::stringstream s;
+      s << "syscall " << sysName << " (";
+      bool first = true;
+      for (auto i : sys.args)
+      {
+        if (!first) s << ", ";
+        else        first = false;
+
+        s << HexPrint(i, 1);
+      }
+      s << ")";
+      return s.str();
+    });
+
+    // Only the exec of the program itself is allowed, other execs and
+    //  new processes are blocked
+    if ((sysName != "execve") || seenFirstSymbol)
+    {
+      denySyscall();
+      std::stringstream s;
+      s << "Blocking syscall - " << sysName;
+      logger->log(Logger::WARN, s.str());
+    }
+  }
+
+  void Stepper::seedDisassembly(std::map<uint64_t, object::LineDisassembly>& lines)
+  {
+    // Only code sections, others are shown as data
+    for (auto section : parser->getSectionAddrMap())
+    {
+      auto secPtr = section.second;
+      if (secPtr->isCode())
+      {
+        auto end = lines.lower_bound(secPtr->getAddress() + secPtr->getSize());
+        for (auto it = lines.lower_bound(secPtr->getAddress()); it != end; ++it)
+        {
+          disasmCache[it->first] = Instruction(it->second.getCodeDis(),
+                                               it->second.getLength(), true);
+        }
+      }
+    }
   }
 
   std::string Stepper::disasmAtAddr(uint64_t addr)
   {
+    auto cached = disasmCache.find(addr);
+    if (cached != disasmCache.end())
+    {
+      return cached->second.text;
+    }
+
     int bytesToRead = MAX_INSTR_BYTES;
     bool error = false;
     std::vector<uint8_t> instrBytes;
 
     while (bytesToRead > 0 && !error)
     {
-      errno = 0;
-      long data = ptrace(PTRACE_PEEKTEXT, childPid, addr, nullptr);
-      if (errno == 0)
+      uint64_t data;
+      if (memory.readWord(addr + instrBytes.size(), data))
       {
         for (unsigned i = 0; i < sizeof(data); ++i)
         {
@@ -1063,7 +1951,31 @@ namespace penguinTrace
       bytesToRead -= sizeof(data);
     }
 
-    return disassembler.disassemble(addr, instrBytes, nullptr);
+    int consumed = 0;
+    std::string dis = disassembler.disassemble(addr, instrBytes, &consumed);
+    if (!error)
+    {
+      disasmCache[addr] = Instruction(dis, consumed, false);
+    }
+    return dis;
+  }
+
+  void Stepper::invalidateDisassembly(uint64_t addr)
+  {
+    // Instructions decoded from the tracee that include the written bytes
+    uint64_t start = (addr > MAX_INSTR_BYTES) ? (addr - MAX_INSTR_BYTES) : 0;
+    auto it = disasmCache.lower_bound(start);
+    while ((it != disasmCache.end()) && (it->first < addr + MIN_INSTR_BYTES))
+    {
+      if (!it->second.image && ((it->first + it->second.length) > addr))
+      {
+        it = disasmCache.erase(it);
+      }
+      else
+      {
+        ++it;
+      }
+    }
   }
 
   void Stepper::getMemoryRanges()
@@ -1127,6 +2039,20 @@ namespace penguinTrace
     }
   }
 
+  void Stepper::discardPipes()
+  {
+    std::stringstream replayed;
+    if (Config::get(C_USE_PTY).Bool())
+    {
+      readFile(pMaster, &replayed);
+    }
+    else
+    {
+      readFile(pOutToParent[PIPE_RD], &replayed);
+      readFile(pErrToParent[PIPE_RD], &replayed);
+    }
+  }
+
   void Stepper::readFile(int fd, std::stringstream* stream)
   {
     int n;
@@ -1165,16 +2091,29 @@ namespace penguinTrace
       fd = pToChild[PIPE_WR];
     }
 
-    while (!stdin.empty())
+    std::queue<std::string> input;
+    {
+      std::lock_guard<std::mutex> lock(stdinMutex);
+      input.swap(stdin);
+    }
+
+    if (!input.empty())
+    {
+      // Input can't be replayed, so can't go back before it
+      clearCheckpoints();
+      stopLog.clear();
+    }
+
+    while (!input.empty())
     {
-      auto str = stdin.front()+"\n";
+      auto str = input.front()+"\n";
 
       if (!writeWrap(fd, str))
       {
         logger->error(Logger::ERROR, "Failed to write to STDIN");
       }
 
-      stdin.pop();
+      input.pop();
     }
   }
 
@@ -1190,10 +2129,7 @@ namespace penguinTrace
     }
     else if (step == STEP_LINE)
     {
-      auto loc = dwarfInfo.exactLocationByPC(cachedPC);
-      // Sometimes get line 0 - don't want to stop here
-      bool lineOk = loc.found() && (loc.line() != 0);
-      return done || hitBreakpoint || lineOk;
+      return done || hitBreakpoint || dwarfInfo.isLineAddress(cachedPC);
     }
     else
     {
@@ -23,16 +23,27 @@
 #ifndef DEBUG_STEPPER_H_
 #define DEBUG_STEPPER_H_
 
+#include <atomic>
+#include <list>
+#include <mutex>
 #include <queue>
 #include <set>
+#include <thread>
 #include <vector>
 
+#include <sys/ptrace.h>
+#include <sys/user.h>
+#include <asm/ptrace.h>
+
 #include "../common/ComponentLogger.h"
 #include "../object/Parser.h"
 #include "../object/Section.h"
 #include "../object/Symbol.h"
 
 #include "../object/Disassembler.h"
+#include "../object/LineDisassembly.h"
+
+#include "TraceeMemory.h"
 
 #include "../dwarf/Info.h"
 
@@ -41,6 +52,9 @@ namespace penguinTrace
   extern const uint32_t BREAKPOINT_WORD;
   extern const uint32_t RETURN_WORD;
   extern const uint32_t RETURN_MASK;
+  extern const uint32_t SYSCALL_WORD;
+  extern const uint32_t SYSCALL_MASK;
+  extern const uint32_t SYSCALL_AUDIT_ARCH;
 
   class Stepper
   {
@@ -50,20 +64,19 @@ namespace penguinTrace
           std::unique_ptr<ComponentLogger> l);
       virtual ~Stepper();
       bool init();
+      void seedDisassembly(std::map<uint64_t, object::LineDisassembly>& lines);
       uint64_t step(StepType step);
       bool active()
       {
         return !done;
       }
-      bool shouldStepAgain()
-      {
-        return stepAgain;
-      }
       bool shouldContinueToEnd()
       {
         return continueToEnd;
       }
       bool singleStepDone(StepType step);
+      void recordStop();
+      bool reverse(bool toBreakpoint);
       bool hitBreak()
       {
         return hitBreakpoint;
@@ -80,22 +93,20 @@ namespace penguinTrace
       {
         return cachedPC;
       }
-      std::map<std::string, uint64_t>& getRegValues()
-      {
-        return registerValues;
-      }
-      std::map<std::string, std::string>& getVarValues()
-      {
-        return variableValues;
-      }
-      std::list<std::string>& getStackTrace()
-      {
-        return stackTrace;
-      }
-      void sendStdin(std::string in)
+      std::map<std::string, uint64_t> getRegValues();
+      std::map<std::string, std::string>& getVarValues();
+      std::list<std::string>& getStackTrace();
+      // Threads of the tracee and the PC each is stopped at
+      std::map<pid_t, uint64_t> getThreads();
+      pid_t getCurrentThread()
       {
-        stdin.push(in);
+        return currentThread;
       }
+      bool selectThread(pid_t tid);
+      // Thread safe, input is written while the tracee is running
+      void sendStdin(std::string in);
+      // Thread safe, kills the tracee if it is running
+      void requestStop();
       std::queue<std::string>& getStdout()
       {
         return stdout;
@@ -111,12 +122,36 @@ namespace penguinTrace
         std::lock_guard<std::mutex> lock(breakpointMutex);
         return breakpointMap;
       }
+      bool queueWatchpoint(uint64_t addr, uint64_t len);
+      void removeWatchpoint(uint64_t addr);
+      bool variableAddress(std::string name, uint64_t& addr, uint64_t& len);
+      std::map<uint64_t, uint64_t>& getWatchpoints()
+      {
+        std::lock_guard<std::mutex> lock(breakpointMutex);
+        return watchpointMap;
+      }
+      std::map<uint64_t, uint64_t>& getPendingWatchpoints()
+      {
+        std::lock_guard<std::mutex> lock(breakpointMutex);
+        return watchpointsToAdd;
+      }
+      bool hitWatch()
+      {
+        return hitWatchpoint;
+      }
+      uint64_t getWatchAddr()
+      {
+        return watchpointAddr;
+      }
       std::set<uint64_t>& getPendingBreakpoints()
       {
         std::lock_guard<std::mutex> lock(breakpointMutex);
         return breakpointsToAdd;
       }
     private:
+      // Options for the tracee, syscalls from the filter stop the tracee and
+      //  new threads are traced
+      static const int TRACE_OPTIONS = PTRACE_O_TRACESECCOMP | PTRACE_O_TRACECLONE;
       struct Range {
         Range() : name(""), start(0), end(0) { }
         Range(std::string name, uint64_t start, uint64_t end)
@@ -131,31 +166,129 @@ namespace penguinTrace
         uint64_t num;
         std::vector<uint64_t> args;
       };
+      // Registers of the stopped tracee, read once per stop and
+      //  written back (if modified) before it is resumed
+      struct RegisterFile {
+        RegisterFile() : regs(), valid(false), dirty(false) { }
+        RegisterSet regs;
+        bool valid;
+        bool dirty;
+      };
+      // Thread of the tracee, registers are cached here while another
+      //  thread is the current one
+      struct Thread {
+        Thread() : registers(), pc(0), running(false), stopExpected(false) { }
+        RegisterFile registers;
+        uint64_t pc;
+        bool running;
+        // Sent SIGSTOP but stopped for another reason first
+        bool stopExpected;
+      };
+      // Decoded instruction, those from the executable are not affected by
+      //  breakpoints written to the tracee
+      struct Instruction {
+        Instruction() : text(""), length(0), image(false) { }
+        Instruction(std::string t, uint64_t l, bool i) : text(t), length(l), image(i) { }
+        std::string text;
+        uint64_t length;
+        bool image;
+      };
+      // Breakpoint and watchpoint changes applied at a step
+      struct BreakpointChanges {
+        std::set<uint64_t> bkptsAdded;
+        std::set<uint64_t> bkptsRemoved;
+        std::map<uint64_t, uint64_t> watchAdded;
+        std::set<uint64_t> watchRemoved;
+        bool empty()
+        {
+          return bkptsAdded.empty() && bkptsRemoved.empty() &&
+                 watchAdded.empty() && watchRemoved.empty();
+        }
+      };
+      // Stopped copy of the tracee (forked from it) and the stepper state
+      //  at that stop
+      struct Checkpoint {
+        pid_t pid;
+        int stepCount;
+        uint64_t memoryBytes;
+        RegisterSet regs;
+        std::map<uint64_t, long> breakpoints;
+        std::map<uint64_t, long> tempBreakpoints;
+        std::map<uint64_t, uint64_t> watchpoints;
+        bool resumePending;
+        enum __ptrace_request resumeRequest;
+        bool continueToEnd;
+        bool hitBreakpoint;
+        bool hitTempBreakpoint;
+        bool hitWatchpoint;
+        uint64_t watchpointAddr;
+        uint64_t cachedPC;
+        std::string lastDisasm;
+      };
       uint64_t firstStep();
       uint64_t allStep(StepType step);
       bool doWait();
       bool unwindRegs();
       uint64_t getRegValue(std::string reg);
+      bool regValueByName(const std::string& reg, uint64_t& value);
       uint64_t getUnwindRegValue(std::string reg);
       uint64_t getMemValue(uint64_t ptr);
       void getVariables(uint64_t pc);
       void getStack(uint64_t pc);
       uint64_t getPC();
       void getRegisters();
+      void setRegisters();
+      long resume(enum __ptrace_request req);
+      long resumeThread(pid_t tid, enum __ptrace_request req);
+      void switchThread(pid_t tid);
+      bool threadEvent(pid_t tid, int status, bool resume);
+      bool threadStopped(pid_t tid, int status);
+      void threadExited(pid_t tid);
+      void stopThreads();
+      void traceeExited(int status);
+      void killTracee();
+      void deferResume(enum __ptrace_request req);
       void setPC(uint64_t pc);
       uint64_t breakPC(uint64_t pc);
       void insertBreak(uint64_t addr);
       void removeBreak(uint64_t addr);
+      void insertTempBreak(uint64_t addr);
+      void removeTempBreaks();
+      void insertLineBreaks(uint64_t pc);
+      bool setWatchpoints(bool enable);
+      bool setAllWatchpoints(bool enable);
+      bool watchpointHit(uint64_t& addr);
+      long writeBreak(uint64_t addr);
+      void clearBreak(uint64_t addr, long prevInstr);
+      uint64_t returnAddress();
+      void applyBreakpointChanges();
+      bool checkpointsEnabled();
+      void checkpoint();
+      void restoreCheckpoint(std::list<Checkpoint>::iterator cp);
+      void clearCheckpoints();
+      bool injectFork(pid_t pid, const RegisterSet& regs, pid_t& forkPid);
+      void killProcess(pid_t pid);
+      Syscall forkSyscall();
+      void syscallRegisters(RegisterSet& regs, uint64_t pc, const Syscall& sys);
       std::string disasmAtAddr(uint64_t addr);
+      void invalidateDisassembly(uint64_t addr);
       bool isLibraryCall(uint64_t pc);
       bool isFunctionReturn(uint64_t pc);
-      bool isSyscall(uint64_t pc);
       Syscall getSyscall();
-      void errorSyscall(uint64_t pc);
+      void denySyscall();
+      void syscallStop();
+      bool installSyscallFilter();
       uint64_t callReturnAddr(uint64_t pc);
       void getMemoryRanges();
       void readFromPipes();
+      // Read output the user has already seen, so the tracee doesn't block
+      //  on a full pipe while it is replayed
+      void discardPipes();
       void pushToPipe();
+      void watchTracee();
+      pid_t waitTracee(int& status);
+      void waitEvents(int timeout);
+      void wake();
       void readFile(int fd, std::stringstream* stream);
       bool isolateSetup();
       bool isolateTracee();
@@ -173,13 +306,31 @@ namespace penguinTrace
 
       // Child process information
       pid_t childPid;
+      // Thread registers are read from and that is stepped, all threads are
+      //  stopped while the tracee is
+      pid_t currentThread;
+      std::map<pid_t, Thread> threads;
+      // Set once a thread is started, fork only copies the calling thread so
+      //  checkpoints can no longer be taken
+      bool threaded;
+      TraceeMemory memory;
+      // Only the thread that started the tracee can ptrace it, variables
+      //  and the stack may be evaluated from the server's threads
+      std::thread::id tracerThread;
       bool done;
       int stepCount;
       std::queue<std::string> firstSymbols;
       bool seenFirstSymbol;
       std::map<uint64_t, long> breakpointMap;
+      // Breakpoints used internally by the stepper, removed at the next stop
+      std::map<uint64_t, long> tempBreakpointMap;
       std::set<uint64_t> breakpointsToAdd;
       std::set<uint64_t> breakpointsToRemove;
+      // Hardware watchpoints, address to length in bytes
+      std::map<uint64_t, uint64_t> watchpointMap;
+      std::map<uint64_t, uint64_t> watchpointsToAdd;
+      std::set<uint64_t> watchpointsToRemove;
+      bool watchpointsArmed;
 
       // Communication pipes
       int pToChild[PIPE_NUM];
@@ -195,19 +346,43 @@ namespace penguinTrace
 
       // Cached values
       uint64_t cachedPC;
-      bool cachedPCvalid;
       std::string lastDisasm;
+      std::map<uint64_t, Instruction> disasmCache;
       std::vector<Range> memoryRanges;
-      // TODO different size registers
-      std::map<std::string, uint64_t> registerValues;
+      RegisterFile registers;
       std::map<std::string, uint64_t> unwindRegisterValues;
       std::map<std::string, std::string> variableValues;
       std::list<std::string> stackTrace;
-      bool stepAgain;
+      // Variables and stack are only evaluated when first requested at a stop
+      bool variablesPending;
+      bool stackPending;
+      // Tracee is left stopped until the next step so its state can be read
+      bool resumePending;
+      enum __ptrace_request resumeRequest;
       bool continueToEnd;
       bool hitBreakpoint;
+      bool hitTempBreakpoint;
+      bool hitWatchpoint;
+      uint64_t watchpointAddr;
+
+      // Checkpoints, oldest first, and what is needed to replay from them
+      std::list<Checkpoint> checkpoints;
+      // Step type of each step, and the breakpoint changes made at it
+      std::vector<StepType> stepLog;
+      std::map<int, BreakpointChanges> changeLog;
+      // Steps that ended a command, and if a breakpoint was hit
+      std::vector<std::pair<int, bool> > stopLog;
+      bool replaying;
+      uint64_t injectAddr;
       std::mutex breakpointMutex;
 
+      // Events while waiting for the tracee (output, input, stop requests)
+      int epollFd;
+      int wakeFd;
+      int pidFd;
+      std::atomic<bool> stopRequested;
+      std::mutex stdinMutex;
+
   };
 
 } /* namespace penguinTrace */
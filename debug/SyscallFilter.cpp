@@ -0,0 +1,104 @@
+// ----------------------------------------------------------------
+// Copyright (C) 2019 Alex Beharrell
+//
+// This file is part of penguinTrace.
+//
+// penguinTrace is free software: you can redistribute it and/or
+// modify it under the terms of the GNU Affero General Public
+// License as published by the Free Software Foundation, either
+// version 3 of the License, or any later version.
+//
+// penguinTrace is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public
+// License along with penguinTrace. If not, see
+// <https://www.gnu.org/licenses/>.
+// ----------------------------------------------------------------
+//
+// penguinTrace Tracee Syscall Filter
+
+#include "Stepper.h"
+
+#include <cstddef>
+#include <vector>
+
+#include <errno.h>
+#include <sched.h>
+
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
+
+namespace penguinTrace
+{
+  // Installed in the child before exec (returns false on failure), so the
+  //  policy holds at full speed when the tracee is continued:
+  // - New processes and execs are refused by the kernel
+  // - Threads are allowed
+  // - The exec of the program and forks (for checkpoints) stop the tracee,
+  //   so the tracer can allow or deny them (see syscallStop)
+  bool Stepper::installSyscallFilter()
+  {
+    std::vector<struct sock_filter> filter;
+
+    auto ret = [&](uint32_t action) {
+      filter.push_back(BPF_STMT(BPF_RET | BPF_K, action));
+    };
+    auto onSyscall = [&](uint32_t num, uint32_t action) {
+      filter.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, num, 0, 1));
+      ret(action);
+    };
+
+    // Syscall numbers are only meaningful for the native ABI
+    filter.push_back(BPF_STMT(BPF_LD | BPF_W | BPF_ABS,
+        offsetof(struct seccomp_data, arch)));
+    filter.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, SYSCALL_AUDIT_ARCH, 1, 0));
+    ret(SECCOMP_RET_KILL);
+
+    filter.push_back(BPF_STMT(BPF_LD | BPF_W | BPF_ABS,
+        offsetof(struct seccomp_data, nr)));
+#ifdef __X32_SYSCALL_BIT
+    // x32 shares the x86-64 audit arch, with this bit set in the number
+    filter.push_back(BPF_JUMP(BPF_JMP | BPF_JGE | BPF_K, __X32_SYSCALL_BIT, 0, 1));
+    ret(SECCOMP_RET_ERRNO | EPERM);
+#endif
+#ifdef SYS_fork
+    onSyscall(SYS_fork, SECCOMP_RET_ERRNO | EPERM);
+#endif
+#ifdef SYS_vfork
+    onSyscall(SYS_vfork, SECCOMP_RET_ERRNO | EPERM);
+#endif
+    onSyscall(SYS_execveat, SECCOMP_RET_ERRNO | EPERM);
+#ifdef SYS_clone3
+    // Threads are created with clone if clone3 isn't available
+    onSyscall(SYS_clone3, SECCOMP_RET_ERRNO | ENOSYS);
+#endif
+    onSyscall(SYS_execve, SECCOMP_RET_TRACE);
+
+    // clone is allowed for threads, anything else goes to the tracer
+    filter.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, SYS_clone, 0, 4));
+    filter.push_back(BPF_STMT(BPF_LD | BPF_W | BPF_ABS,
+        offsetof(struct seccomp_data, args[0])));
+    filter.push_back(BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, CLONE_THREAD, 0, 1));
+    ret(SECCOMP_RET_ALLOW);
+    ret(SECCOMP_RET_TRACE);
+
+    ret(SECCOMP_RET_ALLOW);
+
+    struct sock_fprog prog;
+    prog.len = filter.size();
+    prog.filter = filter.data();
+
+    // Required to install a filter without CAP_SYS_ADMIN
+    if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) == -1)
+    {
+      return false;
+    }
+    return prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &prog) == 0;
+  }
+
+} /* namespace penguinTrace */
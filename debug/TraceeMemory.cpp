@@ -0,0 +1,187 @@
+// ----------------------------------------------------------------
+// Copyright (C) 2019 Alex Beharrell
+//
+// This file is part of penguinTrace.
+//
+// penguinTrace is free software: you can redistribute it and/or
+// modify it under the terms of the GNU Affero General Public
+// License as published by the Free Software Foundation, either
+// version 3 of the License, or any later version.
+//
+// penguinTrace is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public
+// License along with penguinTrace. If not, see
+// <https://www.gnu.org/licenses/>.
+// ----------------------------------------------------------------
+//
+// Cached reads of traced process memory
+
+#include "TraceeMemory.h"
+
+#include <algorithm>
+#include <sstream>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+namespace penguinTrace
+{
+
+  TraceeMemory::TraceeMemory() : pid(0), memFd(-1), useVmReadv(true),
+      pageSize(sysconf(_SC_PAGESIZE))
+  {
+  }
+
+  TraceeMemory::~TraceeMemory()
+  {
+    if (memFd >= 0)
+    {
+      close(memFd);
+    }
+  }
+
+  void TraceeMemory::attach(pid_t p)
+  {
+    if (memFd >= 0)
+    {
+      close(memFd);
+      memFd = -1;
+    }
+    pid = p;
+    useVmReadv = true;
+    invalidate();
+  }
+
+  bool TraceeMemory::read(uint64_t addr, void* buf, size_t len)
+  {
+    uint8_t* out = static_cast<uint8_t*>(buf);
+
+    while (len > 0)
+    {
+      uint64_t pageAddr = addr & ~(pageSize-1);
+      uint64_t offset = addr - pageAddr;
+      size_t n = std::min<uint64_t>(len, pageSize - offset);
+
+      const uint8_t* page = getPage(pageAddr);
+      if (page == nullptr)
+      {
+        return false;
+      }
+      memcpy(out, page + offset, n);
+
+      out += n;
+      addr += n;
+      len -= n;
+    }
+    return true;
+  }
+
+  bool TraceeMemory::readWord(uint64_t addr, uint64_t& value)
+  {
+    return read(addr, &value, sizeof(value));
+  }
+
+  void TraceeMemory::invalidate()
+  {
+    pages.clear();
+    badPages.clear();
+  }
+
+  void TraceeMemory::update(uint64_t addr, uint64_t value)
+  {
+    const uint8_t* in = reinterpret_cast<const uint8_t*>(&value);
+    size_t len = sizeof(value);
+
+    // A word may straddle two pages
+    while (len > 0)
+    {
+      uint64_t pageAddr = addr & ~(pageSize-1);
+      uint64_t offset = addr - pageAddr;
+      size_t n = std::min<uint64_t>(len, pageSize - offset);
+
+      auto it = pages.find(pageAddr);
+      if (it != pages.end())
+      {
+        memcpy(it->second.data() + offset, in, n);
+      }
+
+      in += n;
+      addr += n;
+      len -= n;
+    }
+  }
+
+  const uint8_t* TraceeMemory::getPage(uint64_t pageAddr)
+  {
+    auto it = pages.find(pageAddr);
+    if (it != pages.end())
+    {
+      return it->second.data();
+    }
+    if (badPages.find(pageAddr) != badPages.end())
+    {
+      return nullptr;
+    }
+
+    std::vector<uint8_t> page(pageSize);
+    if (!readPage(pageAddr, page.data()))
+    {
+      badPages.insert(pageAddr);
+      return nullptr;
+    }
+    return pages.emplace(pageAddr, std::move(page)).first->second.data();
+  }
+
+  bool TraceeMemory::readPage(uint64_t pageAddr, uint8_t* buf)
+  {
+    if (pid == 0)
+    {
+      return false;
+    }
+
+    if (useVmReadv)
+    {
+      struct iovec local;
+      struct iovec remote;
+      local.iov_base = buf;
+      local.iov_len = pageSize;
+      remote.iov_base = reinterpret_cast<void*>(pageAddr);
+      remote.iov_len = pageSize;
+
+      ssize_t n = process_vm_readv(pid, &local, 1, &remote, 1, 0);
+      if (n == (ssize_t)pageSize)
+      {
+        return true;
+      }
+      else if (n < 0 && (errno == ENOSYS || errno == EPERM))
+      {
+        // Not permitted (e.g. seccomp or Yama), use /proc/<pid>/mem instead
+        useVmReadv = false;
+      }
+    }
+
+    // Also reached for pages that are mapped but not readable,
+    //  which /proc/<pid>/mem can access as the tracer
+    if (memFd < 0)
+    {
+      std::stringstream s;
+      s << "/proc/" << pid << "/mem";
+      memFd = open(s.str().c_str(), O_RDONLY | O_CLOEXEC);
+      if (memFd < 0)
+      {
+        return false;
+      }
+    }
+
+    ssize_t n = pread(memFd, buf, pageSize, pageAddr);
+    return n == (ssize_t)pageSize;
+  }
+
+} /* namespace penguinTrace */
@@ -0,0 +1,62 @@
+// ----------------------------------------------------------------
+// Copyright (C) 2019 Alex Beharrell
+//
+// This file is part of penguinTrace.
+//
+// penguinTrace is free software: you can redistribute it and/or
+// modify it under the terms of the GNU Affero General Public
+// License as published by the Free Software Foundation, either
+// version 3 of the License, or any later version.
+//
+// penguinTrace is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public
+// License along with penguinTrace. If not, see
+// <https://www.gnu.org/licenses/>.
+// ----------------------------------------------------------------
+//
+// Cached reads of traced process memory
+
+#ifndef DEBUG_TRACEE_MEMORY_H_
+#define DEBUG_TRACEE_MEMORY_H_
+
+#include <map>
+#include <set>
+#include <vector>
+
+#include <stdint.h>
+#include <sys/types.h>
+
+namespace penguinTrace
+{
+  // Reads tracee memory a page at a time (process_vm_readv, falling back
+  //  to /proc/<pid>/mem) and keeps the pages until the tracee is resumed.
+  class TraceeMemory
+  {
+    public:
+      TraceeMemory();
+      virtual ~TraceeMemory();
+      void attach(pid_t p);
+      bool read(uint64_t addr, void* buf, size_t len);
+      bool readWord(uint64_t addr, uint64_t& value);
+      // Drop all cached pages, must be called before the tracee runs
+      void invalidate();
+      // Keep cached pages in step with a word written by POKETEXT
+      void update(uint64_t addr, uint64_t value);
+    private:
+      const uint8_t* getPage(uint64_t pageAddr);
+      bool readPage(uint64_t pageAddr, uint8_t* buf);
+      pid_t pid;
+      int memFd;
+      bool useVmReadv;
+      uint64_t pageSize;
+      std::map<uint64_t, std::vector<uint8_t> > pages;
+      std::set<uint64_t> badPages;
+  };
+
+} /* namespace penguinTrace */
+
+#endif /* DEBUG_TRACEE_MEMORY_H_ */
@@ -22,11 +22,73 @@
 
 #include "Abbrev.h"
 
+#include <algorithm>
+
 namespace penguinTrace
 {
   namespace dwarf
   {
 
+    void AbbrevTableEntry::Finish()
+    {
+      fixedBytes = 0;
+      addrCount = 0;
+      offsetCount = 0;
+      refAddrCount = 0;
+      variable = false;
+
+      std::vector<uint32_t> order(attributes.size());
+      for (uint32_t i = 0; i < order.size(); ++i)
+      {
+        order[i] = i;
+
+        int8_t size = attributes[i].GetSize();
+        switch (size)
+        {
+          case AbbrevAttrib::SIZE_VARIABLE: variable = true; break;
+          case AbbrevAttrib::SIZE_ADDR:     ++addrCount; break;
+          case AbbrevAttrib::SIZE_OFFSET:   ++offsetCount; break;
+          case AbbrevAttrib::SIZE_REF_ADDR: ++refAddrCount; break;
+          default:                          fixedBytes += size; break;
+        }
+      }
+
+      // DIEs keep their attributes sorted by DW_AT for lookup
+      std::stable_sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b)
+      {
+        return attributes[a].GetAT() < attributes[b].GetAT();
+      });
+      for (uint32_t i = 0; i < order.size(); ++i)
+      {
+        attributes[order[i]].SetSlot(i);
+      }
+    }
+
+    AbbrevTableEntry* AbbrevTable::Insert(uint64_t code, const AbbrevTableEntry& entry)
+    {
+      if ((code > 0) && (code <= dense.size() + MAX_GAP))
+      {
+        if (code > dense.size()) dense.resize(code);
+        dense[code-1] = entry;
+        return &dense[code-1];
+      }
+      return &(sparse[code] = entry);
+    }
+
+    AbbrevTable::EntryList AbbrevTable::Entries()
+    {
+      EntryList entries;
+      for (uint64_t i = 0; i < dense.size(); ++i)
+      {
+        if (dense[i].IsValid()) entries.push_back({i+1, &dense[i]});
+      }
+      for (auto& e : sparse)
+      {
+        entries.push_back({e.first, &e.second});
+      }
+      std::sort(entries.begin(), entries.end());
+      return entries;
+    }
 
   } /* namespace dwarf */
 } /* namespace penguinTrace */
@@ -25,6 +25,7 @@
 
 #include "definitions.h"
 
+#include <map>
 #include <vector>
 
 namespace penguinTrace
@@ -35,12 +36,19 @@ namespace penguinTrace
     struct AbbrevAttrib
     {
       public:
+        // Sizes of forms that depend on the unit header, or are read
+        //  from the data
+        static const int8_t SIZE_VARIABLE = -1;
+        static const int8_t SIZE_ADDR = -2;
+        static const int8_t SIZE_OFFSET = -3;
+        static const int8_t SIZE_REF_ADDR = -4;
+
         AbbrevAttrib(dwarf_t::at_t a, dwarf_t::form_t f)
-            : at(a), form(f), iconst(0)
+            : at(a), form(f), iconst(0), size(FormSize(f)), slot(0)
         {
         }
         AbbrevAttrib(dwarf_t::at_t a, dwarf_t::form_t f, int64_t c)
-            : at(a), form(f), iconst(c)
+            : at(a), form(f), iconst(c), size(FormSize(f)), slot(0)
         {
         }
         dwarf_t::at_t GetAT()
@@ -55,10 +63,73 @@ namespace penguinTrace
         {
           return iconst;
         }
+        // Bytes in .debug_info, or one of the SIZE_ values
+        int8_t GetSize()
+        {
+          return size;
+        }
+        // Position when the entry's attributes are sorted by DW_AT
+        uint32_t GetSlot()
+        {
+          return slot;
+        }
+        void SetSlot(uint32_t s)
+        {
+          slot = s;
+        }
+        static int8_t FormSize(dwarf_t::form_t f)
+        {
+          switch (f)
+          {
+            case dwarf_t::DW_FORM_flag_present:
+            case dwarf_t::DW_FORM_implicit_const:
+              return 0;
+            case dwarf_t::DW_FORM_data1:
+            case dwarf_t::DW_FORM_ref1:
+            case dwarf_t::DW_FORM_flag:
+            case dwarf_t::DW_FORM_strx1:
+            case dwarf_t::DW_FORM_addrx1:
+              return 1;
+            case dwarf_t::DW_FORM_data2:
+            case dwarf_t::DW_FORM_ref2:
+            case dwarf_t::DW_FORM_strx2:
+            case dwarf_t::DW_FORM_addrx2:
+              return 2;
+            case dwarf_t::DW_FORM_strx3:
+            case dwarf_t::DW_FORM_addrx3:
+              return 3;
+            case dwarf_t::DW_FORM_data4:
+            case dwarf_t::DW_FORM_ref4:
+            case dwarf_t::DW_FORM_strx4:
+            case dwarf_t::DW_FORM_addrx4:
+            case dwarf_t::DW_FORM_ref_sup4:
+              return 4;
+            case dwarf_t::DW_FORM_data8:
+            case dwarf_t::DW_FORM_ref8:
+            case dwarf_t::DW_FORM_reg_sig8:
+            case dwarf_t::DW_FORM_ref_sup8:
+              return 8;
+            case dwarf_t::DW_FORM_data16:
+              return 16;
+            case dwarf_t::DW_FORM_addr:
+              return SIZE_ADDR;
+            case dwarf_t::DW_FORM_strp:
+            case dwarf_t::DW_FORM_line_strp:
+            case dwarf_t::DW_FORM_sec_offset:
+            case dwarf_t::DW_FORM_strp_sup:
+              return SIZE_OFFSET;
+            case dwarf_t::DW_FORM_ref_addr:
+              return SIZE_REF_ADDR;
+            default:
+              return SIZE_VARIABLE;
+          }
+        }
       private:
         dwarf_t::at_t at;
         dwarf_t::form_t form;
         int64_t iconst;
+        int8_t size;
+        uint32_t slot;
     };
 
     struct AbbrevTableEntry
@@ -66,14 +137,23 @@ namespace penguinTrace
       public:
         typedef std::vector<AbbrevAttrib> AttribList;
 
+        // Unused code in a table
+        AbbrevTableEntry()
+            : tag(dwarf_t::DW_TAG_NULL), has_children(dwarf_t::DW_CHILDREN_no), valid(false),
+              fixedBytes(0), addrCount(0), offsetCount(0), refAddrCount(0), variable(false)
+        {
+        }
         AbbrevTableEntry(dwarf_t::tag_t t, dwarf_t::children_t ch)
-            : tag(t), has_children(ch)
+            : tag(t), has_children(ch), valid(true),
+              fixedBytes(0), addrCount(0), offsetCount(0), refAddrCount(0), variable(false)
         {
         }
         void AddAttrib(const AbbrevAttrib& a)
         {
           attributes.push_back(a);
         }
+        // Called once all attributes are added, to work out the layout
+        void Finish();
         dwarf_t::tag_t GetTag()
         {
           return tag;
@@ -82,14 +162,59 @@ namespace penguinTrace
         {
           return has_children;
         }
+        bool IsValid()
+        {
+          return valid;
+        }
         AttribList& GetAttrs()
         {
           return attributes;
         }
+        // Bytes taken by a DIE's attributes, if the forms fix them
+        bool FixedSize(uint8_t addrBytes, uint8_t offsetBytes, uint8_t refAddrBytes,
+                       uint64_t& size)
+        {
+          size = fixedBytes + addrCount*addrBytes + offsetCount*offsetBytes +
+                 refAddrCount*refAddrBytes;
+          return !variable;
+        }
       private:
         dwarf_t::tag_t tag;
         dwarf_t::children_t has_children;
+        bool valid;
         AttribList attributes;
+        uint32_t fixedBytes;
+        uint32_t addrCount;
+        uint32_t offsetCount;
+        uint32_t refAddrCount;
+        bool variable;
+    };
+
+    // Abbreviations of a unit by code. Codes are normally numbered from
+    //  one so are held in a vector, others go in a map
+    class AbbrevTable
+    {
+      public:
+        typedef std::vector<std::pair<uint64_t, AbbrevTableEntry*> > EntryList;
+
+        // Pointer is valid until the next insert
+        AbbrevTableEntry* Insert(uint64_t code, const AbbrevTableEntry& entry);
+        AbbrevTableEntry* Find(uint64_t code)
+        {
+          if ((code > 0) && (code <= dense.size()) && dense[code-1].IsValid())
+          {
+            return &dense[code-1];
+          }
+          auto it = sparse.find(code);
+          return (it != sparse.end()) ? &it->second : nullptr;
+        }
+        // Entries in code order
+        EntryList Entries();
+      private:
+        // Codes past the end of the vector by more than this are sparse
+        static const uint64_t MAX_GAP = 256;
+        std::vector<AbbrevTableEntry> dense;
+        std::map<uint64_t, AbbrevTableEntry> sparse;
     };
 
   } /* namespace dwarf */
@@ -25,11 +25,11 @@
 
 #include <cassert>
 
-#include <istream>
 #include <stdint.h>
 #include <string>
 #include <vector>
 
+#include "../common/ByteCursor.h"
 #include "../common/Exception.h"
 
 #include "../object/Parser.h"
@@ -41,12 +41,6 @@ namespace penguinTrace
 
     typedef std::map<dwarf_t::section_t, penguinTrace::object::Parser::SectionPtr> SectionMap;
 
-    // Mask of data bits
-    const uint8_t LEB128_MASK = 0x7f;
-    // Mask for end bit
-    const uint8_t LEB128_nMASK = 0x80;
-    const uint8_t LEB128_sMASK = 0x40;
-
     const uint32_t DWARF_INIT_LEN_MAX = 0xfffffff0;
     const uint32_t DWARF_INIT_LEN_64B = 0xffffffff;
 
@@ -65,105 +59,44 @@ namespace penguinTrace
       DWARF_BUF   // Buffer  (std::vector<uint8_t>)
     };
 
-    inline bool LEB128_LAST(uint8_t byte)
+    inline uint8_t ExtractUInt8(ByteCursor& cursor)
     {
-      return !((byte & LEB128_nMASK) == LEB128_nMASK);
+      return cursor.u8();
     }
 
-    inline bool LEB128_SIGNED(uint8_t byte)
+    inline uint16_t ExtractUInt16(ByteCursor& cursor)
     {
-      return ((byte & LEB128_sMASK) == LEB128_sMASK);
+      return cursor.read<uint16_t>();
     }
 
-    inline uint8_t ExtractUInt8(std::istream& ifs)
+    inline uint32_t ExtractUInt32(ByteCursor& cursor)
     {
-      return ifs.get();
+      return cursor.read<uint32_t>();
     }
 
-    inline uint16_t ExtractUInt16(std::istream& ifs)
+    inline uint64_t ExtractUInt64(ByteCursor& cursor)
     {
-      uint16_t value;
-      ifs.read(reinterpret_cast<char *>(&value), sizeof(value));
-      return value;
+      return cursor.read<uint64_t>();
     }
 
-    inline uint32_t ExtractUInt32(std::istream& ifs)
+    inline __uint128_t ExtractUInt128(ByteCursor& cursor)
     {
-      uint32_t value;
-      ifs.read(reinterpret_cast<char *>(&value), sizeof(value));
-      return value;
+      return cursor.read<__uint128_t>();
     }
 
-    inline uint64_t ExtractUInt64(std::istream& ifs)
+    inline uint64_t ExtractULEB128(ByteCursor& cursor)
     {
-      uint64_t value;
-      ifs.read(reinterpret_cast<char *>(&value), sizeof(value));
-      return value;
+      return cursor.uleb128();
     }
 
-    inline __uint128_t ExtractUInt128(std::istream& ifs)
+    inline int64_t ExtractSLEB128(ByteCursor& cursor)
     {
-      __uint128_t value;
-      ifs.read(reinterpret_cast<char *>(&value), sizeof(value));
-      return value;
-    }
-
-    inline uint64_t ExtractULEB128(std::istream& ifs)
-    {
-      uint64_t value = 0;
-      uint8_t byte;
-      int offset = 0;
-      bool done;
-
-      do
-      {
-        byte = ifs.get();
-        done = LEB128_LAST(byte) || (offset >= 64);
-        value |= ((byte & LEB128_MASK) << offset);
-        offset += 7;
-      }
-      while (!done);
-
-      if ((offset >= 64) && !LEB128_LAST(byte))
-      {
-        throw Exception("ULEB128 overflow", __EINFO__);
-      }
-
-      return value;
-    }
-
-    inline int64_t ExtractSLEB128(std::istream& ifs)
-    {
-      uint64_t value = 0;
-      uint8_t byte;
-      int offset = 0;
-      bool done;
-
-      do
-      {
-        byte = ifs.get();
-        done = LEB128_LAST(byte) || (offset >= 64);
-        value |= ((byte & LEB128_MASK) << offset);
-        offset += 7;
-      }
-      while (!done);
-
-      if ((offset < 64) && LEB128_SIGNED(byte))
-      {
-        value |= (~0ULL << offset);
-      }
-
-      if ((offset >= 64) && !LEB128_LAST(byte))
-      {
-        throw Exception("SLEB128 overflow", __EINFO__);
-      }
-
-      return (int64_t)value;
+      return cursor.sleb128();
     }
 
-    inline std::pair<arch_t, uint64_t> ExtractInitialLength(std::istream& ifs)
+    inline std::pair<arch_t, uint64_t> ExtractInitialLength(ByteCursor& cursor)
     {
-      uint32_t val = ExtractUInt32(ifs);
+      uint32_t val = ExtractUInt32(cursor);
       assert(
           ((val <= DWARF_INIT_LEN_MAX) || (val == DWARF_INIT_LEN_64B))
               && "Reserved value for DWARF initial length");
@@ -171,7 +104,7 @@ namespace penguinTrace
 
       if (arch == DWARF64)
       {
-        return std::pair<arch_t, uint64_t>(arch, ExtractUInt64(ifs));
+        return std::pair<arch_t, uint64_t>(arch, ExtractUInt64(cursor));
       }
       else
       {
@@ -179,106 +112,95 @@ namespace penguinTrace
       }
     }
 
-    inline uint64_t ExtractNumBytes(std::istream& ifs, uint8_t num_bytes)
+    inline uint64_t ExtractNumBytes(ByteCursor& cursor, uint8_t num_bytes)
     {
       switch (num_bytes)
       {
-        case 1: return ExtractUInt8(ifs);
-        case 2: return ExtractUInt16(ifs);
-        case 4: return ExtractUInt32(ifs);
-        case 8: return ExtractUInt64(ifs);
+        case 1: return ExtractUInt8(cursor);
+        case 2: return ExtractUInt16(cursor);
+        case 4: return ExtractUInt32(cursor);
+        case 8: return ExtractUInt64(cursor);
         default:
           throw Exception("Unsupported number of bytes", __EINFO__);
       }
     }
 
-    inline uint64_t ExtractSectionOffset(std::istream& ifs, arch_t a)
+    inline uint64_t ExtractSectionOffset(ByteCursor& cursor, arch_t a)
     {
-      return (a == DWARF64) ? ExtractUInt64(ifs) : ExtractUInt32(ifs);
+      return (a == DWARF64) ? ExtractUInt64(cursor) : ExtractUInt32(cursor);
     }
 
-    inline std::string ExtractString(std::istream& ifs)
+    inline StringRef ExtractStringRef(ByteCursor& cursor)
     {
-      std::string s = "";
-      ifs.peek();
-      if (ifs.eof()) return s;
-
-      char c = ifs.get();
-      while (c != '\0' && !ifs.eof())
-      {
-        s += c;
-        c = ifs.get();
-      }
+      return cursor.cstr();
+    }
 
-      return s;
+    inline std::string ExtractString(ByteCursor& cursor)
+    {
+      if (cursor.eof()) return "";
+      return cursor.cstr().str();
     }
 
-    inline std::string ExtractStrp(arch_t arch, std::istream& is, SectionMap& sections, dwarf_t::section_t section)
+    inline StringRef ExtractStrpRef(arch_t arch, ByteCursor& cursor, SectionMap& sections, dwarf_t::section_t section)
     {
-      uint64_t offset = ExtractSectionOffset(is, arch);
+      uint64_t offset = ExtractSectionOffset(cursor, arch);
 
       auto it = sections.find(section);
       assert(it != sections.end() && "Indirect string without matching section present");
-      auto iStrm = it->second->getContents();
-      std::istream istr(&iStrm);
+      ByteCursor strCursor = it->second->getCursor();
+
+      strCursor.seek(offset);
 
-      istr.seekg(offset);
+      return strCursor.cstr();
+    }
 
-      return ExtractString(istr);
+    inline std::string ExtractStrp(arch_t arch, ByteCursor& cursor, SectionMap& sections, dwarf_t::section_t section)
+    {
+      return ExtractStrpRef(arch, cursor, sections, section).str();
     }
 
-    inline std::string ExtractIndirectStrp(uint64_t off, arch_t arch, SectionMap& sections, dwarf_t::section_t section, dwarf_t::section_t ssection)
+    // Base is the offset of the unit's entries in the offsets section
+    inline std::string ExtractIndirectStrp(uint64_t off, uint64_t base, arch_t arch, SectionMap& sections, dwarf_t::section_t section, dwarf_t::section_t ssection)
     {
       auto it = sections.find(section);
       assert(it != sections.end() && "Indirect string without matching section present");
-      auto iStrm = it->second->getContents();
-      std::istream istr(&iStrm);
+      ByteCursor offCursor = it->second->getCursor();
 
-      uint64_t actual_offset =
-        // Unit length
-        ((arch == DWARF64) ? 12 : 4) +
-        // Version
-        2 +
-        // Padding
-        2 +
-        // Offset
-        (off * ((arch == DWARF64) ? 8 : 4));
+      uint64_t actual_offset = base + (off * ((arch == DWARF64) ? 8 : 4));
 
-      istr.seekg(actual_offset);
+      offCursor.seek(actual_offset);
 
-      uint64_t offset = ExtractSectionOffset(istr, arch);
+      uint64_t offset = ExtractSectionOffset(offCursor, arch);
 
       auto sit = sections.find(ssection);
       assert(sit != sections.end() && "Indirect string without matching section present");
-      auto siStrm = sit->second->getContents();
-      std::istream sistr(&siStrm);
+      ByteCursor strCursor = sit->second->getCursor();
 
-      sistr.seekg(offset);
+      strCursor.seek(offset);
 
-      return ExtractString(sistr);
+      return strCursor.cstr().str();
     }
 
-    inline void ExtractBuffer(std::istream& ifs, std::vector<uint8_t>& buf, uint64_t length)
+    inline void ExtractBuffer(ByteCursor& cursor, std::vector<uint8_t>& buf, uint64_t length)
     {
-      for (uint64_t i = 0; i < length; i++)
-      {
-        buf.push_back(ifs.get());
-      }
+      const uint8_t* data = cursor.current();
+      cursor.skip(length);
+      buf.insert(buf.end(), data, data + length);
     }
 
-    inline uint64_t ExtractBlock(std::istream& ifs, std::vector<uint8_t>& buf, uint8_t num_bytes)
+    inline uint64_t ExtractBlock(ByteCursor& cursor, std::vector<uint8_t>& buf, uint8_t num_bytes)
     {
-      uint64_t length = ExtractNumBytes(ifs, num_bytes);
+      uint64_t length = ExtractNumBytes(cursor, num_bytes);
       assert(length != UINT64_MAX);
-      ExtractBuffer(ifs, buf, length);
+      ExtractBuffer(cursor, buf, length);
       return length;
     }
 
-    inline uint64_t ExtractExprLoc(std::istream& ifs, std::vector<uint8_t>& buf)
+    inline uint64_t ExtractExprLoc(ByteCursor& cursor, std::vector<uint8_t>& buf)
     {
-      uint64_t length = ExtractULEB128(ifs);
+      uint64_t length = ExtractULEB128(cursor);
       assert(length != UINT64_MAX);
-      ExtractBuffer(ifs, buf, length);
+      ExtractBuffer(cursor, buf, length);
       return length;
     }
 
@@ -25,8 +25,8 @@
 #include "Arch.h"
 
 #include <sstream>
+#include <string.h>
 
-#include "../common/MemoryBuffer.h"
 #include "../common/StreamOperations.h"
 #include "../common/Config.h"
 
@@ -37,10 +37,6 @@ namespace penguinTrace
   namespace dwarf
   {
 
-    DIE::~DIE()
-    {
-    }
-
     std::string DIE::toString(bool recurse, int indent)
     {
       std::stringstream s;
@@ -63,153 +59,31 @@ namespace penguinTrace
       return s.str();
     }
 
-    bool DIE::containsPC(uint64_t pc)
+    uint64_t DIE::highPC()
     {
       assert(hasPcRange() && "DIE has no PC range");
-      auto lowPcIt = traverse.getAttribute(dwarf_t::DW_AT_low_pc);
       auto highPcIt = traverse.getAttribute(dwarf_t::DW_AT_high_pc);
-      uint64_t lowPc = lowPcIt.second.getInt();
-      uint64_t highPc;
       if (highPcIt.second.form() == dwarf_t::DW_FORM_addr)
       {
-        highPc = highPcIt.second.getInt();
+        return highPcIt.second.getInt();
       }
       else if ((highPcIt.second.form() == dwarf_t::DW_FORM_data4) ||
                (highPcIt.second.form() == dwarf_t::DW_FORM_data8) ||
                (highPcIt.second.form() == dwarf_t::DW_FORM_udata))
       {
-        highPc = lowPc + highPcIt.second.getInt();
+        return lowPC() + highPcIt.second.getInt();
       }
-      else
-      {
-        std::stringstream err;
-        err << "Unexpected PC range type: " << dwarf_t::form_str(highPcIt.second.form());
 
-        throw Exception(err.str(), __EINFO__);
-      }
-      return (pc >= lowPc) && (pc < highPc);
+      std::stringstream err;
+      err << "Unexpected PC range type: " << dwarf_t::form_str(highPcIt.second.form());
+
+      throw Exception(err.str(), __EINFO__);
     }
 
-    std::pair<uint64_t, uint64_t> DIE::getOpOperand(dwarf_t::op_t op,
-        std::istream& is, arch_t arch)
+    bool DIE::containsPC(uint64_t pc)
     {
-      if (op == dwarf_t::DW_OP_addr)
-      {
-        return {ExtractNumBytes(is, sizeof(void*)), 0};
-      }
-      else if (op == dwarf_t::DW_OP_const1u)
-      {
-        return {ExtractUInt8(is), 0};
-      }
-      else if (op == dwarf_t::DW_OP_const1s)
-      {
-        return {(int64_t)((int8_t)ExtractUInt8(is)), 0};
-      }
-      else if (op == dwarf_t::DW_OP_const2u)
-      {
-        return {ExtractUInt16(is), 0};
-      }
-      else if (op == dwarf_t::DW_OP_const2s)
-      {
-        return {(int64_t)((int16_t)ExtractUInt16(is)), 0};
-      }
-      else if (op == dwarf_t::DW_OP_const4u)
-      {
-        return {ExtractUInt32(is), 0};
-      }
-      else if (op == dwarf_t::DW_OP_const4s)
-      {
-        return {(int64_t)((int32_t)ExtractUInt32(is)), 0};
-      }
-      else if (op == dwarf_t::DW_OP_const8u)
-      {
-        return {ExtractUInt64(is), 0};
-      }
-      else if (op == dwarf_t::DW_OP_const8s)
-      {
-        return {ExtractUInt64(is), 0};
-      }
-      else if (op == dwarf_t::DW_OP_constu)
-      {
-        return {ExtractULEB128(is), 0};
-      }
-      else if (op == dwarf_t::DW_OP_consts)
-      {
-        return {ExtractSLEB128(is), 0};
-      }
-      else if (op == dwarf_t::DW_OP_pick)
-      {
-        return {ExtractUInt8(is), 0};
-      }
-      else if (op == dwarf_t::DW_OP_plus_uconst)
-      {
-        return {ExtractULEB128(is), 0};
-      }
-      else if (op == dwarf_t::DW_OP_skip)
-      {
-        return {(int64_t)((int16_t)ExtractUInt16(is)), 0};
-      }
-      else if (op == dwarf_t::DW_OP_bra)
-      {
-        return {(int64_t)((int16_t)ExtractUInt16(is)), 0};
-      }
-      else if (op >= dwarf_t::DW_OP_breg0 && op <= dwarf_t::DW_OP_breg31)
-      {
-        return {ExtractSLEB128(is), 0};
-      }
-      else if (op == dwarf_t::DW_OP_regx)
-      {
-        return {ExtractULEB128(is), 0};
-      }
-      else if (op >= dwarf_t::DW_OP_reg0 && op <= dwarf_t::DW_OP_reg31)
-      {
-        return {(op-dwarf_t::DW_OP_reg0), 0};
-      }
-      else if (op == dwarf_t::DW_OP_fbreg)
-      {
-        return {ExtractSLEB128(is), 0};
-      }
-      else if (op == dwarf_t::DW_OP_bregx)
-      {
-        return {ExtractULEB128(is), ExtractSLEB128(is)};
-      }
-      else if (op == dwarf_t::DW_OP_piece)
-      {
-        return {ExtractULEB128(is), 0};
-      }
-      else if (op == dwarf_t::DW_OP_deref_size)
-      {
-        return {ExtractUInt8(is), 0};
-      }
-      else if (op == dwarf_t::DW_OP_xderef_size)
-      {
-        return {ExtractUInt8(is), 0};
-      }
-      else if (op == dwarf_t::DW_OP_call2)
-      {
-        return {ExtractUInt16(is), 0};
-      }
-      else if (op == dwarf_t::DW_OP_call4)
-      {
-        return {ExtractUInt32(is), 0};
-      }
-      else if (op == dwarf_t::DW_OP_call_ref)
-      {
-        return {ExtractSectionOffset(is, arch), 0};
-      }
-      else if (op == dwarf_t::DW_OP_bit_piece)
-      {
-        return {ExtractULEB128(is), ExtractULEB128(is)};
-      }
-      else if (op == dwarf_t::DW_OP_call_frame_cfa)
-      {
-        return {0, 0};
-      }
-      else
-      {
-        throw Exception(dwarf_t::op_str(op)+ "not supported", __EINFO__);
-      }
-      return {0, 0};
+      assert(hasPcRange() && "DIE has no PC range");
+      return (pc >= lowPC()) && (pc < highPC());
     }
 
     uint64_t DIE::getFrameBase(std::function<uint64_t(std::string)> regCallback,
@@ -218,8 +92,7 @@ namespace penguinTrace
       DIE* current = this;
       while (current->parent != nullptr)
       {
-        auto it = current->traverse.getAttribute(dwarf_t::DW_AT_frame_base);
-        if (it.first)
+        if (current->traverse.hasAttribute(dwarf_t::DW_AT_frame_base))
         {
           return current->getValue(regCallback, memCallback, pc, dwarf_t::DW_AT_frame_base).first;
         }
@@ -245,35 +118,77 @@ namespace penguinTrace
       }
     }
 
+    int DIE::byteSize()
+    {
+      auto it = getType()->traverse.getAttribute(dwarf_t::DW_AT_byte_size);
+      int numBytes = sizeof(void*);
+
+      if (it.first)
+      {
+        numBytes = it.second.getInt();
+      }
+      return numBytes;
+    }
+
     std::pair<uint64_t, uint64_t> DIE::getValue(std::function<uint64_t(std::string)> regCallback,
         std::function<uint64_t(uint64_t)> memCallback,
         uint64_t pc, dwarf_t::at_t at)
     {
-      auto locIt = traverse.getAttribute(at);
-      if (!locIt.first)
+      bool hasLoc = traverse.hasAttribute(at);
+      if (!hasLoc)
       {
         std::cout << toString(true) << std::endl;
       }
-      assert(locIt.first);
+      assert(hasLoc);
+
+      const Expression* expr = traverse.getExpression(at, pc);
+      if (expr == nullptr)
+      {
+        throw Exception("No location at this PC", __EINFO__);
+      }
 
-      // Can be exprloc or sec_offset
-      if (locIt.second.form() == dwarf_t::DW_FORM_sec_offset)
+      // Common single operation expressions
+      switch (expr->shape())
       {
-      // TODO support sec_offset (into loclist in .debug_loc)
-        throw Exception("Unsupported location list", __EINFO__);
+        case Expression::ADDR:
+          return {expr->value(), expr->value()};
+        case Expression::REG:
+          return {regCallback(dwarfRegString(expr->reg())), 0};
+        case Expression::BREG:
+        {
+          uint64_t ptr = regCallback(dwarfRegString(expr->reg()))+(int64_t)expr->value();
+          return {memCallback(ptr), ptr};
+        }
+        case Expression::FBREG:
+        {
+          uint64_t ptr = getFrameBase(regCallback, memCallback, pc)+(int64_t)expr->value();
+          return {maskBytes(memCallback(ptr), byteSize()), ptr};
+        }
+        default:
+          break;
+      }
+
+      if (expr->shape() == Expression::UNSUPPORTED)
+      {
+        throw Exception("Unsupported location expression", __EINFO__);
+      }
+      if (expr->hasPieces())
+      {
+        throw Exception("Location is split into pieces", __EINFO__);
       }
-      MemoryBuffer buffer(locIt.second.getBuffer().data(),
-          locIt.second.getBuffer().size());
-      std::istream is(&buffer);
-      is.peek();
+      return evaluate(expr->ops().begin(), expr->ops().end(), regCallback, memCallback, pc);
+    }
 
+    std::pair<uint64_t, uint64_t> DIE::evaluate(OpIterator begin, OpIterator end,
+        RegCallback regCallback, MemCallback memCallback, uint64_t pc)
+    {
       // Pairs of value, address
       std::queue<std::pair<uint64_t, uint64_t> > stack;
 
-      while (!is.eof())
+      for (auto it = begin; it != end; ++it)
       {
-        dwarf_t::op_t op = dwarf_t::convert_op(ExtractUInt8(is));
-        std::pair<uint64_t, uint64_t> operand = getOpOperand(op, is, arch);
+        dwarf_t::op_t op = it->op;
+        const std::pair<uint64_t, uint64_t>& operand = it->operand;
 
         if (op == dwarf_t::DW_OP_nop)
         {
@@ -283,7 +198,8 @@ namespace penguinTrace
         {
           break;
         }
-        else if (op == dwarf_t::DW_OP_const1u)
+        else if ((op >= dwarf_t::DW_OP_const1u && op <= dwarf_t::DW_OP_consts) ||
+                 (op >= dwarf_t::DW_OP_lit0 && op <= dwarf_t::DW_OP_lit31))
         {
           stack.push({operand.first, 0});
         }
@@ -294,6 +210,10 @@ namespace penguinTrace
 
           stack.push({regCallback(dwarfRegString(regNum)), 0});
         }
+        else if (op == dwarf_t::DW_OP_regx)
+        {
+          stack.push({regCallback(dwarfRegString(operand.first)), 0});
+        }
         else if (op >= dwarf_t::DW_OP_breg0 && op <= dwarf_t::DW_OP_breg31)
         {
           uint64_t regNum = op - dwarf_t::DW_OP_breg0;
@@ -301,27 +221,39 @@ namespace penguinTrace
 
           stack.push({memCallback(ptr), ptr});
         }
+        else if (op == dwarf_t::DW_OP_bregx)
+        {
+          uint64_t ptr = regCallback(dwarfRegString(operand.first))+(int64_t)operand.second;
+
+          stack.push({memCallback(ptr), ptr});
+        }
+        else if (op == dwarf_t::DW_OP_implicit_value)
+        {
+          // Value is held in the expression
+          stack.push({operand.second, 0});
+        }
         else if (op == dwarf_t::DW_OP_fbreg)
         {
           uint64_t fbRegVal = getFrameBase(regCallback, memCallback, pc);
           uint64_t ptr = fbRegVal + (int64_t)operand.first;
 
           uint64_t rawValue = memCallback(ptr);
-          auto type = getType();
-          auto it = type->traverse.getAttribute(dwarf_t::DW_AT_byte_size);
-          int numBytes = sizeof(void*);
 
-          if (it.first)
-          {
-            numBytes = it.second.getInt();
-          }
-
-          stack.push({maskBytes(rawValue, numBytes), ptr});
+          stack.push({maskBytes(rawValue, byteSize()), ptr});
         }
         else if (op == dwarf_t::DW_OP_addr)
         {
           stack.push({operand.first, operand.first});
         }
+        else if ((op == dwarf_t::DW_OP_addrx) || (op == dwarf_t::DW_OP_GNU_addr_index))
+        {
+          uint64_t addr = traverse.getUnit()->address(traverse.getUnit()->header, operand.first);
+          stack.push({addr, addr});
+        }
+        else if ((op == dwarf_t::DW_OP_constx) || (op == dwarf_t::DW_OP_GNU_const_index))
+        {
+          stack.push({traverse.getUnit()->address(traverse.getUnit()->header, operand.first), 0});
+        }
         else if (op == dwarf_t::DW_OP_deref)
         {
           uint64_t addr = stack.front().first;
@@ -330,37 +262,31 @@ namespace penguinTrace
         }
         else if (op == dwarf_t::DW_OP_call_frame_cfa)
         {
-          // CFA is " " so it is first in map (and always SP)
-          auto uMap = frames->getFDEByPc(pc)->unwindInfo(pc);
-          auto f = uMap->find(" ");
+          FDE* fde = traverse.getUnit()->frames->getFDEByPc(pc);
+          CFIRow* row = (fde != nullptr) ? fde->unwindRow(pc) : nullptr;
+          if (row == nullptr)
+          {
+            throw Exception("No frame information for CFA", __EINFO__);
+          }
+          RegRule& rule = row->cfa();
           uint64_t newValue = regCallback(SP_REG_NAME);
 
-          if (f->second.getType() == dwarf::RegRule::SAME)
+          if (rule.getType() == dwarf::RegRule::SAME)
           {
 
           }
-          else if (f->second.getType() == dwarf::RegRule::EXPR)
+          else if (rule.getType() == dwarf::RegRule::EXPR)
           {
             throw Exception("Expression unwind unsupported", __EINFO__);
           }
-          else if (f->second.getType() == dwarf::RegRule::OFFSET)
+          else if (rule.getType() == dwarf::RegRule::OFFSET)
           {
             throw Exception("Expression offset unsupported for stack pointer", __EINFO__);
           }
-          else if (f->second.getType() == dwarf::RegRule::VAL_OFFSET)
+          else if (rule.getType() == dwarf::RegRule::VAL_OFFSET)
           {
-            std::string regFrom = f->second.regName();
-            uint64_t baseValue = regCallback(regFrom);
-            if (f->second.op().isSigned())
-            {
-              int64_t offset = f->second.op().getSInt();
-              newValue = baseValue+offset;
-            }
-            else
-            {
-              uint64_t offset = f->second.op().getInt();
-              newValue = baseValue+offset;
-            }
+            uint64_t baseValue = regCallback(dwarfRegString(rule.regNum()));
+            newValue = baseValue+rule.getOffset();
           }
           else
           {
@@ -380,7 +306,6 @@ namespace penguinTrace
           }
           throw Exception(err.str(), __EINFO__);
         }
-        is.peek();
       }
 
       if (stack.size() > 0)
@@ -393,6 +318,89 @@ namespace penguinTrace
       }
     }
 
+    void DIE::readPieces(const Expression& expr, RegCallback regCallback,
+        MemCallback memCallback, uint64_t pc, std::vector<uint8_t>& bytes,
+        std::vector<bool>& available)
+    {
+      auto begin = expr.ops().begin();
+      for (auto it = begin; it != expr.ops().end(); ++it)
+      {
+        if (it->op == dwarf_t::DW_OP_bit_piece)
+        {
+          throw Exception("Unsupported location: bit pieces", __EINFO__);
+        }
+        else if (it->op != dwarf_t::DW_OP_piece)
+        {
+          continue;
+        }
+
+        uint64_t size = it->operand.first;
+        size_t start = bytes.size();
+        bytes.resize(start + size, 0);
+        available.resize(start + size, true);
+
+        auto end = it;
+        bool stackValue = (begin != end) && ((end-1)->op == dwarf_t::DW_OP_stack_value);
+        if (stackValue) --end;
+
+        if (begin == end)
+        {
+          // No location, the piece has been optimised out
+          std::fill(available.begin() + start, available.end(), false);
+        }
+        else
+        {
+          dwarf_t::op_t last = (end-1)->op;
+          bool single = (end - begin) == 1;
+          bool isReg = single && ((last == dwarf_t::DW_OP_regx) ||
+                                  (last >= dwarf_t::DW_OP_reg0 && last <= dwarf_t::DW_OP_reg31));
+          bool isImplicit = single && (last == dwarf_t::DW_OP_implicit_value);
+          // Address operations give the address as the value
+          bool isAddr = (last == dwarf_t::DW_OP_addr) || (last == dwarf_t::DW_OP_addrx) ||
+                        (last == dwarf_t::DW_OP_fbreg) || (last == dwarf_t::DW_OP_bregx) ||
+                        (last >= dwarf_t::DW_OP_breg0 && last <= dwarf_t::DW_OP_breg31);
+
+          auto v = evaluate(begin, end, regCallback, memCallback, pc);
+          if (isReg || isImplicit || stackValue)
+          {
+            if (size > sizeof(uint64_t))
+            {
+              throw Exception("Unsupported location: value piece larger than a register", __EINFO__);
+            }
+            uint64_t value = (stackValue && isAddr) ? v.second : v.first;
+            memcpy(bytes.data() + start, &value, size);
+          }
+          else if (v.second != 0)
+          {
+            for (uint64_t i = 0; i < size; i += sizeof(uint64_t))
+            {
+              uint64_t word = memCallback(v.second + i);
+              memcpy(bytes.data() + start + i, &word, std::min<uint64_t>(size - i, sizeof(uint64_t)));
+            }
+          }
+          else
+          {
+            throw Exception("Unsupported location: piece has no address", __EINFO__);
+          }
+        }
+        begin = it + 1;
+      }
+    }
+
+    bool DIE::hasLocation(uint64_t pc)
+    {
+      const Expression* expr = traverse.getExpression(dwarf_t::DW_AT_location, pc);
+      // Values on entry to the function need the caller's registers,
+      //  which aren't recovered
+      return (expr != nullptr) && !expr->usesEntryValue();
+    }
+
+    bool DIE::hasPieces(uint64_t pc)
+    {
+      const Expression* expr = traverse.getExpression(dwarf_t::DW_AT_location, pc);
+      return (expr != nullptr) && expr->hasPieces();
+    }
+
     std::pair<bool, int> DIE::arrayLength()
     {
       bool ok = false;
@@ -448,7 +456,10 @@ namespace penguinTrace
     std::string DIE::typeString()
     {
       // Cache to save expense of travesing DIEs?
-      if (typeStrCache.size() > 0) return typeStrCache;
+      auto& typeStrings = traverse.getUnit()->typeStrings;
+      auto cached = typeStrings.find(offset);
+      if (cached != typeStrings.end()) return cached->second;
+      std::string typeStrCache;
       auto ns = getNamespace();
       switch (tag)
       {
@@ -492,6 +503,7 @@ namespace penguinTrace
         default:
           throw Exception(dwarf_t::tag_str(tag)+"\n"+toString(true), __EINFO__);
       }
+      typeStrings.insert({offset, typeStrCache});
       return typeStrCache;
     }
 
@@ -526,7 +538,7 @@ namespace penguinTrace
       // Manually traversing tree so deal with specification elsewhere
       if (ns.length() == 0 && hasAttr(dwarf_t::DW_AT_specification))
       {
-        ns = dies->find(traverse.getAttribute(dwarf_t::DW_AT_specification).second.getInt())->second->getNamespace();
+        ns = traverse.dies()->find(traverse.getAttribute(dwarf_t::DW_AT_specification).second.getInt())->second->getNamespace();
       }
 
       return ns;
@@ -549,39 +561,14 @@ namespace penguinTrace
       return nullptr;
     }
 
-    DIE* DIE::getMainCu()
-    {
-      DIE* main_die = nullptr;
-      DIE* start_die = nullptr;
-      for (auto it = traverse.getChildIterator(false); !it.done(); it.next())
-      {
-        DIE* outer = it.value();
-        for (auto innerit = outer->traverse.getChildIterator(false); !innerit.done(); innerit.next())
-        {
-          DIE* d = innerit.value();
-          if (d->getTag() == dwarf_t::DW_TAG_subprogram && d->hasName()) {
-            if (d->getName() == "main") {
-              main_die = outer;
-            } else if (d->getName() == "_start") {
-              start_die = outer;
-            }
-          }
-        }
-      }
-      if (main_die != nullptr) return main_die;
-      if (start_die != nullptr) return start_die;
-      // Fallback to first child
-      return getFirstChild();
-    }
-
-    void DIE::addAttribute(dwarf_t::at_t at, AttrValue value)
+    void DIE::setAttributes(DIEAttr* attrs, uint32_t numAttrs)
     {
-      traverse.addAttribute(at, value);
+      traverse.setAttributes(attrs, numAttrs);
     }
 
-    void DIE::addChild(std::unique_ptr<DIE> die)
+    void DIE::addChild(DIE* die)
     {
-      traverse.addChild(std::move(die));
+      traverse.addChild(die);
     }
 
   } /* namespace dwarf */
@@ -31,9 +31,12 @@
 #include <list>
 #include <memory>
 #include <functional>
+#include <vector>
+#include <algorithm>
 
 #include "AttrValue.h"
 #include "Frame.h"
+#include "LocationList.h"
 
 #include "../common/ComponentLogger.h"
 
@@ -44,37 +47,61 @@ namespace penguinTrace
     struct CompilationUnitHeader
     {
       public:
-        CompilationUnitHeader(std::istream& ifs)
+        CompilationUnitHeader(ByteCursor& cursor)
         {
-          hdr_start = ifs.tellg();
-          auto init_length = ExtractInitialLength(ifs);
+          hdr_start = cursor.tell();
+          auto init_length = ExtractInitialLength(cursor);
           arch = init_length.first;
           unit_length = init_length.second;
-          unit_start = ifs.tellg();
-          version = ExtractUInt16(ifs);
+          unit_start = cursor.tell();
+          version = ExtractUInt16(cursor);
+          dwo_id = 0;
           if (version >= 5)
           {
-            // drop unit_type
-            ExtractUInt8(ifs);
-
-            addr_bytes = ExtractUInt8(ifs);
-            abbrev_offset = ExtractSectionOffset(ifs, arch);
-            // Other information ignored
+            unit_type = dwarf_t::convert_ut(ExtractUInt8(cursor));
+            addr_bytes = ExtractUInt8(cursor);
+            abbrev_offset = ExtractSectionOffset(cursor, arch);
+            if ((unit_type == dwarf_t::DW_UT_skeleton) ||
+                (unit_type == dwarf_t::DW_UT_split_compile))
+            {
+              dwo_id = ExtractUInt64(cursor);
+            }
+            else if ((unit_type == dwarf_t::DW_UT_type) ||
+                     (unit_type == dwarf_t::DW_UT_split_type))
+            {
+              // Type signature and offset ignored
+              ExtractUInt64(cursor);
+              ExtractSectionOffset(cursor, arch);
+            }
           }
           else
           {
-            abbrev_offset = ExtractSectionOffset(ifs, arch);
-            addr_bytes = ExtractUInt8(ifs);
+            unit_type = dwarf_t::DW_UT_compile;
+            abbrev_offset = ExtractSectionOffset(cursor, arch);
+            addr_bytes = ExtractUInt8(cursor);
           }
-          str_offset = 0;
+          die_base = hdr_start;
+          // Tables default to the first, after its header
+          str_offset = (arch == DWARF64) ? 16 : 8;
+          addr_base = str_offset;
         }
         arch_t Arch() { return arch; }
         uint16_t Version() { return version; }
+        dwarf_t::ut_t UnitType() { return unit_type; }
+        uint64_t DwoId() { return dwo_id; }
         uint64_t AbbrevOffset() { return abbrev_offset; }
         uint8_t AddrBytes() { return addr_bytes; }
         uint64_t CUHeaderStart() { return hdr_start; }
+        uint64_t UnitEnd() { return unit_start + unit_length; }
+        // Offset given to the unit's DIEs, references within the unit
+        //  are relative to this
+        uint64_t DieBase() { return die_base; }
+        void SetDieBase(uint64_t base) { die_base = base; }
+        uint64_t DieOffset(uint64_t sectionOffset) { return die_base + (sectionOffset - hdr_start); }
         uint64_t StrOffset() { return str_offset; }
         void SetStrOffset(uint64_t offset) { str_offset = offset; }
+        uint64_t AddrBase() { return addr_base; }
+        void SetAddrBase(uint64_t base) { addr_base = base; }
         bool Contains(uint64_t offset)
         {
           return (offset < (unit_start + unit_length)) && (offset > unit_start);
@@ -88,9 +115,107 @@ namespace penguinTrace
         // Start (stream pointer after initial length)
         uint64_t unit_start;
         uint16_t version;
+        dwarf_t::ut_t unit_type;
+        // Links skeleton and split units
+        uint64_t dwo_id;
         uint64_t abbrev_offset;
         uint8_t addr_bytes;
+        uint64_t die_base;
         uint64_t str_offset;
+        uint64_t addr_base;
+    };
+
+    class DIE;
+
+    // DIEs by offset, a reference into a unit that has not been
+    //  parsed yet loads that unit through the loader
+    class DIEMap
+    {
+      public:
+        typedef std::vector<std::pair<uint64_t, DIE*> >::iterator iterator;
+        typedef std::function<void(uint64_t)> Loader;
+
+        DIEMap() : loader(nullptr)
+        {
+        }
+        DIEMap(Loader loader) : loader(loader)
+        {
+        }
+        iterator find(uint64_t offset)
+        {
+          auto it = lookup(offset);
+          if (it == dies.end() && loader)
+          {
+            loader(offset);
+            it = lookup(offset);
+          }
+          return it;
+        }
+        iterator end()
+        {
+          return dies.end();
+        }
+        // DIEs of one unit, in offset order
+        void insert(std::vector<std::pair<uint64_t, DIE*> >& unitDies)
+        {
+          auto mid = dies.insert(dies.end(), unitDies.begin(), unitDies.end());
+          std::inplace_merge(dies.begin(), mid, dies.end(),
+              [](const std::pair<uint64_t, DIE*>& a, const std::pair<uint64_t, DIE*>& b)
+              { return a.first < b.first; });
+        }
+      private:
+        iterator lookup(uint64_t offset)
+        {
+          auto it = std::lower_bound(dies.begin(), dies.end(), offset,
+              [](const std::pair<uint64_t, DIE*>& d, uint64_t o) { return d.first < o; });
+          if ((it != dies.end()) && (it->first == offset)) return it;
+          return dies.end();
+        }
+        std::vector<std::pair<uint64_t, DIE*> > dies;
+        Loader loader;
+    };
+
+    // Attribute value is decoded from the section when it is used
+    struct DIEAttr
+    {
+      dwarf_t::at_t at;
+      dwarf_t::form_t form;
+      // Value of DW_FORM_implicit_const, otherwise offset in .debug_info
+      uint64_t offset;
+      bool operator<(const DIEAttr& other) const
+      {
+        return at < other.at;
+      }
+    };
+
+    // State shared by all DIEs in a compilation unit
+    struct DIEUnit
+    {
+      typedef std::function<AttrValue(DIEAttr&, CompilationUnitHeader&)> Decoder;
+      // Location list referenced by a sec_offset or loclistx attribute
+      typedef std::function<LocationList*(AttrValue&, DIEUnit&)> LocListLoader;
+      // Entry of .debug_addr referenced by index
+      typedef std::function<uint64_t(CompilationUnitHeader&, uint64_t)> AddrLoader;
+
+      DIEUnit(CompilationUnitHeader header, DIEMap* dies,
+          std::shared_ptr<Frames> frames, std::shared_ptr<ComponentLogger> logger,
+          Decoder decode, LocListLoader locList, AddrLoader address) :
+          header(header), dies(dies), frames(frames), logger(logger), decode(decode),
+          locList(locList), address(address)
+      {
+      }
+      CompilationUnitHeader header;
+      DIEMap* dies;
+      std::shared_ptr<Frames> frames;
+      std::shared_ptr<ComponentLogger> logger;
+      Decoder decode;
+      LocListLoader locList;
+      AddrLoader address;
+      std::map<uint64_t, std::string> typeStrings;
+      // Location lists by section offset, built when first evaluated
+      std::map<uint64_t, std::unique_ptr<LocationList> > locLists;
+      // Expressions of exprloc attributes by offset, decoded when first evaluated
+      std::map<uint64_t, Expression> exprs;
     };
 
     class DIE
@@ -98,35 +223,28 @@ namespace penguinTrace
       public:
         typedef std::function<uint64_t(uint64_t)> MemCallback;
         typedef std::function<uint64_t(std::string)> RegCallback;
-        typedef std::shared_ptr<std::map<uint64_t, DIE*> > SharedDIEMap;
 
-        DIE(uint64_t offset, dwarf_t::tag_t tag, DIE* parent,
-            SharedDIEMap dies,
-            std::shared_ptr<Frames> frames, arch_t arch,
-            std::shared_ptr<ComponentLogger> logger) :
-            offset(offset), tag(tag), parent(parent),
-            traverse(Traverse(dies, arch)), dies(dies),
-            frames(frames), arch(arch), typeStrCache(""),
-            logger(logger)
+        DIE(uint64_t offset, dwarf_t::tag_t tag, DIE* parent, DIEUnit* unit) :
+            offset(offset), tag(tag), parent(parent), sibling(nullptr),
+            traverse(Traverse(unit))
         {
         }
         DIE() = delete;
-        virtual ~DIE();
-        void addAttribute(dwarf_t::at_t at, AttrValue value);
-        void addChild(std::unique_ptr<DIE> die);
+        // Attributes sorted by DW_AT
+        void setAttributes(DIEAttr* attrs, uint32_t numAttrs);
+        void addChild(DIE* die);
         DIE* getParent()
         {
           return parent;
         }
         DIE* getFirstChild();
-        DIE* getMainCu();
         dwarf_t::tag_t getTag()
         {
           return tag;
         }
         bool hasName()
         {
-          return traverse.getAttribute(dwarf_t::DW_AT_name).first;
+          return traverse.hasAttribute(dwarf_t::DW_AT_name);
         }
         std::string getName()
         {
@@ -165,17 +283,21 @@ namespace penguinTrace
         }
         bool hasType()
         {
-          return traverse.getAttribute(dwarf_t::DW_AT_type).first;
+          return traverse.hasAttribute(dwarf_t::DW_AT_type);
         }
         bool hasAttr(dwarf_t::at_t a)
         {
-          return traverse.getAttribute(a).first;
+          return traverse.hasAttribute(a);
+        }
+        std::pair<bool, AttrValue> getAttribute(dwarf_t::at_t a)
+        {
+          return traverse.getAttribute(a);
         }
         DIE* getType()
         {
           if (!hasType()) throw Exception("DIE doesn't have type:\n"+toString(true), __EINFO__);
-          auto it = dies->find(traverse.getAttribute(dwarf_t::DW_AT_type).second.getInt());
-          assert(it != dies->end());
+          auto it = traverse.dies()->find(traverse.getAttribute(dwarf_t::DW_AT_type).second.getInt());
+          assert(it != traverse.dies()->end());
           return it->second;
         }
         std::string typeString();
@@ -198,8 +320,8 @@ namespace penguinTrace
         }
         bool hasPcRange()
         {
-          return (traverse.getAttribute(dwarf_t::DW_AT_low_pc).first) &&
-                 (traverse.getAttribute(dwarf_t::DW_AT_high_pc).first);
+          return traverse.hasAttribute(dwarf_t::DW_AT_low_pc) &&
+                 traverse.hasAttribute(dwarf_t::DW_AT_high_pc);
         }
         uint64_t lowPC()
         {
@@ -207,37 +329,87 @@ namespace penguinTrace
           assert(val.first);
           return val.second.getInt();
         }
+        uint64_t highPC();
         bool containsPC(uint64_t pc);
-        DIE* functionContaining(uint64_t pc)
+        bool inScope(uint64_t pc, std::vector<DIE*>& scopes)
+        {
+          if (isScope())
+          {
+            return std::find(scopes.begin(), scopes.end(), this) != scopes.end();
+          }
+          return containsPC(pc);
+        }
+        bool isScope()
+        {
+          return (tag == dwarf_t::DW_TAG_subprogram) ||
+                 (tag == dwarf_t::DW_TAG_lexical_block) ||
+                 (tag == dwarf_t::DW_TAG_inlined_subroutine);
+        }
+        void functions(std::list<DIE*>& list)
         {
-          // TODO recurse for inlined functions?
           if (isFunction())
           {
-            if (containsPC(pc))
-            {
-              return this;
-            }
-            else
-            {
-              return nullptr;
-            }
+            list.push_back(this);
+            return;
           }
-          // Iterate over children
           for (auto it = traverse.getChildIterator(false); !it.done(); it.next())
           {
-            DIE* d = it.value()->functionContaining(pc);
-            if (d != nullptr) return d;
+            it.value()->functions(list);
           }
-          return nullptr;
         }
-        void dataObjects(uint64_t pc, std::list<DIE*>& list)
+        // DIEs that can be looked up by name
+        static bool isNamedTag(dwarf_t::tag_t t)
         {
-          if (hasPcRange())
+          switch (t)
           {
-            if (!containsPC(pc))
+            case dwarf_t::DW_TAG_subprogram:
+            case dwarf_t::DW_TAG_variable:
+            case dwarf_t::DW_TAG_base_type:
+            case dwarf_t::DW_TAG_structure_type:
+            case dwarf_t::DW_TAG_class_type:
+            case dwarf_t::DW_TAG_union_type:
+            case dwarf_t::DW_TAG_enumeration_type:
+            case dwarf_t::DW_TAG_typedef:
+            case dwarf_t::DW_TAG_namespace:
+              return true;
+            default:
+              return false;
+          }
+        }
+        // DIEs whose children can be looked up by name, function locals can't
+        static bool isNameScope(dwarf_t::tag_t t)
+        {
+          return (t == dwarf_t::DW_TAG_compile_unit) ||
+                 (t == dwarf_t::DW_TAG_partial_unit) ||
+                 (t == dwarf_t::DW_TAG_namespace) ||
+                 (t == dwarf_t::DW_TAG_structure_type) ||
+                 (t == dwarf_t::DW_TAG_class_type) ||
+                 (t == dwarf_t::DW_TAG_union_type);
+        }
+        // Definitions named by DW_AT_name or DW_AT_linkage_name
+        void namedObjects(const std::string& name, std::vector<DIE*>& list)
+        {
+          for (auto it = traverse.getChildIterator(false); !it.done(); it.next())
+          {
+            DIE* d = it.value();
+            if (isNamedTag(d->tag) && !d->hasAttr(dwarf_t::DW_AT_declaration))
             {
-              return;
+              auto linkageName = d->getAttribute(dwarf_t::DW_AT_linkage_name);
+              if ((d->hasName() && (d->getName() == name)) ||
+                  (linkageName.first && (linkageName.second.getString() == name)))
+              {
+                list.push_back(d);
+              }
             }
+            if (isNameScope(d->tag)) d->namedObjects(name, list);
+          }
+        }
+        // Scopes are the indexed scopes containing the PC
+        void dataObjects(uint64_t pc, std::vector<DIE*>& scopes, std::list<DIE*>& list)
+        {
+          if (hasPcRange() && !inScope(pc, scopes))
+          {
+            return;
           }
 
           if (isDataObject())
@@ -253,18 +425,15 @@ namespace penguinTrace
             // Don't recurse over subprograms
             if (d->tag != dwarf_t::DW_TAG_subprogram)
             {
-              d->dataObjects(pc, list);
+              d->dataObjects(pc, scopes, list);
             }
           }
         }
-        void formalParams(uint64_t pc, std::list<DIE*>& list)
+        void formalParams(uint64_t pc, std::vector<DIE*>& scopes, std::list<DIE*>& list)
         {
-          if (hasPcRange())
+          if (hasPcRange() && !inScope(pc, scopes))
           {
-            if (!containsPC(pc))
-            {
-              return;
-            }
+            return;
           }
 
           if (isFormalParam())
@@ -280,52 +449,88 @@ namespace penguinTrace
             // Don't recurse over subprograms
             if (d->tag != dwarf_t::DW_TAG_subprogram)
             {
-              d->formalParams(pc, list);
+              d->formalParams(pc, scopes, list);
             }
           }
         }
-        static std::pair<uint64_t, uint64_t> getOpOperand(dwarf_t::op_t op,
-            std::istream& is, arch_t arch);
         uint64_t getFrameBase(RegCallback regCallback, MemCallback memCallback, uint64_t pc);
         uint64_t maskBytes(uint64_t value, int numBytes);
+        int byteSize();
         std::pair<uint64_t, uint64_t> getValue(RegCallback regCallback, MemCallback memCallback,
             uint64_t pc, dwarf_t::at_t at);
+        // Object has a location at the PC (optimised code can drop it)
+        bool hasLocation(uint64_t pc);
+        // Location at the PC is split into pieces, which getValue can't give
+        bool hasPieces(uint64_t pc);
         std::string getValueString(RegCallback regCallback, MemCallback memCallback, uint64_t pc);
         std::string getNamespace();
       private:
         typedef std::map<std::string, std::pair<DIE*, uint64_t> > ClsMemMap;
+        typedef std::vector<Expression::Op>::const_iterator OpIterator;
+        // Objects assembled from pieces are read at addresses from here,
+        //  which are never in the tracee
+        static const uint64_t PIECES_ADDR = 0xffff800000000000ULL;
+        // Read of bytes of an assembled object that have no location
+        class Unavailable : public Exception
+        {
+          public:
+            Unavailable(std::string file, int line)
+              : Exception("Part of the object has been optimised out", file, line) {}
+        };
         class PrettyPrint;
         class Traverse {
           public:
             class Iterator {
               public:
-                Iterator(std::list< std::unique_ptr<DIE> >* l, bool inherit)
-                 : list(l), it(l->begin()), nestedIt(nullptr), inherit(inherit) { }
+                Iterator(DIE* first, bool inherit)
+                 : current(first), nestedIt(nullptr), inherit(inherit) { }
                 DIE* value();
                 bool done();
                 void next();
                 ~Iterator();
               private:
-                std::list< std::unique_ptr<DIE> >* list;
-                std::list< std::unique_ptr<DIE> >::iterator it;
+                DIE* current;
                 Iterator * nestedIt;
                 bool inherit;
             };
-            Traverse(SharedDIEMap dies, arch_t a)
-              : dies(dies), arch(a) { }
-            void addAttribute(dwarf_t::at_t at, AttrValue value);
-            void addChild(std::unique_ptr<DIE> die);
+            Traverse(DIEUnit* unit)
+              : unit(unit), attrs(nullptr), numAttrs(0),
+                firstChild(nullptr), lastChild(nullptr) { }
+            void setAttributes(DIEAttr* a, uint32_t n);
+            void addChild(DIE* die);
             Iterator getChildIterator(bool inherit);
             std::pair<bool, AttrValue> getAttribute(dwarf_t::at_t at);
+            bool hasAttribute(dwarf_t::at_t at);
+            // Location expression of an exprloc or location list attribute
+            const Expression* getExpression(dwarf_t::at_t at, uint64_t pc);
             int numChildren();
             std::string toString(bool recurse, int indent);
+            DIEMap* dies()
+            {
+              return unit->dies;
+            }
+            DIEUnit* getUnit()
+            {
+              return unit;
+            }
           private:
+            DIEAttr* findAttr(dwarf_t::at_t at);
+            DIE* specification(dwarf_t::at_t at);
             std::string exprlocString(dwarf_t::at_t at);
-            std::map<dwarf_t::at_t, AttrValue> attributes;
-            std::list< std::unique_ptr<DIE> > children;
-            SharedDIEMap dies;
-            arch_t arch;
+            DIEUnit* unit;
+            DIEAttr* attrs;
+            uint32_t numAttrs;
+            DIE* firstChild;
+            DIE* lastChild;
         };
+        std::pair<uint64_t, uint64_t> evaluate(OpIterator begin, OpIterator end,
+            RegCallback regCallback, MemCallback memCallback, uint64_t pc);
+        // Bytes of an object split across locations, with those of pieces
+        //  that have no location marked unavailable
+        void readPieces(const Expression& expr, RegCallback regCallback, MemCallback memCallback,
+            uint64_t pc, std::vector<uint8_t>& bytes, std::vector<bool>& available);
+        std::string getPiecesString(RegCallback regCallback, MemCallback memCallback,
+            uint64_t pc, const Expression& expr);
         std::string getValueStringByAddr(RegCallback regCallback, MemCallback memCallback,
             uint64_t addr, std::list<dwarf_t::tag_t> tags, int depth, ClsMemMap* memberMap);
         uint64_t getValueByAddr(RegCallback regCallback, MemCallback memCallback,
@@ -339,15 +544,15 @@ namespace penguinTrace
         std::pair<bool, int> arrayLength();
         bool isPointerType();
         std::string arrayStr();
+        arch_t getArch()
+        {
+          return traverse.getUnit()->header.Arch();
+        }
         uint64_t offset;
         dwarf_t::tag_t tag;
         DIE* parent;
+        DIE* sibling;
         Traverse traverse;
-        SharedDIEMap dies;
-        std::shared_ptr<Frames> frames;
-        arch_t arch;
-        std::string typeStrCache;
-        std::shared_ptr<ComponentLogger> logger;
     };
 
   } /* namespace dwarf */
@@ -100,7 +100,7 @@ namespace penguinTrace
     std::string DIE::tryPrettyPrint(RegCallback regCallback, MemCallback memCallback,
         std::string className, ClsMemMap* members)
     {
-      auto printer = PrettyPrint::getPrinter(className, logger->subLogger("Print"));
+      auto printer = PrettyPrint::getPrinter(className, traverse.getUnit()->logger->subLogger("Print"));
 
       if (printer)
       {
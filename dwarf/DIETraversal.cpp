@@ -23,9 +23,9 @@
 #include "DIE.h"
 
 #include <sstream>
+#include <algorithm>
 
 #include "../common/StreamOperations.h"
-#include "../common/MemoryBuffer.h"
 
 namespace penguinTrace
 {
@@ -38,94 +38,166 @@ namespace penguinTrace
       auto locIt = getAttribute(at);
       assert(locIt.first);
 
-      MemoryBuffer buffer(locIt.second.getBuffer().data(),
+      ByteCursor cursor(locIt.second.getBuffer().data(),
           locIt.second.getBuffer().size());
-      std::istream is(&buffer);
-      is.peek();
 
-      while (!is.eof())
+      while (!cursor.eof())
       {
-        dwarf_t::op_t op = dwarf_t::convert_op(ExtractUInt8(is));
-        std::pair<uint64_t, uint64_t> operand = getOpOperand(op, is, arch);
+        dwarf_t::op_t op = dwarf_t::convert_op(ExtractUInt8(cursor));
+        std::pair<uint64_t, uint64_t> operand;
+        try
+        {
+          operand = Expression::operand(op, cursor, unit->header.Arch());
+        }
+        catch (Exception&)
+        {
+          s << "<unsupported operation>" << std::endl;
+          break;
+        }
 
         s << dwarf_t::op_str(op);
         s << " (" << (int64_t)(operand.first) << ")";
         s << std::endl;
-
-        is.peek();
       }
 
       return s.str();
     }
 
 
-    void DIE::Traverse::addAttribute(dwarf_t::at_t at, AttrValue value)
+    void DIE::Traverse::setAttributes(DIEAttr* a, uint32_t n)
     {
-      attributes.insert( {at, value} );
+      attrs = a;
+      numAttrs = n;
     }
 
-    void DIE::Traverse::addChild(std::unique_ptr<DIE> die)
+    void DIE::Traverse::addChild(DIE* die)
     {
-      children.push_back(std::move(die));
+      if (lastChild == nullptr) firstChild = die;
+      else                      lastChild->sibling = die;
+      lastChild = die;
     }
 
     DIE::Traverse::Iterator DIE::Traverse::getChildIterator(bool inherit)
     {
-      return Iterator(&children, inherit);
+      return Iterator(firstChild, inherit);
     }
 
-    std::pair<bool, AttrValue> DIE::Traverse::getAttribute(dwarf_t::at_t at)
+    DIEAttr* DIE::Traverse::findAttr(dwarf_t::at_t at)
+    {
+      DIEAttr* end = attrs + numAttrs;
+      DIEAttr key;
+      key.at = at;
+      DIEAttr* it = std::lower_bound(attrs, end, key);
+      if ((it != end) && (it->at == at)) return it;
+      return nullptr;
+    }
+
+    DIE* DIE::Traverse::specification(dwarf_t::at_t at)
     {
-      auto it = attributes.find(at);
-      if (it != attributes.end())
+      // Attributes that don't apply to specification
+      if ((at == dwarf_t::DW_AT_sibling) ||
+          (at == dwarf_t::DW_AT_declaration))
       {
-        return {true, it->second};
+        return nullptr;
       }
-      auto specAttrIt = attributes.find(dwarf_t::DW_AT_specification);
-      if (specAttrIt != attributes.end())
+      DIEAttr* specAttr = findAttr(dwarf_t::DW_AT_specification);
+      if (specAttr != nullptr)
       {
-        // Attributes that don't apply to specification
-        if ((at != dwarf_t::DW_AT_sibling) &&
-            (at != dwarf_t::DW_AT_declaration))
+        auto specIt = unit->dies->find(unit->decode(*specAttr, unit->header).getInt());
+        if (specIt != unit->dies->end())
         {
-          auto specIt = dies->find(specAttrIt->second.getInt());
-          if (specIt != dies->end())
-          {
-            DIE* spec = specIt->second;
-            return spec->traverse.getAttribute(at);
-          }
+          return specIt->second;
         }
       }
+      return nullptr;
+    }
+
+    std::pair<bool, AttrValue> DIE::Traverse::getAttribute(dwarf_t::at_t at)
+    {
+      DIEAttr* attr = findAttr(at);
+      if (attr != nullptr)
+      {
+        return {true, unit->decode(*attr, unit->header)};
+      }
+      DIE* spec = specification(at);
+      if (spec != nullptr)
+      {
+        return spec->traverse.getAttribute(at);
+      }
       return {false, AttrValue()};
     }
 
+    const Expression* DIE::Traverse::getExpression(dwarf_t::at_t at, uint64_t pc)
+    {
+      DIEAttr* attr = findAttr(at);
+      if (attr == nullptr)
+      {
+        DIE* spec = specification(at);
+        return (spec != nullptr) ? spec->traverse.getExpression(at, pc) : nullptr;
+      }
+
+      // Can be exprloc, or a location list through sec_offset or loclistx
+      if ((attr->form == dwarf_t::DW_FORM_sec_offset) ||
+          (attr->form == dwarf_t::DW_FORM_loclistx))
+      {
+        AttrValue value = unit->decode(*attr, unit->header);
+        LocationList* list = unit->locList(value, *unit);
+        return (list != nullptr) ? list->find(pc) : nullptr;
+      }
+
+      auto it = unit->exprs.find(attr->offset);
+      if (it == unit->exprs.end())
+      {
+        AttrValue value = unit->decode(*attr, unit->header);
+        std::vector<uint8_t>& buf = value.getBuffer();
+        Expression expr(buf.data(), buf.size(), unit->header.Arch());
+        it = unit->exprs.insert(std::make_pair(attr->offset, std::move(expr))).first;
+      }
+      if (it->second.shape() == Expression::EMPTY) return nullptr;
+      return &it->second;
+    }
+
+    bool DIE::Traverse::hasAttribute(dwarf_t::at_t at)
+    {
+      if (findAttr(at) != nullptr) return true;
+      DIE* spec = specification(at);
+      return (spec != nullptr) && spec->traverse.hasAttribute(at);
+    }
+
     int DIE::Traverse::numChildren()
     {
-      return children.size();
+      int n = 0;
+      for (DIE* d = firstChild; d != nullptr; d = d->sibling)
+      {
+        n++;
+      }
+      return n;
     }
 
     std::string DIE::Traverse::toString(bool recurse, int indent)
     {
       std::stringstream s;
-      for (auto it = attributes.begin(); it != attributes.end(); ++it)
+      for (uint32_t i = 0; i < numAttrs; ++i)
       {
+        DIEAttr& attr = attrs[i];
+        AttrValue value = unit->decode(attr, unit->header);
         s << StringPad("", (indent+1)*2);
         s << "- ";
-        s << StringPad(dwarf_t::at_str(it->first), 18);
-        s << it->second.toString();
-        s << " (" << dwarf_t::form_str(it->second.form()) << ")";
+        s << StringPad(dwarf_t::at_str(attr.at), 18);
+        s << value.toString();
+        s << " (" << dwarf_t::form_str(value.form()) << ")";
         s << std::endl;
-        if (it->second.form() == dwarf_t::DW_FORM_exprloc)
+        if (value.form() == dwarf_t::DW_FORM_exprloc)
         {
           s << StringPad("", (indent+2)*2);
-          s << exprlocString(it->first);
+          s << exprlocString(attr.at);
         }
       }
       if (recurse)
       {
-        for (auto it = children.begin(); it != children.end(); ++it)
+        for (DIE* d = firstChild; d != nullptr; d = d->sibling)
         {
-          s << (*it)->toString(true, indent+1);
+          s << d->toString(true, indent+1);
         }
       }
       return s.str();
@@ -142,7 +214,7 @@ namespace penguinTrace
 
     bool DIE::Traverse::Iterator::done()
     {
-      return it == list->end();
+      return current == nullptr;
     }
 
     void DIE::Traverse::Iterator::next()
@@ -154,12 +226,12 @@ namespace penguinTrace
         {
           delete nestedIt;
           nestedIt = nullptr;
-          ++it;
+          current = current->sibling;
         }
       }
       else
       {
-        ++it;
+        current = current->sibling;
       }
     }
 
@@ -167,19 +239,19 @@ namespace penguinTrace
     {
       if (nestedIt != nullptr) return nestedIt->value();
 
-      DIE* d = it->get();
+      DIE* d = current;
 
       auto import = d->traverse.getAttribute(dwarf_t::DW_AT_import);
       if (import.first)
       {
-        auto imported = d->dies->find(import.second.getInt());
-        assert(imported != d->dies->end());
+        auto imported = d->traverse.dies()->find(import.second.getInt());
+        assert(imported != d->traverse.dies()->end());
         return imported->second;
       }
 
       if (inherit && (d->tag == dwarf_t::DW_TAG_inheritance))
       {
-        nestedIt = new Iterator(&d->getType()->traverse.children, true);
+        nestedIt = new Iterator(d->getType()->traverse.firstChild, true);
         return nestedIt->value();
       }
 
@@ -23,6 +23,7 @@
 #include "DIE.h"
 
 #include <sstream>
+#include <string.h>
 
 #include "../common/MemoryBuffer.h"
 #include "../common/StreamOperations.h"
@@ -43,6 +44,15 @@ namespace penguinTrace
       {
         return "";
       }
+      if (!hasLocation(pc))
+      {
+        return "<optimised out>";
+      }
+      const Expression* expr = traverse.getExpression(dwarf_t::DW_AT_location, pc);
+      if (expr->hasPieces())
+      {
+        return getPiecesString(regCallback, memCallback, pc, *expr);
+      }
       auto v = getValue(regCallback, memCallback, pc, dwarf_t::DW_AT_location);
       uint64_t value = v.first;
       uint64_t addr  = v.second;
@@ -73,7 +83,9 @@ namespace penguinTrace
           if (parentParams.size() >= 2)
           {
             if (parentParams[0]->getType()->hasName()
-                && parentParams[0]->getType()->getName() == "int")
+                && parentParams[0]->getType()->getName() == "int"
+                && parentParams[0]->hasLocation(pc)
+                && !parentParams[0]->hasPieces(pc))
             {
               argc = parentParams[0]->getValue(regCallback, memCallback, pc, dwarf_t::DW_AT_location).first;
               argc = argc > Config::get(C_ARGC_MAX).Int() ? Config::get(C_ARGC_MAX).Int() : argc;
@@ -101,13 +113,18 @@ namespace penguinTrace
 
           }
         }
-        else
+        else if (addr != 0)
         {
           // Other pointer - should recurse
           // Only follow pointers at this point, not multiple levels
           std::list<dwarf_t::tag_t> tags;
           s << type->getValueStringByAddr(regCallback, memCallback, addr, tags, 0, nullptr);
         }
+        else
+        {
+          // Pointer held in a register in optimised code
+          s << HexPrint(value, sizeof(void*)*2);
+        }
       }
       else if (type->hasName() && (type->typeString() == "int"))
       {
@@ -139,6 +156,49 @@ namespace penguinTrace
       return s.str();
     }
 
+    std::string DIE::getPiecesString(RegCallback regCallback, MemCallback memCallback,
+        uint64_t pc, const Expression& expr)
+    {
+      std::vector<uint8_t> bytes;
+      std::vector<bool> available;
+      try
+      {
+        readPieces(expr, regCallback, memCallback, pc, bytes, available);
+      }
+      catch (Exception& e)
+      {
+        return "<unsupported location>";
+      }
+
+      // Whole words are read, so pad past the end of the object
+      bytes.resize(bytes.size() + sizeof(uint64_t), 0);
+      MemCallback piecesCallback = [&](uint64_t ptr) -> uint64_t
+      {
+        if ((ptr < PIECES_ADDR) || (ptr >= PIECES_ADDR + available.size()))
+        {
+          return memCallback(ptr);
+        }
+        // Only the first byte is checked, members start on a piece
+        if (!available[ptr - PIECES_ADDR])
+        {
+          throw Unavailable(__EINFO__);
+        }
+        uint64_t value;
+        memcpy(&value, bytes.data() + (ptr - PIECES_ADDR), sizeof(value));
+        return value;
+      };
+
+      try
+      {
+        std::list<dwarf_t::tag_t> tags;
+        return getType()->getValueStringByAddr(regCallback, piecesCallback, PIECES_ADDR, tags, 0, nullptr);
+      }
+      catch (Unavailable& e)
+      {
+        return "<optimised out>";
+      }
+    }
+
     uint64_t DIE::getNumBytes(bool followPtr)
     {
       if (isPointerType() && followPtr)
@@ -322,7 +382,9 @@ namespace penguinTrace
           clsName = getName();
         }
         clsStrm << clsName;
-        clsStrm << " <" << HexPrint(addr, 1) << "> ";
+        // Objects assembled from pieces have no address
+        if (addr < PIECES_ADDR) clsStrm << " <" << HexPrint(addr, 1) << ">";
+        clsStrm << ' ';
         clsStrm << '{';
         bool first = true;
         // Member name -> (type, value)
@@ -343,7 +405,14 @@ namespace penguinTrace
               clsStrm << child->getType()->typeString() << ' ' << child->getName() << " = ";
               // Reset tags, as only intended for const/pointer chains
               std::list<dwarf_t::tag_t> blankTags;
-              clsStrm << child->getType()->getValueStringByAddr(regCallback, memCallback, memAddr, blankTags, depth+1, m);
+              try
+              {
+                clsStrm << child->getType()->getValueStringByAddr(regCallback, memCallback, memAddr, blankTags, depth+1, m);
+              }
+              catch (Unavailable& e)
+              {
+                clsStrm << "<optimised out>";
+              }
 
               DIE * temp = child;
               while (temp->hasType())
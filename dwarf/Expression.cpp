@@ -0,0 +1,316 @@
+// ----------------------------------------------------------------
+// Copyright (C) 2019 Alex Beharrell
+//
+// This file is part of penguinTrace.
+//
+// penguinTrace is free software: you can redistribute it and/or
+// modify it under the terms of the GNU Affero General Public
+// License as published by the Free Software Foundation, either
+// version 3 of the License, or any later version.
+//
+// penguinTrace is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public
+// License along with penguinTrace. If not, see
+// <https://www.gnu.org/licenses/>.
+// ----------------------------------------------------------------
+//
+// DWARF Location Expressions
+
+#include "Expression.h"
+
+namespace penguinTrace
+{
+  namespace dwarf
+  {
+
+    Expression::Expression(const uint8_t* expr, size_t length, arch_t arch) :
+        exprShape(GENERIC), exprReg(0), exprValue(0), entryValue(false), pieces(false)
+    {
+      ByteCursor cursor(expr, length);
+      while (!cursor.eof())
+      {
+        dwarf_t::op_t op = dwarf_t::convert_op(ExtractUInt8(cursor));
+        std::pair<uint64_t, uint64_t> value;
+        try
+        {
+          value = operand(op, cursor, arch);
+        }
+        catch (Exception&)
+        {
+          // Length of an unknown operation isn't known, so nothing after
+          //  it can be decoded either
+          exprOps.clear();
+          exprShape = UNSUPPORTED;
+          entryValue = false;
+          pieces = false;
+          return;
+        }
+
+        if (op == dwarf_t::DW_OP_implicit_value)
+        {
+          // Keep the value (little-endian) rather than its position
+          uint64_t implicit = 0;
+          for (uint64_t i = 0; i < value.first && i < sizeof(implicit); ++i)
+          {
+            implicit |= (uint64_t)expr[value.second+i] << (i*8);
+          }
+          value.second = implicit;
+        }
+        else if ((op == dwarf_t::DW_OP_entry_value) || (op == dwarf_t::DW_OP_GNU_entry_value))
+        {
+          entryValue = true;
+        }
+        else if ((op == dwarf_t::DW_OP_piece) || (op == dwarf_t::DW_OP_bit_piece))
+        {
+          pieces = true;
+        }
+        exprOps.push_back({op, value});
+      }
+
+      if (exprOps.empty())
+      {
+        exprShape = EMPTY;
+      }
+      else if (exprOps.size() == 1)
+      {
+        dwarf_t::op_t op = exprOps[0].op;
+        auto& value = exprOps[0].operand;
+        if (op == dwarf_t::DW_OP_addr)
+        {
+          exprShape = ADDR;
+          exprValue = value.first;
+        }
+        else if (op >= dwarf_t::DW_OP_reg0 && op <= dwarf_t::DW_OP_reg31)
+        {
+          exprShape = REG;
+          exprReg = op - dwarf_t::DW_OP_reg0;
+        }
+        else if (op == dwarf_t::DW_OP_regx)
+        {
+          exprShape = REG;
+          exprReg = value.first;
+        }
+        else if (op >= dwarf_t::DW_OP_breg0 && op <= dwarf_t::DW_OP_breg31)
+        {
+          exprShape = BREG;
+          exprReg = op - dwarf_t::DW_OP_breg0;
+          exprValue = value.first;
+        }
+        else if (op == dwarf_t::DW_OP_bregx)
+        {
+          exprShape = BREG;
+          exprReg = value.first;
+          exprValue = value.second;
+        }
+        else if (op == dwarf_t::DW_OP_fbreg)
+        {
+          exprShape = FBREG;
+          exprValue = value.first;
+        }
+      }
+    }
+
+    std::pair<uint64_t, uint64_t> Expression::operand(dwarf_t::op_t op,
+        ByteCursor& cursor, arch_t arch)
+    {
+      if (op == dwarf_t::DW_OP_addr)
+      {
+        return {ExtractNumBytes(cursor, sizeof(void*)), 0};
+      }
+      else if (op == dwarf_t::DW_OP_const1u)
+      {
+        return {ExtractUInt8(cursor), 0};
+      }
+      else if (op == dwarf_t::DW_OP_const1s)
+      {
+        return {(int64_t)((int8_t)ExtractUInt8(cursor)), 0};
+      }
+      else if (op == dwarf_t::DW_OP_const2u)
+      {
+        return {ExtractUInt16(cursor), 0};
+      }
+      else if (op == dwarf_t::DW_OP_const2s)
+      {
+        return {(int64_t)((int16_t)ExtractUInt16(cursor)), 0};
+      }
+      else if (op == dwarf_t::DW_OP_const4u)
+      {
+        return {ExtractUInt32(cursor), 0};
+      }
+      else if (op == dwarf_t::DW_OP_const4s)
+      {
+        return {(int64_t)((int32_t)ExtractUInt32(cursor)), 0};
+      }
+      else if (op == dwarf_t::DW_OP_const8u)
+      {
+        return {ExtractUInt64(cursor), 0};
+      }
+      else if (op == dwarf_t::DW_OP_const8s)
+      {
+        return {ExtractUInt64(cursor), 0};
+      }
+      else if (op == dwarf_t::DW_OP_constu)
+      {
+        return {ExtractULEB128(cursor), 0};
+      }
+      else if (op == dwarf_t::DW_OP_consts)
+      {
+        return {ExtractSLEB128(cursor), 0};
+      }
+      else if (op == dwarf_t::DW_OP_pick)
+      {
+        return {ExtractUInt8(cursor), 0};
+      }
+      else if (op == dwarf_t::DW_OP_plus_uconst)
+      {
+        return {ExtractULEB128(cursor), 0};
+      }
+      else if (op == dwarf_t::DW_OP_skip)
+      {
+        return {(int64_t)((int16_t)ExtractUInt16(cursor)), 0};
+      }
+      else if (op == dwarf_t::DW_OP_bra)
+      {
+        return {(int64_t)((int16_t)ExtractUInt16(cursor)), 0};
+      }
+      else if (op >= dwarf_t::DW_OP_breg0 && op <= dwarf_t::DW_OP_breg31)
+      {
+        return {ExtractSLEB128(cursor), 0};
+      }
+      else if (op == dwarf_t::DW_OP_regx)
+      {
+        return {ExtractULEB128(cursor), 0};
+      }
+      else if (op >= dwarf_t::DW_OP_reg0 && op <= dwarf_t::DW_OP_reg31)
+      {
+        return {(op-dwarf_t::DW_OP_reg0), 0};
+      }
+      else if (op == dwarf_t::DW_OP_fbreg)
+      {
+        return {ExtractSLEB128(cursor), 0};
+      }
+      else if (op == dwarf_t::DW_OP_bregx)
+      {
+        return {ExtractULEB128(cursor), ExtractSLEB128(cursor)};
+      }
+      else if (op == dwarf_t::DW_OP_piece)
+      {
+        return {ExtractULEB128(cursor), 0};
+      }
+      else if ((op == dwarf_t::DW_OP_addrx) || (op == dwarf_t::DW_OP_constx) ||
+               (op == dwarf_t::DW_OP_GNU_addr_index) || (op == dwarf_t::DW_OP_GNU_const_index))
+      {
+        // Index into .debug_addr, resolved when evaluated
+        return {ExtractULEB128(cursor), 0};
+      }
+      else if (op == dwarf_t::DW_OP_deref_size)
+      {
+        return {ExtractUInt8(cursor), 0};
+      }
+      else if (op == dwarf_t::DW_OP_xderef_size)
+      {
+        return {ExtractUInt8(cursor), 0};
+      }
+      else if (op == dwarf_t::DW_OP_call2)
+      {
+        return {ExtractUInt16(cursor), 0};
+      }
+      else if (op == dwarf_t::DW_OP_call4)
+      {
+        return {ExtractUInt32(cursor), 0};
+      }
+      else if (op == dwarf_t::DW_OP_call_ref)
+      {
+        return {ExtractSectionOffset(cursor, arch), 0};
+      }
+      else if (op == dwarf_t::DW_OP_bit_piece)
+      {
+        return {ExtractULEB128(cursor), ExtractULEB128(cursor)};
+      }
+      else if (op == dwarf_t::DW_OP_call_frame_cfa)
+      {
+        return {0, 0};
+      }
+      else if ((op == dwarf_t::DW_OP_implicit_pointer) ||
+               (op == dwarf_t::DW_OP_GNU_implicit_pointer))
+      {
+        // DIE of the object pointed to, and an offset into it
+        uint64_t die = ExtractSectionOffset(cursor, arch);
+        return {die, ExtractSLEB128(cursor)};
+      }
+      else if (op == dwarf_t::DW_OP_GNU_parameter_ref)
+      {
+        // Offset of the parameter DIE in the unit
+        return {ExtractUInt32(cursor), 0};
+      }
+      else if (op == dwarf_t::DW_OP_GNU_variable_value)
+      {
+        return {ExtractSectionOffset(cursor, arch), 0};
+      }
+      else if ((op == dwarf_t::DW_OP_convert) || (op == dwarf_t::DW_OP_GNU_convert) ||
+               (op == dwarf_t::DW_OP_reinterpret) || (op == dwarf_t::DW_OP_GNU_reinterpret))
+      {
+        // Unit offset of the base type
+        return {ExtractULEB128(cursor), 0};
+      }
+      else if ((op == dwarf_t::DW_OP_regval_type) || (op == dwarf_t::DW_OP_GNU_regval_type))
+      {
+        // Register, then the unit offset of its type
+        uint64_t reg = ExtractULEB128(cursor);
+        return {reg, ExtractULEB128(cursor)};
+      }
+      else if ((op == dwarf_t::DW_OP_deref_type) || (op == dwarf_t::DW_OP_GNU_deref_type) ||
+               (op == dwarf_t::DW_OP_xderef_type))
+      {
+        // Size read, then the unit offset of the type
+        uint64_t size = ExtractUInt8(cursor);
+        return {size, ExtractULEB128(cursor)};
+      }
+      else if ((op == dwarf_t::DW_OP_const_type) || (op == dwarf_t::DW_OP_GNU_const_type))
+      {
+        // Unit offset of the type, and position of the value that follows
+        uint64_t type = ExtractULEB128(cursor);
+        uint64_t length = ExtractUInt8(cursor);
+        uint64_t position = cursor.tell();
+        cursor.skip(length);
+        return {type, position};
+      }
+      else if ((op == dwarf_t::DW_OP_implicit_value) ||
+               (op == dwarf_t::DW_OP_entry_value) ||
+               (op == dwarf_t::DW_OP_GNU_entry_value))
+      {
+        // Length and position of the block that follows
+        uint64_t length = ExtractULEB128(cursor);
+        uint64_t position = cursor.tell();
+        cursor.skip(length);
+        return {length, position};
+      }
+      else if (op >= dwarf_t::DW_OP_lit0 && op <= dwarf_t::DW_OP_lit31)
+      {
+        return {(op-dwarf_t::DW_OP_lit0), 0};
+      }
+      else if ((op == dwarf_t::DW_OP_deref) ||
+               (op >= dwarf_t::DW_OP_dup && op <= dwarf_t::DW_OP_ne) ||
+               (op == dwarf_t::DW_OP_nop) ||
+               (op == dwarf_t::DW_OP_push_object_address) ||
+               (op == dwarf_t::DW_OP_form_tls_address) ||
+               (op == dwarf_t::DW_OP_GNU_push_tls_address) ||
+               (op == dwarf_t::DW_OP_GNU_uninit) ||
+               (op == dwarf_t::DW_OP_stack_value))
+      {
+        // Stack operations without operands
+        return {0, 0};
+      }
+      else
+      {
+        throw Exception(dwarf_t::op_str(op)+ "not supported", __EINFO__);
+      }
+      return {0, 0};
+    }
+
+  } /* namespace dwarf */
+} /* namespace penguinTrace */
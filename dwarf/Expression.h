@@ -0,0 +1,108 @@
+// ----------------------------------------------------------------
+// Copyright (C) 2019 Alex Beharrell
+//
+// This file is part of penguinTrace.
+//
+// penguinTrace is free software: you can redistribute it and/or
+// modify it under the terms of the GNU Affero General Public
+// License as published by the Free Software Foundation, either
+// version 3 of the License, or any later version.
+//
+// penguinTrace is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public
+// License along with penguinTrace. If not, see
+// <https://www.gnu.org/licenses/>.
+// ----------------------------------------------------------------
+//
+// DWARF Location Expressions
+
+#ifndef DWARF_EXPRESSION_H_
+#define DWARF_EXPRESSION_H_
+
+#include "definitions.h"
+
+#include "Common.h"
+
+#include <utility>
+#include <vector>
+
+namespace penguinTrace
+{
+  namespace dwarf
+  {
+
+    // Location expression decoded once from its bytecode. Expressions
+    //  made of a single common operation are recognised so they can be
+    //  evaluated without stepping through the operations.
+    class Expression
+    {
+      public:
+        enum shape_t
+        {
+          EMPTY,
+          // Address is the operand
+          ADDR,
+          // Value is held in a register
+          REG,
+          // Address is a register plus an offset
+          BREG,
+          // Address is the frame base plus an offset
+          FBREG,
+          // Anything else, evaluated operation by operation
+          GENERIC,
+          // Has an operation that can't be decoded
+          UNSUPPORTED
+        };
+        struct Op
+        {
+          dwarf_t::op_t op;
+          std::pair<uint64_t, uint64_t> operand;
+        };
+        Expression(const uint8_t* expr, size_t length, arch_t arch);
+        static std::pair<uint64_t, uint64_t> operand(dwarf_t::op_t op,
+            ByteCursor& cursor, arch_t arch);
+        shape_t shape() const
+        {
+          return exprShape;
+        }
+        // Register number for REG and BREG
+        uint64_t reg() const
+        {
+          return exprReg;
+        }
+        // Address for ADDR, offset for BREG and FBREG
+        uint64_t value() const
+        {
+          return exprValue;
+        }
+        // Needs the value of registers on entry to the function
+        bool usesEntryValue() const
+        {
+          return entryValue;
+        }
+        // Object is split across locations by DW_OP_piece
+        bool hasPieces() const
+        {
+          return pieces;
+        }
+        const std::vector<Op>& ops() const
+        {
+          return exprOps;
+        }
+      private:
+        std::vector<Op> exprOps;
+        shape_t exprShape;
+        uint64_t exprReg;
+        uint64_t exprValue;
+        bool entryValue;
+        bool pieces;
+    };
+
+  } /* namespace dwarf */
+} /* namespace penguinTrace */
+
+#endif /* DWARF_EXPRESSION_H_ */
@@ -24,6 +24,8 @@
 
 #include "Arch.h"
 
+#include <algorithm>
+
 #include <stdio.h>
 #include <inttypes.h>
 
@@ -35,27 +37,50 @@ namespace penguinTrace
     std::string RegRule::toString(bool cfa)
     {
       std::stringstream s;
-      std::string regName = cfa ? reg : "CFA";
+      std::string regName = cfa ? dwarfRegString(reg) : "CFA";
       switch (type)
       {
         case UNDEFINED: return "u";
         case SAME:      return "s";
         case OFFSET:
-          s << "[" << regName << operand.toString(true) << "]";
+          s << "[" << regName << (offset > 0 ? "+" : "") << offset << "]";
           return s.str();
         case VAL_OFFSET:
-          s << regName << operand.toString(true);
+          s << regName << (offset > 0 ? "+" : "") << offset;
           return s.str();
-        case REGISTER:  return reg;
+        case REGISTER:  return dwarfRegString(reg);
         case EXPR:      return "[e]";
         case VAL_EXPR:  return "e";
         default:        return "?";
       }
     }
 
-    CFA CFA::parseCFA(std::istream& ifs, uint64_t offset)
+    RegRule* CFIRow::getRule(uint64_t reg)
+    {
+      auto it = std::lower_bound(rules.begin(), rules.end(), reg,
+          [](const std::pair<uint64_t, RegRule>& r, uint64_t reg) { return r.first < reg; });
+      if (it == rules.end() || it->first != reg) return nullptr;
+      return &it->second;
+    }
+
+    void CFIRow::setRule(uint64_t reg, RegRule rule)
+    {
+      auto it = std::lower_bound(rules.begin(), rules.end(), reg,
+          [](const std::pair<uint64_t, RegRule>& r, uint64_t reg) { return r.first < reg; });
+      if (it != rules.end() && it->first == reg) it->second = rule;
+      else rules.insert(it, { reg, rule });
+    }
+
+    void CFIRow::clearRule(uint64_t reg)
     {
-      dwarf_t::cfa_t cfa = dwarf_t::convert_cfa(ExtractUInt8(ifs));
+      auto it = std::lower_bound(rules.begin(), rules.end(), reg,
+          [](const std::pair<uint64_t, RegRule>& r, uint64_t reg) { return r.first < reg; });
+      if (it != rules.end() && it->first == reg) rules.erase(it);
+    }
+
+    CFA CFA::parseCFA(ByteCursor& cursor, uint64_t offset)
+    {
+      dwarf_t::cfa_t cfa = dwarf_t::convert_cfa(ExtractUInt8(cursor));
       AttrValue operand1;
       AttrValue operand2;
 
@@ -78,31 +103,31 @@ namespace penguinTrace
           cfa == dwarf_t::DW_CFA_def_cfa_offset ||
           cfa == dwarf_t::DW_CFA_GNU_args_size)
       {
-        operand1 = AttrValue(dwarf_t::DW_FORM_NULL, ExtractULEB128(ifs), 8, false);
+        operand1 = AttrValue(dwarf_t::DW_FORM_NULL, ExtractULEB128(cursor), 8, false);
       }
       else if (cfa == dwarf_t::DW_CFA_offset_extended_sf ||
                cfa == dwarf_t::DW_CFA_def_cfa_sf ||
                cfa == dwarf_t::DW_CFA_val_offset_sf)
       {
-        operand1 = AttrValue(dwarf_t::DW_FORM_NULL, ExtractULEB128(ifs), 8, false);
-        operand2 = AttrValue(dwarf_t::DW_FORM_NULL, ExtractSLEB128(ifs), 8, true);
+        operand1 = AttrValue(dwarf_t::DW_FORM_NULL, ExtractULEB128(cursor), 8, false);
+        operand2 = AttrValue(dwarf_t::DW_FORM_NULL, ExtractSLEB128(cursor), 8, true);
       }
       else if (cfa == dwarf_t::DW_CFA_def_cfa_offset_sf)
       {
-        operand1 = AttrValue(dwarf_t::DW_FORM_NULL, ExtractSLEB128(ifs), 8, true);
+        operand1 = AttrValue(dwarf_t::DW_FORM_NULL, ExtractSLEB128(cursor), 8, true);
       }
       else if (cfa == dwarf_t::DW_CFA_def_cfa_expression)
       {
         std::vector<uint8_t> tmpBuf;
-        ExtractExprLoc(ifs, tmpBuf);
+        ExtractExprLoc(cursor, tmpBuf);
         operand1 = AttrValue(dwarf_t::DW_FORM_NULL, tmpBuf);
       }
       else if (cfa == dwarf_t::DW_CFA_expression ||
                cfa == dwarf_t::DW_CFA_val_expression)
       {
-        operand1 = AttrValue(dwarf_t::DW_FORM_NULL, ExtractULEB128(ifs), 8, false);
+        operand1 = AttrValue(dwarf_t::DW_FORM_NULL, ExtractULEB128(cursor), 8, false);
         std::vector<uint8_t> tmpBuf;
-        ExtractExprLoc(ifs, tmpBuf);
+        ExtractExprLoc(cursor, tmpBuf);
         operand2 = AttrValue(dwarf_t::DW_FORM_NULL, tmpBuf);
       }
       else if (cfa == dwarf_t::DW_CFA_set_loc)
@@ -113,15 +138,15 @@ namespace penguinTrace
       }
       else if (cfa == dwarf_t::DW_CFA_advance_loc1)
       {
-        operand1 = AttrValue(dwarf_t::DW_FORM_NULL, ExtractUInt8(ifs), 1, false);
+        operand1 = AttrValue(dwarf_t::DW_FORM_NULL, ExtractUInt8(cursor), 1, false);
       }
       else if (cfa == dwarf_t::DW_CFA_advance_loc2)
       {
-        operand1 = AttrValue(dwarf_t::DW_FORM_NULL, ExtractUInt16(ifs), 2, false);
+        operand1 = AttrValue(dwarf_t::DW_FORM_NULL, ExtractUInt16(cursor), 2, false);
       }
       else if (cfa == dwarf_t::DW_CFA_advance_loc4)
       {
-        operand1 = AttrValue(dwarf_t::DW_FORM_NULL, ExtractUInt32(ifs), 4, false);
+        operand1 = AttrValue(dwarf_t::DW_FORM_NULL, ExtractUInt32(cursor), 4, false);
       }
       else if (cfa == dwarf_t::DW_CFA_offset_extended ||
                cfa == dwarf_t::DW_CFA_def_cfa ||
@@ -129,8 +154,8 @@ namespace penguinTrace
                cfa == dwarf_t::DW_CFA_val_offset)
       {
         // Number of bytes is not entirely relevant
-        operand1 = AttrValue(dwarf_t::DW_FORM_NULL, ExtractULEB128(ifs), 8, false);
-        operand2 = AttrValue(dwarf_t::DW_FORM_NULL, ExtractULEB128(ifs), 8, false);
+        operand1 = AttrValue(dwarf_t::DW_FORM_NULL, ExtractULEB128(cursor), 8, false);
+        operand2 = AttrValue(dwarf_t::DW_FORM_NULL, ExtractULEB128(cursor), 8, false);
       }
       else
       {
@@ -217,7 +242,7 @@ namespace penguinTrace
     FDE::FDE(uint64_t offset, uint64_t ciePtr, CIE* cie, uint64_t start,
         uint64_t end, std::list<CFA> instrs) :
         FrameEntry(offset, instrs), ciePtr(ciePtr), cie(cie), startAddr(start), endAddr(
-            end)
+            end), compiled(false), unsupportedLoc(UINT64_MAX)
     {
 
     }
@@ -259,34 +284,34 @@ namespace penguinTrace
       return s.str();
     }
 
-    Frames::Frames()
+    Frames::Frames() : searchTable(false)
     {
     }
 
-    Frames::Frames(std::istream& ifs,
-        std::map<std::string, uint64_t>& sectionAddrs, bool eh)
+    Frames::Frames(ByteCursor& cursor,
+        std::map<std::string, uint64_t>& sectionAddrs, bool eh,
+        ByteCursor* hdr) : searchTable(false)
     {
-      ifs.peek();
-      bool done = ifs.eof();
+      bool done = cursor.eof();
 
       while (!done)
       {
-        int64_t offset = ifs.tellg();
-        auto initLen = ExtractInitialLength(ifs);
+        uint64_t offset = cursor.tell();
+        auto initLen = ExtractInitialLength(cursor);
 
         if (initLen.second != 0)
         {
-          int64_t offset2 = ifs.tellg();
-          uint64_t ident = ExtractSectionOffset(ifs, initLen.first);
+          uint64_t offset2 = cursor.tell();
+          uint64_t ident = ExtractSectionOffset(cursor, initLen.first);
           // .eh_frame uses ident = 0
           // .dwarf_frame uses all bits set
           bool isCie = eh ? (ident == 0) : ((ident == 0xffffffff) || (ident == ((uint64_t)-1)));
           if (isCie)
           {
-            int64_t last = offset2 + initLen.second;
+            uint64_t last = offset2 + initLen.second;
 
-            uint64_t version = ExtractUInt8(ifs);
-            std::string aug = ExtractString(ifs);
+            uint64_t version = ExtractUInt8(cursor);
+            std::string aug = ExtractString(cursor);
 
             assert(((version == 1) || (version == 4)) && "Only support DWARFv1/4 currently");
             uint64_t addrSize = 0;
@@ -295,21 +320,21 @@ namespace penguinTrace
 
             if (version == 4)
             {
-              addrSize = ExtractUInt8(ifs);
-              segmentSize = ExtractUInt8(ifs);
+              addrSize = ExtractUInt8(cursor);
+              segmentSize = ExtractUInt8(cursor);
             }
 
-            uint64_t codeAlign = ExtractULEB128(ifs);
-            int64_t dataAlign = ExtractSLEB128(ifs);
+            uint64_t codeAlign = ExtractULEB128(cursor);
+            int64_t dataAlign = ExtractSLEB128(cursor);
             // Version 2 is unused for frame information
             uint64_t returnAddrCol;
             if (version == 1)
             {
-              returnAddrCol = ExtractUInt8(ifs);
+              returnAddrCol = ExtractUInt8(cursor);
             }
             else if ((version == 3) || (version == 4))
             {
-              returnAddrCol = ExtractULEB128(ifs);
+              returnAddrCol = ExtractULEB128(cursor);
             }
             else
             {
@@ -322,15 +347,15 @@ namespace penguinTrace
             uint8_t ptrRepr = 0xff;
             if (aug == "zR")
             {
-              uint64_t augLen = ExtractULEB128(ifs);
+              uint64_t augLen = ExtractULEB128(cursor);
               assert(augLen == 1);
-              ptrRepr = ExtractUInt8(ifs);
+              ptrRepr = ExtractUInt8(cursor);
             }
             else if (aug == "zRS")
             {
-              uint64_t augLen = ExtractULEB128(ifs);
+              uint64_t augLen = ExtractULEB128(cursor);
               assert(augLen == 1);
-              ptrRepr = ExtractUInt8(ifs);
+              ptrRepr = ExtractUInt8(cursor);
               signal = true;
               aug = "zR";
             }
@@ -340,10 +365,9 @@ namespace penguinTrace
             }
             else if (aug[0] == 'z' && aug[aug.length()-1] == 'R')
             {
-              uint64_t augLen = ExtractULEB128(ifs);
-              std::vector<uint8_t> tmpBuf;
-              ExtractBuffer(ifs, tmpBuf, augLen-1);
-              ptrRepr = ExtractUInt8(ifs);
+              uint64_t augLen = ExtractULEB128(cursor);
+              cursor.skip(augLen-1);
+              ptrRepr = ExtractUInt8(cursor);
             }
             else
             {
@@ -351,15 +375,13 @@ namespace penguinTrace
             }
 
             std::list<CFA> cfas;
-            auto lastPos = ifs.tellg();
-            while (ifs.tellg() != last)
+            while (cursor.tell() != last)
             {
-              if (ifs.eof() || ifs.tellg() > last)
+              if (cursor.eof() || cursor.tell() > last)
               {
                 throw Exception("Reached EOF in CIE", __EINFO__);
               }
-              lastPos = ifs.tellg();
-              cfas.push_back(CFA::parseCFA(ifs, offset));
+              cfas.push_back(CFA::parseCFA(cursor, offset));
             }
 
             CIE* cie = new CIE(offset, version, aug, codeAlign, dataAlign,
@@ -370,7 +392,7 @@ namespace penguinTrace
           }
           else
           {
-            int64_t last = offset2 + initLen.second;
+            uint64_t last = offset2 + initLen.second;
             uint64_t ciePtr = eh ? offset2-ident : ident;
             auto it = frames.find(ciePtr);
             assert(it != frames.end());
@@ -383,12 +405,12 @@ namespace penguinTrace
             {
               uint64_t base = sectionAddrs[dwarf_t::convert_section(
                   dwarf_t::DW_SECTION_eh_frame)];
-              uint64_t curOffset = ifs.tellg();
+              uint64_t curOffset = cursor.tell();
 
               if (cie->format() == dwarf_t::DW_EH_PE_sdata4)
               {
-                int64_t offset = (int32_t)ExtractUInt32(ifs);
-                int64_t size   = (int32_t)ExtractUInt32(ifs);
+                int64_t offset = (int32_t)ExtractUInt32(cursor);
+                int64_t size   = (int32_t)ExtractUInt32(cursor);
                 startAddr = (int64_t) base + (int64_t) curOffset
                     + (int64_t)offset;
                 endAddr   = (int64_t)startAddr + (int64_t)size;
@@ -399,7 +421,7 @@ namespace penguinTrace
               }
               // PC relative is relative to the start of the
               //  .eh_frame section + this offset
-              // e.g. ifs.tellg()+[.eh_frame]+sdata4
+              // e.g. cursor.tell()+[.eh_frame]+sdata4
               // So need to get address of .eh_frame section
               //  (or other sections if .text relative etc.)
             }
@@ -407,8 +429,8 @@ namespace penguinTrace
             {
               if (cie->getVersion() == 4 && cie->getAddrSize() != 0)
               {
-                uint64_t start = ExtractNumBytes(ifs, cie->getAddrSize());
-                uint64_t end   = ExtractNumBytes(ifs, cie->getAddrSize());
+                uint64_t start = ExtractNumBytes(cursor, cie->getAddrSize());
+                uint64_t end   = ExtractNumBytes(cursor, cie->getAddrSize());
                 startAddr = start;
                 endAddr   = start+end;
               }
@@ -418,12 +440,12 @@ namespace penguinTrace
               }
             }
 
-            //uint64_t initLoc = ExtractNumBytes(ifs, ADDR_BYTES);
-            //uint64_t lastLoc = ExtractNumBytes(ifs, ADDR_BYTES);
+            //uint64_t initLoc = ExtractNumBytes(cursor, ADDR_BYTES);
+            //uint64_t lastLoc = ExtractNumBytes(cursor, ADDR_BYTES);
 
             if (cie->getAugmentation() == "zR")
             {
-              uint64_t augLen = ExtractULEB128(ifs);
+              uint64_t augLen = ExtractULEB128(cursor);
               assert(augLen == 0);
             }
             else if (cie->getAugmentation() == "")
@@ -431,9 +453,8 @@ namespace penguinTrace
             }
             else if (cie->getAugmentation() == "zPLR")
             {
-              uint64_t augLen = ExtractULEB128(ifs);
-              std::vector<uint8_t> tmpBuf;
-              ExtractBuffer(ifs, tmpBuf, augLen);
+              uint64_t augLen = ExtractULEB128(cursor);
+              cursor.skip(augLen);
             }
             else
             {
@@ -443,15 +464,13 @@ namespace penguinTrace
             }
 
             std::list<CFA> cfas;
-            auto lastPos = ifs.tellg();
-            while (ifs.tellg() != last)
+            while (cursor.tell() != last)
             {
-              if (ifs.eof() || ifs.tellg() > last)
+              if (cursor.eof() || cursor.tell() > last)
               {
                 throw Exception("Reached EOF in FDE", __EINFO__);
               }
-              lastPos = ifs.tellg();
-              cfas.push_back(CFA::parseCFA(ifs, offset));
+              cfas.push_back(CFA::parseCFA(cursor, offset));
             }
 
             FDE* fde = new FDE(offset, ciePtr, cie, startAddr, endAddr, cfas);
@@ -460,131 +479,260 @@ namespace penguinTrace
             frames.insert(std::make_pair(offset, std::move(ptr)));
           }
         }
-        ifs.peek();
-        done = ifs.eof();
+        done = cursor.eof();
       }
 
-      for (auto it = frames.begin(); it != frames.end(); ++it)
+      if (eh && hdr != nullptr)
       {
-        FDE* fde = dynamic_cast<FDE*>(it->second.get());
-        if (fde != nullptr)
+        uint64_t hdrAddr = sectionAddrs[dwarf_t::convert_section(
+            dwarf_t::DW_SECTION_eh_frame_hdr)];
+        uint64_t ehAddr = sectionAddrs[dwarf_t::convert_section(
+            dwarf_t::DW_SECTION_eh_frame)];
+        searchTable = parseSearchTable(*hdr, hdrAddr, ehAddr);
+      }
+
+      if (!searchTable)
+      {
+        fdeByPc.clear();
+        for (auto it = frames.begin(); it != frames.end(); ++it)
         {
-          fdeByPc[fde->getStartAddr()] = fde;
+          FDE* fde = dynamic_cast<FDE*>(it->second.get());
+          if (fde != nullptr)
+          {
+            fdeByPc.push_back({fde->getStartAddr(), fde});
+          }
         }
+        std::stable_sort(fdeByPc.begin(), fdeByPc.end(),
+            [](const std::pair<uint64_t, FDE*>& a, const std::pair<uint64_t, FDE*>& b)
+            { return a.first < b.first; });
       }
     }
 
-    FDE* Frames::getFDEByPc(uint64_t pc)
+    bool Frames::parseSearchTable(ByteCursor& hdr, uint64_t hdrAddr, uint64_t ehAddr)
     {
-      for (auto it = fdeByPc.begin(); it != fdeByPc.end(); ++it)
+      // .eh_frame_hdr holds a table of (initial location, FDE address)
+      //  sorted by location, as generated by the linker
+      if (hdr.remaining() < 12) return false;
+
+      uint64_t version  = ExtractUInt8(hdr);
+      uint64_t ptrEnc   = ExtractUInt8(hdr);
+      uint64_t countEnc = ExtractUInt8(hdr);
+      uint64_t tableEnc = ExtractUInt8(hdr);
+
+      uint64_t datarelSdata4 = dwarf_t::convert_eh_pe(dwarf_t::DW_EH_PE_datarel) |
+                               dwarf_t::convert_eh_pe(dwarf_t::DW_EH_PE_sdata4);
+      uint64_t ptrFmt = ptrEnc & 0x0f;
+
+      if (version != 1 ||
+          countEnc != dwarf_t::convert_eh_pe(dwarf_t::DW_EH_PE_udata4) ||
+          tableEnc != datarelSdata4 ||
+          (ptrFmt != dwarf_t::convert_eh_pe(dwarf_t::DW_EH_PE_udata4) &&
+           ptrFmt != dwarf_t::convert_eh_pe(dwarf_t::DW_EH_PE_sdata4)))
       {
-        if (it->second->contains(pc)) return it->second;
+        return false;
       }
+
+      // Pointer to .eh_frame, already known from the section headers
+      ExtractUInt32(hdr);
+      uint64_t count = ExtractUInt32(hdr);
+      if (hdr.remaining() < count * 8) return false;
+
+      fdeByPc.reserve(count);
+      for (uint64_t i = 0; i < count; ++i)
+      {
+        int64_t loc = (int32_t)ExtractUInt32(hdr);
+        int64_t fdeAddr = (int32_t)ExtractUInt32(hdr);
+
+        uint64_t start = (int64_t)hdrAddr + loc;
+        uint64_t offset = (int64_t)hdrAddr + fdeAddr - (int64_t)ehAddr;
+
+        auto it = frames.find(offset);
+        if (it == frames.end()) return false;
+        FDE* fde = dynamic_cast<FDE*>(it->second.get());
+        if (fde == nullptr || fde->getStartAddr() != start) return false;
+        if (!fdeByPc.empty() && fdeByPc.back().first > start) return false;
+
+        fdeByPc.push_back({start, fde});
+      }
+
+      return true;
+    }
+
+    FDE* Frames::getFDEByPc(uint64_t pc)
+    {
+      auto it = std::upper_bound(fdeByPc.begin(), fdeByPc.end(), pc,
+          [](uint64_t pc, const std::pair<uint64_t, FDE*>& f) { return pc < f.first; });
+      if (it == fdeByPc.begin()) return nullptr;
+      --it;
+      if (it->second->contains(pc)) return it->second;
       return nullptr;
     }
 
-    std::unique_ptr<std::map<std::string, RegRule> > FDE::unwindInfo(uint64_t pc)
+    CFIRow* FDE::unwindRow(uint64_t pc)
     {
-      auto info = std::unique_ptr<std::map<std::string, RegRule> >(
-          new std::map<std::string, RegRule>());
+      if (!compiled) compileRows();
 
-      uint64_t loc = startAddr;
-      std::list<CFA> instrs(cie->getInstructions());
-      instrs.insert(instrs.end(), instructions.begin(), instructions.end());
+      if (pc >= unsupportedLoc)
+      {
+        throw Exception(unsupportedErr, __EINFO__);
+      }
 
-      // Initial instructions
-      // CFA defined as " " to ensure first in map
-      for (auto it : instrs)
+      auto it = std::upper_bound(rows.begin(), rows.end(), pc,
+          [](uint64_t pc, CFIRow& r) { return pc < r.getLoc(); });
+      if (it == rows.begin()) return nullptr;
+      return &*(--it);
+    }
+
+    void FDE::compileRows()
+    {
+      compiled = true;
+      rows.clear();
+
+      int64_t dataAlign = (int64_t)cie->getDataAlign();
+      CFIRow row(startAddr);
+      // State after the CIE initial instructions, used by restore
+      CFIRow initial(startAddr);
+      std::vector<CFIRow> stateStack;
+
+      std::list<CFA>* programs[] = { &cie->getInstructions(), &instructions };
+
+      for (unsigned p = 0; p < 2; ++p)
       {
-        dwarf_t::cfa_t cfa = it.type();
-        if (cfa >= dwarf_t::DW_CFA_advance_loc_delta0 &&
-            cfa <= dwarf_t::DW_CFA_advance_loc_delta63)
-        {
-          uint64_t delta = (cfa - dwarf_t::DW_CFA_advance_loc_delta0)
-              * cie->getCodeAlign();
-          uint64_t newLoc = loc + delta;
+        if (p == 1) initial = row;
 
-          if (pc >= newLoc) loc = newLoc;
-          else              break;
-        }
-        else if ((cfa == dwarf_t::DW_CFA_advance_loc1) ||
-                 (cfa == dwarf_t::DW_CFA_advance_loc2) ||
-                 (cfa == dwarf_t::DW_CFA_advance_loc4))
+        for (auto& it : *programs[p])
         {
-          uint64_t delta = it.op1().getInt() * cie->getCodeAlign();
-          uint64_t newLoc = loc + delta;
+          dwarf_t::cfa_t cfa = it.type();
+          uint64_t delta = 0;
+          bool advance = false;
 
-          if (pc >= newLoc) loc = newLoc;
-          else              break;
-        }
-        else if (cfa >= dwarf_t::DW_CFA_restore_reg0 &&
-                 cfa <= dwarf_t::DW_CFA_restore_reg63)
-        {
-          //uint64_t reg = cfa - dwarf_t::DW_CFA_restore_reg0;
-          // TODO restore reg
-          throw Exception("restore_reg unhandled", __EINFO__);
-        }
-        else if (cfa >= dwarf_t::DW_CFA_offset_reg0 &&
-                 cfa <= dwarf_t::DW_CFA_offset_reg63)
-        {
-          uint64_t reg = cfa - dwarf_t::DW_CFA_offset_reg0;
-          std::string regName = (reg == cie->raCol()) ? "ra" : dwarfRegString(reg);
-          int64_t offset = ((int64_t)it.op1().getInt())*cie->getDataAlign();
-          AttrValue value = AttrValue(dwarf_t::DW_FORM_NULL, offset, 8, true);
-          if (info->find(regName) != info->end()) info->erase(regName);
-          info->insert(
-            { regName, RegRule(RegRule::OFFSET, regName, value) });
-        }
-        else if (cfa == dwarf_t::DW_CFA_def_cfa)
-        {
-          std::string regName = dwarfRegString(it.op1().getInt());
-          uint64_t offset = it.op2().getInt();
-          if (info->find(" ") != info->end()) info->erase(" ");
-          info->insert(
-                { " ", RegRule(RegRule::VAL_OFFSET, regName,
-                    AttrValue(dwarf_t::DW_FORM_NULL, offset, 1, true)) });
-        }
-        else if (cfa == dwarf_t::DW_CFA_def_cfa_offset)
-        {
-          assert(info->find(" ") != info->end());
-          auto currentRuleIt = info->find(" ");
-          auto currentRule = currentRuleIt->second.regName();
-          uint64_t offset = it.op1().getInt();
-          if (info->find(" ") != info->end()) info->erase(" ");
-          info->insert(
-                { " ", RegRule(RegRule::VAL_OFFSET, currentRule,
-                    AttrValue(dwarf_t::DW_FORM_NULL, offset, 1, true)) });
-        }
-        else if (cfa == dwarf_t::DW_CFA_def_cfa_register)
-        {
-          auto currentRuleIt = info->find(" ");
-          auto currentRule = currentRuleIt->second.op();
-          std::string regName = dwarfRegString(it.op1().getInt());
-          if (info->find(" ") != info->end()) info->erase(" ");
-          info->insert(
-                { " ", RegRule(RegRule::VAL_OFFSET, regName,
-                    currentRule) });
-        }
-        else if (cfa == dwarf_t::DW_CFA_nop)
-        {
+          if (cfa >= dwarf_t::DW_CFA_advance_loc_delta0 &&
+              cfa <= dwarf_t::DW_CFA_advance_loc_delta63)
+          {
+            delta = (cfa - dwarf_t::DW_CFA_advance_loc_delta0) * cie->getCodeAlign();
+            advance = true;
+          }
+          else if ((cfa == dwarf_t::DW_CFA_advance_loc1) ||
+                   (cfa == dwarf_t::DW_CFA_advance_loc2) ||
+                   (cfa == dwarf_t::DW_CFA_advance_loc4))
+          {
+            delta = it.op1().getInt() * cie->getCodeAlign();
+            advance = true;
+          }
+          else if ((cfa >= dwarf_t::DW_CFA_restore_reg0 &&
+                    cfa <= dwarf_t::DW_CFA_restore_reg63) ||
+                   cfa == dwarf_t::DW_CFA_restore_extended)
+          {
+            uint64_t reg = (cfa == dwarf_t::DW_CFA_restore_extended) ?
+                it.op1().getInt() : cfa - dwarf_t::DW_CFA_restore_reg0;
+            RegRule* rule = initial.getRule(reg);
+            if (rule != nullptr) row.setRule(reg, *rule);
+            else                 row.clearRule(reg);
+          }
+          else if (cfa >= dwarf_t::DW_CFA_offset_reg0 &&
+                   cfa <= dwarf_t::DW_CFA_offset_reg63)
+          {
+            uint64_t reg = cfa - dwarf_t::DW_CFA_offset_reg0;
+            int64_t offset = ((int64_t)it.op1().getInt())*dataAlign;
+            row.setRule(reg, RegRule(RegRule::OFFSET, offset));
+          }
+          else if (cfa == dwarf_t::DW_CFA_offset_extended)
+          {
+            int64_t offset = ((int64_t)it.op2().getInt())*dataAlign;
+            row.setRule(it.op1().getInt(), RegRule(RegRule::OFFSET, offset));
+          }
+          else if (cfa == dwarf_t::DW_CFA_offset_extended_sf)
+          {
+            int64_t offset = it.op2().getSInt()*dataAlign;
+            row.setRule(it.op1().getInt(), RegRule(RegRule::OFFSET, offset));
+          }
+          else if (cfa == dwarf_t::DW_CFA_val_offset)
+          {
+            int64_t offset = ((int64_t)it.op2().getInt())*dataAlign;
+            row.setRule(it.op1().getInt(), RegRule(RegRule::VAL_OFFSET, offset));
+          }
+          else if (cfa == dwarf_t::DW_CFA_val_offset_sf)
+          {
+            int64_t offset = it.op2().getSInt()*dataAlign;
+            row.setRule(it.op1().getInt(), RegRule(RegRule::VAL_OFFSET, offset));
+          }
+          else if (cfa == dwarf_t::DW_CFA_register)
+          {
+            row.setRule(it.op1().getInt(),
+                RegRule(RegRule::REGISTER, it.op2().getInt(), 0));
+          }
+          else if (cfa == dwarf_t::DW_CFA_undefined)
+          {
+            row.setRule(it.op1().getInt(), RegRule(RegRule::UNDEFINED, 0));
+          }
+          else if (cfa == dwarf_t::DW_CFA_same_value)
+          {
+            row.setRule(it.op1().getInt(), RegRule(RegRule::SAME, 0));
+          }
+          else if (cfa == dwarf_t::DW_CFA_def_cfa)
+          {
+            row.cfa() = RegRule(RegRule::VAL_OFFSET, it.op1().getInt(),
+                                it.op2().getInt());
+          }
+          else if (cfa == dwarf_t::DW_CFA_def_cfa_sf)
+          {
+            row.cfa() = RegRule(RegRule::VAL_OFFSET, it.op1().getInt(),
+                                it.op2().getSInt()*dataAlign);
+          }
+          else if (cfa == dwarf_t::DW_CFA_def_cfa_offset)
+          {
+            row.cfa() = RegRule(RegRule::VAL_OFFSET, row.cfa().regNum(),
+                                it.op1().getInt());
+          }
+          else if (cfa == dwarf_t::DW_CFA_def_cfa_offset_sf)
+          {
+            row.cfa() = RegRule(RegRule::VAL_OFFSET, row.cfa().regNum(),
+                                it.op1().getSInt()*dataAlign);
+          }
+          else if (cfa == dwarf_t::DW_CFA_def_cfa_register)
+          {
+            row.cfa() = RegRule(RegRule::VAL_OFFSET, it.op1().getInt(),
+                                row.cfa().getOffset());
+          }
+          else if (cfa == dwarf_t::DW_CFA_remember_state)
+          {
+            stateStack.push_back(row);
+          }
+          else if (cfa == dwarf_t::DW_CFA_restore_state)
+          {
+            if (stateStack.empty())
+            {
+              throw Exception("restore_state without remember_state", __EINFO__);
+            }
+            uint64_t loc = row.getLoc();
+            row = stateStack.back();
+            row.setLoc(loc);
+            stateStack.pop_back();
+          }
+          else if (cfa == dwarf_t::DW_CFA_nop ||
+                   cfa == dwarf_t::DW_CFA_GNU_args_size)
+          {
 
-        }
-        else
-        {
-          std::stringstream err;
-          err << dwarf_t::cfa_str(cfa) << " unhandled";
-          throw Exception(err.str(), __EINFO__);
-        }
-      }
+          }
+          else
+          {
+            // Only fails unwinding for the addresses this applies to
+            std::stringstream err;
+            err << dwarf_t::cfa_str(cfa) << " unhandled";
+            unsupportedLoc = row.getLoc();
+            unsupportedErr = err.str();
+            return;
+          }
 
-      if (loc != pc)
-      {
-        loc = endAddr;
+          if (advance && delta != 0)
+          {
+            rows.push_back(row);
+            row.setLoc(row.getLoc() + delta);
+          }
+        }
       }
 
-      assert(loc >= pc);
-
-      return info;
+      rows.push_back(row);
     }
 
   } /* namespace dwarf */
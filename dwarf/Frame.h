@@ -31,7 +31,6 @@
 #include <map>
 #include <memory>
 
-#include <istream>
 #include <iomanip>
 
 #include "definitions.h"
@@ -58,34 +57,73 @@ namespace penguinTrace
           EXPR,
           VAL_EXPR
         };
-        RegRule(regrule_t type, std::string reg, AttrValue op) :
-            type(type), reg(reg), operand(op)
+        RegRule(regrule_t type, uint64_t reg, int64_t offset) :
+            type(type), reg(reg), offset(offset)
         {
 
         }
-        RegRule(regrule_t type, AttrValue op) :
-            type(type), reg(""), operand(op)
+        RegRule(regrule_t type, int64_t offset) :
+            type(type), reg(0), offset(offset)
+        {
+
+        }
+        RegRule() :
+            type(UNDEFINED), reg(0), offset(0)
         {
 
         }
-        RegRule() = delete;
         std::string toString(bool cfa);
-        std::string regName()
+        uint64_t regNum()
         {
           return reg;
         }
-        AttrValue op()
+        int64_t getOffset()
         {
-          return operand;
+          return offset;
         }
         regrule_t getType()
         {
           return type;
         }
       private:
-        regrule_t   type;
-        std::string reg;
-        AttrValue   operand;
+        regrule_t type;
+        uint64_t  reg;
+        int64_t   offset;
+    };
+
+    // One row of the CFI table, valid from loc up to the next row
+    class CFIRow
+    {
+      public:
+        CFIRow(uint64_t loc) : loc(loc)
+        {
+
+        }
+        CFIRow() = delete;
+        uint64_t getLoc()
+        {
+          return loc;
+        }
+        void setLoc(uint64_t newLoc)
+        {
+          loc = newLoc;
+        }
+        RegRule& cfa()
+        {
+          return cfaRule;
+        }
+        std::vector<std::pair<uint64_t, RegRule> >& getRules()
+        {
+          return rules;
+        }
+        RegRule* getRule(uint64_t reg);
+        void setRule(uint64_t reg, RegRule rule);
+        void clearRule(uint64_t reg);
+      private:
+        uint64_t loc;
+        RegRule  cfaRule;
+        // Sorted by DWARF register number
+        std::vector<std::pair<uint64_t, RegRule> > rules;
     };
 
     class CFA
@@ -97,7 +135,7 @@ namespace penguinTrace
 
         }
         CFA() = delete;
-        static CFA parseCFA(std::istream& ifs, uint64_t offset);
+        static CFA parseCFA(ByteCursor& cursor, uint64_t offset);
         dwarf_t::cfa_t type()
         {
           return cfa;
@@ -124,7 +162,7 @@ namespace penguinTrace
         virtual ~FrameEntry();
         virtual std::string headerRepr() = 0;
         virtual std::string repr() = 0;
-        std::list<CFA> getInstructions()
+        std::list<CFA>& getInstructions()
         {
           return instructions;
         }
@@ -212,27 +250,47 @@ namespace penguinTrace
         {
           return (pc >= startAddr) && (pc <= endAddr);
         }
-        std::unique_ptr<std::map<std::string, RegRule> > unwindInfo(uint64_t pc);
+        uint64_t raCol()
+        {
+          return cie->raCol();
+        }
+        // Row of the CFI table covering pc, the table is compiled
+        //  from the CIE and FDE instructions on first use
+        CFIRow* unwindRow(uint64_t pc);
       private:
+        void compileRows();
         uint64_t ciePtr;
         CIE*     cie;
         uint64_t startAddr;
         uint64_t endAddr;
+        bool     compiled;
+        std::vector<CFIRow> rows;
+        // Rows from this address on need an unsupported instruction
+        uint64_t    unsupportedLoc;
+        std::string unsupportedErr;
     };
 
     class Frames
     {
       public:
-        Frames(std::istream& ifs, std::map<std::string, uint64_t>& sectionAddrs, bool eh);
+        Frames(ByteCursor& cursor, std::map<std::string, uint64_t>& sectionAddrs, bool eh,
+               ByteCursor* hdr = nullptr);
         Frames();
         std::map<uint64_t, std::unique_ptr<FrameEntry> >& getFramesByOffset()
         {
           return frames;
         }
         FDE* getFDEByPc(uint64_t pc);
+        bool hasSearchTable()
+        {
+          return searchTable;
+        }
       private:
+        bool parseSearchTable(ByteCursor& hdr, uint64_t hdrAddr, uint64_t ehAddr);
         std::map<uint64_t, std::unique_ptr<FrameEntry> > frames;
-        std::map<uint64_t, FDE* > fdeByPc;
+        // Sorted by start address
+        std::vector<std::pair<uint64_t, FDE*> > fdeByPc;
+        bool searchTable;
     };
 
   } /* namespace dwarf */
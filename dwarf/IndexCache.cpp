@@ -0,0 +1,276 @@
+// ----------------------------------------------------------------
+// Copyright (C) 2019 Alex Beharrell
+//
+// This file is part of penguinTrace.
+//
+// penguinTrace is free software: you can redistribute it and/or
+// modify it under the terms of the GNU Affero General Public
+// License as published by the Free Software Foundation, either
+// version 3 of the License, or any later version.
+//
+// penguinTrace is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public
+// License along with penguinTrace. If not, see
+// <https://www.gnu.org/licenses/>.
+// ----------------------------------------------------------------
+//
+// Cache of Debug Information Indices
+
+#include "IndexCache.h"
+
+#include <cstring>
+#include <iomanip>
+#include <set>
+#include <sstream>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "definitions.h"
+
+#include "Common.h"
+#include "../common/Common.h"
+
+namespace penguinTrace
+{
+  namespace dwarf
+  {
+
+    static const char INDEX_MAGIC[8] = {'P', 'T', 'I', 'N', 'D', 'E', 'X', '\0'};
+    static const uint64_t INDEX_BYTE_ORDER = 0x0102030405060708ULL;
+
+    IndexCache::IndexCache(std::string dir, object::Parser* parser) :
+        dir(dir), path(dir + "/" + key(parser) + ".idx")
+    {
+    }
+
+    std::string IndexCache::key(object::Parser* parser)
+    {
+      std::stringstream s;
+      s << std::hex << std::setfill('0');
+
+      auto& sections = parser->getSectionNameMap();
+      auto noteIt = sections.find(".note.gnu.build-id");
+      if (noteIt != sections.end())
+      {
+        try
+        {
+          ByteCursor cursor = noteIt->second->getCursor();
+          uint32_t nameSize = ExtractUInt32(cursor);
+          uint32_t descSize = ExtractUInt32(cursor);
+          ExtractUInt32(cursor);
+          // Name is padded to 4 bytes
+          cursor.skip((nameSize + 3) & ~3u);
+          if (descSize > 0)
+          {
+            s << "b-";
+            for (uint32_t i = 0; i < descSize; ++i)
+            {
+              s << std::setw(2) << (unsigned)ExtractUInt8(cursor);
+            }
+            return s.str();
+          }
+        }
+        catch (Exception&)
+        {
+          // Malformed note, fall back to hashing
+          s.str("");
+        }
+      }
+
+      // FNV-1a over the names and contents of the debug sections
+      uint64_t hash = 0xcbf29ce484222325ULL;
+      for (auto& sec : sections)
+      {
+        if (sec.first.compare(0, 6, ".debug") != 0) continue;
+        ByteCursor cursor = sec.second->getCursor();
+        for (auto c : sec.first)
+        {
+          hash = (hash ^ (uint8_t)c) * 0x100000001b3ULL;
+        }
+        const uint8_t* data = cursor.current();
+        for (size_t i = 0; i < cursor.size(); ++i)
+        {
+          hash = (hash ^ data[i]) * 0x100000001b3ULL;
+        }
+      }
+      s << "h-" << std::setw(16) << hash;
+      return s.str();
+    }
+
+    bool IndexCache::load(LineTable& lines, std::vector<uint64_t>& entries, bool& hasEntries)
+    {
+      if (lines.size() != 0 || lines.numFiles() != 0) return false;
+
+      int fd = open(path.c_str(), O_RDONLY);
+      if (fd < 0) return false;
+
+      struct stat st;
+      if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(Header))
+      {
+        close(fd);
+        return false;
+      }
+      size_t size = st.st_size;
+
+      void* addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+      close(fd);
+      if (addr == MAP_FAILED) return false;
+
+      std::shared_ptr<const void> mapping(addr,
+          [size](const void* p) { munmap(const_cast<void*>(p), size); });
+
+      const uint8_t* base = static_cast<const uint8_t*>(addr);
+      const Header* header = static_cast<const Header*>(addr);
+
+      if (memcmp(header->magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0 ||
+          header->version != FORMAT_VERSION || header->byteOrder != INDEX_BYTE_ORDER)
+      {
+        return false;
+      }
+
+      // Check the counts against the file size before using any of them
+      size_t remaining = size - sizeof(Header);
+      uint64_t numRows = header->numRows;
+      uint64_t numRanges = header->numRanges;
+      uint64_t numEntries = header->numEntries;
+      if (numRows > remaining / (2*sizeof(uint64_t) + sizeof(uint32_t))) return false;
+      remaining -= numRows * (2*sizeof(uint64_t) + sizeof(uint32_t));
+      if (numRanges > remaining / sizeof(LineTable::LineRange)) return false;
+      remaining -= numRanges * sizeof(LineTable::LineRange);
+      if (numEntries > remaining / sizeof(uint64_t)) return false;
+      remaining -= numEntries * sizeof(uint64_t);
+      if (header->numFiles > remaining) return false;
+      remaining -= header->numFiles;
+      if (header->namesSize != remaining) return false;
+
+      const uint8_t* pos = base + sizeof(Header);
+      const uint64_t* addrs = reinterpret_cast<const uint64_t*>(pos);
+      pos += numRows * sizeof(uint64_t);
+      const uint64_t* rows = reinterpret_cast<const uint64_t*>(pos);
+      pos += numRows * sizeof(uint64_t);
+      const LineTable::LineRange* ranges = reinterpret_cast<const LineTable::LineRange*>(pos);
+      pos += numRanges * sizeof(LineTable::LineRange);
+      const uint64_t* entryPCs = reinterpret_cast<const uint64_t*>(pos);
+      pos += numEntries * sizeof(uint64_t);
+      const uint32_t* fileIds = reinterpret_cast<const uint32_t*>(pos);
+      pos += numRows * sizeof(uint32_t);
+      const uint8_t* sources = pos;
+      pos += header->numFiles;
+      const char* names = reinterpret_cast<const char*>(pos);
+
+      std::vector<std::string> files;
+      std::set<std::string> seen;
+      const char* name = names;
+      const char* namesEnd = names + header->namesSize;
+      while (name < namesEnd)
+      {
+        const char* nameEnd = static_cast<const char*>(memchr(name, '\0', namesEnd - name));
+        if (nameEnd == nullptr) return false;
+        files.push_back(std::string(name, nameEnd));
+        if (!seen.insert(files.back()).second) return false;
+        name = nameEnd + 1;
+      }
+      if (files.size() != header->numFiles) return false;
+
+      for (uint64_t i = 0; i < numRows; ++i)
+      {
+        if (fileIds[i] >= files.size()) return false;
+      }
+      for (uint64_t i = 0; i < numRanges; ++i)
+      {
+        if (ranges[i].file >= files.size()) return false;
+      }
+
+      for (uint32_t i = 0; i < files.size(); ++i)
+      {
+        lines.internFile(files[i]);
+        if (sources[i]) lines.markSource(i);
+      }
+      lines.assign(addrs, rows, fileIds, numRows, ranges, numRanges, mapping);
+
+      hasEntries = header->hasEntries != 0;
+      entries.assign(entryPCs, entryPCs + numEntries);
+
+      return true;
+    }
+
+    bool IndexCache::store(LineTable& lines, const std::vector<uint64_t>* entries)
+    {
+      if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) return false;
+
+      std::string names;
+      std::vector<uint8_t> sources(lines.numFiles());
+      for (uint32_t i = 0; i < lines.numFiles(); ++i)
+      {
+        names += lines.fileName(i);
+        names += '\0';
+        sources[i] = lines.isSource(i) ? 1 : 0;
+      }
+
+      Header header;
+      memcpy(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+      header.version = FORMAT_VERSION;
+      header.numFiles = lines.numFiles();
+      header.byteOrder = INDEX_BYTE_ORDER;
+      header.numRows = lines.size();
+      header.numRanges = lines.numRanges();
+      header.numEntries = (entries != nullptr) ? entries->size() : 0;
+      header.namesSize = names.size();
+      header.hasEntries = (entries != nullptr) ? 1 : 0;
+
+      std::vector<std::pair<const void*, size_t> > parts = {
+        {&header, sizeof(header)},
+        {lines.pcData(), lines.size() * sizeof(uint64_t)},
+        {lines.rowData(), lines.size() * sizeof(uint64_t)},
+        {lines.rangeData(), lines.numRanges() * sizeof(LineTable::LineRange)},
+        {(entries != nullptr) ? entries->data() : nullptr, header.numEntries * sizeof(uint64_t)},
+        {lines.fileData(), lines.size() * sizeof(uint32_t)},
+        {sources.data(), sources.size()},
+        {names.data(), names.size()}
+      };
+
+      // Written under a temporary name so concurrent sessions only
+      //  ever map a complete index
+      auto tmp = getTempFile(path, false);
+      if (tmp.first < 0) return false;
+
+      bool ok = true;
+      for (auto& part : parts)
+      {
+        const uint8_t* data = static_cast<const uint8_t*>(part.first);
+        size_t left = part.second;
+        while (ok && left > 0)
+        {
+          ssize_t written = write(tmp.first, data, left);
+          if (written < 0 && errno == EINTR) continue;
+          if (written <= 0)
+          {
+            ok = false;
+            break;
+          }
+          data += written;
+          left -= written;
+        }
+      }
+      close(tmp.first);
+
+      if (ok && chmod(tmp.second.c_str(), 0644) == 0 &&
+          rename(tmp.second.c_str(), path.c_str()) == 0)
+      {
+        return true;
+      }
+      unlink(tmp.second.c_str());
+      return false;
+    }
+
+  } /* namespace dwarf */
+} /* namespace penguinTrace */
@@ -0,0 +1,76 @@
+// ----------------------------------------------------------------
+// Copyright (C) 2019 Alex Beharrell
+//
+// This file is part of penguinTrace.
+//
+// penguinTrace is free software: you can redistribute it and/or
+// modify it under the terms of the GNU Affero General Public
+// License as published by the Free Software Foundation, either
+// version 3 of the License, or any later version.
+//
+// penguinTrace is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public
+// License along with penguinTrace. If not, see
+// <https://www.gnu.org/licenses/>.
+// ----------------------------------------------------------------
+//
+// Cache of Debug Information Indices
+
+#ifndef DWARF_INDEXCACHE_H_
+#define DWARF_INDEXCACHE_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "LineTable.h"
+#include "../object/Parser.h"
+
+namespace penguinTrace
+{
+  namespace dwarf
+  {
+
+    // Indices built from the debug information of a binary, kept in a
+    //  directory so later sessions for the same binary can map them
+    //  instead of parsing. Files are named by the GNU build ID, or by a
+    //  hash of the debug sections for binaries without one.
+    class IndexCache
+    {
+      public:
+        IndexCache(std::string dir, object::Parser* parser);
+        // Line table and, if they were stored, function entry addresses.
+        //  The line table must be empty.
+        bool load(LineTable& lines, std::vector<uint64_t>& entries, bool& hasEntries);
+        bool store(LineTable& lines, const std::vector<uint64_t>* entries);
+        std::string getPath()
+        {
+          return path;
+        }
+      private:
+        static const uint32_t FORMAT_VERSION = 1;
+        struct Header
+        {
+          char     magic[8];
+          uint32_t version;
+          uint32_t numFiles;
+          uint64_t byteOrder;
+          uint64_t numRows;
+          uint64_t numRanges;
+          uint64_t numEntries;
+          uint64_t namesSize;
+          uint64_t hasEntries;
+        };
+        static std::string key(object::Parser* parser);
+        std::string dir;
+        std::string path;
+    };
+
+  } /* namespace dwarf */
+} /* namespace penguinTrace */
+
+#endif /* DWARF_INDEXCACHE_H_ */
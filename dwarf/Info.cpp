@@ -23,8 +23,15 @@
 #include "Info.h"
 
 #include <sstream>
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <fstream>
+#include <thread>
 
+#include "../common/Config.h"
 #include "../common/StreamOperations.h"
+#include "../object/ParserFactory.h"
 
 namespace penguinTrace
 {
@@ -33,8 +40,8 @@ namespace penguinTrace
 
     Info::Info(penguinTrace::object::Parser* p,
         std::unique_ptr<ComponentLogger> logger) :
-        parsed(false), parsedLine(false), parsedSections(false),
-        parser(p), cuSrcName(""), logger(std::move(logger))
+        parsed(false), parsedLine(false), parsedSections(false), parsedEntries(false),
+        parsedNames(false), parser(p), cuSrcName(""), cuSrcFile(LineTable::NO_FILE), logger(std::move(logger)), mainCu(nullptr)
     {
 
     }
@@ -69,10 +76,10 @@ namespace penguinTrace
       logger->log(Logger::DBG, "Line Program:");
 
       unsigned lineMax = 9;
-      for (auto it : locationByPc)
+      for (size_t row = 0; row < lines.size(); ++row)
       {
-        lineMax = (it.second.filename().size() > lineMax) ?
-            it.second.filename().size() : lineMax;
+        lineMax = (lines.fileName(lines.file(row)).size() > lineMax) ?
+            lines.fileName(lines.file(row)).size() : lineMax;
       }
       std::stringstream lnHdr;
       lnHdr << StringPad("PC", 11);
@@ -81,13 +88,13 @@ namespace penguinTrace
       lnHdr << StringPad("Column", 5);
       logger->log(Logger::DBG, lnHdr.str());
 
-      for (auto it : locationByPc)
+      for (size_t row = 0; row < lines.size(); ++row)
       {
         std::stringstream s;
-        s << HexPrint(it.second.pc(), 8) << ' ';
-        s << StringPad(it.second.filename(), lineMax);
-        s << std::setw(5) << it.second.line();
-        s << std::setw(5) << it.second.column();
+        s << HexPrint(lines.pc(row), 8) << ' ';
+        s << StringPad(lines.fileName(lines.file(row)), lineMax);
+        s << std::setw(5) << lines.line(row);
+        s << std::setw(5) << lines.column(row);
 
         logger->log(Logger::DBG, s.str());
       }
@@ -98,12 +105,15 @@ namespace penguinTrace
       lnHdr2 << StringPad("PC", 11);
       logger->log(Logger::DBG, lnHdr2.str());
 
-      for (auto it : locationByLine)
+      auto srcRanges = lines.fileRanges(cuSrcFile);
+      for (auto it = srcRanges.first; it != srcRanges.second; ++it)
       {
         std::stringstream s;
-        s << std::setw(5) << it.second.line();
+        s << std::setw(5) << it->line;
         s << ' ';
-        s << HexPrint(it.second.pc(), 8);
+        s << HexPrint(it->low, 8);
+        s << '-';
+        s << HexPrint(it->high, 8);
         logger->log(Logger::DBG, s.str());
       }
 
@@ -116,13 +126,13 @@ namespace penguinTrace
         s << "Compilation Unit @";
         s << HexPrint(it->first, 2) << std::endl;
 
-        for (auto jt = it->second.begin(); jt != it->second.end(); ++jt)
+        for (auto& jt : it->second.Entries())
         {
-          auto attrs = jt->second.GetAttrs();
+          auto attrs = jt.second->GetAttrs();
 
-          s << "  Abbrev Code <" << jt->first << "> ";
-          s << dwarf_t::tag_str(jt->second.GetTag()) << " ";
-          s << dwarf_t::children_str(jt->second.HasChildren());
+          s << "  Abbrev Code <" << jt.first << "> ";
+          s << dwarf_t::tag_str(jt.second->GetTag()) << " ";
+          s << dwarf_t::children_str(jt.second->HasChildren());
           s << std::endl;
 
           for (auto kt = attrs.begin(); kt != attrs.end(); ++kt)
@@ -136,6 +146,8 @@ namespace penguinTrace
 
       logger->log(Logger::DBG, "DIEs:");
 
+      loadAllUnits();
+
       logger->log(Logger::DBG, info->toString());
 
       logger->log(Logger::DBG, "");
@@ -169,6 +181,21 @@ namespace penguinTrace
 
         sectionAddrs[it->first] = it->second->getAddress();
       }
+
+      // Compressed sections needed to index the units are decompressed
+      //  together, the rest only when first used
+      std::vector<object::Parser::SectionPtr> compressed;
+      for (auto section : {dwarf_t::DW_SECTION_info, dwarf_t::DW_SECTION_abbrev,
+                           dwarf_t::DW_SECTION_aranges, dwarf_t::DW_SECTION_addr,
+                           dwarf_t::DW_SECTION_str, dwarf_t::DW_SECTION_str_offsets,
+                           dwarf_t::DW_SECTION_line_str})
+      {
+        auto it = sections.find(section);
+        if (it != sections.end() && it->second->isLazy()) compressed.push_back(it->second);
+      }
+      runWorkers(std::min<size_t>(parseThreads(), compressed.size()), compressed.size(),
+          [&compressed](size_t i, unsigned) { compressed[i]->load(); });
+
       parsedSections = true;
     }
 
@@ -178,55 +205,75 @@ namespace penguinTrace
       if (!parsedSections) parseSections();
       if (!parsedLine) parseLineSection();
 
-      parseAddrTable();
-      parseAbbrev();
-      parseFrame();
-      parseInfo();
-
-      auto cuDie = info->getMainCu();
-      if (cuDie != nullptr)
+      if (parseThreads() > 1)
       {
-        if (cuDie->getTag() == dwarf_t::DW_TAG_compile_unit && cuDie->hasName())
+        // Frames are independent of the other sections, so they are
+        // parsed while the calling thread reads abbreviations
+        std::exception_ptr frameError;
+        std::thread frameThread([this, &frameError]()
         {
-          cuSrcName = cuDie->getName();
-        }
+          try
+          {
+            parseFrame();
+          }
+          catch (...)
+          {
+            frameError = std::current_exception();
+          }
+        });
+        parseAbbrev();
+        frameThread.join();
+        if (frameError) std::rethrow_exception(frameError);
+      }
+      else
+      {
+        parseAbbrev();
+        parseFrame();
       }
+      indexUnits();
 
-      for (auto it : locationByPc)
+      mainCu = mainUnit();
+      if (mainCu != nullptr)
       {
-        if (it.second.filename() == cuSrcName)
+        if (mainCu->getTag() == dwarf_t::DW_TAG_compile_unit && mainCu->hasName())
         {
-          // Only store first location by line
-          if (locationByLine.find(it.second.line()) == locationByLine.end())
-          {
-            locationByLine.insert({it.second.line(), it.second});
-          }
+          cuSrcName = mainCu->getName();
         }
       }
 
+      // Unit name may be relative to the compilation directory
+      cuSrcFile = lines.findFile(cuSrcName);
+      if (cuSrcFile != LineTable::NO_FILE)
+      {
+        cuSrcName = lines.fileName(cuSrcFile);
+        lines.markSource(cuSrcFile);
+      }
+
       parsed = true;
     }
 
+    Info::CodeLocation Info::lineRow(size_t row)
+    {
+      return CodeLocation(lines.pc(row), &lines.fileName(lines.file(row)), lines.line(row),
+                          lines.column(row), lines.prologueEnd(row), lines.epilogueBegin(row));
+    }
+
     Info::CodeLocation Info::locationByPC(uint64_t pc, bool matchSrc)
     {
       if (!parsedLine) parseLineSection();
 
-      auto it = locationByPc.find(pc);
+      size_t row = lines.lowerBound(pc);
 
-      if (it != locationByPc.end())
+      if ((row < lines.size()) && (lines.pc(row) == pc))
       {
-        if (matchSrc && cuSrcName.size() > 0 && it->second.filename() != cuSrcName) return CodeLocation();
-        return it->second;
+        if (matchSrc && !inSource(row)) return CodeLocation();
+        return lineRow(row);
       }
-      else
+      else if ((row < lines.size()) && (row > 0))
       {
-        it = locationByPc.lower_bound(pc);
-        if (it != locationByPc.end() && it != locationByPc.begin())
-        {
-          --it;
-          if (matchSrc && cuSrcName.size() > 0 && it->second.filename() != cuSrcName) return CodeLocation();
-          return it->second;
-        }
+        --row;
+        if (matchSrc && !inSource(row)) return CodeLocation();
+        return lineRow(row);
       }
 
       return CodeLocation();
@@ -236,12 +283,12 @@ namespace penguinTrace
     {
       if (!parsedLine) parseLineSection();
 
-      auto it = locationByPc.find(pc);
+      size_t row = lines.find(pc);
 
-      if (it != locationByPc.end())
+      if (row < lines.size())
       {
-        if (cuSrcName.size() > 0 && it->second.filename() != cuSrcName) return CodeLocation();
-        return it->second;
+        if (!inSource(row)) return CodeLocation();
+        return lineRow(row);
       }
 
       return CodeLocation();
@@ -252,17 +299,72 @@ namespace penguinTrace
       if (!parsed) parse();
 
       // Location by line only in source
+      return locationByFileLine(cuSrcFile, line);
+    }
+
+    Info::CodeLocation Info::exactLocationByLine(const std::string& file, uint64_t line)
+    {
+      if (!parsed) parse();
+
+      return locationByFileLine(lines.findFile(file), line);
+    }
+
+    Info::CodeLocation Info::locationByFileLine(uint32_t file, uint64_t line)
+    {
+      if (file == LineTable::NO_FILE) return CodeLocation();
 
-      auto it = locationByLine.find(line);
+      // First address generated for the line
+      auto range = lines.lineRanges(file, line);
 
-      if (it != locationByLine.end())
+      if (range.first != range.second)
       {
-        return it->second;
+        return lineRow(lines.find(range.first->low));
       }
 
       return CodeLocation();
     }
 
+    void Info::lineAddresses(uint64_t low, uint64_t high, std::set<uint64_t>& addrs)
+    {
+      if (!parsed) parse();
+
+      for (size_t row = lines.lowerBound(low);
+           row < lines.size() && lines.pc(row) < high; ++row)
+      {
+        if (isLineAddress(lines.pc(row)))
+        {
+          addrs.insert(lines.pc(row));
+        }
+      }
+    }
+
+    void Info::functionEntries(std::set<uint64_t>& addrs)
+    {
+      if (!parsed) parse();
+
+      if (!parsedEntries)
+      {
+        // Functions of every unit with line information, so stepping
+        //  can stop in other translation units
+        loadAllUnits();
+        for (auto& u : units)
+        {
+          std::list<DIE*> functions;
+          if (u.second.die != nullptr) u.second.die->functions(functions);
+          for (auto f : functions)
+          {
+            if (isLineAddress(f->lowPC()))
+            {
+              entryPCs.push_back(f->lowPC());
+            }
+          }
+        }
+        parsedEntries = true;
+        storeIndex(true);
+      }
+      addrs.insert(entryPCs.begin(), entryPCs.end());
+    }
+
     void Info::parseAbbrev()
     {
       if (sections.find(dwarf_t::DW_SECTION_abbrev) == sections.end())
@@ -273,317 +375,1322 @@ namespace penguinTrace
       assert(sections.find(dwarf_t::DW_SECTION_abbrev) != sections.end());
 
       auto abbrevSection = sections[dwarf_t::DW_SECTION_abbrev];
-      auto abbrevStream = abbrevSection->getContents();
-      std::istream is(&abbrevStream);
+      ByteCursor cursor = abbrevSection->getCursor();
 
-      bool done = false;
+      while (!cursor.eof())
+      {
+        // Create map for this CU
+        uint64_t cuOffset = cursor.tell();
+        parseAbbrevTable(cursor, abbrevTable[cuOffset]);
+      }
+    }
 
-      uint64_t cuIndex = 0;
+    // Reads the abbreviations of one unit, up to the terminating code
+    void Info::parseAbbrevTable(ByteCursor& cursor, AbbrevTable& table)
+    {
+      bool cuDone = false;
 
-      while (!done)
+      while (!cuDone && !cursor.eof())
       {
-        // Done for compilation unit
-        bool cuDone = false;
-        uint64_t cuOffset = is.tellg();
+        uint64_t abbrevCode = ExtractULEB128(cursor);
 
-        // Create map for this CU
-        abbrevTable[cuOffset];
+        if (abbrevCode == 0)
+        {
+          cuDone = true;
+          continue;
+        }
 
-        while (!cuDone)
+        uint64_t abbrevTag = ExtractULEB128(cursor);
+        dwarf_t::tag_t tag = dwarf_t::convert_tag(abbrevTag);
+
+        uint8_t abbrevHasChildren = ExtractUInt8(cursor);
+        dwarf_t::children_t hasChildren = dwarf_t::convert_children(abbrevHasChildren);
+
+        AbbrevTableEntry* entry = table.Insert(abbrevCode, AbbrevTableEntry(tag, hasChildren));
+
+        bool entryDone = false;
+
+        while (!entryDone)
         {
-          uint64_t abbrevCode = ExtractULEB128(is);
+          uint64_t attribName = ExtractULEB128(cursor);
+          uint64_t attribForm = ExtractULEB128(cursor);
+          dwarf_t::at_t name = dwarf_t::convert_at(attribName);
+          dwarf_t::form_t form = dwarf_t::convert_form(attribForm);
 
-          if (abbrevCode == 0)
+          entryDone = (attribName == 0) && (attribForm == 0);
+
+          if (!entryDone)
           {
-            cuDone = true;
-            continue;
+            if (form == dwarf_t::DW_FORM_implicit_const)
+            {
+              int64_t c = ExtractSLEB128(cursor);
+              // Add attrib to entry
+              entry->AddAttrib( AbbrevAttrib(name, form, c) );
+            }
+            else
+            {
+              // Add attrib to entry
+              entry->AddAttrib( AbbrevAttrib(name, form) );
+            }
           }
+        }
+        entry->Finish();
+      }
+    }
+
+    AttrValue Info::parseAttribute(dwarf_t::form_t form, int64_t implicitConst,
+                                   CompilationUnitHeader& header, ByteCursor& cursor,
+                                   SectionMap& unitSections)
+    {
+      std::vector<uint8_t> tmpBuffer;
+      uint64_t tmpOffset;
 
-          uint64_t abbrevTag = ExtractULEB128(is);
-          dwarf_t::tag_t tag = dwarf_t::convert_tag(abbrevTag);
+      switch (form)
+      {
+        case dwarf_t::DW_FORM_strp:
+          return AttrValue(form, ExtractStrp(header.Arch(), cursor, unitSections, dwarf_t::DW_SECTION_str));
+        case dwarf_t::DW_FORM_line_strp:
+          return AttrValue(form, ExtractStrp(header.Arch(), cursor, unitSections, dwarf_t::DW_SECTION_line_str));
+        case dwarf_t::DW_FORM_string:
+          return AttrValue(form, ExtractString(cursor));
+        case dwarf_t::DW_FORM_udata:
+          // Data length is based on maximum
+          return AttrValue(form, ExtractULEB128(cursor), 8, false);
+        case dwarf_t::DW_FORM_sdata:
+          // Data length is based on maximum
+          return AttrValue(form, ExtractSLEB128(cursor), 8, true);
+        case dwarf_t::DW_FORM_data1:
+          return AttrValue(form, ExtractUInt8(cursor), 1, false);
+        case dwarf_t::DW_FORM_data2:
+          return AttrValue(form, ExtractUInt16(cursor), 2, false);
+        case dwarf_t::DW_FORM_data4:
+          return AttrValue(form, ExtractUInt32(cursor), 4, false);
+        case dwarf_t::DW_FORM_data8:
+          return AttrValue(form, ExtractUInt64(cursor), 8, false);
+        case dwarf_t::DW_FORM_addr:
+          return AttrValue(form, ExtractNumBytes(cursor, header.AddrBytes()),
+              header.AddrBytes(), false);
+        case dwarf_t::DW_FORM_ref_addr:
+          // In DWARFv2, size of address on target
+          // In DWARFv3/4, depends on DWARF arch
+          if (header.Version() == 2)
+          {
+            return AttrValue(form, ExtractNumBytes(cursor, sizeof(void*)),
+                sizeof(void*), false);
+          }
+          else
+          {
+            return AttrValue(form, ExtractSectionOffset(cursor, header.Arch()),
+                ((header.Arch() == dwarf::DWARF64) ? 8 : 4), false);
+          }
+          break;
+        case dwarf_t::DW_FORM_sec_offset:
+          return AttrValue(form, ExtractSectionOffset(cursor, header.Arch()),
+              ((header.Arch() == dwarf::DWARF64) ? 8 : 4), false);
+        case dwarf_t::DW_FORM_flag:
+          return AttrValue(form, ExtractUInt8(cursor) != 0);
+        case dwarf_t::DW_FORM_flag_present:
+          return AttrValue(form, true);
+        case dwarf_t::DW_FORM_ref4:
+          return AttrValue(form, ExtractUInt32(cursor)+header.DieBase(), 4, false);
+        case dwarf_t::DW_FORM_block1:
+          ExtractBlock(cursor, tmpBuffer, 1);
+          return AttrValue(form, tmpBuffer);
+        case dwarf_t::DW_FORM_exprloc:
+          ExtractExprLoc(cursor, tmpBuffer);
+          return AttrValue(form, tmpBuffer);
+        case dwarf_t::DW_FORM_implicit_const:
+          return AttrValue(form, implicitConst);
+        case dwarf_t::DW_FORM_strx:
+          tmpOffset = ExtractULEB128(cursor);
+          return AttrValue(form, ExtractIndirectStrp(tmpOffset, header.StrOffset(), header.Arch(), unitSections, dwarf_t::DW_SECTION_str_offsets, dwarf_t::DW_SECTION_str));
+        case dwarf_t::DW_FORM_strx1:
+          tmpOffset = ExtractUInt8(cursor);
+          return AttrValue(form, ExtractIndirectStrp(tmpOffset, header.StrOffset(), header.Arch(), unitSections, dwarf_t::DW_SECTION_str_offsets, dwarf_t::DW_SECTION_str));
+        case dwarf_t::DW_FORM_strx2:
+          tmpOffset = ExtractUInt16(cursor);
+          return AttrValue(form, ExtractIndirectStrp(tmpOffset, header.StrOffset(), header.Arch(), unitSections, dwarf_t::DW_SECTION_str_offsets, dwarf_t::DW_SECTION_str));
+        case dwarf_t::DW_FORM_strx4:
+          tmpOffset = ExtractUInt32(cursor);
+          return AttrValue(form, ExtractIndirectStrp(tmpOffset, header.StrOffset(), header.Arch(), unitSections, dwarf_t::DW_SECTION_str_offsets, dwarf_t::DW_SECTION_str));
+        case dwarf_t::DW_FORM_addrx:
+          return AttrValue(form, indexedAddress(header, ExtractULEB128(cursor)), header.AddrBytes(), false);
+        case dwarf_t::DW_FORM_addrx1:
+          return AttrValue(form, indexedAddress(header, ExtractUInt8(cursor)), header.AddrBytes(), false);
+        case dwarf_t::DW_FORM_addrx2:
+          return AttrValue(form, indexedAddress(header, ExtractUInt16(cursor)), header.AddrBytes(), false);
+        case dwarf_t::DW_FORM_addrx4:
+          return AttrValue(form, indexedAddress(header, ExtractUInt32(cursor)), header.AddrBytes(), false);
+        case dwarf_t::DW_FORM_loclistx:
+        case dwarf_t::DW_FORM_rnglistx:
+          // Index resolved when the list is read
+          return AttrValue(form, ExtractULEB128(cursor), 8, false);
+        default:
+          throw Exception("Unhandled: "+dwarf_t::form_str(form), __EINFO__);
+      }
+    }
 
-          uint8_t abbrevHasChildren = is.get();
-          dwarf_t::children_t hasChildren = dwarf_t::convert_children(abbrevHasChildren);
+    AttrValue Info::decodeAttribute(DIEAttr& attr, CompilationUnitHeader& header,
+                                    SectionMap& unitSections)
+    {
+      ByteCursor cursor = unitSections.find(dwarf_t::DW_SECTION_info)->second->getCursor();
+      if (attr.form != dwarf_t::DW_FORM_implicit_const) cursor.seek(attr.offset);
+      return parseAttribute(attr.form, attr.offset, header, cursor, unitSections);
+    }
 
-          auto it = abbrevTable[cuOffset].insert(
-              {abbrevCode, AbbrevTableEntry(tag, hasChildren)}
-          );
+    LocationList* Info::locationList(AttrValue& attr, DIEUnit& context, Unit& unit,
+                                     SectionMap& unitSections)
+    {
+      bool v5 = context.header.Version() >= 5;
+      auto sectionIt = unitSections.find(v5 ? dwarf_t::DW_SECTION_loclists : dwarf_t::DW_SECTION_loc);
+      if ((sectionIt == unitSections.end()) || (unit.die == nullptr))
+      {
+        return nullptr;
+      }
+      DIE* unitDie = unit.die;
+      ByteCursor cursor = sectionIt->second->getCursor();
 
-          AbbrevTableEntry* entry = &(it.first->second);
+      uint64_t offset = attr.getInt();
+      if (attr.form() == dwarf_t::DW_FORM_loclistx)
+      {
+        // Index into the offsets that follow the list table header
+        uint8_t offsetBytes = (context.header.Arch() == dwarf::DWARF64) ? 8 : 4;
+        auto baseAttr = unitDie->getAttribute(dwarf_t::DW_AT_loclists_base);
+        uint64_t base = baseAttr.first ? baseAttr.second.getInt() : ((offsetBytes == 8) ? 20 : 12);
+        cursor.seek(base + offset*offsetBytes);
+        offset = base + ExtractNumBytes(cursor, offsetBytes);
+      }
 
-          bool entryDone = false;
+      auto cached = context.locLists.find(offset);
+      if (cached != context.locLists.end()) return cached->second.get();
 
-          while (!entryDone)
-          {
-            uint64_t attribName = ExtractULEB128(is);
-            uint64_t attribForm = ExtractULEB128(is);
-            dwarf_t::at_t name = dwarf_t::convert_at(attribName);
-            dwarf_t::form_t form = dwarf_t::convert_form(attribForm);
+      // Offsets in the list are relative to the unit's base address,
+      //  which the skeleton holds for a split unit
+      DIE* baseDie = (unit.skeleton != nullptr) ? unit.skeleton : unitDie;
+      uint64_t base = baseDie->hasAttr(dwarf_t::DW_AT_low_pc) ? baseDie->lowPC() : 0;
+      std::unique_ptr<LocationList> list(new LocationList());
+      cursor.seek(offset);
+      if (v5)
+      {
+        readLocLists(cursor, context.header, base, *list);
+      }
+      else
+      {
+        readLoc(cursor, context.header, base, *list);
+      }
+      list->build();
 
-            entryDone = (attribName == 0) && (attribForm == 0);
+      LocationList* result = list.get();
+      context.locLists.insert(std::make_pair(offset, std::move(list)));
+      return result;
+    }
 
-            if (!entryDone)
-            {
-              if (form == dwarf_t::DW_FORM_implicit_const)
-              {
-                int64_t c = ExtractSLEB128(is);
-                // Add attrib to entry
-                entry->AddAttrib( AbbrevAttrib(name, form, c) );
-              }
-              else
-              {
-                // Add attrib to entry
-                entry->AddAttrib( AbbrevAttrib(name, form) );
-              }
-            }
+    void Info::readLoc(ByteCursor& cursor, CompilationUnitHeader& header,
+                       uint64_t base, LocationList& list)
+    {
+      uint64_t baseSelect = (header.AddrBytes() == 8) ? UINT64_MAX : UINT32_MAX;
+
+      while (!cursor.eof())
+      {
+        uint64_t start = ExtractNumBytes(cursor, header.AddrBytes());
+        uint64_t end   = ExtractNumBytes(cursor, header.AddrBytes());
+
+        if ((start == 0) && (end == 0)) break;
+
+        if (start == baseSelect)
+        {
+          base = end;
+          continue;
+        }
+
+        uint16_t length = ExtractUInt16(cursor);
+        const uint8_t* expr = cursor.current();
+        cursor.skip(length);
+        list.add(base + start, base + end, Expression(expr, length, header.Arch()));
+      }
+    }
+
+    void Info::readLocLists(ByteCursor& cursor, CompilationUnitHeader& header,
+                            uint64_t base, LocationList& list)
+    {
+      bool done = false;
+
+      while (!done && !cursor.eof())
+      {
+        dwarf_t::lle_t kind = dwarf_t::convert_lle(ExtractUInt8(cursor));
+        uint64_t low = 0;
+        uint64_t high = 0;
+        bool hasExpr = true;
+        bool isDefault = false;
+
+        switch (kind)
+        {
+          case dwarf_t::DW_LLE_end_of_list:
+            done = true;
+            hasExpr = false;
+            break;
+          case dwarf_t::DW_LLE_base_addressx:
+            base = indexedAddress(header, ExtractULEB128(cursor));
+            hasExpr = false;
+            break;
+          case dwarf_t::DW_LLE_startx_endx:
+            low  = indexedAddress(header, ExtractULEB128(cursor));
+            high = indexedAddress(header, ExtractULEB128(cursor));
+            break;
+          case dwarf_t::DW_LLE_startx_length:
+            low  = indexedAddress(header, ExtractULEB128(cursor));
+            high = low + ExtractULEB128(cursor);
+            break;
+          case dwarf_t::DW_LLE_offset_pair:
+            low  = base + ExtractULEB128(cursor);
+            high = base + ExtractULEB128(cursor);
+            break;
+          case dwarf_t::DW_LLE_default_location:
+            isDefault = true;
+            break;
+          case dwarf_t::DW_LLE_base_address:
+            base = ExtractNumBytes(cursor, header.AddrBytes());
+            hasExpr = false;
+            break;
+          case dwarf_t::DW_LLE_start_end:
+            low  = ExtractNumBytes(cursor, header.AddrBytes());
+            high = ExtractNumBytes(cursor, header.AddrBytes());
+            break;
+          case dwarf_t::DW_LLE_start_length:
+            low  = ExtractNumBytes(cursor, header.AddrBytes());
+            high = low + ExtractULEB128(cursor);
+            break;
+          default:
+            throw Exception("Unknown location list entry", __EINFO__);
+        }
+
+        if (hasExpr)
+        {
+          uint64_t length = ExtractULEB128(cursor);
+          const uint8_t* expr = cursor.current();
+          cursor.skip(length);
+          if (isDefault)
+          {
+            list.setDefault(Expression(expr, length, header.Arch()));
+          }
+          else
+          {
+            list.add(low, high, Expression(expr, length, header.Arch()));
           }
         }
+      }
+    }
 
-        cuIndex++;
+    // Split units share the executable's .debug_addr
+    uint64_t Info::indexedAddress(CompilationUnitHeader& header, uint64_t index)
+    {
+      auto addrSectionIt = sections.find(dwarf_t::DW_SECTION_addr);
+      if (addrSectionIt == sections.end())
+      {
+        throw Exception("Address index without a .debug_addr section", __EINFO__);
+      }
+
+      ByteCursor cursor = addrSectionIt->second->getCursor();
+      cursor.seek(header.AddrBase() + index*header.AddrBytes());
+      return ExtractNumBytes(cursor, header.AddrBytes());
+    }
 
-        is.peek();
-        done = is.eof();
+    void Info::skipAttribute(dwarf_t::form_t form, CompilationUnitHeader& header,
+                             ByteCursor& cursor)
+    {
+      uint64_t offsetBytes = (header.Arch() == dwarf::DWARF64) ? 8 : 4;
+      switch (form)
+      {
+        case dwarf_t::DW_FORM_flag_present:
+        case dwarf_t::DW_FORM_implicit_const:
+          break;
+        case dwarf_t::DW_FORM_data1:
+        case dwarf_t::DW_FORM_flag:
+        case dwarf_t::DW_FORM_strx1:
+        case dwarf_t::DW_FORM_addrx1:
+          cursor.skip(1);
+          break;
+        case dwarf_t::DW_FORM_data2:
+        case dwarf_t::DW_FORM_strx2:
+        case dwarf_t::DW_FORM_addrx2:
+          cursor.skip(2);
+          break;
+        case dwarf_t::DW_FORM_data4:
+        case dwarf_t::DW_FORM_ref4:
+        case dwarf_t::DW_FORM_strx4:
+        case dwarf_t::DW_FORM_addrx4:
+          cursor.skip(4);
+          break;
+        case dwarf_t::DW_FORM_data8:
+          cursor.skip(8);
+          break;
+        case dwarf_t::DW_FORM_udata:
+        case dwarf_t::DW_FORM_sdata:
+        case dwarf_t::DW_FORM_strx:
+        case dwarf_t::DW_FORM_addrx:
+        case dwarf_t::DW_FORM_loclistx:
+        case dwarf_t::DW_FORM_rnglistx:
+          // Continuation bits are the same for signed and unsigned
+          cursor.uleb128();
+          break;
+        case dwarf_t::DW_FORM_strp:
+        case dwarf_t::DW_FORM_line_strp:
+        case dwarf_t::DW_FORM_sec_offset:
+          cursor.skip(offsetBytes);
+          break;
+        case dwarf_t::DW_FORM_ref_addr:
+          cursor.skip((header.Version() == 2) ? sizeof(void*) : offsetBytes);
+          break;
+        case dwarf_t::DW_FORM_addr:
+          cursor.skip(header.AddrBytes());
+          break;
+        case dwarf_t::DW_FORM_string:
+          cursor.cstr();
+          break;
+        case dwarf_t::DW_FORM_block1:
+          cursor.skip(cursor.u8());
+          break;
+        case dwarf_t::DW_FORM_exprloc:
+          cursor.skip(cursor.uleb128());
+          break;
+        default:
+          throw Exception("Unhandled: "+dwarf_t::form_str(form), __EINFO__);
       }
     }
 
-    void Info::parseAddrTable()
+    // Skips using the size worked out from the abbreviation where possible
+    void Info::skipAttribute(AbbrevAttrib& attr, CompilationUnitHeader& header,
+                             ByteCursor& cursor)
     {
-      if (sections.find(dwarf_t::DW_SECTION_addr) != sections.end())
+      int8_t size = attr.GetSize();
+      if (size >= 0)
+      {
+        cursor.skip(size);
+      }
+      else if (size == AbbrevAttrib::SIZE_ADDR)
+      {
+        cursor.skip(header.AddrBytes());
+      }
+      else if (size == AbbrevAttrib::SIZE_OFFSET)
+      {
+        cursor.skip((header.Arch() == dwarf::DWARF64) ? 8 : 4);
+      }
+      else
       {
-        auto addrSection = sections[dwarf_t::DW_SECTION_addr];
-        auto addrStream = addrSection->getContents();
-        std::istream is(&addrStream);
+        skipAttribute(attr.GetForm(), header, cursor);
+      }
+    }
 
-        ExtractInitialLength(is);
-        ExtractUInt16(is);
-        auto addr_size = ExtractUInt8(is);
-        auto segment_size = ExtractUInt8(is);
-        addrTableSize = addr_size;
+    // Steps over a DIE whose attributes aren't needed
+    void Info::skipAttributes(AbbrevTableEntry& abbrevEntry, CompilationUnitHeader& header,
+                              ByteCursor& cursor)
+    {
+      uint8_t offsetBytes = (header.Arch() == dwarf::DWARF64) ? 8 : 4;
+      uint8_t refAddrBytes = (header.Version() == 2) ? sizeof(void*) : offsetBytes;
+      uint64_t size;
+      if (abbrevEntry.FixedSize(header.AddrBytes(), offsetBytes, refAddrBytes, size))
+      {
+        cursor.skip(size);
+        return;
+      }
+      for (auto& attr : abbrevEntry.GetAttrs())
+      {
+        skipAttribute(attr, header, cursor);
+      }
+    }
 
-        if (segment_size != 0)
+    void Info::readAttributes(AbbrevTableEntry& abbrevEntry, DIEUnit& unit,
+                              ByteCursor& cursor, DIEAttr* attrs)
+    {
+      // Attributes are placed in DW_AT order as they are read
+      for (auto& abbrevAttr : abbrevEntry.GetAttrs())
+      {
+        DIEAttr* attr = attrs + abbrevAttr.GetSlot();
+        attr->at = abbrevAttr.GetAT();
+        attr->form = abbrevAttr.GetForm();
+        if (attr->form == dwarf_t::DW_FORM_implicit_const)
         {
-          logger->log(Logger::ERROR, "Non-zero segment size unsupported");
-          return;
+          attr->offset = abbrevAttr.GetConst();
+          continue;
         }
 
-        is.peek();
-        while (!is.eof())
+        attr->offset = cursor.tell();
+        // Needed to decode the string and address index forms
+        if (attr->at == dwarf_t::DW_AT_str_offsets_base)
+        {
+          unit.header.SetStrOffset(parseAttribute(attr->form, 0, unit.header, cursor, sections).getInt());
+        }
+        else if (attr->at == dwarf_t::DW_AT_addr_base)
         {
-          addrTable.push_back(ExtractNumBytes(is, addr_size));
-          is.peek();
+          unit.header.SetAddrBase(parseAttribute(attr->form, 0, unit.header, cursor, sections).getInt());
+        }
+        else
+        {
+          skipAttribute(abbrevAttr, unit.header, cursor);
         }
       }
     }
 
-    void Info::parseInfo()
+    void Info::indexUnits()
     {
+      dieLogger = logger->subLogger("DIE");
+      dies = DIEMap(std::bind(&Info::loadUnitContaining, this, std::placeholders::_1));
+      info = std::unique_ptr<DIE>(new DIE(0, dwarf_t::DW_TAG_NULL, nullptr, nullptr));
+
       if (sections.find(dwarf_t::DW_SECTION_info) == sections.end())
       {
         logger->log(Logger::ERROR, "No .debug_info section in binary");
         return;
       }
-      assert(sections.find(dwarf_t::DW_SECTION_info) != sections.end());
-
-      auto infoSection = sections[dwarf_t::DW_SECTION_info];
-      auto infoStream = infoSection->getContents();
-      std::istream is(&infoStream);
 
-      is.peek();
+      // Only unit headers are read here, DIEs are parsed on first use
+      ByteCursor cursor = sections[dwarf_t::DW_SECTION_info]->getCursor();
 
-      int cuIndex = 0;
+      while (!cursor.eof())
+      {
+        uint64_t offset = cursor.tell();
+        CompilationUnitHeader header(cursor);
+        units.insert({offset, Unit(header.UnitEnd(), units.size())});
+        cursor.seek(header.UnitEnd());
+      }
 
-      std::shared_ptr<std::map<uint64_t, DIE*> > dies(new std::map<uint64_t, DIE*>());
-      std::shared_ptr<ComponentLogger> dieLogger = logger->subLogger("DIE");
-      DIE* currentDie = new DIE(0, dwarf_t::DW_TAG_NULL, nullptr, dies, frames, DWARF64, dieLogger);
+      std::set<uint64_t> covered;
+      parseAranges(covered);
 
-      while (!is.eof())
+      for (auto& u : units)
       {
-        CompilationUnitHeader header(is);
+        if ((covered.find(u.first) == covered.end()) && !unitRangeFromDIE(u.first))
+        {
+          // Can't tell which addresses this unit covers
+          unrangedUnits.push_back(u.first);
+          loadUnit(u.first);
+        }
+      }
 
-        assert(header.Version() > 2 && "Only DWARFv3/4 supported");
+      logger->log(Logger::DBG, [&]() {
+        std::stringstream s;
+        s << "Units: " << units.size() << ", address ranges: " << unitByAddr.size();
+        s << ", without ranges: " << unrangedUnits.size();
+        return s.str();
+      });
+    }
 
-        auto cuAbbrevTblIt = abbrevTable.find(header.AbbrevOffset());
-        assert(cuAbbrevTblIt != abbrevTable.end());
-        auto cuAbbrevTbl = cuAbbrevTblIt->second;
+    void Info::parseAranges(std::set<uint64_t>& covered)
+    {
+      if (sections.find(dwarf_t::DW_SECTION_aranges) == sections.end()) return;
 
-        bool cuDone = !header.Contains(is.tellg());
+      ByteCursor cursor = sections[dwarf_t::DW_SECTION_aranges]->getCursor();
 
-        while (!cuDone)
+      while (!cursor.eof())
+      {
+        uint64_t setStart = cursor.tell();
+        auto initLen = ExtractInitialLength(cursor);
+        uint64_t setEnd = cursor.tell() + initLen.second;
+        uint16_t version = ExtractUInt16(cursor);
+        uint64_t unitOffset = ExtractSectionOffset(cursor, initLen.first);
+        uint8_t addrSize = ExtractUInt8(cursor);
+        uint8_t segmentSize = ExtractUInt8(cursor);
+
+        if ((version != 2) || (segmentSize != 0) || (units.find(unitOffset) == units.end()))
         {
-          assert((uint64_t)is.tellg() > header.CUHeaderStart());
-          // DIE offsets are not relative to header
-          uint64_t dieOffset = (uint64_t)is.tellg();
-          uint64_t abbrevCode = ExtractULEB128(is);
+          // Unit is treated as having no ranges
+          cursor.seek(setEnd);
+          continue;
+        }
 
-          if (abbrevCode == 0)
+        // Tuples are aligned to twice the address size from the set start
+        uint64_t tupleSize = 2 * addrSize;
+        uint64_t misalign = (cursor.tell() - setStart) % tupleSize;
+        if (misalign != 0) cursor.skip(tupleSize - misalign);
+
+        while (cursor.tell() + tupleSize <= setEnd)
+        {
+          uint64_t addr = ExtractNumBytes(cursor, addrSize);
+          uint64_t length = ExtractNumBytes(cursor, addrSize);
+          if ((addr == 0) && (length == 0)) break;
+          if (length != 0)
           {
-            if (currentDie->getParent() != nullptr)
-            {
-              // Pop - replace current DIE with parent
-              currentDie = currentDie->getParent();
-            }
+            unitByAddr.insert({addr, {addr + length, unitOffset}});
+          }
+        }
+
+        covered.insert(unitOffset);
+        cursor.seek(setEnd);
+      }
+    }
+
+    bool Info::unitRangeFromDIE(uint64_t offset)
+    {
+      ByteCursor cursor = sections[dwarf_t::DW_SECTION_info]->getCursor();
+      cursor.seek(offset);
+      CompilationUnitHeader header(cursor);
+
+      auto cuAbbrevTblIt = abbrevTable.find(header.AbbrevOffset());
+      if (cuAbbrevTblIt == abbrevTable.end()) return false;
+
+      uint64_t dieOffset = cursor.tell();
+      AbbrevTableEntry* abbrevEntryPtr = cuAbbrevTblIt->second.Find(ExtractULEB128(cursor));
+      if (abbrevEntryPtr == nullptr) return false;
+
+      // Only the unit DIE itself is parsed
+      AbbrevTableEntry& abbrevEntry = *abbrevEntryPtr;
+      std::unique_ptr<DIEUnit> context(newContext(header, units.find(offset)->second, sections));
+      std::vector<DIEAttr> attrs(abbrevEntry.GetAttrs().size());
+      readAttributes(abbrevEntry, *context, cursor, attrs.data());
+
+      DIE unitDie(dieOffset, abbrevEntry.GetTag(), nullptr, context.get());
+      unitDie.setAttributes(attrs.data(), attrs.size());
+
+      // Non-contiguous units (DW_AT_ranges) are parsed up front
+      if (unitDie.hasAttr(dwarf_t::DW_AT_ranges) || !unitDie.hasPcRange()) return false;
+
+      unitByAddr.insert({unitDie.lowPC(), {unitDie.highPC(), offset}});
+      return true;
+    }
+
+    DIE* Info::loadUnit(uint64_t offset)
+    {
+      auto unitIt = units.find(offset);
+      assert(unitIt != units.end());
+      Unit& unit = unitIt->second;
+
+      if (unit.loaded) return unit.die;
+      unit.loaded = true;
+
+      UnitDies unitDies;
+      parseUnit(offset, unit, arena, unitDies);
+      finishUnit(unit, unitDies);
+      indexScopes(unit, unitDies);
+
+      return unit.die;
+    }
+
+    // Only touches the unit and arena given, so units can be parsed
+    // concurrently as long as each thread has its own arena
+    void Info::parseUnit(uint64_t offset, Unit& unit, DIEArena& unitArena, UnitDies& unitDies)
+    {
+      ByteCursor cursor = sections.find(dwarf_t::DW_SECTION_info)->second->getCursor();
+      cursor.seek(offset);
+
+      CompilationUnitHeader header(cursor);
+
+      assert(header.Version() > 2 && "Only DWARFv3/4 supported");
+
+      auto cuAbbrevTblIt = abbrevTable.find(header.AbbrevOffset());
+      assert(cuAbbrevTblIt != abbrevTable.end());
+
+      unit.context.reset(newContext(header, unit, sections));
+
+      parseDIEs(cursor, header, cuAbbrevTblIt->second, unit.context.get(), unitArena, unitDies);
+      if (!unitDies.empty()) unit.die = unitDies.front().second;
+
+      if ((unit.die != nullptr) && (unit.die->getTag() == dwarf_t::DW_TAG_skeleton_unit))
+      {
+        parseSplitUnit(unit, unitArena, unitDies);
+      }
+    }
+
+    void Info::parseDIEs(ByteCursor& cursor, CompilationUnitHeader& header, AbbrevTable& abbrevs,
+                         DIEUnit* context, DIEArena& unitArena, UnitDies& unitDies)
+    {
+      // The unit DIE is attached to the shared root in finishUnit
+      DIE* currentDie = info.get();
+
+      bool cuDone = !header.Contains(cursor.tell());
+
+      while (!cuDone)
+      {
+        assert((uint64_t)cursor.tell() > header.CUHeaderStart());
+        // DIE offsets are not relative to header
+        uint64_t dieOffset = header.DieOffset(cursor.tell());
+        uint64_t abbrevCode = ExtractULEB128(cursor);
+
+        if (abbrevCode == 0)
+        {
+          if (currentDie->getParent() != nullptr)
+          {
+            // Pop - replace current DIE with parent
+            currentDie = currentDie->getParent();
+          }
+        }
+        else
+        {
+          AbbrevTableEntry* abbrevEntryPtr = abbrevs.Find(abbrevCode);
+          if (abbrevEntryPtr == nullptr)
+          {
+            logger->log(Logger::ERROR, "Cannot parse debug information (missing abbreviation for DIE)");
+            break;
           }
           else
           {
-            auto abbrevEntryIt = cuAbbrevTbl.find(abbrevCode);
-            if (abbrevEntryIt == cuAbbrevTbl.end())
+            AbbrevTableEntry& abbrevEntry = *abbrevEntryPtr;
+
+            bool nextHasChildren = abbrevEntry.HasChildren() == dwarf_t::DW_CHILDREN_yes;
+
+            DIE* die = unitArena.dies.create(dieOffset, abbrevEntry.GetTag(), currentDie, context);
+            unitDies.push_back( {dieOffset, die} );
+
+            uint32_t numAttrs = abbrevEntry.GetAttrs().size();
+            DIEAttr* attrs = unitArena.attrs.allocate(numAttrs);
+            readAttributes(abbrevEntry, *context, cursor, attrs);
+            die->setAttributes(attrs, numAttrs);
+
+            if (currentDie != info.get()) currentDie->addChild(die);
+            if (nextHasChildren)
             {
-              logger->log(Logger::ERROR, "Cannot parse debug information (missing abbreviation for DIE)");
-              DIE * nullDIE = new DIE(0, dwarf_t::DW_TAG_NULL, nullptr, dies, frames, DWARF64, dieLogger);
-              info = std::unique_ptr<DIE>(nullDIE);
-              return;
+              currentDie = die;
             }
-            else
+          }
+        }
+
+        cuDone = !header.Contains(cursor.tell());
+      }
+    }
+
+    DIEUnit* Info::newContext(CompilationUnitHeader& header, Unit& unit, SectionMap& unitSections)
+    {
+      return new DIEUnit(header, &dies, frames, dieLogger,
+          [this, &unitSections](DIEAttr& attr, CompilationUnitHeader& h)
+          {
+            return decodeAttribute(attr, h, unitSections);
+          },
+          [this, &unit, &unitSections](AttrValue& attr, DIEUnit& context)
+          {
+            return locationList(attr, context, unit, unitSections);
+          },
+          std::bind(&Info::indexedAddress, this, std::placeholders::_1, std::placeholders::_2));
+    }
+
+    // The DIEs of a skeleton unit are in its .dwo file, or a .dwp package
+    // next to the executable, which is only opened when the unit is used
+    void Info::parseSplitUnit(Unit& unit, DIEArena& unitArena, UnitDies& unitDies)
+    {
+      DIE* skeleton = unit.die;
+      CompilationUnitHeader& skeletonHeader = unit.context->header;
+
+      std::unique_ptr<SplitUnit> split(new SplitUnit());
+      if (!findSplitUnit(skeleton, skeletonHeader.DwoId(), *split)) return;
+
+      ByteCursor cursor = split->sections.find(dwarf_t::DW_SECTION_info)->second->getCursor();
+      while (!cursor.eof())
+      {
+        CompilationUnitHeader header(cursor);
+        if ((header.UnitType() != dwarf_t::DW_UT_split_compile) ||
+            (header.DwoId() != skeletonHeader.DwoId()))
+        {
+          cursor.seek(header.UnitEnd());
+          continue;
+        }
+
+        auto abbrevIt = split->sections.find(dwarf_t::DW_SECTION_abbrev);
+        if (abbrevIt == split->sections.end()) break;
+        ByteCursor abbrevCursor = abbrevIt->second->getCursor();
+        abbrevCursor.seek(header.AbbrevOffset());
+        parseAbbrevTable(abbrevCursor, split->abbrevs);
+
+        // Offsets in the split file overlap those in the executable, so the
+        //  DIEs are placed after all of them, in the order of the skeletons
+        header.SetDieBase((1ULL << 63) + (unit.index << 32));
+        // Addresses are in the executable's .debug_addr
+        header.SetAddrBase(skeletonHeader.AddrBase());
+
+        split->context.reset(newContext(header, unit, split->sections));
+        size_t first = unitDies.size();
+        parseDIEs(cursor, header, split->abbrevs, split->context.get(), unitArena, unitDies);
+        if (unitDies.size() > first)
+        {
+          unit.skeleton = skeleton;
+          unit.die = unitDies[first].second;
+          unit.split = std::move(split);
+        }
+        return;
+      }
+
+      logger->log(Logger::WARN, "No split unit matching skeleton at offset "+
+          std::to_string(skeletonHeader.CUHeaderStart()));
+    }
+
+    bool Info::findSplitUnit(DIE* skeleton, uint64_t dwoId, SplitUnit& split)
+    {
+      std::lock_guard<std::mutex> lock(splitMutex);
+
+      std::string exeDir = parser->getFilename();
+      exeDir = (exeDir.find('/') != std::string::npos) ? exeDir.substr(0, exeDir.rfind('/')+1) : "";
+
+      std::vector<std::string> paths;
+      std::string name;
+      auto dwoName = skeleton->getAttribute(dwarf_t::DW_AT_dwo_name);
+      if (dwoName.first)
+      {
+        name = dwoName.second.getString();
+        auto compDir = skeleton->getAttribute(dwarf_t::DW_AT_comp_dir);
+        if ((name.size() > 0) && (name[0] != '/') && compDir.first)
+        {
+          paths.push_back(compDir.second.getString()+"/"+name);
+        }
+        else
+        {
+          paths.push_back(name);
+        }
+        // Objects moved along with the executable
+        paths.push_back(exeDir+name.substr(name.rfind('/')+1));
+      }
+
+      for (auto& path : paths)
+      {
+        auto file = splitFile(path);
+        if (file == nullptr) continue;
+
+        for (auto& s : file->getSectionNameMap())
+        {
+          std::string name = s.first;
+          if ((name.size() > 4) && (name.compare(name.size()-4, 4, ".dwo") == 0))
+          {
+            dwarf_t::section_t section = dwarf_t::convert_section(name.substr(0, name.size()-4));
+            if (section != dwarf_t::DW_SECTION_NULL) split.sections[section] = s.second;
+          }
+        }
+        if (split.sections.find(dwarf_t::DW_SECTION_info) != split.sections.end())
+        {
+          split.file = file;
+          break;
+        }
+        split.sections.clear();
+      }
+
+      if (split.file == nullptr)
+      {
+        auto file = splitFile(parser->getFilename()+".dwp");
+        if ((file != nullptr) && packageSections(file.get(), dwoId, split.sections))
+        {
+          split.file = file;
+        }
+      }
+
+      if (split.file == nullptr)
+      {
+        logger->log(Logger::WARN, "Split debug information '"+name+"' not found");
+        return false;
+      }
+
+      auto addrIt = sections.find(dwarf_t::DW_SECTION_addr);
+      if (addrIt != sections.end()) split.sections[dwarf_t::DW_SECTION_addr] = addrIt->second;
+
+      return true;
+    }
+
+    std::shared_ptr<object::Parser> Info::splitFile(const std::string& path)
+    {
+      auto it = splitFiles.find(path);
+      if (it != splitFiles.end()) return it->second;
+
+      std::shared_ptr<object::Parser> file;
+      if (std::ifstream(path).good())
+      {
+        file = object::ParserFactory::getParser(path, logger->subLogger("SPLIT"));
+        if (!file->parse())
+        {
+          logger->log(Logger::WARN, "Failed to read '"+path+"'");
+          file.reset();
+        }
+        else
+        {
+          logger->log(Logger::DBG, "Opened split debug information '"+path+"'");
+        }
+      }
+      splitFiles[path] = file;
+      return file;
+    }
+
+    // Finds the unit's contribution to each section of a package file
+    //  from its .debug_cu_index
+    bool Info::packageSections(object::Parser* file, uint64_t dwoId, SectionMap& unitSections)
+    {
+      auto& fileSections = file->getSectionNameMap();
+      auto indexIt = fileSections.find(dwarf_t::convert_section(dwarf_t::DW_SECTION_cu_index));
+      if (indexIt == fileSections.end()) return false;
+
+      ByteCursor cursor = indexIt->second->getCursor();
+      uint32_t version = ExtractUInt32(cursor);
+      uint32_t numColumns = ExtractUInt32(cursor);
+      uint32_t numUnits = ExtractUInt32(cursor);
+      uint32_t numSlots = ExtractUInt32(cursor);
+
+      if (version != 5)
+      {
+        logger->log(Logger::WARN, "Unsupported package index version "+std::to_string(version));
+        return false;
+      }
+      if ((numSlots == 0) || ((numSlots & (numSlots-1)) != 0)) return false;
+
+      uint64_t hashes = cursor.tell();
+      uint64_t indices = hashes + 8*numSlots;
+      uint64_t offsets = indices + 4*numSlots;
+      uint64_t sizes = offsets + 4*numColumns*(numUnits+1);
+
+      // Open addressing, with the step taken from the upper bits
+      uint64_t mask = numSlots-1;
+      uint64_t slot = dwoId & mask;
+      uint64_t step = ((dwoId >> 32) & mask) | 1;
+      uint32_t row = 0;
+      for (uint32_t i = 0; i < numSlots; ++i, slot = (slot + step) & mask)
+      {
+        cursor.seek(indices + 4*slot);
+        uint32_t index = ExtractUInt32(cursor);
+        if (index == 0) break;
+        cursor.seek(hashes + 8*slot);
+        if (ExtractUInt64(cursor) == dwoId)
+        {
+          row = index;
+          break;
+        }
+      }
+      if ((row == 0) || (row > numUnits)) return false;
+
+      for (uint32_t col = 0; col < numColumns; ++col)
+      {
+        cursor.seek(offsets + 4*col);
+        dwarf_t::sect_t sect = dwarf_t::convert_sect(ExtractUInt32(cursor));
+        cursor.seek(offsets + 4*(row*numColumns + col));
+        uint32_t offset = ExtractUInt32(cursor);
+        cursor.seek(sizes + 4*((row-1)*numColumns + col));
+        uint32_t size = ExtractUInt32(cursor);
+
+        dwarf_t::section_t section;
+        switch (sect)
+        {
+          case dwarf_t::DW_SECT_info:        section = dwarf_t::DW_SECTION_info; break;
+          case dwarf_t::DW_SECT_abbrev:      section = dwarf_t::DW_SECTION_abbrev; break;
+          case dwarf_t::DW_SECT_line:        section = dwarf_t::DW_SECTION_line; break;
+          case dwarf_t::DW_SECT_loclists:    section = dwarf_t::DW_SECTION_loclists; break;
+          case dwarf_t::DW_SECT_str_offsets: section = dwarf_t::DW_SECTION_str_offsets; break;
+          default: continue;
+        }
+        auto sectionIt = fileSections.find(dwarf_t::convert_section(section)+".dwo");
+        if (sectionIt == fileSections.end()) continue;
+        unitSections[section] = object::Parser::SectionPtr(
+            new object::Section(*sectionIt->second, offset, size));
+      }
+
+      // Strings are shared by all units in the package
+      auto strIt = fileSections.find(dwarf_t::convert_section(dwarf_t::DW_SECTION_str)+".dwo");
+      if (strIt != fileSections.end()) unitSections[dwarf_t::DW_SECTION_str] = strIt->second;
+
+      return unitSections.find(dwarf_t::DW_SECTION_info) != unitSections.end();
+    }
+
+    // Merges a parsed unit into the shared indices
+    void Info::finishUnit(Unit& unit, UnitDies& unitDies)
+    {
+      for (auto& d : unitDies)
+      {
+        // A split unit replaces its skeleton
+        if ((d.second->getParent() == info.get()) && (d.second != unit.skeleton))
+        {
+          info->addChild(d.second);
+        }
+      }
+
+      dies.insert(unitDies);
+    }
+
+    void Info::indexScopes(Unit& unit, UnitDies& unitDies)
+    {
+      for (auto& d : unitDies)
+      {
+        DIE* die = d.second;
+        if (die->isScope() && die->hasPcRange())
+        {
+          unit.scopes.add(die->lowPC(), die->highPC(), die);
+        }
+      }
+      unit.scopes.build();
+    }
+
+    void Info::loadUnitContaining(uint64_t dieOffset)
+    {
+      auto it = units.upper_bound(dieOffset);
+      if (it == units.begin()) return;
+      --it;
+      if (dieOffset < it->second.end) loadUnit(it->first);
+    }
+
+    void Info::loadAllUnits()
+    {
+      std::vector<std::pair<uint64_t, Unit*> > pending;
+      for (auto& u : units)
+      {
+        if (u.second.loaded) continue;
+        u.second.loaded = true;
+        pending.push_back( {u.first, &u.second} );
+      }
+
+      unsigned numThreads = std::min<size_t>(parseThreads(), pending.size());
+      std::vector<UnitDies> results(pending.size());
+
+      if (numThreads > 1)
+      {
+        logger->log(Logger::DBG, "Parsing "+std::to_string(pending.size())+
+            " units on "+std::to_string(numThreads)+" threads");
+
+        while (workerArenas.size() < numThreads)
+        {
+          workerArenas.push_back(std::unique_ptr<DIEArena>(new DIEArena()));
+        }
+      }
+
+      runWorkers(numThreads, pending.size(), [&](size_t i, unsigned t)
+      {
+        DIEArena& unitArena = (numThreads > 1) ? *workerArenas[t] : arena;
+        parseUnit(pending[i].first, *pending[i].second, unitArena, results[i]);
+      });
+
+      // Scopes may follow references into other units, so every unit
+      // is merged before any are indexed
+      for (size_t i = 0; i < pending.size(); ++i)
+      {
+        finishUnit(*pending[i].second, results[i]);
+      }
+      for (size_t i = 0; i < pending.size(); ++i)
+      {
+        indexScopes(*pending[i].second, results[i]);
+      }
+    }
+
+    void Info::runWorkers(unsigned numThreads, size_t numItems,
+                          const std::function<void(size_t, unsigned)>& work)
+    {
+      if (numThreads <= 1)
+      {
+        for (size_t i = 0; i < numItems; ++i) work(i, 0);
+        return;
+      }
+
+      std::atomic<size_t> next(0);
+      std::vector<std::exception_ptr> errors(numThreads);
+      std::vector<std::thread> workers;
+
+      for (unsigned t = 0; t < numThreads; ++t)
+      {
+        workers.push_back(std::thread([t, numItems, &work, &next, &errors]()
+        {
+          try
+          {
+            for (size_t i = next++; i < numItems; i = next++)
             {
-              assert(abbrevEntryIt != cuAbbrevTbl.end());
-              AbbrevTableEntry& abbrevEntry = abbrevEntryIt->second;
+              work(i, t);
+            }
+          }
+          catch (...)
+          {
+            errors[t] = std::current_exception();
+          }
+        }));
+      }
+      for (auto& w : workers) w.join();
 
-              bool nextHasChildren = abbrevEntry.HasChildren() == dwarf_t::DW_CHILDREN_yes;
+      for (auto& e : errors)
+      {
+        if (e) std::rethrow_exception(e);
+      }
+    }
 
-              DIE* die = new DIE(dieOffset, abbrevEntry.GetTag(), currentDie, dies, frames, header.Arch(), dieLogger);
-              dies->insert( {dieOffset, die} );
+    unsigned Info::parseThreads()
+    {
+      int64_t n = Config::get(C_PARSE_THREADS).Int();
+      if (n > 0) return (unsigned)n;
+      // Parsing is memory bound so few threads are worthwhile
+      unsigned cores = std::thread::hardware_concurrency();
+      return std::max(1u, std::min(cores, 8u));
+    }
 
-              for (auto it = abbrevEntry.GetAttrs().begin();
-                  it != abbrevEntry.GetAttrs().end(); ++it)
-              {
-                AttrValue val;
-                std::vector<uint8_t> tmpBuffer;
-                uint64_t tmpOffset;
+    Info::Unit* Info::unitByPC(uint64_t pc)
+    {
+      auto it = unitByAddr.upper_bound(pc);
+      if (it == unitByAddr.begin()) return nullptr;
+      --it;
+      if (pc >= it->second.first) return nullptr;
+      loadUnit(it->second.second);
+      return &units.find(it->second.second)->second;
+    }
 
-                switch (it->GetForm())
-                {
-                  case dwarf_t::DW_FORM_strp:
-                    val = AttrValue(it->GetForm(), ExtractStrp(header.Arch(), is, sections, dwarf_t::DW_SECTION_str));
-                    break;
-                  case dwarf_t::DW_FORM_line_strp:
-                    val = AttrValue(it->GetForm(), ExtractStrp(header.Arch(), is, sections, dwarf_t::DW_SECTION_line_str));
-                    break;
-                  case dwarf_t::DW_FORM_string:
-                    val = AttrValue(it->GetForm(), ExtractString(is));
-                    break;
-                  case dwarf_t::DW_FORM_udata:
-                    // Data length is based on maximum
-                    val = AttrValue(it->GetForm(), ExtractULEB128(is), 8, false);
-                    break;
-                  case dwarf_t::DW_FORM_sdata:
-                    // Data length is based on maximum
-                    val = AttrValue(it->GetForm(), ExtractSLEB128(is), 8, true);
-                    break;
-                  case dwarf_t::DW_FORM_data1:
-                    val = AttrValue(it->GetForm(), ExtractUInt8(is), 1, false);
-                    break;
-                  case dwarf_t::DW_FORM_data2:
-                    val = AttrValue(it->GetForm(), ExtractUInt16(is), 2, false);
-                    break;
-                  case dwarf_t::DW_FORM_data4:
-                    val = AttrValue(it->GetForm(), ExtractUInt32(is), 4, false);
-                    break;
-                  case dwarf_t::DW_FORM_data8:
-                    val = AttrValue(it->GetForm(), ExtractUInt64(is), 8, false);
-                    break;
-                  case dwarf_t::DW_FORM_addr:
-                    val = AttrValue(it->GetForm(), ExtractNumBytes(is, header.AddrBytes()),
-                        header.AddrBytes(), false);
-                    break;
-                  case dwarf_t::DW_FORM_ref_addr:
-                    // In DWARFv2, size of address on target
-                    // In DWARFv3/4, depends on DWARF arch
-                    if (header.Version() == 2)
-                    {
-                      val = AttrValue(it->GetForm(), ExtractNumBytes(is, sizeof(void*)),
-                          sizeof(void*), false);
-                    }
-                    else
-                    {
-                      val = AttrValue(it->GetForm(), ExtractSectionOffset(is, header.Arch()),
-                          ((header.Arch() == dwarf::DWARF64) ? 8 : 4), false);
-                    }
-                    break;
-                  case dwarf_t::DW_FORM_sec_offset:
-                    val = AttrValue(it->GetForm(), ExtractSectionOffset(is, header.Arch()),
-                        ((header.Arch() == dwarf::DWARF64) ? 8 : 4), false);
-                    break;
-                  case dwarf_t::DW_FORM_flag:
-                    val = AttrValue(it->GetForm(), ExtractUInt8(is) != 0);
-                    break;
-                  case dwarf_t::DW_FORM_flag_present:
-                    val = AttrValue(it->GetForm(), true);
-                    break;
-                  case dwarf_t::DW_FORM_ref4:
-                    val = AttrValue(it->GetForm(), ExtractUInt32(is)+header.CUHeaderStart(), 4, false);
-                    break;
-                  case dwarf_t::DW_FORM_block1:
-                    ExtractBlock(is, tmpBuffer, 1);
-                    val = AttrValue(it->GetForm(), tmpBuffer);
-                    break;
-                  case dwarf_t::DW_FORM_exprloc:
-                    ExtractExprLoc(is, tmpBuffer);
-                    val = AttrValue(it->GetForm(), tmpBuffer);
-                    break;
-                  case dwarf_t::DW_FORM_implicit_const:
-                    val = AttrValue(it->GetForm(), it->GetConst());
-                    break;
-                  case dwarf_t::DW_FORM_strx:
-                    tmpOffset = ExtractULEB128(is);
-                    val = AttrValue(it->GetForm(), ExtractIndirectStrp(tmpOffset, header.Arch(), sections, dwarf_t::DW_SECTION_str_offsets, dwarf_t::DW_SECTION_str));
-                    break;
-                  case dwarf_t::DW_FORM_strx1:
-                    tmpOffset = ExtractUInt8(is);
-                    val = AttrValue(it->GetForm(), ExtractIndirectStrp(tmpOffset, header.Arch(), sections, dwarf_t::DW_SECTION_str_offsets, dwarf_t::DW_SECTION_str));
-                    break;
-                  case dwarf_t::DW_FORM_strx2:
-                    tmpOffset = ExtractUInt16(is);
-                    val = AttrValue(it->GetForm(), ExtractIndirectStrp(tmpOffset, header.Arch(), sections, dwarf_t::DW_SECTION_str_offsets, dwarf_t::DW_SECTION_str));
-                    break;
-                  case dwarf_t::DW_FORM_strx4:
-                    tmpOffset = ExtractUInt32(is);
-                    val = AttrValue(it->GetForm(), ExtractIndirectStrp(tmpOffset, header.Arch(), sections, dwarf_t::DW_SECTION_str_offsets, dwarf_t::DW_SECTION_str));
-                    break;
-                  case dwarf_t::DW_FORM_addrx:
-                    val = AttrValue(it->GetForm(), addrTable[ExtractULEB128(is)], addrTableSize, false);
-                    break;
-                  case dwarf_t::DW_FORM_addrx1:
-                    val = AttrValue(it->GetForm(), addrTable[ExtractUInt8(is)], addrTableSize, false);
-                    break;
-                  case dwarf_t::DW_FORM_addrx2:
-                    val = AttrValue(it->GetForm(), addrTable[ExtractUInt16(is)], addrTableSize, false);
-                    break;
-                  case dwarf_t::DW_FORM_addrx4:
-                    val = AttrValue(it->GetForm(), addrTable[ExtractUInt32(is)], addrTableSize, false);
-                    break;
-                  default:
-                    throw Exception("Unhandled: "+dwarf_t::form_str(it->GetForm()), __EINFO__);
-                }
+    DIE* Info::mainUnit()
+    {
+      auto& symbols = parser->getSymbolNameMap();
+      for (auto name : { "main", "_start" })
+      {
+        auto it = symbols.find(name);
+        if (it != symbols.end())
+        {
+          Unit* unit = unitByPC(it->second->getAddress());
+          if ((unit != nullptr) && (unit->die != nullptr)) return unit->die;
+        }
+      }
+      // Fallback to first unit
+      if (units.empty()) return nullptr;
+      return loadUnit(units.begin()->first);
+    }
 
-                if (it->GetAT() == dwarf_t::DW_AT_str_offsets_base)
-                {
-                  header.SetStrOffset(val.getInt());
-                }
+    DIE* Info::scopeChain(uint64_t pc, std::vector<DIE*>& scopes)
+    {
+      std::vector<Unit*> candidates;
+      Unit* unit = unitByPC(pc);
+      if (unit != nullptr) candidates.push_back(unit);
+      for (auto offset : unrangedUnits)
+      {
+        candidates.push_back(&units.find(offset)->second);
+      }
 
-                die->addAttribute(it->GetAT(), val);
-              }
+      for (auto u : candidates)
+      {
+        scopes.clear();
+        u->scopes.containing(pc, scopes);
+        // Scopes outside the innermost function aren't visible
+        for (size_t i = 0; i < scopes.size(); ++i)
+        {
+          if (scopes[i]->isFunction())
+          {
+            scopes.resize(i+1);
+            return scopes[i];
+          }
+        }
+      }
+      scopes.clear();
+      return nullptr;
+    }
 
-              currentDie->addChild(std::unique_ptr<DIE>(die));
-              if (nextHasChildren)
-              {
-                currentDie = die;
-              }
+    void Info::parseNames()
+    {
+      if (!parsed) parse();
+
+      std::set<uint64_t> unitOffsets;
+      for (auto& u : units) unitOffsets.insert(u.first);
+      std::set<uint64_t> covered;
+
+      auto namesIt = sections.find(dwarf_t::DW_SECTION_names);
+      if (namesIt != sections.end())
+      {
+        ByteCursor cursor = namesIt->second->getCursor();
+        nameIndex.readDebugNames(cursor, sections, unitOffsets, covered);
+      }
+      auto gdbIndexIt = sections.find(dwarf_t::DW_SECTION_gdb_index);
+      if (covered.empty() && (gdbIndexIt != sections.end()))
+      {
+        ByteCursor cursor = gdbIndexIt->second->getCursor();
+        if (!nameIndex.readGdbIndex(cursor, unitOffsets, covered))
+        {
+          logger->log(Logger::WARN, "Unsupported .gdb_index version");
+        }
+      }
+
+      // Units missing from the index are scanned for names, without
+      //  building their DIEs
+      std::vector<uint64_t> pending;
+      for (auto& u : units)
+      {
+        if (covered.find(u.first) == covered.end()) pending.push_back(u.first);
+      }
+
+      std::vector<std::vector<std::pair<std::string, NameIndex::Entry> > > results(pending.size());
+      std::vector<char> scanned(pending.size());
+      runWorkers(std::min<size_t>(parseThreads(), pending.size()), pending.size(),
+          [&](size_t i, unsigned) { scanned[i] = scanNames(pending[i], results[i]); });
+
+      for (size_t i = 0; i < pending.size(); ++i)
+      {
+        if (!scanned[i]) unindexedUnits.push_back(pending[i]);
+        for (auto& r : results[i]) nameIndex.add(r.first, r.second);
+      }
+
+      logger->log(Logger::DBG, [&]() {
+        std::stringstream s;
+        s << "Names: " << nameIndex.size() << ", units indexed: " << covered.size();
+        s << ", scanned: " << (pending.size() - unindexedUnits.size());
+        s << ", unindexed: " << unindexedUnits.size();
+        return s.str();
+      });
+
+      parsedNames = true;
+    }
+
+    // False if the unit's names can't be read without loading it
+    bool Info::scanNames(uint64_t offset, std::vector<std::pair<std::string, NameIndex::Entry> >& found)
+    {
+      ByteCursor cursor = sections.find(dwarf_t::DW_SECTION_info)->second->getCursor();
+      cursor.seek(offset);
+      CompilationUnitHeader header(cursor);
+
+      auto cuAbbrevTblIt = abbrevTable.find(header.AbbrevOffset());
+      if (cuAbbrevTblIt == abbrevTable.end()) return true;
+
+      std::unique_ptr<DIEUnit> context(newContext(header, units.find(offset)->second, sections));
+      // Whether children of each open DIE can be named
+      std::vector<bool> scopes;
+      // Member declarations are named through DW_AT_specification by
+      //  their definitions, which usually have no name of their own
+      std::map<uint64_t, std::vector<std::string> > declarations;
+      std::vector<std::pair<uint64_t, NameIndex::Entry> > definitions;
+      std::vector<DIEAttr> attrs;
+      uint64_t unitDieOffset = cursor.tell();
+
+      while (header.Contains(cursor.tell()))
+      {
+        uint64_t dieOffset = cursor.tell();
+        uint64_t abbrevCode = ExtractULEB128(cursor);
+
+        if (abbrevCode == 0)
+        {
+          if (!scopes.empty()) scopes.pop_back();
+          continue;
+        }
+
+        AbbrevTableEntry* abbrevEntryPtr = cuAbbrevTblIt->second.Find(abbrevCode);
+        if (abbrevEntryPtr == nullptr) break;
+        AbbrevTableEntry& abbrevEntry = *abbrevEntryPtr;
+        dwarf_t::tag_t tag = abbrevEntry.GetTag();
+
+        if (tag == dwarf_t::DW_TAG_skeleton_unit) return false;
+
+        bool visible = scopes.empty() || scopes.back();
+        bool named = visible && DIE::isNamedTag(tag);
+        // The unit DIE is read for the bases of indexed forms
+        if (named || (dieOffset == unitDieOffset))
+        {
+          attrs.resize(abbrevEntry.GetAttrs().size());
+          readAttributes(abbrevEntry, *context, cursor, attrs.data());
+        }
+        else
+        {
+          skipAttributes(abbrevEntry, header, cursor);
+        }
+
+        if (named)
+        {
+          std::vector<std::string> names;
+          bool declaration = false;
+          uint64_t specification = 0;
+          for (auto& attr : attrs)
+          {
+            if ((attr.at == dwarf_t::DW_AT_name) || (attr.at == dwarf_t::DW_AT_linkage_name))
+            {
+              names.push_back(decodeAttribute(attr, context->header, sections).getString());
+            }
+            else if (attr.at == dwarf_t::DW_AT_declaration)
+            {
+              declaration = true;
+            }
+            else if (attr.at == dwarf_t::DW_AT_specification)
+            {
+              specification = decodeAttribute(attr, context->header, sections).getInt();
             }
           }
 
-          cuDone = !header.Contains(is.tellg());
+          NameIndex::Entry entry = {offset, dieOffset - offset, tag};
+          if (declaration)
+          {
+            declarations[dieOffset] = names;
+          }
+          else if (names.empty() && (specification != 0))
+          {
+            definitions.push_back({specification, entry});
+          }
+          for (auto& n : names)
+          {
+            if (!declaration) found.push_back({n, entry});
+          }
+        }
+
+        if (abbrevEntry.HasChildren() == dwarf_t::DW_CHILDREN_yes)
+        {
+          scopes.push_back(visible && DIE::isNameScope(tag));
         }
-        cuIndex++;
-        is.peek();
       }
 
-      info = std::unique_ptr<DIE>(currentDie);
+      for (auto& d : definitions)
+      {
+        auto declIt = declarations.find(d.first);
+        if (declIt == declarations.end()) continue;
+        for (auto& n : declIt->second) found.push_back({n, d.second});
+      }
+      return true;
+    }
+
+    void Info::diesByName(const std::string& name, std::vector<DIE*>& found)
+    {
+      if (!parsedNames) parseNames();
+
+      // Names are indexed without their scope, which is checked once
+      //  the DIEs are loaded
+      size_t qualifierLength = NameIndex::qualifierLength(name);
+      std::string baseName = name.substr(qualifierLength);
+      std::string qualifier = name.substr(0, qualifierLength);
+
+      std::vector<DIE*> candidates;
+      std::set<uint64_t> searched;
+      const NameIndex::Entries* entries = nameIndex.find(baseName);
+      if (entries != nullptr)
+      {
+        for (auto& e : *entries)
+        {
+          Unit& unit = units.find(e.unit)->second;
+          if (loadUnit(e.unit) == nullptr) continue;
+
+          if (e.die == NameIndex::NO_DIE)
+          {
+            // Only the unit is known
+            if (searched.insert(e.unit).second) unit.die->namedObjects(baseName, candidates);
+            continue;
+          }
+
+          // Offsets of a split unit are relative to the unit in the .dwo
+          DIEUnit* context = unit.split ? unit.split->context.get() : unit.context.get();
+          auto it = dies.find(context->header.DieBase() + e.die);
+          if (it != dies.end()) candidates.push_back(it->second);
+        }
+      }
+
+      for (auto offset : unindexedUnits)
+      {
+        DIE* unitDie = loadUnit(offset);
+        if (unitDie != nullptr) unitDie->namedObjects(baseName, candidates);
+      }
+
+      std::set<DIE*> seen;
+      for (auto d : candidates)
+      {
+        if (!seen.insert(d).second) continue;
+        if (qualifierLength > 0)
+        {
+          // Types and namespaces are part of their own namespace
+          std::string ns = d->getNamespace();
+          std::string own = baseName+"::";
+          if ((ns.size() >= own.size()) && (ns.compare(ns.size()-own.size(), own.size(), own) == 0) &&
+              DIE::isNameScope(d->getTag()))
+          {
+            ns.resize(ns.size()-own.size());
+          }
+          if (ns != qualifier) continue;
+        }
+        found.push_back(d);
+      }
     }
 
     void Info::parseLineSection()
     {
       if (!parsedSections) parseSections();
 
+      std::string cacheDir = Config::get(C_INDEX_CACHE_DIR).String();
+      if (cacheDir.size() > 0)
+      {
+        indexCache.reset(new IndexCache(cacheDir, parser));
+        if (indexCache->load(lines, entryPCs, parsedEntries))
+        {
+          logger->log(Logger::DBG, "Loaded index from '"+indexCache->getPath()+"'");
+          parsedLine = true;
+          return;
+        }
+      }
+
       if (sections.find(dwarf_t::DW_SECTION_line) == sections.end())
       {
         logger->log(Logger::ERROR, "No .debug_line section in binary");
@@ -592,47 +1699,47 @@ namespace penguinTrace
       assert(sections.find(dwarf_t::DW_SECTION_line) != sections.end());
 
       auto lineSection = sections[dwarf_t::DW_SECTION_line];
-      auto lineStream = lineSection->getContents();
-      std::istream is(&lineStream);
+      ByteCursor cursor = lineSection->getCursor();
 
-      is.peek();
-      while (!is.eof())
+      while (!cursor.eof())
       {
-        auto lineProgram = std::unique_ptr<LineProgramHeader>(new LineProgramHeader(is, sections));
+        auto lineProgram = std::unique_ptr<LineProgramHeader>(new LineProgramHeader(cursor, sections));
         LineStateMachine state(*lineProgram);
-
-        is.peek();
-        while (!is.eof() && lineProgram->Contains(is.tellg()))
+        // Program file number to interned file
+        std::map<uint64_t, uint32_t> fileIds;
+        // Primary source file of the unit, index 1 before DWARFv5
+        int primary = (lineProgram->Version() >= 5) ? 0 : 1;
+        if (lineProgram->HasFile(primary))
         {
-          uint8_t firstByte = ExtractUInt8(is);
+          lines.markSource(lines.internFile(lineProgram->Filename(primary)));
+        }
 
-          if (is.eof())
-          {
-            break;
-          }
+        while (!cursor.eof() && lineProgram->Contains(cursor.tell()))
+        {
+          uint8_t firstByte = ExtractUInt8(cursor);
 
           if (firstByte == 0x00)
           {
             // Extended Opcode
             // length(ULEB128), opcode(byte), data(length - 1)
-            uint64_t length = ExtractULEB128(is);
+            uint64_t length = ExtractULEB128(cursor);
             uint64_t dataLength = length-1;
-            uint8_t opval = ExtractUInt8(is);
+            uint8_t opval = ExtractUInt8(cursor);
             dwarf_t::lne_t op = dwarf_t::convert_lne(opval);
 
             switch (op)
             {
               case dwarf_t::DW_LNE_end_sequence:
-                addLineStateMachine(state.EndSequence(), lineProgram.get());
+                addLineStateMachine(state.EndSequence(), lineProgram.get(), fileIds);
                 break;
               case dwarf_t::DW_LNE_set_address:
-                state.SetAddr(ExtractNumBytes(is, dataLength));
+                state.SetAddr(ExtractNumBytes(cursor, dataLength));
                 break;
               case dwarf_t::DW_LNE_define_file:
-                lineProgram->addFilename(is);
+                lineProgram->addFilename(cursor);
                 break;
               case dwarf_t::DW_LNE_set_discriminator:
-                state.SetDiscriminator(ExtractULEB128(is));
+                state.SetDiscriminator(ExtractULEB128(cursor));
                 break;
               default:
                 throw Exception("Unknown extended opcode", __EINFO__);
@@ -644,7 +1751,7 @@ namespace penguinTrace
             if (firstByte >= lineProgram->OpcodeBase())
             {
               // Special opcode (no operands)
-              addLineStateMachine(state.SpecialOp(firstByte), lineProgram.get());
+              addLineStateMachine(state.SpecialOp(firstByte), lineProgram.get(), fileIds);
             }
             else
             {
@@ -657,24 +1764,24 @@ namespace penguinTrace
 
               if (op == dwarf_t::DW_LNS_fixed_advance_pc)
               {
-                uOperand = ExtractUInt16(is);
+                uOperand = ExtractUInt16(cursor);
               }
               else if (op == dwarf_t::DW_LNS_advance_line)
               {
-                sOperand = ExtractSLEB128(is);
+                sOperand = ExtractSLEB128(cursor);
               }
               else
               {
                 for (int i = 0; i < lineProgram->OpcodeLengths()[firstByte-1]; ++i)
                 {
-                  operands.push_back(ExtractULEB128(is));
+                  operands.push_back(ExtractULEB128(cursor));
                 }
               }
 
               switch (op)
               {
                 case dwarf_t::DW_LNS_copy:
-                  addLineStateMachine(state.Copy(), lineProgram.get());
+                  addLineStateMachine(state.Copy(), lineProgram.get(), fileIds);
                   break;
                 case dwarf_t::DW_LNS_advance_pc:
                   state.AdvancePC(operands[0]);
@@ -718,17 +1825,39 @@ namespace penguinTrace
             }
           }
         }
-        is.peek();
       }
 
+      lines.finalise();
+
       parsedLine = true;
+
+      storeIndex(false);
     }
 
-    void Info::addLineStateMachine(LineStateMachine lsm, LineProgramHeader* hdr)
+    void Info::storeIndex(bool withEntries)
     {
-      locationByPc.insert({lsm.GetPC(),
-        CodeLocation(lsm.GetPC(), hdr->Filename(lsm.GetFile()), lsm.GetLine(),
-                     lsm.GetColumn(), lsm.GetPrologueEnd(), lsm.GetEpilogueBegin())});
+      if (!indexCache) return;
+
+      if (indexCache->store(lines, withEntries ? &entryPCs : nullptr))
+      {
+        logger->log(Logger::DBG, "Stored index in '"+indexCache->getPath()+"'");
+      }
+      else
+      {
+        logger->log(Logger::WARN, "Could not store index in '"+indexCache->getPath()+"'");
+      }
+    }
+
+    void Info::addLineStateMachine(LineStateMachine lsm, LineProgramHeader* hdr,
+                                   std::map<uint64_t, uint32_t>& fileIds)
+    {
+      auto fileIt = fileIds.find(lsm.GetFile());
+      if (fileIt == fileIds.end())
+      {
+        fileIt = fileIds.insert({lsm.GetFile(), lines.internFile(hdr->Filename(lsm.GetFile()))}).first;
+      }
+      lines.add(lsm.GetPC(), fileIt->second, lsm.GetLine(), lsm.GetColumn(),
+                lsm.GetPrologueEnd(), lsm.GetEpilogueBegin(), lsm.GetEndSequence());
     }
 
     void Info::parseFrame()
@@ -765,10 +1894,18 @@ namespace penguinTrace
 
       if (sPtr != nullptr)
       {
-        auto frameStream = sPtr->getContents();
-        std::istream is(&frameStream);
+        ByteCursor cursor = sPtr->getCursor();
 
-        frames = std::unique_ptr<Frames>(new Frames(is, sectionAddrs, eh));
+        auto hdrSectionIt = sections.find(dwarf_t::DW_SECTION_eh_frame_hdr);
+        if (eh && hdrSectionIt != sections.end())
+        {
+          ByteCursor hdrCursor = hdrSectionIt->second->getCursor();
+          frames = std::unique_ptr<Frames>(new Frames(cursor, sectionAddrs, eh, &hdrCursor));
+        }
+        else
+        {
+          frames = std::unique_ptr<Frames>(new Frames(cursor, sectionAddrs, eh));
+        }
         std::stringstream s;
         s << "addr = " << HexPrint(sPtr->getAddress(), 1);
         s << std::endl;
@@ -779,6 +1916,8 @@ namespace penguinTrace
         s << "No. section addrs = " << sectionAddrs.size();
         s << std::endl;
         s << "No. frame entries = " << frames->getFramesByOffset().size();
+        s << std::endl;
+        s << "FDE index from .eh_frame_hdr = " << (frames->hasSearchTable() ? "yes" : "no");
         logger->log(Logger::TRACE, s.str());
       }
     }
@@ -789,16 +1928,16 @@ namespace penguinTrace
 
       if (function != nullptr)
       {
-        auto it = locationByPc.find(function->lowPC());
-        while (it != locationByPc.end() && function->containsPC(pc))
+        size_t row = lines.find(function->lowPC());
+        while (row < lines.size() && function->containsPC(pc))
         {
-          if (it->second.prologueEnd() && !it->second.epilogueBegin())
+          if (lines.prologueEnd(row) && !lines.epilogueBegin(row))
           {
             // Stack is corrupted after return so don't display vars
-            return (pc < it->first) || !function->containsPC(pc+MIN_INSTR_BYTES);
+            return (pc < lines.pc(row)) || !function->containsPC(pc+MIN_INSTR_BYTES);
           }
 
-          ++it;
+          ++row;
         }
       }
 
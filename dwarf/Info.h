@@ -24,15 +24,22 @@
 #define DWARF_INFO_H_
 
 #include <list>
+#include <mutex>
+#include <set>
 
 #include "definitions.h"
 #include "Abbrev.h"
 #include "LineProgram.h"
+#include "LineTable.h"
 #include "Frame.h"
+#include "IndexCache.h"
+#include "NameIndex.h"
 #include "DIE.h"
+#include "ScopeIndex.h"
 
 #include "../object/Parser.h"
 #include "../common/ComponentLogger.h"
+#include "../common/Arena.h"
 
 namespace penguinTrace
 {
@@ -46,14 +53,14 @@ namespace penguinTrace
         {
           public:
             CodeLocation()
-              : fnd(false), p(0), ln(0), col(0), fname(""), pEnd(false), eBegin(false) {}
-            CodeLocation(uint64_t p, std::string f, uint64_t l, uint64_t c, bool end, bool ep)
+              : fnd(false), p(0), ln(0), col(0), fname(nullptr), pEnd(false), eBegin(false) {}
+            CodeLocation(uint64_t p, const std::string* f, uint64_t l, uint64_t c, bool end, bool ep)
               : fnd(true), p(p), ln(l), col(c), fname(f), pEnd(end), eBegin(ep) {}
             bool found() { return fnd; }
             uint64_t pc() { return p; }
             uint64_t line() { return ln; }
             uint64_t column() { return col; }
-            std::string filename() { return fname; }
+            std::string filename() { return (fname != nullptr) ? *fname : ""; }
             bool prologueEnd() { return pEnd; }
             bool epilogueBegin() { return eBegin; }
           private:
@@ -61,7 +68,8 @@ namespace penguinTrace
             uint64_t p;
             uint64_t ln;
             uint64_t col;
-            std::string fname;
+            // Interned in the line table
+            const std::string* fname;
             bool pEnd;
             bool eBegin;
         };
@@ -73,32 +81,63 @@ namespace penguinTrace
         CodeLocation locationByPC(uint64_t addr, bool matchSrc);
         CodeLocation exactLocationByPC(uint64_t addr);
         CodeLocation exactLocationByLine(uint64_t line);
+        // Line in any file with line information, by full path or suffix
+        CodeLocation exactLocationByLine(const std::string& file, uint64_t line);
+        bool isLineAddress(uint64_t pc)
+        {
+          auto loc = exactLocationByPC(pc);
+          // Sometimes get line 0 - don't want to stop here
+          return loc.found() && (loc.line() != 0);
+        }
+        // Location is in the source file of the main compilation unit
+        bool inMainSource(CodeLocation& loc)
+        {
+          if (!parsed) parse();
+          return loc.found() && ((cuSrcName.size() == 0) || (loc.filename() == cuSrcName));
+        }
+        void lineAddresses(uint64_t low, uint64_t high, std::set<uint64_t>& addrs);
+        void functionEntries(std::set<uint64_t>& addrs);
         DIE* functionByPC(uint64_t addr)
         {
           if (!parsed) parse();
-          return info->functionContaining(addr);
+          std::vector<DIE*> scopes;
+          return scopeChain(addr, scopes);
         }
         void dataObjects(uint64_t pc, std::list<DIE*>& list)
         {
           if (!parsed) parse();
-          DIE* func = info->functionContaining(pc);
-          if (func != nullptr) func->dataObjects(pc, list);
+          std::vector<DIE*> scopes;
+          DIE* func = scopeChain(pc, scopes);
+          if (func != nullptr) func->dataObjects(pc, scopes, list);
         }
         void formalParams(uint64_t pc, std::list<DIE*>& list)
         {
           if (!parsed) parse();
-          DIE* func = info->functionContaining(pc);
-          if (func != nullptr) func->formalParams(pc, list);
+          std::vector<DIE*> scopes;
+          DIE* func = scopeChain(pc, scopes);
+          if (func != nullptr) func->formalParams(pc, scopes, list);
+        }
+        // Definitions with the name, loading only the units that have it
+        void diesByName(const std::string& name, std::vector<DIE*>& found);
+        DIE* functionByName(const std::string& name)
+        {
+          std::vector<DIE*> found;
+          diesByName(name, found);
+          for (auto d : found)
+          {
+            if (d->isFunction()) return d;
+          }
+          return nullptr;
         }
         bool inFunctionPrologue(uint64_t pc);
         uint64_t nextLinePC(uint64_t pc)
         {
           if (!parsed) parse();
 
-          auto it = locationByPc.upper_bound(pc);
-          if (it != locationByPc.end())
+          size_t row = lines.upperBound(pc);
+          if (row < lines.size())
           {
-            return it->second.pc();
+            return lines.pc(row);
           }
 
           return 0;
@@ -110,30 +149,138 @@ namespace penguinTrace
           return frames->getFDEByPc(pc);
         }
       private:
+        // DIEs of a skeleton unit held in a .dwo or .dwp file
+        struct SplitUnit
+        {
+          std::shared_ptr<object::Parser> file;
+          // Sections of the unit, .debug_addr is in the executable
+          SectionMap sections;
+          AbbrevTable abbrevs;
+          std::unique_ptr<DIEUnit> context;
+        };
+        struct Unit
+        {
+          public:
+            Unit(uint64_t end, uint64_t index)
+              : end(end), index(index), die(nullptr), skeleton(nullptr), loaded(false) {}
+            uint64_t end;
+            // Position in .debug_info, used to place split DIE offsets
+            uint64_t index;
+            // Unit DIE, of the split unit if there is one
+            DIE* die;
+            DIE* skeleton;
+            bool loaded;
+            std::unique_ptr<DIEUnit> context;
+            std::unique_ptr<SplitUnit> split;
+            ScopeIndex scopes;
+        };
+        // Storage for DIEs, one for each thread parsing units
+        struct DIEArena
+        {
+          Arena<DIE> dies;
+          Arena<DIEAttr> attrs;
+        };
+        typedef std::vector<std::pair<uint64_t, DIE*> > UnitDies;
+
         void parseSections();
         void parse();
         void parseAbbrev();
-        void parseAddrTable();
-        void parseInfo();
+        void parseAbbrevTable(ByteCursor& cursor, AbbrevTable& table);
+        void indexUnits();
+        void parseAranges(std::set<uint64_t>& covered);
+        bool unitRangeFromDIE(uint64_t offset);
+        DIE* loadUnit(uint64_t offset);
+        void parseUnit(uint64_t offset, Unit& unit, DIEArena& arena, UnitDies& unitDies);
+        void parseDIEs(ByteCursor& cursor, CompilationUnitHeader& header, AbbrevTable& abbrevs,
+                       DIEUnit* context, DIEArena& unitArena, UnitDies& unitDies);
+        DIEUnit* newContext(CompilationUnitHeader& header, Unit& unit, SectionMap& unitSections);
+        void parseSplitUnit(Unit& unit, DIEArena& unitArena, UnitDies& unitDies);
+        bool findSplitUnit(DIE* skeleton, uint64_t dwoId, SplitUnit& split);
+        std::shared_ptr<object::Parser> splitFile(const std::string& path);
+        bool packageSections(object::Parser* file, uint64_t dwoId, SectionMap& unitSections);
+        void finishUnit(Unit& unit, UnitDies& unitDies);
+        void indexScopes(Unit& unit, UnitDies& unitDies);
+        unsigned parseThreads();
+        // Calls work(item, worker) for each item on up to numThreads threads
+        void runWorkers(unsigned numThreads, size_t numItems,
+                        const std::function<void(size_t, unsigned)>& work);
+        void loadUnitContaining(uint64_t dieOffset);
+        void loadAllUnits();
+        Unit* unitByPC(uint64_t pc);
+        DIE* mainUnit();
+        DIE* scopeChain(uint64_t pc, std::vector<DIE*>& scopes);
+        void readAttributes(AbbrevTableEntry& abbrevEntry, DIEUnit& unit,
+                            ByteCursor& cursor, DIEAttr* attrs);
+        void skipAttribute(dwarf_t::form_t form, CompilationUnitHeader& header,
+                           ByteCursor& cursor);
+        void skipAttribute(AbbrevAttrib& attr, CompilationUnitHeader& header,
+                           ByteCursor& cursor);
+        void skipAttributes(AbbrevTableEntry& abbrevEntry, CompilationUnitHeader& header,
+                            ByteCursor& cursor);
+        AttrValue decodeAttribute(DIEAttr& attr, CompilationUnitHeader& header,
+                                  SectionMap& unitSections);
+        LocationList* locationList(AttrValue& attr, DIEUnit& context, Unit& unit,
+                                   SectionMap& unitSections);
+        void readLoc(ByteCursor& cursor, CompilationUnitHeader& header,
+                     uint64_t base, LocationList& list);
+        void readLocLists(ByteCursor& cursor, CompilationUnitHeader& header,
+                          uint64_t base, LocationList& list);
+        uint64_t indexedAddress(CompilationUnitHeader& header, uint64_t index);
+        AttrValue parseAttribute(dwarf_t::form_t form, int64_t implicitConst,
+                                 CompilationUnitHeader& header, ByteCursor& cursor,
+                                 SectionMap& unitSections);
+        void parseNames();
+        bool scanNames(uint64_t offset, std::vector<std::pair<std::string, NameIndex::Entry> >& found);
         void recurseInfoAttrs(DIE* d);
         void parseLineSection();
+        void storeIndex(bool withEntries);
         void parseFrame();
-        void addLineStateMachine(LineStateMachine lsm, LineProgramHeader* hdr);
+        void addLineStateMachine(LineStateMachine lsm, LineProgramHeader* hdr,
+                                 std::map<uint64_t, uint32_t>& fileIds);
+        CodeLocation lineRow(size_t row);
+        CodeLocation locationByFileLine(uint32_t file, uint64_t line);
+        bool inSource(size_t row)
+        {
+          return (cuSrcName.size() == 0) || lines.isSource(lines.file(row));
+        }
         bool parsed;
         bool parsedLine;
         bool parsedSections;
+        bool parsedEntries;
+        bool parsedNames;
         penguinTrace::object::Parser* parser;
         std::string cuSrcName;
+        uint32_t cuSrcFile;
         std::unique_ptr<ComponentLogger> logger;
         SectionMap sections;
         std::map<std::string, uint64_t> sectionAddrs;
         std::shared_ptr<Frames> frames;
-        std::map<uint64_t, CodeLocation> locationByPc;
-        std::map<uint64_t, CodeLocation> locationByLine;
-        std::map<uint64_t, std::map<uint64_t, AbbrevTableEntry> > abbrevTable;
-        std::vector<uint64_t> addrTable;
-        uint64_t addrTableSize;
+        LineTable lines;
+        // Entry addresses of functions with line information
+        std::vector<uint64_t> entryPCs;
+        std::unique_ptr<IndexCache> indexCache;
+        NameIndex nameIndex;
+        // Units that could only be indexed by loading them (split units),
+        //  searched on every lookup
+        std::vector<uint64_t> unindexedUnits;
+        std::map<uint64_t, AbbrevTable> abbrevTable;
         std::unique_ptr<DIE> info;
+        DIEMap dies;
+        // Storage for the DIEs of all loaded units
+        DIEArena arena;
+        std::vector<std::unique_ptr<DIEArena> > workerArenas;
+        std::shared_ptr<ComponentLogger> dieLogger;
+        // Units by offset in .debug_info, DIEs are only parsed for
+        //  the units that are used
+        std::map<uint64_t, Unit> units;
+        // Start address to (end address, unit offset)
+        std::map<uint64_t, std::pair<uint64_t, uint64_t> > unitByAddr;
+        // Units with no known address range, parsed up front
+        std::vector<uint64_t> unrangedUnits;
+        DIE* mainCu;
+        // Opened .dwo and .dwp files by path, null if missing
+        std::map<std::string, std::shared_ptr<object::Parser> > splitFiles;
+        std::mutex splitMutex;
     };
 
   } /* namespace dwarf */
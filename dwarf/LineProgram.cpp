@@ -27,6 +27,12 @@ namespace penguinTrace
   namespace dwarf
   {
 
+    bool LineProgramHeader::HasFile(int index)
+    {
+      unsigned fIdx = index - ((version >= 5) ? 0 : 1);
+      return (fIdx < file_names.size()) && file_names[fIdx].Valid();
+    }
+
     std::string LineProgramHeader::Filename(int index)
     {
       // DWARFv5 adds a file at index 0, previously this was omitted
@@ -39,11 +45,14 @@ namespace penguinTrace
       if (!fname.Valid()) return err.str();
 
       unsigned dirIdx = fname.DirIndex();
-      if (dirIdx == 0)
+      // DWARFv5 also lists the compilation directory at index 0,
+      //  previously index 0 meant relative to the compilation directory
+      unsigned incIdx = dirIdx - ((version >= 5) ? 0 : 1);
+      if ((dirIdx == 0) && (version < 5))
       {
         dir = "";
       }
-      else if ((dirIdx-1) >= include_directories.size())
+      else if (incIdx >= include_directories.size())
       {
         std::stringstream err;
         err << "DIR_NOT_FOUND(" << fname.DirIndex() << ")/";
@@ -51,14 +60,14 @@ namespace penguinTrace
       }
       else
       {
-        dir = include_directories[dirIdx-1] + "/";
+        dir = include_directories[incIdx] + "/";
       }
       return dir + fname.Name();
     }
 
-    void LineProgramHeader::addFilename(std::istream& is)
+    void LineProgramHeader::addFilename(ByteCursor& cursor)
     {
-      LineProgramFileEntry file(is);
+      LineProgramFileEntry file(cursor);
       if (!file.Valid()) throw Exception("Invalid filename for DW_LNE_define_file", __EINFO__);
       file_names.push_back(file);
     }
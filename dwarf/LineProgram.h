@@ -28,7 +28,6 @@
 #include <sstream>
 #include <vector>
 
-#include <istream>
 #include <iomanip>
 
 #include "definitions.h"
@@ -43,15 +42,15 @@ namespace penguinTrace
     struct LineProgramFileEntry
     {
       public:
-        LineProgramFileEntry(std::istream& ifs)
+        LineProgramFileEntry(ByteCursor& cursor)
           : md5(0)
         {
-          filename = ExtractString(ifs);
+          filename = ExtractString(cursor);
           if (Valid())
           {
-            directory_index = ExtractULEB128(ifs);
-            last_modified = ExtractULEB128(ifs);
-            file_bytes = ExtractULEB128(ifs);
+            directory_index = ExtractULEB128(cursor);
+            last_modified = ExtractULEB128(cursor);
+            file_bytes = ExtractULEB128(cursor);
           }
           else
           {
@@ -81,49 +80,49 @@ namespace penguinTrace
     struct LineProgramHeader
     {
       public:
-        LineProgramHeader(std::istream& ifs, SectionMap& sections)
+        LineProgramHeader(ByteCursor& cursor, SectionMap& sections)
         {
-          lp_start = ifs.tellg();
-          auto init_length = ExtractInitialLength(ifs);
+          lp_start = cursor.tell();
+          auto init_length = ExtractInitialLength(cursor);
           arch = init_length.first;
           unit_length = init_length.second;
-          unit_start = ifs.tellg();
-          version = ExtractUInt16(ifs);
+          unit_start = cursor.tell();
+          version = ExtractUInt16(cursor);
           if (version >= 5)
           {
-            v5_address_size = ExtractUInt8(ifs);
-            v5_segment_selector_size = ExtractUInt8(ifs);
+            v5_address_size = ExtractUInt8(cursor);
+            v5_segment_selector_size = ExtractUInt8(cursor);
           }
-          header_length = ExtractSectionOffset(ifs, arch);
-          minimum_instruction_length = ExtractUInt8(ifs);
+          header_length = ExtractSectionOffset(cursor, arch);
+          minimum_instruction_length = ExtractUInt8(cursor);
           if (version >= 4)
           {
-            maximum_operations_per_instruction = ExtractUInt8(ifs);
+            maximum_operations_per_instruction = ExtractUInt8(cursor);
           }
           else
           {
             maximum_operations_per_instruction = 1;
           }
-          default_is_stmt = ExtractUInt8(ifs) != 0;
-          line_base = ExtractUInt8(ifs);
-          line_range = ExtractUInt8(ifs);
-          opcode_base = ExtractUInt8(ifs);
+          default_is_stmt = ExtractUInt8(cursor) != 0;
+          line_base = ExtractUInt8(cursor);
+          line_range = ExtractUInt8(cursor);
+          opcode_base = ExtractUInt8(cursor);
           for (int i = 0; i < opcode_base - 1; i++)
           {
-            standard_opcode_lengths.push_back(ExtractUInt8(ifs));
+            standard_opcode_lengths.push_back(ExtractUInt8(cursor));
           }
           if (version >= 5)
           {
             std::vector<std::pair<dwarf_t::lnct_t, dwarf_t::form_t>> directory_entries;
             std::vector<std::pair<dwarf_t::lnct_t, dwarf_t::form_t>> file_entries;
-            int directory_entry_format_count = ExtractUInt8(ifs);
+            int directory_entry_format_count = ExtractUInt8(cursor);
             for (int i = 0; i < directory_entry_format_count; i++)
             {
-              dwarf_t::lnct_t content_type_code = dwarf_t::convert_lnct(ExtractULEB128(ifs));
-              dwarf_t::form_t form_code = dwarf_t::convert_form(ExtractULEB128(ifs));
+              dwarf_t::lnct_t content_type_code = dwarf_t::convert_lnct(ExtractULEB128(cursor));
+              dwarf_t::form_t form_code = dwarf_t::convert_form(ExtractULEB128(cursor));
               directory_entries.push_back(std::make_pair(content_type_code, form_code));
             }
-            uint64_t dir_names_count = ExtractULEB128(ifs);
+            uint64_t dir_names_count = ExtractULEB128(cursor);
             for (int i = 0; i < dir_names_count; i++)
             {
               std::string dir_name = "";
@@ -132,7 +131,7 @@ namespace penguinTrace
                 std::string tmp;
                 switch (it->second) {
                   case dwarf_t::DW_FORM_line_strp:
-                    tmp = ExtractStrp(arch, ifs, sections, dwarf_t::DW_SECTION_line_str);
+                    tmp = ExtractStrp(arch, cursor, sections, dwarf_t::DW_SECTION_line_str);
                     break;
                   default:
                     throw Exception("Unknown form", __EINFO__);
@@ -148,14 +147,14 @@ namespace penguinTrace
               include_directories.push_back(dir_name);
             }
 
-            int file_name_entry_format_count = ExtractUInt8(ifs);
+            int file_name_entry_format_count = ExtractUInt8(cursor);
             for (int i = 0; i < file_name_entry_format_count; i++)
             {
-              dwarf_t::lnct_t content_type_code = dwarf_t::convert_lnct(ExtractULEB128(ifs));
-              dwarf_t::form_t form_code = dwarf_t::convert_form(ExtractULEB128(ifs));
+              dwarf_t::lnct_t content_type_code = dwarf_t::convert_lnct(ExtractULEB128(cursor));
+              dwarf_t::form_t form_code = dwarf_t::convert_form(ExtractULEB128(cursor));
               file_entries.push_back(std::make_pair(content_type_code, form_code));
             }
-            int file_names_count = ExtractULEB128(ifs);
+            int file_names_count = ExtractULEB128(cursor);
             for (int i = 0; i < file_names_count; i++)
             {
               std::string filename = "";
@@ -166,38 +165,41 @@ namespace penguinTrace
               for (auto it = file_entries.begin(); it != file_entries.end(); it++)
               {
                 std::stringstream s;
+                StringRef ref(nullptr, 0);
                 __uint128_t value128;
                 uint64_t value;
                 switch (it->second) {
                   case dwarf_t::DW_FORM_string:
-                    s << ExtractString(ifs);
+                    s << ExtractString(cursor);
                   case dwarf_t::DW_FORM_line_strp:
-                    s << ExtractStrp(arch, ifs, sections, dwarf_t::DW_SECTION_line_str);
+                    ref = ExtractStrpRef(arch, cursor, sections, dwarf_t::DW_SECTION_line_str);
+                    s.write(ref.data(), ref.length());
                     break;
                   case dwarf_t::DW_FORM_strp:
-                    s << ExtractStrp(arch, ifs, sections, dwarf_t::DW_SECTION_str);
+                    ref = ExtractStrpRef(arch, cursor, sections, dwarf_t::DW_SECTION_str);
+                    s.write(ref.data(), ref.length());
                     break;
                   // TODO supplemental string section
                   //case dwarf_t::DW_FORM_strp_sup:
-                  //  s << "supplemental offset: " << ExtractSectionOffset(ifs, arch);
+                  //  s << "supplemental offset: " << ExtractSectionOffset(cursor, arch);
                   //  break;
                   case dwarf_t::DW_FORM_data1:
-                    value = ExtractUInt8(ifs);
+                    value = ExtractUInt8(cursor);
                     break;
                   case dwarf_t::DW_FORM_data2:
-                    value = ExtractUInt16(ifs);
+                    value = ExtractUInt16(cursor);
                     break;
                   case dwarf_t::DW_FORM_data4:
-                    value = ExtractUInt32(ifs);
+                    value = ExtractUInt32(cursor);
                     break;
                   case dwarf_t::DW_FORM_data8:
-                    value = ExtractUInt64(ifs);
+                    value = ExtractUInt64(cursor);
                     break;
                   case dwarf_t::DW_FORM_data16:
-                    value128 = ExtractUInt128(ifs);
+                    value128 = ExtractUInt128(cursor);
                     break;
                   case dwarf_t::DW_FORM_udata:
-                    value = ExtractULEB128(ifs);
+                    value = ExtractULEB128(cursor);
                     break;
                   default:
                     printf("%s\n", dwarf_t::form_str(it->second).c_str());
@@ -234,7 +236,7 @@ namespace penguinTrace
             bool valid;
             do
             {
-              std::string inc_dir = ExtractString(ifs);
+              std::string inc_dir = ExtractString(cursor);
               valid = inc_dir.length() > 0;
               if (valid)
               {
@@ -244,7 +246,7 @@ namespace penguinTrace
             while (valid);
             do
             {
-              LineProgramFileEntry file(ifs);
+              LineProgramFileEntry file(cursor);
               valid = file.Valid();
               if (valid)
               {
@@ -268,12 +270,13 @@ namespace penguinTrace
         std::vector<uint8_t>& OpcodeLengths() { return standard_opcode_lengths; }
         std::vector<std::string>& IncDirs() { return include_directories; }
         std::vector<LineProgramFileEntry>& FileNames() { return file_names; }
+        bool HasFile(int index);
         std::string Filename(int index);
         bool Contains(uint64_t offset)
         {
           return (offset < (unit_start + unit_length)) && (offset > unit_start);
         }
-        void addFilename(std::istream& is);
+        void addFilename(ByteCursor& cursor);
       private:
         uint64_t lp_start;
         arch_t arch;
@@ -371,6 +374,10 @@ namespace penguinTrace
         {
           return epilogue_begin;
         }
+        bool GetEndSequence()
+        {
+          return end_sequence;
+        }
         void SetBasicBlock()
         {
           basic_block = true;
@@ -0,0 +1,228 @@
+// ----------------------------------------------------------------
+// Copyright (C) 2019 Alex Beharrell
+//
+// This file is part of penguinTrace.
+//
+// penguinTrace is free software: you can redistribute it and/or
+// modify it under the terms of the GNU Affero General Public
+// License as published by the Free Software Foundation, either
+// version 3 of the License, or any later version.
+//
+// penguinTrace is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public
+// License along with penguinTrace. If not, see
+// <https://www.gnu.org/licenses/>.
+// ----------------------------------------------------------------
+//
+// DWARF Line Table
+
+#include "LineTable.h"
+
+#include <algorithm>
+
+namespace penguinTrace
+{
+  namespace dwarf
+  {
+
+    const uint32_t LineTable::NO_FILE;
+    const uint64_t LineTable::LINE_MASK;
+    const uint64_t LineTable::COLUMN_MASK;
+
+    LineTable::LineTable() :
+        addrs(nullptr), rows(nullptr), fileIds(nullptr), numRows(0),
+        ranges(nullptr), rangeCount(0)
+    {
+    }
+
+    uint32_t LineTable::internFile(const std::string& name)
+    {
+      auto it = fileByName.find(name);
+      if (it != fileByName.end()) return it->second;
+      uint32_t id = files.size();
+      files.push_back(name);
+      fileByName.insert({name, id});
+      return id;
+    }
+
+    uint32_t LineTable::fileIndex(const std::string& name)
+    {
+      auto it = fileByName.find(name);
+      if (it != fileByName.end()) return it->second;
+      return NO_FILE;
+    }
+
+    uint32_t LineTable::findFile(const std::string& name)
+    {
+      uint32_t file = fileIndex(name);
+      if (file != NO_FILE || name.size() == 0) return file;
+
+      std::string suffix = (name[0] == '/') ? name : "/" + name;
+      for (uint32_t i = 0; i < files.size(); ++i)
+      {
+        const std::string& f = files[i];
+        if ((f.size() >= suffix.size()) &&
+            (f.compare(f.size()-suffix.size(), suffix.size(), suffix) == 0))
+        {
+          // Ambiguous if more than one file matches
+          if (file != NO_FILE) return NO_FILE;
+          file = i;
+        }
+      }
+      return file;
+    }
+
+    void LineTable::markSource(uint32_t file)
+    {
+      if (file >= sourceFiles.size()) sourceFiles.resize(file+1, false);
+      sourceFiles[file] = true;
+    }
+
+    void LineTable::add(uint64_t pc, uint32_t file, uint64_t line, uint64_t column,
+                        bool prologueEnd, bool epilogueBegin, bool endSequence)
+    {
+      uint64_t row = std::min(line, LINE_MASK);
+      row |= std::min(column, COLUMN_MASK) << COLUMN_SHIFT;
+      if (prologueEnd)   row |= PROLOGUE_END;
+      if (epilogueBegin) row |= EPILOGUE_BEGIN;
+      if (endSequence)   row |= END_SEQUENCE;
+      addrStore.push_back(pc);
+      rowStore.push_back(row);
+      fileStore.push_back(file);
+    }
+
+    void LineTable::finalise()
+    {
+      std::vector<size_t> order(addrStore.size());
+      for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+      std::stable_sort(order.begin(), order.end(),
+          [this](size_t a, size_t b) { return addrStore[a] < addrStore[b]; });
+
+      std::vector<uint64_t> sortedAddrs;
+      std::vector<uint64_t> sortedRows;
+      std::vector<uint32_t> sortedFiles;
+      sortedAddrs.reserve(order.size());
+      sortedRows.reserve(order.size());
+      sortedFiles.reserve(order.size());
+
+      for (auto i : order)
+      {
+        if (!sortedAddrs.empty() && (sortedAddrs.back() == addrStore[i]))
+        {
+          // Next sequence can start where the previous one ended
+          if ((sortedRows.back() & END_SEQUENCE) && !(rowStore[i] & END_SEQUENCE))
+          {
+            sortedRows.back() = rowStore[i];
+            sortedFiles.back() = fileStore[i];
+          }
+          continue;
+        }
+        sortedAddrs.push_back(addrStore[i]);
+        sortedRows.push_back(rowStore[i]);
+        sortedFiles.push_back(fileStore[i]);
+      }
+
+      addrStore.swap(sortedAddrs);
+      rowStore.swap(sortedRows);
+      fileStore.swap(sortedFiles);
+
+      addrs = addrStore.data();
+      rows = rowStore.data();
+      fileIds = fileStore.data();
+      numRows = addrStore.size();
+
+      buildRanges();
+    }
+
+    void LineTable::assign(const uint64_t* pcArray, const uint64_t* rowArray, const uint32_t* fileArray,
+                           size_t rowCount, const LineRange* rangeArray, size_t rangeTotal,
+                           std::shared_ptr<const void> storage)
+    {
+      addrStore.clear();
+      rowStore.clear();
+      fileStore.clear();
+      rangeStore.clear();
+
+      addrs = pcArray;
+      rows = rowArray;
+      fileIds = fileArray;
+      numRows = rowCount;
+      ranges = rangeArray;
+      rangeCount = rangeTotal;
+      mapping = storage;
+    }
+
+    void LineTable::buildRanges()
+    {
+      rangeStore.clear();
+
+      for (size_t row = 0; row < numRows; ++row)
+      {
+        if (endSequence(row) || line(row) == 0) continue;
+
+        uint64_t high = (row+1 < numRows) ? addrs[row+1] : addrs[row];
+        if (!rangeStore.empty())
+        {
+          LineRange& last = rangeStore.back();
+          if (last.file == file(row) && last.line == line(row) && last.high == addrs[row])
+          {
+            last.high = high;
+            continue;
+          }
+        }
+        rangeStore.push_back({file(row), line(row), addrs[row], high});
+      }
+
+      std::sort(rangeStore.begin(), rangeStore.end(),
+          [](const LineRange& a, const LineRange& b)
+          {
+            if (a.file != b.file) return a.file < b.file;
+            if (a.line != b.line) return a.line < b.line;
+            return a.low < b.low;
+          });
+
+      ranges = rangeStore.data();
+      rangeCount = rangeStore.size();
+    }
+
+    std::pair<LineTable::RangeIt, LineTable::RangeIt> LineTable::fileRanges(uint32_t file)
+    {
+      LineRange key = {file, 0, 0, 0};
+      return std::equal_range(ranges, ranges + rangeCount, key,
+          [](const LineRange& a, const LineRange& b) { return a.file < b.file; });
+    }
+
+    std::pair<LineTable::RangeIt, LineTable::RangeIt> LineTable::lineRanges(uint32_t file, uint32_t line)
+    {
+      LineRange key = {file, line, 0, 0};
+      return std::equal_range(ranges, ranges + rangeCount, key,
+          [](const LineRange& a, const LineRange& b)
+          {
+            if (a.file != b.file) return a.file < b.file;
+            return a.line < b.line;
+          });
+    }
+
+    size_t LineTable::find(uint64_t pc)
+    {
+      size_t row = lowerBound(pc);
+      if ((row < numRows) && (addrs[row] == pc)) return row;
+      return numRows;
+    }
+
+    size_t LineTable::lowerBound(uint64_t pc)
+    {
+      return std::lower_bound(addrs, addrs + numRows, pc) - addrs;
+    }
+
+    size_t LineTable::upperBound(uint64_t pc)
+    {
+      return std::upper_bound(addrs, addrs + numRows, pc) - addrs;
+    }
+
+  } /* namespace dwarf */
+} /* namespace penguinTrace */
@@ -0,0 +1,178 @@
+// ----------------------------------------------------------------
+// Copyright (C) 2019 Alex Beharrell
+//
+// This file is part of penguinTrace.
+//
+// penguinTrace is free software: you can redistribute it and/or
+// modify it under the terms of the GNU Affero General Public
+// License as published by the Free Software Foundation, either
+// version 3 of the License, or any later version.
+//
+// penguinTrace is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public
+// License along with penguinTrace. If not, see
+// <https://www.gnu.org/licenses/>.
+// ----------------------------------------------------------------
+//
+// DWARF Line Table
+
+#ifndef DWARF_LINETABLE_H_
+#define DWARF_LINETABLE_H_
+
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace penguinTrace
+{
+  namespace dwarf
+  {
+
+    // Rows of all line programs, sorted by address and stored as
+    //  separate arrays. Filenames are interned so rows only hold an index.
+    //  The arrays are either built here or mapped from an index cache.
+    class LineTable
+    {
+      public:
+        LineTable();
+        static const uint32_t NO_FILE = UINT32_MAX;
+
+        // Address range generated for a line, ranges are sorted
+        //  by file, line and then address
+        struct LineRange
+        {
+          uint32_t file;
+          uint32_t line;
+          uint64_t low;
+          uint64_t high;
+        };
+        typedef const LineRange* RangeIt;
+
+        uint32_t internFile(const std::string& name);
+        // Interned index of a filename or NO_FILE
+        uint32_t fileIndex(const std::string& name);
+        // Exact filename or a unique path suffix match, else NO_FILE
+        uint32_t findFile(const std::string& name);
+        const std::string& fileName(uint32_t file)
+        {
+          return files[file];
+        }
+        size_t numFiles()
+        {
+          return files.size();
+        }
+        // Primary source file of a line program
+        void markSource(uint32_t file);
+        bool isSource(uint32_t file)
+        {
+          return (file < sourceFiles.size()) && sourceFiles[file];
+        }
+        void add(uint64_t pc, uint32_t file, uint64_t line, uint64_t column,
+                 bool prologueEnd, bool epilogueBegin, bool endSequence);
+        // Sort rows and build the line ranges. Only the first row added
+        //  for an address is kept, unless it ends a sequence.
+        void finalise();
+        // Use rows and ranges held elsewhere, which stay valid as long
+        //  as mapping is held. Files must already be interned.
+        void assign(const uint64_t* pcArray, const uint64_t* rowArray, const uint32_t* fileArray,
+                    size_t rowCount, const LineRange* rangeArray, size_t rangeTotal,
+                    std::shared_ptr<const void> storage);
+        std::pair<RangeIt, RangeIt> fileRanges(uint32_t file);
+        std::pair<RangeIt, RangeIt> lineRanges(uint32_t file, uint32_t line);
+        size_t size()
+        {
+          return numRows;
+        }
+        size_t numRanges()
+        {
+          return rangeCount;
+        }
+        const uint64_t* pcData()
+        {
+          return addrs;
+        }
+        const uint64_t* rowData()
+        {
+          return rows;
+        }
+        const uint32_t* fileData()
+        {
+          return fileIds;
+        }
+        const LineRange* rangeData()
+        {
+          return ranges;
+        }
+        // Index of the row at exactly this address, or size()
+        size_t find(uint64_t pc);
+        // Index of the first row at or after this address
+        size_t lowerBound(uint64_t pc);
+        // Index of the first row after this address
+        size_t upperBound(uint64_t pc);
+        uint64_t pc(size_t row)
+        {
+          return addrs[row];
+        }
+        uint32_t file(size_t row)
+        {
+          return fileIds[row];
+        }
+        uint32_t line(size_t row)
+        {
+          return rows[row] & LINE_MASK;
+        }
+        uint32_t column(size_t row)
+        {
+          return (rows[row] >> COLUMN_SHIFT) & COLUMN_MASK;
+        }
+        bool prologueEnd(size_t row)
+        {
+          return (rows[row] & PROLOGUE_END) != 0;
+        }
+        bool epilogueBegin(size_t row)
+        {
+          return (rows[row] & EPILOGUE_BEGIN) != 0;
+        }
+        bool endSequence(size_t row)
+        {
+          return (rows[row] & END_SEQUENCE) != 0;
+        }
+      private:
+        // Line in the low 32 bits, then column and flags
+        static const uint64_t LINE_MASK      = 0xffffffffULL;
+        static const int      COLUMN_SHIFT   = 32;
+        static const uint64_t COLUMN_MASK    = 0x1fffffffULL;
+        static const uint64_t END_SEQUENCE   = 1ULL << 61;
+        static const uint64_t PROLOGUE_END   = 1ULL << 62;
+        static const uint64_t EPILOGUE_BEGIN = 1ULL << 63;
+        const uint64_t* addrs;
+        const uint64_t* rows;
+        const uint32_t* fileIds;
+        size_t numRows;
+        const LineRange* ranges;
+        size_t rangeCount;
+        // Rows as they are added, then sorted by finalise
+        std::vector<uint64_t> addrStore;
+        std::vector<uint64_t> rowStore;
+        std::vector<uint32_t> fileStore;
+        std::vector<LineRange> rangeStore;
+        std::shared_ptr<const void> mapping;
+        // Deque so references to names stay valid
+        std::deque<std::string> files;
+        std::map<std::string, uint32_t> fileByName;
+        std::vector<bool> sourceFiles;
+        void buildRanges();
+    };
+
+  } /* namespace dwarf */
+} /* namespace penguinTrace */
+
+#endif /* DWARF_LINETABLE_H_ */
@@ -0,0 +1,76 @@
+// ----------------------------------------------------------------
+// Copyright (C) 2019 Alex Beharrell
+//
+// This file is part of penguinTrace.
+//
+// penguinTrace is free software: you can redistribute it and/or
+// modify it under the terms of the GNU Affero General Public
+// License as published by the Free Software Foundation, either
+// version 3 of the License, or any later version.
+//
+// penguinTrace is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public
+// License along with penguinTrace. If not, see
+// <https://www.gnu.org/licenses/>.
+// ----------------------------------------------------------------
+//
+// DWARF Location Lists
+
+#include "LocationList.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace penguinTrace
+{
+  namespace dwarf
+  {
+
+    void LocationList::add(uint64_t low, uint64_t high, Expression expr)
+    {
+      // Empty ranges can never match
+      if (low >= high) return;
+      ranges.push_back({low, high, exprs.size()});
+      exprs.push_back(std::move(expr));
+    }
+
+    void LocationList::setDefault(Expression expr)
+    {
+      hasDefault = true;
+      defaultIndex = exprs.size();
+      exprs.push_back(std::move(expr));
+    }
+
+    void LocationList::build()
+    {
+      std::stable_sort(ranges.begin(), ranges.end(),
+          [](const Range& a, const Range& b) { return a.low < b.low; });
+    }
+
+    const Expression* LocationList::find(uint64_t pc)
+    {
+      // Last range starting at or before the PC
+      auto it = std::upper_bound(ranges.begin(), ranges.end(), pc,
+          [](uint64_t p, const Range& r) { return p < r.low; });
+
+      const Expression* match = nullptr;
+      if ((it != ranges.begin()) && (pc < (it-1)->high))
+      {
+        match = &exprs[(it-1)->index];
+      }
+      else if (hasDefault)
+      {
+        match = &exprs[defaultIndex];
+      }
+
+      // Empty expression also means there is no location
+      if ((match == nullptr) || (match->shape() == Expression::EMPTY)) return nullptr;
+      return match;
+    }
+
+  } /* namespace dwarf */
+} /* namespace penguinTrace */
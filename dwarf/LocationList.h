@@ -0,0 +1,74 @@
+// ----------------------------------------------------------------
+// Copyright (C) 2019 Alex Beharrell
+//
+// This file is part of penguinTrace.
+//
+// penguinTrace is free software: you can redistribute it and/or
+// modify it under the terms of the GNU Affero General Public
+// License as published by the Free Software Foundation, either
+// version 3 of the License, or any later version.
+//
+// penguinTrace is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public
+// License along with penguinTrace. If not, see
+// <https://www.gnu.org/licenses/>.
+// ----------------------------------------------------------------
+//
+// DWARF Location Lists
+
+#ifndef DWARF_LOCATIONLIST_H_
+#define DWARF_LOCATIONLIST_H_
+
+#include "Expression.h"
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+namespace penguinTrace
+{
+  namespace dwarf
+  {
+
+    // Location expressions of an object by PC range, read from a list in
+    //  .debug_loc (DWARFv4) or .debug_loclists (DWARFv5). Ranges are sorted
+    //  by start address so the expression for a PC is a binary search.
+    class LocationList
+    {
+      public:
+        LocationList() : hasDefault(false), defaultIndex(0)
+        {
+        }
+        void add(uint64_t low, uint64_t high, Expression expr);
+        // Used for any PC not covered by a range
+        void setDefault(Expression expr);
+        void build();
+        // Expression for the PC, null if the object has no location there
+        //  (i.e. it has been optimised out)
+        const Expression* find(uint64_t pc);
+        size_t size()
+        {
+          return ranges.size();
+        }
+      private:
+        struct Range
+        {
+          uint64_t low;
+          uint64_t high;
+          // Within exprs
+          size_t index;
+        };
+        std::vector<Range> ranges;
+        std::vector<Expression> exprs;
+        bool hasDefault;
+        size_t defaultIndex;
+    };
+
+  } /* namespace dwarf */
+} /* namespace penguinTrace */
+
+#endif /* DWARF_LOCATIONLIST_H_ */
@@ -0,0 +1,267 @@
+// ----------------------------------------------------------------
+// Copyright (C) 2019 Alex Beharrell
+//
+// This file is part of penguinTrace.
+//
+// penguinTrace is free software: you can redistribute it and/or
+// modify it under the terms of the GNU Affero General Public
+// License as published by the Free Software Foundation, either
+// version 3 of the License, or any later version.
+//
+// penguinTrace is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public
+// License along with penguinTrace. If not, see
+// <https://www.gnu.org/licenses/>.
+// ----------------------------------------------------------------
+//
+// DWARF Name Index
+
+#include "NameIndex.h"
+
+#include <map>
+
+namespace penguinTrace
+{
+  namespace dwarf
+  {
+
+    namespace
+    {
+      uint64_t readIndexValue(dwarf_t::form_t form, ByteCursor& cursor)
+      {
+        switch (form)
+        {
+          case dwarf_t::DW_FORM_flag_present:
+            return 1;
+          case dwarf_t::DW_FORM_data1:
+          case dwarf_t::DW_FORM_ref1:
+            return ExtractUInt8(cursor);
+          case dwarf_t::DW_FORM_data2:
+          case dwarf_t::DW_FORM_ref2:
+            return ExtractUInt16(cursor);
+          case dwarf_t::DW_FORM_data4:
+          case dwarf_t::DW_FORM_ref4:
+            return ExtractUInt32(cursor);
+          case dwarf_t::DW_FORM_data8:
+          case dwarf_t::DW_FORM_ref8:
+            return ExtractUInt64(cursor);
+          case dwarf_t::DW_FORM_udata:
+          case dwarf_t::DW_FORM_ref_udata:
+            return ExtractULEB128(cursor);
+          case dwarf_t::DW_FORM_sdata:
+            return ExtractSLEB128(cursor);
+          default:
+            throw Exception("Unhandled name index form: "+dwarf_t::form_str(form), __EINFO__);
+        }
+      }
+    }
+
+    size_t NameIndex::qualifierLength(const std::string& name)
+    {
+      size_t length = 0;
+      int depth = 0;
+      for (size_t i = 0; i + 1 < name.size(); ++i)
+      {
+        char c = name[i];
+        if ((c == '<') || (c == '(')) ++depth;
+        else if (((c == '>') || (c == ')')) && (depth > 0)) --depth;
+        else if ((depth == 0) && (c == ':') && (name[i+1] == ':'))
+        {
+          length = i + 2;
+          ++i;
+        }
+      }
+      return length;
+    }
+
+    bool NameIndex::readDebugNames(ByteCursor& cursor, SectionMap& sections,
+                                   std::set<uint64_t>& units, std::set<uint64_t>& covered)
+    {
+      auto strIt = sections.find(dwarf_t::DW_SECTION_str);
+      if (strIt == sections.end()) return false;
+      ByteCursor strCursor = strIt->second->getCursor();
+
+      bool found = false;
+
+      // One table per unit unless the linker merged them
+      while (!cursor.eof())
+      {
+        auto initLen = ExtractInitialLength(cursor);
+        uint64_t tableEnd = cursor.tell() + initLen.second;
+        arch_t arch = initLen.first;
+        uint8_t offsetBytes = (arch == DWARF64) ? 8 : 4;
+
+        uint16_t version = ExtractUInt16(cursor);
+        if (version != 5)
+        {
+          cursor.seek(tableEnd);
+          continue;
+        }
+        // Padding
+        ExtractUInt16(cursor);
+        uint32_t cuCount = ExtractUInt32(cursor);
+        uint32_t localTuCount = ExtractUInt32(cursor);
+        uint32_t foreignTuCount = ExtractUInt32(cursor);
+        uint32_t bucketCount = ExtractUInt32(cursor);
+        uint32_t nameCount = ExtractUInt32(cursor);
+        uint32_t abbrevSize = ExtractUInt32(cursor);
+        uint32_t augmentationSize = ExtractUInt32(cursor);
+        cursor.skip(augmentationSize);
+
+        std::vector<uint64_t> cuOffsets;
+        for (uint32_t i = 0; i < cuCount; ++i)
+        {
+          cuOffsets.push_back(ExtractSectionOffset(cursor, arch));
+        }
+        cursor.skip(localTuCount*offsetBytes + foreignTuCount*8);
+        // Names are all read, so the hash table isn't needed
+        if (bucketCount > 0) cursor.skip(4*bucketCount + 4*nameCount);
+
+        uint64_t strOffsets = cursor.tell();
+        uint64_t entryOffsets = strOffsets + nameCount*offsetBytes;
+        uint64_t abbrevs = entryOffsets + nameCount*offsetBytes;
+        uint64_t entryPool = abbrevs + abbrevSize;
+
+        struct Abbrev
+        {
+          dwarf_t::tag_t tag;
+          std::vector<std::pair<dwarf_t::idx_t, dwarf_t::form_t> > attrs;
+        };
+        std::map<uint64_t, Abbrev> abbrevTable;
+        cursor.seek(abbrevs);
+        while (cursor.tell() < entryPool)
+        {
+          uint64_t code = ExtractULEB128(cursor);
+          if (code == 0) break;
+          Abbrev& abbrev = abbrevTable[code];
+          abbrev.tag = dwarf_t::convert_tag(ExtractULEB128(cursor));
+          while (true)
+          {
+            uint64_t idx = ExtractULEB128(cursor);
+            uint64_t form = ExtractULEB128(cursor);
+            if ((idx == 0) && (form == 0)) break;
+            abbrev.attrs.push_back({dwarf_t::convert_idx(idx), dwarf_t::convert_form(form)});
+          }
+        }
+
+        for (uint32_t i = 0; i < nameCount; ++i)
+        {
+          cursor.seek(strOffsets + i*offsetBytes);
+          strCursor.seek(ExtractSectionOffset(cursor, arch));
+          std::string name = ExtractString(strCursor);
+
+          cursor.seek(entryOffsets + i*offsetBytes);
+          cursor.seek(entryPool + ExtractSectionOffset(cursor, arch));
+
+          // Entries for the name end with a zero code
+          for (uint64_t code = ExtractULEB128(cursor); code != 0; code = ExtractULEB128(cursor))
+          {
+            auto abbrevIt = abbrevTable.find(code);
+            if (abbrevIt == abbrevTable.end())
+            {
+              throw Exception("Name index entry without abbreviation", __EINFO__);
+            }
+
+            // A single unit is implied when there is no unit attribute
+            uint64_t cu = (cuCount == 1) ? 0 : UINT64_MAX;
+            uint64_t die = NO_DIE;
+            for (auto& attr : abbrevIt->second.attrs)
+            {
+              uint64_t value = readIndexValue(attr.second, cursor);
+              switch (attr.first)
+              {
+                case dwarf_t::DW_IDX_compile_unit: cu = value; break;
+                case dwarf_t::DW_IDX_die_offset:   die = value; break;
+                // Entries in type units aren't used
+                case dwarf_t::DW_IDX_type_unit:    cu = UINT64_MAX; break;
+                default: break;
+              }
+            }
+
+            if ((cu < cuOffsets.size()) && (units.find(cuOffsets[cu]) != units.end()))
+            {
+              add(name, {cuOffsets[cu], die, abbrevIt->second.tag});
+            }
+          }
+        }
+
+        for (auto offset : cuOffsets)
+        {
+          if (units.find(offset) != units.end()) covered.insert(offset);
+        }
+        found = true;
+        cursor.seek(tableEnd);
+      }
+
+      return found;
+    }
+
+    bool NameIndex::readGdbIndex(ByteCursor& cursor, std::set<uint64_t>& units,
+                                 std::set<uint64_t>& covered)
+    {
+      // Older versions hash names differently or have no symbol kinds
+      uint32_t version = ExtractUInt32(cursor);
+      if ((version < 7) || (version > 8)) return false;
+
+      uint32_t cuList = ExtractUInt32(cursor);
+      uint32_t tuList = ExtractUInt32(cursor);
+      // Address area
+      ExtractUInt32(cursor);
+      uint32_t symbolTable = ExtractUInt32(cursor);
+      uint32_t constantPool = ExtractUInt32(cursor);
+
+      std::vector<uint64_t> cuOffsets;
+      cursor.seek(cuList);
+      for (uint32_t i = 0; i < (tuList - cuList) / 16; ++i)
+      {
+        cuOffsets.push_back(ExtractUInt64(cursor));
+        // Unit length
+        ExtractUInt64(cursor);
+      }
+
+      ByteCursor poolCursor = cursor;
+      uint32_t numSlots = (constantPool - symbolTable) / 8;
+      for (uint32_t slot = 0; slot < numSlots; ++slot)
+      {
+        cursor.seek(symbolTable + 8*slot);
+        uint32_t nameOffset = ExtractUInt32(cursor);
+        uint32_t vectorOffset = ExtractUInt32(cursor);
+        if ((nameOffset == 0) && (vectorOffset == 0)) continue;
+
+        // Names are fully qualified
+        poolCursor.seek(constantPool + nameOffset);
+        std::string name = ExtractString(poolCursor);
+
+        poolCursor.seek(constantPool + vectorOffset);
+        uint32_t count = ExtractUInt32(poolCursor);
+        for (uint32_t i = 0; i < count; ++i)
+        {
+          uint32_t value = ExtractUInt32(poolCursor);
+          // Indices past the units are type units
+          uint32_t cu = value & 0xffffff;
+          if ((cu >= cuOffsets.size()) || (units.find(cuOffsets[cu]) == units.end())) continue;
+
+          dwarf_t::tag_t tag = dwarf_t::DW_TAG_NULL;
+          switch ((value >> 28) & 0x7)
+          {
+            case 2: tag = dwarf_t::DW_TAG_variable; break;
+            case 3: tag = dwarf_t::DW_TAG_subprogram; break;
+            default: break;
+          }
+          add(name.substr(qualifierLength(name)), {cuOffsets[cu], NO_DIE, tag});
+        }
+      }
+
+      for (auto offset : cuOffsets)
+      {
+        if (units.find(offset) != units.end()) covered.insert(offset);
+      }
+      return true;
+    }
+
+  } /* namespace dwarf */
+} /* namespace penguinTrace */
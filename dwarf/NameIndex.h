@@ -0,0 +1,88 @@
+// ----------------------------------------------------------------
+// Copyright (C) 2019 Alex Beharrell
+//
+// This file is part of penguinTrace.
+//
+// penguinTrace is free software: you can redistribute it and/or
+// modify it under the terms of the GNU Affero General Public
+// License as published by the Free Software Foundation, either
+// version 3 of the License, or any later version.
+//
+// penguinTrace is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public
+// License along with penguinTrace. If not, see
+// <https://www.gnu.org/licenses/>.
+// ----------------------------------------------------------------
+//
+// DWARF Name Index
+
+#ifndef DWARF_NAMEINDEX_H_
+#define DWARF_NAMEINDEX_H_
+
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "definitions.h"
+
+#include "Common.h"
+
+namespace penguinTrace
+{
+  namespace dwarf
+  {
+
+    // Units and DIEs by name, read from .debug_names or .gdb_index, or
+    //  added by scanning units neither of them cover
+    class NameIndex
+    {
+      public:
+        static const uint64_t NO_DIE = UINT64_MAX;
+        struct Entry
+        {
+          // Offset of the unit in .debug_info
+          uint64_t unit;
+          // Offset of the DIE from the start of its unit, for a split
+          //  unit from the start of the unit in the .dwo, or NO_DIE if
+          //  only the unit is known
+          uint64_t die;
+          // DW_TAG_NULL if the kind of DIE isn't known
+          dwarf_t::tag_t tag;
+        };
+        typedef std::vector<Entry> Entries;
+
+        // Units are the offsets of all units, those with names in the
+        //  index are added to covered
+        bool readDebugNames(ByteCursor& cursor, SectionMap& sections,
+                            std::set<uint64_t>& units, std::set<uint64_t>& covered);
+        bool readGdbIndex(ByteCursor& cursor, std::set<uint64_t>& units,
+                          std::set<uint64_t>& covered);
+        void add(const std::string& name, const Entry& entry)
+        {
+          names[name].push_back(entry);
+        }
+        const Entries* find(const std::string& name)
+        {
+          auto it = names.find(name);
+          return (it != names.end()) ? &it->second : nullptr;
+        }
+        size_t size()
+        {
+          return names.size();
+        }
+        // Length of the scope qualifier of a name, "ns::cls::" in
+        //  "ns::cls::f<a::b>", as names are indexed without it
+        static size_t qualifierLength(const std::string& name);
+      private:
+        std::unordered_map<std::string, Entries> names;
+    };
+
+  } /* namespace dwarf */
+} /* namespace penguinTrace */
+
+#endif /* DWARF_NAMEINDEX_H_ */
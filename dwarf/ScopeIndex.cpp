@@ -0,0 +1,75 @@
+// ----------------------------------------------------------------
+// Copyright (C) 2019 Alex Beharrell
+//
+// This file is part of penguinTrace.
+//
+// penguinTrace is free software: you can redistribute it and/or
+// modify it under the terms of the GNU Affero General Public
+// License as published by the Free Software Foundation, either
+// version 3 of the License, or any later version.
+//
+// penguinTrace is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public
+// License along with penguinTrace. If not, see
+// <https://www.gnu.org/licenses/>.
+// ----------------------------------------------------------------
+//
+// DWARF Scope Address Ranges
+
+#include "ScopeIndex.h"
+
+#include <algorithm>
+
+namespace penguinTrace
+{
+  namespace dwarf
+  {
+
+    void ScopeIndex::add(uint64_t low, uint64_t high, DIE* die)
+    {
+      scopes.push_back({low, high, die, NO_PARENT});
+    }
+
+    void ScopeIndex::build()
+    {
+      // Outer scopes first, equal ranges stay in tree order
+      std::stable_sort(scopes.begin(), scopes.end(),
+          [](const Scope& a, const Scope& b)
+          {
+            return (a.low < b.low) || ((a.low == b.low) && (a.high > b.high));
+          });
+
+      std::vector<size_t> open;
+      for (size_t i = 0; i < scopes.size(); ++i)
+      {
+        while (!open.empty() && (scopes[open.back()].high <= scopes[i].low))
+        {
+          open.pop_back();
+        }
+        if (!open.empty()) scopes[i].parent = open.back();
+        open.push_back(i);
+      }
+    }
+
+    void ScopeIndex::containing(uint64_t pc, std::vector<DIE*>& chain)
+    {
+      auto it = std::upper_bound(scopes.begin(), scopes.end(), pc,
+          [](uint64_t p, const Scope& s) { return p < s.low; });
+      if (it == scopes.begin()) return;
+
+      // Last scope starting at or before the PC, anything containing
+      //  the PC is either it or encloses it
+      size_t i = (it - scopes.begin()) - 1;
+      while (i != NO_PARENT)
+      {
+        if (pc < scopes[i].high) chain.push_back(scopes[i].die);
+        i = scopes[i].parent;
+      }
+    }
+
+  } /* namespace dwarf */
+} /* namespace penguinTrace */
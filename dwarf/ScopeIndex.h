@@ -0,0 +1,66 @@
+// ----------------------------------------------------------------
+// Copyright (C) 2019 Alex Beharrell
+//
+// This file is part of penguinTrace.
+//
+// penguinTrace is free software: you can redistribute it and/or
+// modify it under the terms of the GNU Affero General Public
+// License as published by the Free Software Foundation, either
+// version 3 of the License, or any later version.
+//
+// penguinTrace is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public
+// License along with penguinTrace. If not, see
+// <https://www.gnu.org/licenses/>.
+// ----------------------------------------------------------------
+//
+// DWARF Scope Address Ranges
+
+#ifndef DWARF_SCOPEINDEX_H_
+#define DWARF_SCOPEINDEX_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+namespace penguinTrace
+{
+  namespace dwarf
+  {
+
+    class DIE;
+
+    // PC ranges of the scopes (subprograms, blocks, inlined subroutines)
+    //  in a unit, sorted by start address. Ranges are expected to nest, so
+    //  each scope links to the closest one enclosing it.
+    class ScopeIndex
+    {
+      public:
+        void add(uint64_t low, uint64_t high, DIE* die);
+        void build();
+        // Scopes containing the PC, innermost first
+        void containing(uint64_t pc, std::vector<DIE*>& chain);
+        size_t size()
+        {
+          return scopes.size();
+        }
+      private:
+        static const size_t NO_PARENT = SIZE_MAX;
+        struct Scope
+        {
+          uint64_t low;
+          uint64_t high;
+          DIE* die;
+          size_t parent;
+        };
+        std::vector<Scope> scopes;
+    };
+
+  } /* namespace dwarf */
+} /* namespace penguinTrace */
+
+#endif /* DWARF_SCOPEINDEX_H_ */
@@ -0,0 +1,98 @@
+// ----------------------------------------------------------------
+// Copyright (C) 2019 Alex Beharrell
+//
+// This file is part of penguinTrace.
+//
+// penguinTrace is free software: you can redistribute it and/or
+// modify it under the terms of the GNU Affero General Public
+// License as published by the Free Software Foundation, either
+// version 3 of the License, or any later version.
+//
+// penguinTrace is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public
+// License along with penguinTrace. If not, see
+// <https://www.gnu.org/licenses/>.
+// ----------------------------------------------------------------
+//
+// Decompression of Compressed Sections
+
+#include "Decompress.h"
+
+#ifdef USE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef USE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace penguinTrace
+{
+  namespace object
+  {
+
+    std::string compressionName(compression_t type)
+    {
+      switch (type)
+      {
+        case COMPRESS_ZLIB:
+          return "zlib";
+        case COMPRESS_ZSTD:
+          return "zstd";
+      }
+      return "unknown";
+    }
+
+    bool canDecompress(compression_t type)
+    {
+      switch (type)
+      {
+        case COMPRESS_ZLIB:
+#ifdef USE_ZLIB
+          return true;
+#else
+          return false;
+#endif
+        case COMPRESS_ZSTD:
+#ifdef USE_ZSTD
+          return true;
+#else
+          return false;
+#endif
+      }
+      return false;
+    }
+
+    bool decompress(compression_t type, const uint8_t* src, size_t srcSize,
+                    uint8_t* dst, size_t dstSize)
+    {
+      switch (type)
+      {
+        case COMPRESS_ZLIB:
+        {
+#ifdef USE_ZLIB
+          uLongf outSize = dstSize;
+          int ret = uncompress(dst, &outSize, src, srcSize);
+          return (ret == Z_OK) && (outSize == dstSize);
+#else
+          return false;
+#endif
+        }
+        case COMPRESS_ZSTD:
+        {
+#ifdef USE_ZSTD
+          size_t ret = ZSTD_decompress(dst, dstSize, src, srcSize);
+          return !ZSTD_isError(ret) && (ret == dstSize);
+#else
+          return false;
+#endif
+        }
+      }
+      return false;
+    }
+
+  } /* namespace object */
+} /* namespace penguinTrace */
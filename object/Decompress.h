@@ -0,0 +1,51 @@
+// ----------------------------------------------------------------
+// Copyright (C) 2019 Alex Beharrell
+//
+// This file is part of penguinTrace.
+//
+// penguinTrace is free software: you can redistribute it and/or
+// modify it under the terms of the GNU Affero General Public
+// License as published by the Free Software Foundation, either
+// version 3 of the License, or any later version.
+//
+// penguinTrace is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public
+// License along with penguinTrace. If not, see
+// <https://www.gnu.org/licenses/>.
+// ----------------------------------------------------------------
+//
+// Decompression of Compressed Sections
+
+#ifndef OBJECT_DECOMPRESS_H_
+#define OBJECT_DECOMPRESS_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace penguinTrace
+{
+  namespace object
+  {
+
+    enum compression_t
+    {
+      COMPRESS_ZLIB,
+      COMPRESS_ZSTD
+    };
+
+    std::string compressionName(compression_t type);
+    // Support depends on the libraries penguinTrace was built with
+    bool canDecompress(compression_t type);
+    // Output must exactly fill dst
+    bool decompress(compression_t type, const uint8_t* src, size_t srcSize,
+                    uint8_t* dst, size_t dstSize);
+
+  } /* namespace object */
+} /* namespace penguinTrace */
+
+#endif /* OBJECT_DECOMPRESS_H_ */
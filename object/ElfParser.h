@@ -25,9 +25,15 @@
 #ifdef USE_ELF
 #include <elf.h>
 
+#ifndef ELFCOMPRESS_ZSTD
+#define ELFCOMPRESS_ZSTD 2
+#endif
+
+#include <cstring>
 #include <fstream>
 #include <list>
 
+#include "Decompress.h"
 #include "Parser.h"
 
 #include "../common/ComponentLogger.h"
@@ -63,6 +69,7 @@ namespace penguinTrace
         typedef Elf64_Shdr SectionHeader;
         typedef Elf64_Phdr ProgHeader;
         typedef Elf64_Sym  Symbol;
+        typedef Elf64_Chdr CompressionHeader;
     };
 
     template <> class ElfParser::Types<ELFCLASS32>
@@ -72,6 +79,7 @@ namespace penguinTrace
         typedef Elf32_Shdr SectionHeader;
         typedef Elf32_Phdr ProgHeader;
         typedef Elf32_Sym  Symbol;
+        typedef Elf32_Chdr CompressionHeader;
     };
 
     template<typename T>
@@ -90,6 +98,7 @@ namespace penguinTrace
       typedef typename Types<N>::SectionHeader SHdr;
       typedef typename Types<N>::ProgHeader PHdr;
       typedef typename Types<N>::Symbol Sym;
+      typedef typename Types<N>::CompressionHeader CHdr;
 
       auto header = readStruct<EHdr>(strm, 0);
 
@@ -158,6 +167,8 @@ namespace penguinTrace
       uint64_t nameSHdrOffset = nameSHdr.sh_offset;
 
       std::map<std::string, SHdr> sHeaders;
+      // Compression and uncompressed size of compressed sections
+      std::map<std::string, std::pair<compression_t, uint64_t> > compressed;
       std::list<PHdr> pHeaders;
       std::string symTable = ".symtab";
       std::string strTable = ".strtab";
@@ -170,7 +181,12 @@ namespace penguinTrace
         std::string name = "";
         std::getline(strm, name, '\0');
 
-        assert(sHeaders.find(name) == sHeaders.end());
+        // Also catches .debug_ sections already read from a .zdebug_ copy
+        if (sHeaders.find(name) != sHeaders.end())
+        {
+          logger->log(Logger::WARN, "Duplicate section '"+name+"' ignored");
+          continue;
+        }
 
         if (data.sh_type == SHT_SYMTAB)
         {
@@ -185,10 +201,53 @@ namespace penguinTrace
           strTable = name;
         }
 
-        auto buffer = std::unique_ptr<std::vector<uint8_t> >(new std::vector<uint8_t>(data.sh_size));
+        uint64_t fileOffset = data.sh_offset;
+        uint64_t fileSize = data.sh_size;
+
+        // Compressed sections are read as they are and only
+        //  decompressed when used
+        if ((data.sh_flags & SHF_COMPRESSED) && (data.sh_size >= sizeof(CHdr)))
+        {
+          auto chdr = readStruct<CHdr>(strm, data.sh_offset);
+          if ((chdr.ch_type == ELFCOMPRESS_ZLIB) || (chdr.ch_type == ELFCOMPRESS_ZSTD))
+          {
+            compression_t type = (chdr.ch_type == ELFCOMPRESS_ZLIB) ? COMPRESS_ZLIB : COMPRESS_ZSTD;
+            compressed[name] = {type, chdr.ch_size};
+            fileOffset += sizeof(CHdr);
+            fileSize -= sizeof(CHdr);
+          }
+          else
+          {
+            logger->log(Logger::WARN, "Unknown compression for section '"+name+"'");
+          }
+        }
+        else if ((name.compare(0, 8, ".zdebug_") == 0) && (data.sh_size >= 12))
+        {
+          // GNU format: "ZLIB" then the big-endian uncompressed size
+          uint8_t zhdr[12];
+          strm.seekg(data.sh_offset);
+          strm.read(reinterpret_cast<char*>(zhdr), sizeof(zhdr));
+          if (memcmp(zhdr, "ZLIB", 4) == 0)
+          {
+            uint64_t zsize = 0;
+            for (int b = 4; b < 12; ++b) zsize = (zsize << 8) | zhdr[b];
+            std::string debugName = ".debug_" + name.substr(8);
+            if (sHeaders.find(debugName) != sHeaders.end())
+            {
+              logger->log(Logger::WARN, "Section '"+name+"' duplicates '"+debugName+"', ignored");
+              continue;
+            }
+            name = debugName;
+            compressed[name] = {COMPRESS_ZLIB, zsize};
+            fileOffset += sizeof(zhdr);
+            fileSize -= sizeof(zhdr);
+          }
+        }
+
+        auto buffer = std::unique_ptr<std::vector<uint8_t> >(new std::vector<uint8_t>(fileSize));
 
-        strm.seekg(data.sh_offset);
-        strm.read(reinterpret_cast<char*>(buffer->data()), data.sh_size);
+        strm.seekg(fileOffset);
+        strm.read(reinterpret_cast<char*>(buffer->data()), fileSize);
 
         sHeaders[name] = data;
         sectionBuffers.insert(std::make_pair(name, std::move(buffer)));
@@ -227,7 +286,28 @@ namespace penguinTrace
           }
         }
 
-        SectionPtr section(new object::Section(name, addr, hdr.sh_size, isCode, dataPtr));
+        SectionPtr section;
+        auto compIt = compressed.find(name);
+        if (compIt != compressed.end())
+        {
+          compression_t type = compIt->second.first;
+          if (!canDecompress(type))
+          {
+            logger->log(Logger::WARN, "Cannot read section '"+name+"', built without "+
+                compressionName(type)+" support");
+            continue;
+          }
+          size_t srcSize = sectionBuffers.find(name)->second->size();
+          section = SectionPtr(new object::Section(name, addr, compIt->second.second, isCode,
+              [type, dataPtr, srcSize](uint8_t* dst, size_t size)
+              {
+                return decompress(type, dataPtr, srcSize, dst, size);
+              }));
+        }
+        else
+        {
+          section = SectionPtr(new object::Section(name, addr, hdr.sh_size, isCode, dataPtr));
+        }
 
         if (name != "")
         {
@@ -250,6 +330,15 @@ namespace penguinTrace
         s2 << "section = " << name << (isCode ? " (code)" : "") << std::endl;
       }
 
+      // Split DWARF objects may have no symbols
+      if ((sHeaders.find(symTable) == sHeaders.end()) ||
+          (sectionByName.find(strTable) == sectionByName.end()))
+      {
+        logger->log(Logger::DBG, s.str());
+        logger->log(Logger::TRACE, s2.str());
+        return true;
+      }
+
       assert((sHeaders[symTable].sh_size % sizeof(Sym)) == 0);
       uint64_t numSymbs = sHeaders[symTable].sh_size / sizeof(Sym);
 
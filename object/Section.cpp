@@ -22,14 +22,41 @@
 
 #include "Section.h"
 
+#include "../common/Exception.h"
+
 namespace penguinTrace
 {
   namespace object
   {
 
+    Section::Section(Section& parent, uint64_t offset, size_t size)
+        : name(parent.name), virtualAddr(parent.virtualAddr+offset), size(size),
+          code(parent.code), data(nullptr)
+    {
+      if ((offset > parent.size) || (size > (parent.size - offset)))
+      {
+        throw Exception("Range outside of section '"+name+"'", __EINFO__);
+      }
+      parent.load();
+      data = parent.data + offset;
+      buffer = std::unique_ptr<MemoryBuffer>(new MemoryBuffer(data, size));
+    }
+
     Section::~Section()
     {
     }
 
+    void Section::loadContents()
+    {
+      std::unique_ptr<uint8_t[]> contents(new uint8_t[size]);
+      if (!loader(contents.get(), size))
+      {
+        throw Exception("Failed to load contents of section '"+name+"'", __EINFO__);
+      }
+      storage = std::move(contents);
+      data = storage.get();
+      buffer = std::unique_ptr<MemoryBuffer>(new MemoryBuffer(data, size));
+    }
+
   } /* namespace object */
 } /* namespace penguinTrace */
@@ -23,8 +23,11 @@
 #ifndef OBJECT_SECTION_H_
 #define OBJECT_SECTION_H_
 
+#include <functional>
 #include <memory>
+#include <mutex>
 
+#include "../common/ByteCursor.h"
 #include "../common/MemoryBuffer.h"
 
 namespace penguinTrace
@@ -39,12 +42,23 @@ namespace penguinTrace
         {
 
         };
+        // Fills the contents of a section, returns false on failure
+        typedef std::function<bool(uint8_t* dst, size_t size)> Loader;
         Section(std::string name, uint64_t addr, size_t size,
             bool code, uint8_t* data)
-            : name(name), virtualAddr(addr), size(size), code(code)
+            : name(name), virtualAddr(addr), size(size), code(code), data(data)
         {
           buffer = std::unique_ptr<MemoryBuffer>(new MemoryBuffer(data, size));
         }
+        // Contents are only produced (e.g. decompressed) when first used
+        Section(std::string name, uint64_t addr, size_t size,
+            bool code, Loader loader)
+            : name(name), virtualAddr(addr), size(size), code(code), data(nullptr),
+              loader(loader)
+        {
+        }
+        // Part of another section, which must outlive it
+        Section(Section& parent, uint64_t offset, size_t size);
         virtual ~Section();
         std::string getName()
         {
@@ -64,9 +78,24 @@ namespace penguinTrace
         }
         MemoryBuffer& getContents()
         {
+          load();
           buffer->pubseekpos(0);
           return *buffer;
         }
+        ByteCursor getCursor()
+        {
+          load();
+          return ByteCursor(data, size);
+        }
+        bool isLazy()
+        {
+          return loader != nullptr;
+        }
+        // Safe to call from several threads
+        void load()
+        {
+          if (loader) std::call_once(loaded, &Section::loadContents, this);
+        }
         bool contains(uint64_t addr)
         {
           return (addr >= virtualAddr) && (addr < (virtualAddr+size));
@@ -76,7 +105,12 @@ namespace penguinTrace
         uint64_t     virtualAddr;
         size_t       size;
         bool         code;
+        uint8_t*     data;
         std::unique_ptr<MemoryBuffer> buffer;
+        Loader       loader;
+        std::once_flag loaded;
+        std::unique_ptr<uint8_t[]> storage;
+        void loadContents();
     };
 
   } /* namespace object */
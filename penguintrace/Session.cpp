@@ -22,6 +22,13 @@
 
 #include "Session.h"
 
+#include <cassert>
+#include <errno.h>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
 #include "../common/Exception.h"
 
 namespace penguinTrace
@@ -35,6 +42,23 @@ namespace penguinTrace
       std::time_t t = std::time(nullptr);
       timeCreated = t;
       timeModified = t;
+
+      taskEventFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+      epollFd = epoll_create1(EPOLL_CLOEXEC);
+      if (taskEventFd == -1 || epollFd == -1)
+      {
+        throw Exception("Failed to create session event descriptors", __EINFO__);
+      }
+      struct epoll_event ev;
+      ev.events = EPOLLIN;
+      ev.data.fd = taskEventFd;
+      epoll_ctl(epollFd, EPOLL_CTL_ADD, taskEventFd, &ev);
+    }
+
+    Session::~Session()
+    {
+      close(epollFd);
+      close(taskEventFd);
     }
 
     std::queue<CompileFailureReason>* Session::getCompileFailures()
@@ -84,6 +108,7 @@ namespace penguinTrace
 
     void Session::setParser(std::unique_ptr<object::Parser> p, std::unique_ptr<ComponentLogger> l)
     {
+      std::lock_guard<std::mutex> lock(dwarfMutex);
       parser = std::move(p);
       dwarfInfo = std::unique_ptr<dwarf::Info>(new dwarf::Info(parser.get(), std::move(l)));
     }
@@ -108,6 +133,11 @@ namespace penguinTrace
       return dwarfInfo.get();
     }
 
+    std::unique_lock<std::mutex> Session::lockDwarfInfo()
+    {
+      return std::unique_lock<std::mutex>(dwarfMutex);
+    }
+
     std::map<uint64_t, object::LineDisassembly>* Session::getDisasmMap()
     {
       return &disasmMap;
@@ -119,6 +149,12 @@ namespace penguinTrace
         std::lock_guard<std::mutex> lock(threadMutex);
         taskQueueRunning = false;
       }
+      // Don't wait on a running tracee
+      if (stepper)
+      {
+        stepper->requestStop();
+      }
+      wakeTaskQueue();
 
       if (thread)
       {
@@ -184,6 +220,41 @@ namespace penguinTrace
       }
 
       taskQueue.push(std::move(c));
+      wakeTaskQueue();
+    }
+
+    void Session::enqueueStop()
+    {
+      {
+        std::lock_guard<std::mutex> log(stopMutex);
+        pendingStop = true;
+      }
+      // A running command finishes once the tracee is killed
+      if (stepper)
+      {
+        stepper->requestStop();
+      }
+      wakeTaskQueue();
+    }
+
+    void Session::wakeTaskQueue()
+    {
+      uint64_t one = 1;
+      ssize_t ret = write(taskEventFd, &one, sizeof(one));
+      assert(ret == sizeof(one));
+    }
+
+    void Session::waitForTask()
+    {
+      // Sleeps until woken, commands queued since the queue was checked
+      //  leave the event set so aren't missed
+      struct epoll_event ev;
+      if (epoll_wait(epollFd, &ev, 1, -1) == 1)
+      {
+        uint64_t count;
+        ssize_t ret = read(taskEventFd, &count, sizeof(count));
+        assert(ret == sizeof(count) || errno == EAGAIN);
+      }
     }
 
     void Session::processTaskQueue()
@@ -218,12 +289,14 @@ namespace penguinTrace
             task = std::move(taskQueue.front());
           }
         }
-        // Clear lock during long running task
-        std::this_thread::yield();
         if (task)
         {
           task->run();
         }
+        else
+        {
+          waitForTask();
+        }
         {
           std::lock_guard<std::mutex> lock(threadMutex);
           if (task)
@@ -233,14 +306,13 @@ namespace penguinTrace
 
           run = taskQueueRunning;
         }
-        if (taskQueue.empty())
         {
           std::lock_guard<std::mutex> log(stopMutex);
           if (pendingStop)
           {
             std::lock_guard<std::mutex> lock(threadMutex);
             run = false;
-            // Should be empty but MT
+            // Commands after a stop are dropped
             while (!taskQueue.empty())
             {
               taskQueue.pop();
@@ -248,8 +320,6 @@ namespace penguinTrace
             pendingRemove = true;
           }
         }
-        // Yield thread when mutex is out of scope
-        std::this_thread::yield();
       }
     }
 
@@ -44,6 +44,7 @@ namespace penguinTrace
   {
     public:
       Session(std::string f, std::string name, std::function<void()> sc);
+      virtual ~Session();
       std::queue<CompileFailureReason>* getCompileFailures();
       std::string executable();
       void setParser(std::unique_ptr<object::Parser> p, std::unique_ptr<ComponentLogger> l);
@@ -51,15 +52,14 @@ namespace penguinTrace
       void setStepper(std::unique_ptr<Stepper> s);
       Stepper* getStepper();
       dwarf::Info* getDwarfInfo();
+      // Held while the DWARF information is used from a request thread, it
+      //  is parsed lazily and replaced (with the parser) by a new build
+      std::unique_lock<std::mutex> lockDwarfInfo();
       std::map<uint64_t, object::LineDisassembly>* getDisasmMap();
       bool pendingCommands();
       void enqueueCommand(std::unique_ptr<SessionCmd> c);
       void cleanup();
-      void enqueueStop()
-      {
-        std::lock_guard<std::mutex> log(stopMutex);
-        pendingStop = true;
-      }
+      void enqueueStop();
       bool toRemove();
       void setRemove();
       std::string timeString();
@@ -81,6 +81,7 @@ namespace penguinTrace
       std::unique_ptr<std::thread> thread;
       std::queue<std::unique_ptr<SessionCmd> > taskQueue;
       std::unique_ptr<dwarf::Info> dwarfInfo;
+      std::mutex dwarfMutex;
       bool taskQueueRunning;
       std::mutex stopMutex;
       bool pendingStop;
@@ -91,9 +92,14 @@ namespace penguinTrace
       std::string source;
       std::string lang;
       std::unique_ptr<std::vector<char> > objBuffer;
+      // Wakes the idle task thread when there is a command or stop
+      int taskEventFd;
+      int epollFd;
 
       void processTaskQueue();
       void processTaskQueueImpl();
+      void wakeTaskQueue();
+      void waitForTask();
   };
 } /* namespace penguinTrace */
 
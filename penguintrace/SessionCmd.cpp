@@ -44,28 +44,27 @@ namespace penguinTrace
 
   void StepCmd::run()
   {
-    stepper->step(step);
-
-    if (STEPPER_ALWAYS_SINGLE_STEP)
+    if (step == STEP_BACK || step == STEP_BACK_CONT)
     {
-      bool done = stepper->singleStepDone(step);
-
-      while (!done)
-      {
-        stepper->step(step);
-        done = stepper->singleStepDone(step);
-      }
+      stepper->reverse(step == STEP_BACK_CONT);
+      return;
     }
 
-    if (stepper->shouldStepAgain() && stepper->active())
+    stepper->step(step);
+
+    bool done = stepper->singleStepDone(step);
+
+    while (!done)
     {
-      stepper->step(STEP_INSTR);
+      stepper->step(step);
+      done = stepper->singleStepDone(step);
     }
 
     if (stepper->shouldContinueToEnd() && stepper->active())
     {
       stepper->step(STEP_CONT);
     }
+    stepper->recordStop();
   }
 
   std::string StepCmd::repr()
@@ -73,16 +72,6 @@ namespace penguinTrace
     return "StepCmd";
   }
 
-  void StdinCmd::run()
-  {
-    stepper->sendStdin(string);
-  }
-
-  std::string StdinCmd::repr()
-  {
-    return "StdinCmd";
-  }
-
   void CompileCmd::run()
   {
     // Empty any unconsumed compile failures in session
@@ -323,6 +312,7 @@ namespace penguinTrace
         std::unique_ptr<Stepper> stepper(
             new Stepper(session->executable(), session->getParser(),
                         std::move(argsQueue), log->subLogger("STEP")));
+        stepper->seedDisassembly(*session->getDisasmMap());
 
         if (stepper->init())
         {
@@ -50,17 +50,6 @@ namespace penguinTrace
       StepType step;
   };
 
-  class StdinCmd : public SessionCmd
-  {
-    public:
-      StdinCmd(Stepper* s, std::string str) : stepper(s), string(str) {}
-      virtual void run();
-      virtual std::string repr();
-    private:
-      Stepper* stepper;
-      std::string string;
-  };
-
   class CompileCmd : public SessionCmd
   {
     public:
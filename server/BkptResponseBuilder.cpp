@@ -68,6 +68,7 @@ namespace penguinTrace
         auto setIt = action.find("set");
         auto addrIt = action.find("addr");
         auto lineIt = action.find("line");
+        auto functionIt = action.find("function");
         bool set = (setIt != action.end()) && (setIt->second == "true");
         setBkptOk &= setIt != action.end();
         if (addrIt != action.end())
@@ -94,18 +95,55 @@ namespace penguinTrace
         }
         else if (lineIt != action.end())
         {
-          std::stringstream s(lineIt->second);
+          // Either a line in the main source or file:line
+          std::string lineStr = urlDecode(lineIt->second);
+          auto sep = lineStr.rfind(':');
+          std::stringstream s(lineStr.substr((sep == std::string::npos) ? 0 : sep+1));
           uint64_t addr = 0;
           s >> addr;
+          bool line = true;
+          if (addr != 0 && sep != std::string::npos)
+          {
+            auto dwarfLock = session->lockDwarfInfo();
+            auto loc = session->getDwarfInfo()->exactLocationByLine(lineStr.substr(0, sep), addr);
+            addr = loc.found() ? loc.pc() : 0;
+            line = false;
+          }
           if (addr != 0)
           {
             if (set)
             {
-              session->getStepper()->queueBreakpoint(addr, true);
+              session->getStepper()->queueBreakpoint(addr, line);
             }
             else
             {
-              session->getStepper()->removeBreakpoint(addr, true);
+              session->getStepper()->removeBreakpoint(addr, line);
+            }
+          }
+          else
+          {
+            // Failed to get address
+            setBkptOk = false;
+          }
+        }
+        else if (functionIt != action.end())
+        {
+          // Entry of a function definition, by name or linkage name
+          uint64_t addr = 0;
+          {
+            auto dwarfLock = session->lockDwarfInfo();
+            auto func = session->getDwarfInfo()->functionByName(urlDecode(functionIt->second));
+            addr = (func != nullptr) ? func->lowPC() : 0;
+          }
+          if (addr != 0)
+          {
+            if (set)
+            {
+              session->getStepper()->queueBreakpoint(addr, false);
+            }
+            else
+            {
+              session->getStepper()->removeBreakpoint(addr, false);
             }
           }
           else
@@ -116,7 +154,7 @@ namespace penguinTrace
         }
         else
         {
-          logger->log(Logger::ERROR, "No address or line for breakpoint");
+          logger->log(Logger::ERROR, "No address, line or function for breakpoint");
           setBkptOk = false;
         }
 
@@ -28,6 +28,8 @@
 #include "CompileResponseBuilder.h"
 #include "StepResponseBuilder.h"
 #include "BkptResponseBuilder.h"
+#include "WatchResponseBuilder.h"
+#include "ThreadResponseBuilder.h"
 #include "StateResponseBuilder.h"
 #include "StopResponseBuilder.h"
 #include "StdinResponseBuilder.h"
@@ -113,8 +115,16 @@ namespace penguinTrace
           new StepResponseBuilder(STEP_LINE, sMgr, l->subLogger("step")));
       r->routeTable["continue"] = std::unique_ptr<ResponseBuilder> (
           new StepResponseBuilder(STEP_CONT, sMgr, l->subLogger("step")));
+      r->routeTable["step-back"] = std::unique_ptr<ResponseBuilder> (
+          new StepResponseBuilder(STEP_BACK, sMgr, l->subLogger("step")));
+      r->routeTable["continue-back"] = std::unique_ptr<ResponseBuilder> (
+          new StepResponseBuilder(STEP_BACK_CONT, sMgr, l->subLogger("step")));
       r->routeTable["breakpoint"] = std::unique_ptr<ResponseBuilder> (
           new BkptResponseBuilder (sMgr, l->subLogger ("bkpt")));
+      r->routeTable["watchpoint"] = std::unique_ptr<ResponseBuilder> (
+          new WatchResponseBuilder(sMgr, l->subLogger("watch")));
+      r->routeTable["thread"] = std::unique_ptr<ResponseBuilder> (
+          new ThreadResponseBuilder(sMgr, l->subLogger("thread")));
       r->routeTable["stdin"] = std::unique_ptr<ResponseBuilder>(
           new StdinResponseBuilder(sMgr, l->subLogger("stdin")));
       r->routeTable["session-state"] = std::unique_ptr<ResponseBuilder> (
@@ -29,6 +29,7 @@ namespace penguinTrace
 
     std::unique_ptr<Serialize> Serialize::sessionState(Session& session)
     {
+      auto dwarfLock = session.lockDwarfInfo();
       std::unique_ptr<Serialize> resp(new Serialize());
 
       resp->stream << "{";
@@ -111,12 +112,20 @@ namespace penguinTrace
           resp->addInt("line", loc.line());
           resp->stream << ",";
           resp->addInt("column", loc.column());
+          resp->stream << ",";
+          resp->addString("file", jsonEscape(loc.filename()));
+          resp->stream << ",";
+          resp->addBool("main", session.getDwarfInfo()->inMainSource(loc));
           resp->stream << "},";
         }
         resp->addQueue("stdout", session.getStepper()->getStdout());
         resp->stream << ",";
         resp->addBreakpoints(session);
         resp->stream << ",";
+        resp->addWatchpoints(session);
+        resp->stream << ",";
+        resp->addThreads(session);
+        resp->stream << ",";
         resp->addStackTrace(session);
         resp->stream << "}";
 
@@ -127,14 +136,11 @@ namespace penguinTrace
 
     std::unique_ptr<Serialize> Serialize::stepState(Session& session)
     {
+      auto dwarfLock = session.lockDwarfInfo();
       std::unique_ptr<Serialize> resp(new Serialize());
       uint64_t pc = session.getStepper()->getLastPC();
-
-      auto disItr = session.getDisasmMap ()->find (pc);
-      std::string disasmStr =
-          (disItr != session.getDisasmMap ()->end ()) ?
-              disItr->second.getCodeDis () :
-              session.getStepper ()->getLastDisasm ();
+      // Stepper's disassembly cache is seeded from the session's map
+      std::string disasmStr = session.getStepper()->getLastDisasm();
 
       auto loc = session.getDwarfInfo()->locationByPC(pc, true);
 
@@ -167,6 +173,10 @@ namespace penguinTrace
         resp->addInt("line", loc.line());
         resp->stream << ",";
         resp->addInt("column", loc.column());
+        resp->stream << ",";
+        resp->addString("file", jsonEscape(loc.filename()));
+        resp->stream << ",";
+        resp->addBool("main", session.getDwarfInfo()->inMainSource(loc));
         resp->stream << "},";
       }
 
@@ -174,14 +184,51 @@ namespace penguinTrace
       resp->stream << ",";
       resp->addBreakpoints(session);
       resp->stream << ",";
+      resp->addWatchpoints(session);
+      resp->stream << ", \"watchHit\": ";
+      resp->stream << (session.getStepper()->hitWatch() ? session.getStepper()->getWatchAddr() : 0);
+      resp->stream << ",";
+      resp->addThreads(session);
+      resp->stream << ",";
       resp->addStackTrace(session);
       resp->stream << "}";
 
       return resp;
     }
 
+    std::unique_ptr<Serialize> Serialize::watchState(Session &session, bool ok)
+    {
+      std::unique_ptr<Serialize> resp(new Serialize());
+
+      resp->stream << "{";
+      resp->addBool("watch", ok);
+      resp->stream << ",";
+      resp->addBool("error", false);
+      resp->stream << ",";
+      resp->addWatchpoints(session);
+      resp->stream << "}";
+
+      return resp;
+    }
+
+    std::unique_ptr<Serialize> Serialize::threadState(Session &session, bool ok)
+    {
+      std::unique_ptr<Serialize> resp(new Serialize());
+
+      resp->stream << "{";
+      resp->addBool("thread", ok);
+      resp->stream << ",";
+      resp->addBool("error", false);
+      resp->stream << ",";
+      resp->addThreads(session);
+      resp->stream << "}";
+
+      return resp;
+    }
+
     std::unique_ptr<Serialize> Serialize::bkptState(Session &session, bool ok)
     {
+      auto dwarfLock = session.lockDwarfInfo();
       std::unique_ptr<Serialize> resp(new Serialize());
 
       resp->stream << "{";
@@ -221,7 +268,7 @@ namespace penguinTrace
       for (auto b : bkptList)
       {
         auto loc = session.getDwarfInfo()->exactLocationByPC(b);
-        if (loc.found())
+        if (session.getDwarfInfo()->inMainSource(loc))
         {
           bkptLineList.insert(loc.line());
         }
@@ -233,6 +280,35 @@ namespace penguinTrace
       });
     }
 
+    void Serialize::addWatchpoints(Session& session)
+    {
+      auto watches = session.getStepper()->getWatchpoints();
+      auto pendWatches = session.getStepper()->getPendingWatchpoints();
+
+      for (auto w : pendWatches)
+      {
+        watches[w.first] = w.second;
+      }
+      addArray("watchpoints", watches.begin(), watches.end(), [&](std::pair<uint64_t, uint64_t> v) {
+        std::stringstream s;
+        s << "{\"addr\": " << v.first << ", \"len\": " << v.second << "}";
+        return s.str();
+      });
+    }
+
+    void Serialize::addThreads(Session& session)
+    {
+      auto threads = session.getStepper()->getThreads();
+      pid_t current = session.getStepper()->getCurrentThread();
+
+      addArray("threads", threads.begin(), threads.end(), [&](std::pair<pid_t, uint64_t> v) {
+        std::stringstream s;
+        s << "{\"tid\": " << v.first << ", \"pc\": " << v.second;
+        s << ", \"current\": " << (v.first == current ? "true" : "false") << "}";
+        return s.str();
+      });
+    }
+
     void Serialize::addStackTrace(Session& session)
     {
       auto stack = session.getStepper()->getStackTrace();
@@ -38,6 +38,8 @@ namespace penguinTrace
         static std::unique_ptr<Serialize> stepState(Session& session);
         static std::unique_ptr<Serialize> sessionState(Session &session);
         static std::unique_ptr<Serialize> bkptState(Session &session, bool ok);
+        static std::unique_ptr<Serialize> watchState(Session &session, bool ok);
+        static std::unique_ptr<Serialize> threadState(Session &session, bool ok);
         void print(std::ostream &out) const
         {
           out << stream.str();
@@ -67,6 +69,8 @@ namespace penguinTrace
           stream << ']';
         }
         void addBreakpoints(Session& session);
+        void addWatchpoints(Session& session);
+        void addThreads(Session& session);
         void addStackTrace(Session& session);
         void addQueue(std::string name, std::queue<std::string>& queue);
         void addMap(std::string name, std::map<std::string, uint64_t> values);
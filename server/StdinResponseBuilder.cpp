@@ -55,9 +55,8 @@ namespace penguinTrace
 
       if (session.valid() && session->getStepper() != nullptr)
       {
-        session->enqueueCommand(
-            std::unique_ptr<SessionCmd>(
-                new StdinCmd(session->getStepper(), req.getBody())));
+        // Not queued behind a running step, e.g. a tracee waiting on input
+        session->getStepper()->sendStdin(req.getBody());
 
         resp->stream() << "{\"stdin\": true}";
       }
@@ -0,0 +1,102 @@
+// ----------------------------------------------------------------
+// Copyright (C) 2019 Alex Beharrell
+//
+// This file is part of penguinTrace.
+//
+// penguinTrace is free software: you can redistribute it and/or
+// modify it under the terms of the GNU Affero General Public
+// License as published by the Free Software Foundation, either
+// version 3 of the License, or any later version.
+//
+// penguinTrace is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public
+// License along with penguinTrace. If not, see
+// <https://www.gnu.org/licenses/>.
+// ----------------------------------------------------------------
+//
+// Thread Response Builder
+
+#include "ThreadResponseBuilder.h"
+
+#include "Serialize.h"
+
+namespace penguinTrace
+{
+  namespace server
+  {
+
+    ThreadResponseBuilder::ThreadResponseBuilder(SessionManager* sMgr,
+                                                 std::unique_ptr<ComponentLogger> l)
+        : ResponseBuilder(true, true), logger(std::move(l)), sessionMgr(sMgr)
+    {
+    }
+
+    ThreadResponseBuilder::~ThreadResponseBuilder()
+    {
+    }
+
+    std::unique_ptr<Response> ThreadResponseBuilder::getResponse(Request& req)
+    {
+      logger->log(Logger::DBG, [&]() {
+        std::stringstream s;
+        s << "Request Contents:" << std::endl;
+        s << req.getBody();
+        return s.str();
+      });
+
+      std::string msg = "Thread";
+      std::unique_ptr<Response> resp(new Response(HTTP200, req, msg, "application/json; charset=utf-8"));
+
+      auto session = sessionMgr->lockSession(sessionId(req));
+
+      if (session.valid() && session->pendingCommands())
+      {
+        // Threads change while commands run on the session thread, the
+        //  list can only be read (or a thread selected) once they finish
+        resp->stream() << "{\"thread\": false, \"error\": false, \"retry\": true}";
+        logger->log(Logger::TRACE, "No threads - pending commands");
+      }
+      else if (session.valid() && session->getStepper() != nullptr)
+      {
+        pid_t tid = 0;
+        for (auto it : split(req.getBody(), '&'))
+        {
+          auto pair = split(it, '=');
+          if ((pair.size() == 2) && (pair[0] == "tid"))
+          {
+            std::stringstream s(pair[1]);
+            s >> tid;
+          }
+        }
+
+        // No commands can be queued while the session is locked, so the
+        //  tracee stays stopped. Registers of all threads are cached
+        bool selectOk = (tid != 0) && session->getStepper()->selectThread(tid);
+        if (!selectOk)
+        {
+          logger->log(Logger::ERROR, "Failed to select thread");
+        }
+
+        resp->stream() << *Serialize::threadState(*session, selectOk);
+      }
+      else
+      {
+        // Returning error to reset state of web interface
+        resp->stream() << "{\"thread\": false, \"error\": true}";
+      }
+
+      logger->log(Logger::DBG, [&]() {
+        std::stringstream s;
+        s << "Response Contents:" << std::endl;
+        s << resp->stream().str();
+        return s.str();
+      });
+      return resp;
+    }
+
+  } /* namespace server */
+} /* namespace penguinTrace */
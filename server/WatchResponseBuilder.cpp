@@ -0,0 +1,139 @@
+// ----------------------------------------------------------------
+// Copyright (C) 2019 Alex Beharrell
+//
+// This file is part of penguinTrace.
+//
+// penguinTrace is free software: you can redistribute it and/or
+// modify it under the terms of the GNU Affero General Public
+// License as published by the Free Software Foundation, either
+// version 3 of the License, or any later version.
+//
+// penguinTrace is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public
+// License along with penguinTrace. If not, see
+// <https://www.gnu.org/licenses/>.
+// ----------------------------------------------------------------
+//
+// Watchpoint Response Builder
+
+#include "WatchResponseBuilder.h"
+
+#include "Serialize.h"
+
+namespace penguinTrace
+{
+  namespace server
+  {
+
+    WatchResponseBuilder::WatchResponseBuilder(SessionManager* sMgr,
+                                               std::unique_ptr<ComponentLogger> l)
+        : ResponseBuilder(true, true), logger(std::move(l)), sessionMgr(sMgr)
+    {
+    }
+
+    WatchResponseBuilder::~WatchResponseBuilder()
+    {
+    }
+
+    std::unique_ptr<Response> WatchResponseBuilder::getResponse(Request& req)
+    {
+      logger->log(Logger::DBG, [&]() {
+        std::stringstream s;
+        s << "Request Contents:" << std::endl;
+        s << req.getBody();
+        return s.str();
+      });
+
+      std::string msg = "Watchpoint";
+      std::unique_ptr<Response> resp(new Response(HTTP200, req, msg, "application/json; charset=utf-8"));
+
+      auto session = sessionMgr->lockSession(sessionId(req));
+
+      if (session.valid() && session->getStepper() != nullptr)
+      {
+        bool setWatchOk = true;
+
+        std::map<std::string, std::string> action;
+        for (auto it : split(req.getBody(), '&'))
+        {
+          auto pair = split(it, '=');
+          if (pair.size() == 2)
+          {
+            action[pair[0]] = pair[1];
+          }
+        }
+
+        auto setIt = action.find("set");
+        auto addrIt = action.find("addr");
+        auto lenIt = action.find("len");
+        auto varIt = action.find("var");
+        bool set = (setIt != action.end()) && (setIt->second == "true");
+        setWatchOk &= setIt != action.end();
+
+        uint64_t addr = 0;
+        uint64_t len = ADDR_BYTES;
+        if (addrIt != action.end())
+        {
+          std::stringstream s(addrIt->second);
+          s >> std::hex >> addr;
+          if (lenIt != action.end())
+          {
+            std::stringstream l(lenIt->second);
+            l >> len;
+          }
+        }
+        else if (varIt != action.end())
+        {
+          // Resolving the variable reads the stopped tracee
+          if (session->pendingCommands() ||
+              !session->getStepper()->variableAddress(urlDecode(varIt->second), addr, len))
+          {
+            logger->log(Logger::ERROR, "Failed to find address for watchpoint");
+            addr = 0;
+          }
+        }
+        else
+        {
+          logger->log(Logger::ERROR, "No address or variable for watchpoint");
+        }
+
+        if (addr != 0)
+        {
+          if (set)
+          {
+            setWatchOk &= session->getStepper()->queueWatchpoint(addr, len);
+          }
+          else
+          {
+            session->getStepper()->removeWatchpoint(addr);
+          }
+        }
+        else
+        {
+          // Failed to get address
+          setWatchOk = false;
+        }
+
+        resp->stream() << *Serialize::watchState(*session, setWatchOk);
+      }
+      else
+      {
+        // Returning error to reset state of web interface
+        resp->stream() << "{\"watch\": false, \"error\": true}";
+      }
+
+      logger->log(Logger::DBG, [&]() {
+        std::stringstream s;
+        s << "Response Contents:" << std::endl;
+        s << resp->stream().str();
+        return s.str();
+      });
+      return resp;
+    }
+
+  } /* namespace server */
+} /* namespace penguinTrace */
@@ -77,6 +77,17 @@ ptrace.supportedLanguages = [
 ];
 
 ptrace.currentLanguage = null;
+
+ptrace.optLevels = [
+  {level: "0", name: "-O0 (none)"},
+  {level: "1", name: "-O1"},
+  {level: "2", name: "-O2"},
+  {level: "3", name: "-O3"},
+  {level: "s", name: "-Os (size)"},
+  {level: "g", name: "-Og (debug)"}
+];
+
+ptrace.currentOptLevel = "0";
 ptrace.menuDone = false;
 
 ptrace.autoStep = false;
@@ -324,7 +335,8 @@ ptrace.commonStateUpdate = function(data)
 
   ptrace.breakpointUpdate(data);
 
-  if (!data.done && ("location" in data))
+  // Only highlight locations in the source being shown
+  if (!data.done && ("location" in data) && data['location']['main'])
   {
     var line = data['location']['line']-1;
     var column = data['location']['column'];
@@ -512,6 +524,7 @@ ptrace.pollSessionStateNoRetry = function ()
 ptrace.compileAction = function()
 {
   var endpoint = ptrace.compileEndpoint+"?lang="+ptrace.currentLanguage.lang;
+  endpoint += "&opt="+ptrace.currentOptLevel;
   endpoint += "&args="
   endpoint +=  encodeURIComponent($('#menu-input-text')[0].value);
   $.post(endpoint, ptrace.sourceCode.getValue(), function(data) {
@@ -805,6 +818,16 @@ ptrace.setupMenu = function(arch)
     });
     $('#menu-lang').append(elem);
   });
+  $('#menu-opt').empty();
+  ptrace.optLevels.forEach(function(opt)
+  {
+    var elem = $("<li id='opt-"+opt.level+"'>"+opt.name+"</li>");
+    elem.click(function() {
+      ptrace.setOptLevel(opt.level);
+    });
+    $('#menu-opt').append(elem);
+  });
+  ptrace.setOptLevel(ptrace.currentOptLevel);
   for (var key in codeExamples)
   {
     (function() {
@@ -939,6 +962,13 @@ ptrace.setLanguage = function(lang)
   $('#lang-'+lang.lang).addClass('selected');
 }
 
+ptrace.setOptLevel = function(level)
+{
+  ptrace.currentOptLevel = level;
+  $('#menu-opt li').removeClass('selected');
+  $('#opt-'+level).addClass('selected');
+}
+
 ptrace.loadCode = function(code)
 {
   ptrace.setLanguage(code.lang);
@@ -78,10 +78,15 @@ int main(int argc, char **argv)
           {
           }
           stepper.step(penguinTrace::STEP_INSTR);
+          // Variables and stack are only evaluated on request, log every step
+          stepper.getVarValues();
+          stepper.getStackTrace();
 
           if (stepper.shouldContinueToEnd() && stepper.active())
           {
             stepper.step(penguinTrace::STEP_CONT);
+            stepper.getVarValues();
+            stepper.getStackTrace();
           }
 
           while (!stepper.getStdout().empty())
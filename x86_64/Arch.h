@@ -27,13 +27,22 @@
 #include <string>
 #include <stdint.h>
 
+struct user_regs_struct;
+
 namespace penguinTrace
 {
+  // Register set returned by PTRACE_GETREGSET (NT_PRSTATUS)
+  typedef ::user_regs_struct RegisterSet;
+
   const int MAX_INSTR_BYTES = 15;
   const int MIN_INSTR_BYTES = 1;
 
   const int ADDR_BYTES = 8;
 
+  // Debug registers DR0-DR3, trap after the access
+  const unsigned MAX_WATCHPOINTS = 4;
+  const bool WATCHPOINT_BEFORE_ACCESS = false;
+
   extern const char * PC_REG_NAME;
   extern const char * SP_REG_NAME;
   extern const char * FB_REG_NAME;
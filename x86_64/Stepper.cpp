@@ -30,72 +30,135 @@
 #include <sys/wait.h>
 
 #include <sys/syscall.h>
+#include <linux/audit.h>
+
+#include <cstddef>
+#include <errno.h>
 
 namespace penguinTrace
 {
   const uint32_t BREAKPOINT_WORD = 0xccUL;
   const uint32_t RETURN_WORD     = 0xc3UL;
   const uint32_t RETURN_MASK     = 0xffUL;
+  const uint32_t SYSCALL_WORD    = 0x050fUL;
+  const uint32_t SYSCALL_MASK    = 0xffffUL;
+  const uint32_t SYSCALL_AUDIT_ARCH = AUDIT_ARCH_X86_64;
 
-  void Stepper::getRegisters()
+  namespace
   {
-  user_regs_struct regs;
-  struct iovec ioregs;
-  ioregs.iov_base = &regs;
-  ioregs.iov_len = sizeof(regs);
-
-  ptrace(PTRACE_GETREGSET, childPid, NT_PRSTATUS, &ioregs);
-
-  registerValues["r15"]    = regs.r15;
-  registerValues["r14"]    = regs.r14;
-  registerValues["r13"]    = regs.r13;
-  registerValues["r12"]    = regs.r12;
-  registerValues["rbp"]    = regs.rbp;
-  registerValues["rbx"]    = regs.rbx;
-  registerValues["r11"]    = regs.r11;
-  registerValues["r10"]    = regs.r10;
-  registerValues["r9"]     = regs.r9;
-  registerValues["r8"]     = regs.r8;
-  registerValues["rax"]    = regs.rax;
-  registerValues["rcx"]    = regs.rcx;
-  registerValues["rdx"]    = regs.rdx;
-  registerValues["rsi"]    = regs.rsi;
-  registerValues["rdi"]    = regs.rdi;
-  registerValues["rip"]    = regs.rip;
-  registerValues["cs"]     = regs.cs;
-  registerValues["eflags"] = regs.eflags;
-  registerValues["rsp"]    = regs.rsp;
-  registerValues["ss"]     = regs.ss;
+    struct RegisterDesc
+    {
+      const char * name;
+      unsigned long long user_regs_struct::* field;
+    };
+
+    const RegisterDesc REGISTERS[] = {
+      {"r15",    &user_regs_struct::r15},
+      {"r14",    &user_regs_struct::r14},
+      {"r13",    &user_regs_struct::r13},
+      {"r12",    &user_regs_struct::r12},
+      {"rbp",    &user_regs_struct::rbp},
+      {"rbx",    &user_regs_struct::rbx},
+      {"r11",    &user_regs_struct::r11},
+      {"r10",    &user_regs_struct::r10},
+      {"r9",     &user_regs_struct::r9},
+      {"r8",     &user_regs_struct::r8},
+      {"rax",    &user_regs_struct::rax},
+      {"rcx",    &user_regs_struct::rcx},
+      {"rdx",    &user_regs_struct::rdx},
+      {"rsi",    &user_regs_struct::rsi},
+      {"rdi",    &user_regs_struct::rdi},
+      {"rip",    &user_regs_struct::rip},
+      {"cs",     &user_regs_struct::cs},
+      {"eflags", &user_regs_struct::eflags},
+      {"rsp",    &user_regs_struct::rsp},
+      {"ss",     &user_regs_struct::ss},
+    };
+
+    // Offset of a debug register in struct user for PTRACE_PEEKUSER/POKEUSER
+    uint64_t debugRegOffset(int reg)
+    {
+      return offsetof(struct user, u_debugreg) + reg*sizeof(((struct user*)0)->u_debugreg[0]);
+    }
+
+    const int DR_STATUS = 6;
+    const int DR_CONTROL = 7;
+
+    // DR7 length encoding for 1, 2, 4 and 8 bytes
+    uint64_t debugRegLen(uint64_t len)
+    {
+      switch (len)
+      {
+        case 1: return 0x0;
+        case 2: return 0x1;
+        case 8: return 0x2;
+        default: return 0x3;
+      }
+    }
   }
 
-  uint64_t Stepper::getPC()
+  void Stepper::getRegisters()
   {
-    user_regs_struct regs;
     struct iovec ioregs;
-    ioregs.iov_base = &regs;
-    ioregs.iov_len = sizeof(regs);
+    ioregs.iov_base = &registers.regs;
+    ioregs.iov_len = sizeof(registers.regs);
 
-    ptrace(PTRACE_GETREGSET, childPid, NT_PRSTATUS, &ioregs);
+    int ret = ptrace(PTRACE_GETREGSET, currentThread, NT_PRSTATUS, &ioregs);
+    assert(ret == 0);
 
-    cachedPC = regs.rip;
-    cachedPCvalid = true;
-    return regs.rip;
+    registers.valid = true;
+    registers.dirty = false;
   }
 
-  void Stepper::setPC(uint64_t pc)
+  void Stepper::setRegisters()
   {
-    cachedPCvalid = false;
-    user_regs_struct regs;
-    struct iovec ioregs;
-    ioregs.iov_base = &regs;
-    ioregs.iov_len = sizeof(regs);
+    if (registers.valid && registers.dirty)
+    {
+      struct iovec ioregs;
+      ioregs.iov_base = &registers.regs;
+      ioregs.iov_len = sizeof(registers.regs);
 
-    int ret1 = ptrace(PTRACE_GETREGSET, childPid, NT_PRSTATUS, &ioregs);
+      int ret = ptrace(PTRACE_SETREGSET, currentThread, NT_PRSTATUS, &ioregs);
+      assert(ret == 0);
+      registers.dirty = false;
+    }
+  }
 
-    regs.rip = pc;
+  std::map<std::string, uint64_t> Stepper::getRegValues()
+  {
+    std::map<std::string, uint64_t> values;
+    for (auto r : REGISTERS)
+    {
+      values[r.name] = registers.regs.*r.field;
+    }
+    return values;
+  }
+
+  bool Stepper::regValueByName(const std::string& reg, uint64_t& value)
+  {
+    for (auto r : REGISTERS)
+    {
+      if (reg == r.name)
+      {
+        value = registers.regs.*r.field;
+        return true;
+      }
+    }
+    return false;
+  }
 
-    int ret2 = ptrace(PTRACE_SETREGSET, childPid, NT_PRSTATUS, &ioregs);
-    assert(ret1 == 0 && ret2 == 0);
+  uint64_t Stepper::getPC()
+  {
+    assert(registers.valid);
+    cachedPC = registers.regs.rip;
+    return registers.regs.rip;
+  }
+
+  void Stepper::setPC(uint64_t pc)
+  {
+    assert(registers.valid);
+    registers.regs.rip = pc;
+    registers.dirty = true;
   }
 
   uint64_t Stepper::breakPC(uint64_t pc)
@@ -103,33 +166,102 @@ namespace penguinTrace
     return pc-1;
   }
 
-  bool Stepper::isSyscall(uint64_t pc)
+  bool Stepper::setWatchpoints(bool enable)
   {
-    uint32_t instr = (uint32_t)ptrace(PTRACE_PEEKTEXT, childPid, pc, nullptr);
-    return (instr & 0xffff) == 0x050f;
+    if (enable && (watchpointMap.size() > MAX_WATCHPOINTS))
+    {
+      return false;
+    }
+
+    // Disable all before changing addresses
+    if (ptrace(PTRACE_POKEUSER, currentThread, debugRegOffset(DR_CONTROL), 0) != 0)
+    {
+      return false;
+    }
+    if (!enable)
+    {
+      return true;
+    }
+
+    uint64_t control = 0;
+    int i = 0;
+    for (auto it : watchpointMap)
+    {
+      if (ptrace(PTRACE_POKEUSER, currentThread, debugRegOffset(i), it.first) != 0)
+      {
+        return false;
+      }
+      // Local enable, break on data writes
+      control |= 1ULL << (i*2);
+      control |= (0x1 | (debugRegLen(it.second) << 2)) << (16 + i*4);
+      i++;
+    }
+
+    return ptrace(PTRACE_POKEUSER, currentThread, debugRegOffset(DR_CONTROL), control) == 0;
+  }
+
+  bool Stepper::watchpointHit(uint64_t& addr)
+  {
+    errno = 0;
+    uint64_t status = ptrace(PTRACE_PEEKUSER, currentThread, debugRegOffset(DR_STATUS), nullptr);
+    if ((errno != 0) || ((status & 0xf) == 0))
+    {
+      return false;
+    }
+    // Status is sticky, so clear for the next stop
+    ptrace(PTRACE_POKEUSER, currentThread, debugRegOffset(DR_STATUS), 0);
+
+    int i = 0;
+    for (auto it : watchpointMap)
+    {
+      if (status & (1ULL << i))
+      {
+        addr = it.first;
+        return true;
+      }
+      i++;
+    }
+    return false;
   }
 
   Stepper::Syscall Stepper::getSyscall()
   {
-    uint64_t num = registerValues["rax"];
-    std::vector<uint64_t> args;
+    // At syscall entry rax already holds -ENOSYS
+    uint64_t num = registers.regs.orig_rax;
+    std::vector<uint64_t> args = {
+      registers.regs.rdi, registers.regs.rsi, registers.regs.rdx,
+      registers.regs.r10, registers.regs.r8, registers.regs.r9
+    };
     return Syscall(num, args);
   }
 
-  void Stepper::errorSyscall(uint64_t pc)
+  void Stepper::denySyscall()
   {
-    setPC(pc+2);
-    user_regs_struct regs;
-    struct iovec ioregs;
-    ioregs.iov_base = &regs;
-    ioregs.iov_len = sizeof(regs);
-
-    int ret1 = ptrace(PTRACE_GETREGSET, childPid, NT_PRSTATUS, &ioregs);
+    registers.regs.orig_rax = -1;
+    registers.regs.rax = -EPERM;
+    registers.dirty = true;
+  }
 
-    regs.rax = -1;
+  Stepper::Syscall Stepper::forkSyscall()
+  {
+    // clone with no exit signal so the tracee isn't sent SIGCHLD when a
+    //  checkpoint is killed
+    std::vector<uint64_t> args = {0, 0, 0, 0, 0};
+    return Syscall(SYS_clone, args);
+  }
 
-    int ret2 = ptrace(PTRACE_SETREGSET, childPid, NT_PRSTATUS, &ioregs);
-    assert(ret1 == 0 && ret2 == 0);
+  void Stepper::syscallRegisters(RegisterSet& regs, uint64_t pc, const Syscall& sys)
+  {
+    unsigned long long RegisterSet::* argRegs[] = {
+      &RegisterSet::rdi, &RegisterSet::rsi, &RegisterSet::rdx,
+      &RegisterSet::r10, &RegisterSet::r8, &RegisterSet::r9
+    };
+    regs.rip = pc;
+    regs.rax = sys.num;
+    for (unsigned i = 0; i < sys.args.size() && i < 6; i++)
+    {
+      regs.*argRegs[i] = sys.args[i];
+    }
   }
 
   bool Stepper::isLibraryCall(uint64_t pc)